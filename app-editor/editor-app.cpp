@@ -24,8 +24,9 @@ void load_editor_intrinsic_assets(path root)
 
         if (entry.path().extension().string() == ".mesh")
         {
-            auto geo_import = import_mesh_binary(path);
-            create_handle_for_asset(std::string("poly-" + get_filename_without_extension(path)).c_str(), make_mesh_from_geometry(geo_import));
+            const runtime_mesh_binary_view view(path);
+            auto geo_import = import_mesh_binary(view);
+            create_handle_for_asset(std::string("poly-" + get_filename_without_extension(path)).c_str(), make_mesh_from_binary(view));
             create_handle_for_asset(std::string("poly-" + get_filename_without_extension(path)).c_str(), std::move(geo_import));
         }
     }
@@ -263,6 +264,7 @@ void scene_editor_app::on_update(const app_update_event & e)
     editorProfiler.begin("on_update");
     flycam.update(e.timestep_ms);
     shaderMonitor.handle_recompile();
+    resolver->update(); // uploads assets decoded in the background since the last frame
     gizmo->on_update(cam, float2(static_cast<float>(width), static_cast<float>(height)));
     editorProfiler.end("on_update");
 }
@@ -349,26 +351,12 @@ void scene_editor_app::on_draw()
         renderer_payload.views.clear();
         renderer_payload.render_components.clear();
         renderer_payload.point_lights.clear();
+        renderer_payload.spot_lights.clear();
         renderer_payload.sunlight = nullptr;
 
-        // Does the entity have a material? If so, we can render it. 
-        for (const auto e : scene.entity_list())
-        {
-            if (material_component * mat_c = scene.render_system->get_material_component(e))
-            {
-                auto mesh_c = scene.render_system->get_mesh_component(e);
-                if (!mesh_c) continue; // for the case that we just created a material component and haven't set a mesh yet
-
-                auto xform_c = scene.xform_system->get_world_transform(e);
-                assert(xform_c != nullptr); // we did something bad if this entity doesn't also have a world transform component
-
-                auto scale_c = scene.xform_system->get_local_transform(e);
-                assert(scale_c != nullptr); 
-
-                render_component r = assemble_render_component(scene, e);
-                renderer_payload.render_components.push_back(r);
-            }
-        }
+        // Does the entity have a material and a mesh? If so, we can render it. 
+        scene.render_system->gather_renderables(renderer_payload.render_components);
+        renderer_payload.visibility = scene.render_system->update_visibility(renderer_payload.render_components);
 
         // Gather directional light. The sunlight is an implicit directional light created
         // on the renderer (it is not tracked by the orchestrator so isn't in the scene.entity_list())
@@ -377,14 +365,9 @@ void scene_editor_app::on_draw()
             renderer_payload.sunlight = implicit_sun;
         }
 
-        // Gather point lights
-        for (const auto e : scene.entity_list())
-        {
-            if (auto pt_light_c = scene.render_system->get_point_light_component(e))
-            {
-                renderer_payload.point_lights.push_back(pt_light_c);
-            }
-        }
+        // Gather point and spot lights
+        scene.render_system->gather_point_lights(renderer_payload.point_lights);
+        scene.render_system->gather_spot_lights(renderer_payload.spot_lights);
 
         // Add single-viewport camera
         renderer_payload.views.push_back(view_data(0, cam.pose, projectionMatrix));
@@ -584,6 +567,7 @@ void scene_editor_app::on_draw()
                             else if (type_name == get_typename<material_component>()) system_pointer->create(selection, get_typeid<material_component>(), &material_component(selection));
                             else if (type_name == get_typename<geometry_component>()) system_pointer->create(selection, get_typeid<geometry_component>(), &geometry_component(selection));
                             else if (type_name == get_typename<point_light_component>()) system_pointer->create(selection, get_typeid<point_light_component>(), &point_light_component(selection));
+                            else if (type_name == get_typename<spot_light_component>()) system_pointer->create(selection, get_typeid<spot_light_component>(), &spot_light_component(selection));
                             else if (type_name == get_typename<directional_light_component>()) system_pointer->create(selection, get_typeid<directional_light_component>(), &directional_light_component(selection));
                         }
                     });
@@ -1,46 +1,18 @@
-#ifdef FOUR_CASCADES
-vec4 get_cascade_weights(float depth, vec4 splitNear, vec4 splitFar)
+// Index of the first cascade whose split range contains the view-space depth, or -1 if there is none
+int get_cascade_index(float depth, vec4 splitPlanes[MAX_CASCADES])
 {
-    return (step(splitNear, vec4(depth))) * (step(depth, splitFar));
-}
-
-mat4 get_cascade_viewproj(vec4 weights, mat4 viewProj[4])
-{
-    return viewProj[0] * weights.x + viewProj[1] * weights.y + viewProj[2] * weights.z + viewProj[3] * weights.w;
-}
-
-float get_cascade_layer(vec4 weights) 
-{
-    return 0.0 * weights.x + 1.0 * weights.y + 2.0 * weights.z + 3.0 * weights.w;   
-}
-
-vec3 get_cascade_weighted_color(vec4 weights) 
-{
-    return vec3(1,0,0) * weights.x + vec3(0,1,0) * weights.y + vec3(0,0,1) * weights.z + vec3(1,0,1) * weights.w;
-}
-#endif
-
-#ifdef TWO_CASCADES
-vec2 get_cascade_weights(float depth, vec2 splitNear, vec2 splitFar)
-{
-    return (step(splitNear, vec2(depth))) * (step(depth, splitFar)); 
-}
-
-mat4 get_cascade_viewproj(vec2 weights, mat4 viewProj[2])
-{
-    return viewProj[0] * weights.x + viewProj[1] * weights.y;
-}
-
-float get_cascade_layer(vec2 weights) 
-{
-    return 0.0 * weights.x +  1.0 * weights.y; 
+    for (int c = 0; c < u_cascadeCount; ++c)
+    {
+        if (depth >= splitPlanes[c].x && depth <= splitPlanes[c].y) return c;
+    }
+    return -1;
 }
 
-vec3 get_cascade_weighted_color(vec2 weights) 
+vec3 get_cascade_color(int cascade) 
 {
-    return vec3(1,0,0) * weights.x + vec3(0,1,0) * weights.y;
+    const vec3 colors[MAX_CASCADES] = { vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1), vec3(1, 0, 1) };
+    return (cascade >= 0) ? colors[cascade] : vec3(0);
 }
-#endif
 
 float compute_distance_fade(float depth, float zFar, float shadowTerm, float maxDist)
 {
@@ -79,24 +51,14 @@ float sample_shadowmap(sampler2DArray shadowMap, vec2 size, vec2 uv, float compa
     return c;
 }
 
-float calculate_csm_coefficient(sampler2DArray map, vec3 biasedWorldPos, vec3 viewPos, mat4 viewProjArray[NUM_CASCADES], vec4 splitPlanes[NUM_CASCADES], out vec3 weightedColor)
+float calculate_csm_coefficient(sampler2DArray map, vec3 biasedWorldPos, vec3 viewPos, mat4 viewProjArray[MAX_CASCADES], vec4 splitPlanes[MAX_CASCADES], out vec3 weightedColor)
 {
-    #ifdef FOUR_CASCADES
-    vec4 weights = get_cascade_weights(-viewPos.z,
-        vec4(splitPlanes[0].x, splitPlanes[1].x, splitPlanes[2].x, splitPlanes[3].x),
-        vec4(splitPlanes[0].y, splitPlanes[1].y, splitPlanes[2].y, splitPlanes[3].y)
-    );
-    #endif
-
-    #ifdef TWO_CASCADES
-    vec2 weights = get_cascade_weights(-viewPos.z,
-        vec2(splitPlanes[0].x, splitPlanes[1].x),
-        vec2(splitPlanes[0].y, splitPlanes[1].y));
-    #endif
+    const int cascade = get_cascade_index(-viewPos.z, splitPlanes);
+    if (cascade < 0) return 1;
+    const float layer = float(cascade);
 
     // Get vertex position in light space
-    mat4 lightViewProj = get_cascade_viewproj(weights, viewProjArray);
-    vec4 vertexLightPostion = lightViewProj * vec4(biasedWorldPos, 1.0);
+    vec4 vertexLightPostion = viewProjArray[cascade] * vec4(biasedWorldPos, 1.0);
 
     // Compute perspective divide and transform to 0-1 range
     const vec3 coords = (vertexLightPostion.xyz / vertexLightPostion.w) / 2.0 + 0.5;
@@ -112,7 +74,7 @@ float calculate_csm_coefficient(sampler2DArray map, vec3 biasedWorldPos, vec3 vi
     // Non-PCF path, hard shadows
     #ifdef USE_HARD_SHADOWS
     {
-        float closestDepth = texture(map, vec3(coords.xy, get_cascade_layer(weights))).r;
+        float closestDepth = texture(map, vec3(coords.xy, layer)).r;
         shadowTerm = (currentDepth - constant_bias) > closestDepth ? 1.0 : 0.0;
     }
     #endif
@@ -125,7 +87,7 @@ float calculate_csm_coefficient(sampler2DArray map, vec3 biasedWorldPos, vec3 vi
         {
             for (int y = -1; y <= 1; ++y)
             {
-                float pcfDepth = texture(map, vec3(coords.xy + vec2(x * texelSize, y * texelSize), get_cascade_layer(weights))).r;
+                float pcfDepth = texture(map, vec3(coords.xy + vec2(x * texelSize, y * texelSize), layer)).r;
                 shadowTerm += currentDepth - constant_bias > pcfDepth  ? 1.0 : 0.0;
             }
         }
@@ -150,14 +112,14 @@ float calculate_csm_coefficient(sampler2DArray map, vec3 biasedWorldPos, vec3 vi
         for (uint i = 0; i < samples; i++)
         {
             uint index = uint(samples * random(coords.xy * i)) % samples; // A pseudo-random number between 0 and 15, different for each pixel and each index
-            float d = sample_shadowmap(map, textureSize(map, 0).xy, coords.xy + (poissonDisk[index] / packing),  coords.z, get_cascade_layer(weights));
+            float d = sample_shadowmap(map, textureSize(map, 0).xy, coords.xy + (poissonDisk[index] / packing),  coords.z, layer);
             shadowTerm += currentDepth - constant_bias > d  ? 1.0 : 0.0;
         }   
         shadowTerm /= samples;
     }
     #endif
 
-    //weightedColor = get_cascade_weighted_color(weights);
+    //weightedColor = get_cascade_color(cascade);
     //float compute_distance_fade(float depth, float zFar, float shadowTerm, float maxDist)
     //float fade = compute_distance_fade(coords.z, 4, shadowTerm, 1);
 
@@ -18,6 +18,51 @@ in vec2 v_texcoord;
 in vec3 v_tangent;
 in vec3 v_bitangent;
 
+#ifdef SINGLE_PASS_STEREO
+#define STEREO_EYE int(gl_FragCoord.x >= resolution.x)
+#endif
+
+#ifdef GPU_DRIVEN_SUBMISSION
+flat in uint v_objectIndex;
+#define u_receiveShadow (u_objects[v_objectIndex].params.x)
+#endif
+
+#ifdef BINDLESS_MATERIALS
+
+// Parameters come from this draw's entry in the material buffer and every texture slot is checked at 
+// runtime, so all materials share one program.
+#define u_material (u_materials[uint(u_objects[v_objectIndex].params.y)])
+#define u_albedo (u_material.albedoOpacity.xyz)
+#define u_opacity (u_material.albedoOpacity.w)
+#define u_emissive (u_material.emissive.xyz)
+#define u_emissiveStrength (u_material.emissive.w)
+#define u_roughness (u_material.surface.x)
+#define u_metallic (u_material.surface.y)
+#define u_specularLevel (u_material.surface.z)
+#define u_occlusionStrength (u_material.surface.w)
+#define u_ambientStrength (u_material.lighting.x)
+#define u_shadowOpacity (u_material.lighting.y)
+
+// Texture slots follow uniforms::material_texture_slot
+#define has_map(slot) (u_material.textures[slot] != uvec2(0))
+#define s_albedo sampler2D(u_material.textures[0])
+#define s_normal sampler2D(u_material.textures[1])
+#define s_roughness sampler2D(u_material.textures[2])
+#define s_metallic sampler2D(u_material.textures[3])
+#define s_emissive sampler2D(u_material.textures[4])
+#define s_occlusion sampler2D(u_material.textures[5])
+
+#define HAS_ALBEDO_MAP
+#define HAS_NORMAL_MAP
+#define HAS_ROUGHNESS_MAP
+#define HAS_METALNESS_MAP
+#define HAS_EMISSIVE_MAP
+#define HAS_OCCLUSION_MAP
+
+#else
+
+#define has_map(slot) true
+
 // Material Uniforms
 uniform float u_roughness = 1;
 uniform float u_metallic = 1;
@@ -59,6 +104,8 @@ uniform float u_occlusionStrength = 1.0;
 uniform float u_ambientStrength = 1.0;
 uniform float u_emissiveStrength = 1.0;
 
+#endif
+
 #ifdef ENABLE_SHADOWS
     uniform sampler2DArray s_csmArray;
 #endif
@@ -150,20 +197,23 @@ void main()
     float metallic = u_metallic;
 
 #ifdef HAS_NORMAL_MAP
-    vec3 nSample = normalize(texture(s_normal, v_texcoord).xyz * 2.0 - 1.0);
-    N = normalize(calc_normal_map(v_normal, normalize(v_tangent), normalize(v_bitangent), normalize(nSample)).xyz);
+    if (has_map(1))
+    {
+        vec3 nSample = normalize(texture(s_normal, v_texcoord).xyz * 2.0 - 1.0);
+        N = normalize(calc_normal_map(v_normal, normalize(v_tangent), normalize(v_bitangent), normalize(nSample)).xyz);
+    }
 #endif
 
 #ifdef HAS_ROUGHNESS_MAP
-    roughness = texture(s_roughness, v_texcoord).r * roughness;
+    if (has_map(2)) roughness = texture(s_roughness, v_texcoord).r * roughness;
 #endif
 
 #ifdef HAS_METALNESS_MAP
-    metallic = texture(s_metallic, v_texcoord).r * metallic;
+    if (has_map(3)) metallic = texture(s_metallic, v_texcoord).r * metallic;
 #endif
 
 #ifdef HAS_ALBEDO_MAP
-    albedo *= sRGBToLinear(texture(s_albedo, v_texcoord).rgb, DEFAULT_GAMMA); 
+    if (has_map(0)) albedo *= sRGBToLinear(texture(s_albedo, v_texcoord).rgb, DEFAULT_GAMMA); 
 #endif
 
 //#ifdef HAS_NORMAL_MAP
@@ -233,10 +283,16 @@ void main()
         Lo += NdotL * u_directionalLight.color * (diffuseContrib + specContrib);
     }
 
-    // Compute point lights
-    for (int i = 0; i < u_activePointLights; ++i)
+    // Compute point and spot lights in this fragment's cluster
+    uvec2 clusterRange = u_clusterRanges[get_cluster_index(gl_FragCoord.xy, -v_view_space_position.z)];
+    for (uint i = 0u; i < clusterRange.y; ++i)
     {
-        vec3 L = normalize(u_pointLights[i].position - v_world_position); 
+        Light light = u_lights[u_clusterLightIndices[clusterRange.x + i]];
+
+        vec3 L;
+        float attenuation = evaluate_light(light, v_world_position, L);
+        if (attenuation <= 0.0) continue;
+
         vec3 H = normalize(L + V);  
 
         float NdotL = clamp(dot(N, L), 0.001, 1.0);
@@ -250,13 +306,10 @@ void main()
             diffuseColor, specularColor
         );
 
-        float dist = length(u_pointLights[i].position - v_world_position);
-        float attenuation = point_light_attenuation(u_pointLights[i].radius, 2.0, 0.1, dist); // reasonable intensity is 0.01 to 8
-
         vec3 diffuseContrib, specContrib;
         compute_cook_torrance(data, attenuation, diffuseContrib, specContrib);
 
-        Lo += NdotL * u_pointLights[i].color * (diffuseContrib + specContrib) * attenuation;
+        Lo += NdotL * light.colorType.xyz * (diffuseContrib + specContrib) * attenuation;
     }
 
     #ifdef USE_IMAGE_BASED_LIGHTING
@@ -278,12 +331,15 @@ void main()
     #endif
 
     #ifdef HAS_EMISSIVE_MAP
-        Lo += texture(s_emissive, v_texcoord).rgb * u_emissiveStrength; 
+        if (has_map(4)) Lo += texture(s_emissive, v_texcoord).rgb * u_emissiveStrength; 
     #endif
 
     #ifdef HAS_OCCLUSION_MAP
-        float ao = texture(s_occlusion, v_texcoord).r;
-        Lo = mix(Lo, Lo * ao, u_occlusionStrength);
+        if (has_map(5))
+        {
+            float ao = texture(s_occlusion, v_texcoord).r;
+            Lo = mix(Lo, Lo * ao, u_occlusionStrength);
+        }
     #endif
 
     Lo += (u_emissive * u_emissiveStrength);
@@ -8,6 +8,10 @@ in vec2 v_texcoord;
 in vec3 v_tangent;
 in vec3 v_bitangent;
 
+#ifdef SINGLE_PASS_STEREO
+#define STEREO_EYE int(gl_FragCoord.x >= resolution.x)
+#endif
+
 // Material Uniforms
 uniform vec3 u_diffuseColor;
 uniform vec3 u_specularColor;
@@ -77,20 +81,23 @@ void main()
         Lo += (diffuseContrib + specContrib);
     }
 
-    // Compute point lights
-    for (int i = 0; i < u_activePointLights; ++i)
+    // Compute point and spot lights in this fragment's cluster
+    uvec2 clusterRange = u_clusterRanges[get_cluster_index(gl_FragCoord.xy, -v_view_space_position.z)];
+    for (uint i = 0u; i < clusterRange.y; ++i)
     {
-        vec3 L = normalize(u_pointLights[i].position - v_world_position); 
+        Light light = u_lights[u_clusterLightIndices[clusterRange.x + i]];
+
+        vec3 L;
+        float attenuation = evaluate_light(light, v_world_position, L);
+        if (attenuation <= 0.0) continue;
+
         vec3 H = normalize(L + V);  
 
         float NdotL = clamp(dot(N, L), 0.001, 1.0);
         float NdotH = clamp(dot(N, H), 0.0, 1.0);
         float LdotH = clamp(dot(L, H), 0.0, 1.0);
 
-        float dist = length(u_pointLights[i].position - v_world_position);
-        float attenuation = point_light_attenuation(u_pointLights[i].radius, 2.0, 0.1, dist); // reasonable intensity is 0.01 to 8
-
-        const vec3 irradiance = NdotL * u_pointLights[i].color;
+        const vec3 irradiance = NdotL * light.colorType.xyz;
 
         vec3 diffuseContrib, specContrib;
         diffuseContrib += irradiance * lambert_diffuse(diffuseColor);
@@ -1,15 +1,28 @@
 #version 450
 
+#ifdef GPU_DRIVEN_SUBMISSION
+#extension GL_ARB_shader_draw_parameters : enable
+#endif
+
+#ifdef BINDLESS_MATERIALS
+#extension GL_ARB_bindless_texture : require
+#endif
+
 #define saturate(x) clamp(x, 0.0, 1.0)
 #define PI 3.1415926535897932384626433832795
 #define INV_PI 1.0 / PI
 #define RCP_4PI 1.0 / (4 * PI)
 #define DEFAULT_GAMMA 2.2
 
-#define TWO_CASCADES // fixme
+const int MAX_CASCADES = 4;
 
-const int MAX_POINT_LIGHTS = 4;
-const int NUM_CASCADES = 2;
+// Must match uniforms::CLUSTER_GRID_* in uniforms.hpp
+const uint CLUSTER_GRID_X = 16u;
+const uint CLUSTER_GRID_Y = 9u;
+const uint CLUSTER_GRID_Z = 24u;
+
+const float LIGHT_TYPE_POINT = 0.0;
+const float LIGHT_TYPE_SPOT = 1.0;
 
 struct DirectionalLight
 {
@@ -18,35 +31,134 @@ struct DirectionalLight
     float amount;
 }; 
 
-struct PointLight
+// Point and spot lights, see uniforms::light_gpu
+struct Light
 {
-    vec3 color;
-    vec3 position;
-    float radius;
+    vec4 positionRange;  // world-space position (xyz), distance beyond which the light has no effect (w)
+    vec4 colorType;      // color (xyz), LIGHT_TYPE_* (w)
+    vec4 directionAngle; // spot: direction (xyz), cosine of the cone half-angle (w)
+    vec4 attenuation;    // point: radius (x); spot: constant, linear, quadratic (xyz)
 };
 
 layout(binding = 0, std140) uniform PerScene
 {
     DirectionalLight u_directionalLight;
-    PointLight u_pointLights[MAX_POINT_LIGHTS];
     float u_time;
-    int u_activePointLights;
+    int u_activeLights;
     int sunlightActive;
+    int u_cascadeCount;
     vec2 resolution;
     vec2 invResolution;
-    vec4 u_cascadesPlane[NUM_CASCADES];
-    mat4 u_cascadesMatrix[NUM_CASCADES];
-    float u_cascadesNear[NUM_CASCADES];
-    float u_cascadesFar[NUM_CASCADES];
+    vec4 u_cascadesPlane[MAX_CASCADES];
+    mat4 u_cascadesMatrix[MAX_CASCADES];
+    float u_cascadesNear[MAX_CASCADES];
+    float u_cascadesFar[MAX_CASCADES];
+};
+
+#ifdef SINGLE_PASS_STEREO
+
+// Both eyes are drawn in one pass into a side-by-side target, left eye in the left half. Every object
+// is drawn with two instances per copy and odd instances are the right eye. Shaders define STEREO_EYE
+// before reading view data: gl_InstanceID & 1 in the vertex stage, the half of the target in the fragment stage.
+struct ViewData
+{
+    mat4 viewMatrix;
+    mat4 viewProjMatrix;
+    vec4 eyePos;
+    vec4 clusterDepth;
 };
 
+layout(binding = 1, std140) uniform PerView
+{
+    ViewData u_views[2];
+};
+
+#define u_viewMatrix (u_views[STEREO_EYE].viewMatrix)
+#define u_viewProjMatrix (u_views[STEREO_EYE].viewProjMatrix)
+#define u_eyePos (u_views[STEREO_EYE].eyePos)
+
+#else
+
 layout(binding = 1, std140) uniform PerView
 {
     mat4 u_viewMatrix;
     mat4 u_viewProjMatrix;
     vec4 u_eyePos;
+    vec4 u_clusterDepth; // x: scale, y: bias mapping log(view depth) to a cluster slice
+};
+
+#endif
+
+// Lights visible to any view this frame, and for the current view a range of the index list per cluster
+layout(binding = 5, std430) readonly buffer LightArray
+{
+    Light u_lights[];
+};
+
+layout(binding = 6, std430) readonly buffer ClusterRangeArray
+{
+    uvec2 u_clusterRanges[]; // x: offset into u_clusterLightIndices, y: count
+};
+
+layout(binding = 7, std430) readonly buffer ClusterLightIndexArray
+{
+    uint u_clusterLightIndices[];
+};
+
+// Cluster containing a fragment, from its window position and view-space depth (positive in front of the eye)
+uint get_cluster_index(vec2 fragCoord, float viewDepth)
+{
+#ifdef SINGLE_PASS_STEREO
+    // The right eye's clusters follow the left eye's in u_clusterRanges
+    uint eye = (fragCoord.x >= resolution.x) ? 1u : 0u;
+    fragCoord.x -= float(eye) * resolution.x;
+    vec4 clusterDepth = u_views[eye].clusterDepth;
+#else
+    uint eye = 0u;
+    vec4 clusterDepth = u_clusterDepth;
+#endif
+    uvec2 tile = min(uvec2(fragCoord * invResolution * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y)), uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    uint slice = min(uint(max(log(viewDepth) * clusterDepth.x + clusterDepth.y, 0.0)), CLUSTER_GRID_Z - 1);
+    return eye * (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z) + (slice * CLUSTER_GRID_Y + tile.y) * CLUSTER_GRID_X + tile.x;
+}
+
+#ifdef GPU_DRIVEN_SUBMISSION
+
+// Per-object data for indirect draws, indexed by the baseInstance of each draw command
+struct ObjectData
+{
+    mat4 modelMatrix;
+    mat4 modelMatrixIT;
+    vec4 boundingSphere;
+    vec4 params; // x: receive shadow, y: material index (BINDLESS_MATERIALS)
+};
+
+layout(binding = 3, std430) readonly buffer PerObjectArray
+{
+    ObjectData u_objects[];
+};
+
+#ifdef BINDLESS_MATERIALS
+
+// Parameters and texture handles of every material drawn this frame, see uniforms::material_gpu
+struct MaterialData
+{
+    vec4 albedoOpacity;
+    vec4 emissive;
+    vec4 surface;   // roughness, metallic, specular level, occlusion strength
+    vec4 lighting;  // ambient strength, shadow opacity, texcoord scale (zw)
+    uvec2 textures[8];
 };
 
+layout(binding = 9, std430) readonly buffer MaterialArray
+{
+    MaterialData u_materials[];
+};
+
+#endif
+
+#else
+
 layout(binding = 2, std140) uniform PerObject
 {
     mat4 u_modelMatrix;
@@ -55,6 +167,8 @@ layout(binding = 2, std140) uniform PerObject
     float u_receiveShadow;
 };
 
+#endif
+
 vec2 get_shadow_offsets(vec3 N, vec3 L) 
 {
   float cos_alpha = clamp(dot(N, L), 0.0, 1.0);
@@ -85,6 +199,27 @@ float point_light_attenuation(float radius, float intensity, float cutoff, float
     return attenuation;
 }
 
+// Spot lights use inverse polynomial falloff windowed to reach zero at the light's range, multiplied
+// by a soft edge over the outer tenth of the cone.
+float spot_light_attenuation(Light light, vec3 L, float dist)
+{
+    float falloff = 1.0 / dot(light.attenuation.xyz, vec3(1.0, dist, dist * dist));
+    float window = saturate(1.0 - pow(dist / light.positionRange.w, 4.0));
+    float cosAngle = dot(-L, light.directionAngle.xyz);
+    float cone = smoothstep(light.directionAngle.w, mix(light.directionAngle.w, 1.0, 0.1), cosAngle);
+    return falloff * window * window * cone;
+}
+
+// Returns the attenuation of a point or spot light at a world-space position and the direction towards it
+float evaluate_light(Light light, vec3 position, out vec3 L)
+{
+    vec3 toLight = light.positionRange.xyz - position;
+    float dist = length(toLight);
+    L = toLight / max(dist, 1e-5);
+    if (light.colorType.w == LIGHT_TYPE_SPOT) return spot_light_attenuation(light, L, dist);
+    return point_light_attenuation(light.attenuation.x, 2.0, 0.1, dist); // reasonable intensity is 0.01 to 8
+}
+
 // http://blog.selfshadow.com/publications/blending-in-detail/
 vec3 blend_normals_unity(vec3 geometric, vec3 detail)
 {
@@ -15,17 +15,53 @@ out vec3 v_tangent;
 out vec3 v_bitangent;
 out vec3 v_color;
 
+#ifdef GPU_DRIVEN_SUBMISSION
+flat out uint v_objectIndex;
+#endif
+
 uniform vec2 u_texCoordScale = vec2(1, 1);
 
+#ifdef SINGLE_PASS_STEREO
+#define STEREO_EYE (gl_InstanceID & 1)
+#endif
+
 void main()
 {
-    vec4 worldPosition = u_modelMatrix * vec4(inPosition, 1.0);
+#ifdef GPU_DRIVEN_SUBMISSION
+    uint objectIndex = gl_BaseInstanceARB;
+    mat4 modelMatrix = u_objects[objectIndex].modelMatrix;
+    mat4 modelMatrixIT = u_objects[objectIndex].modelMatrixIT;
+    mat4 modelViewMatrix = u_viewMatrix * modelMatrix;
+    v_objectIndex = objectIndex;
+#else
+    mat4 modelMatrix = u_modelMatrix;
+    mat4 modelMatrixIT = u_modelMatrixIT;
+#ifdef SINGLE_PASS_STEREO
+    mat4 modelViewMatrix = u_viewMatrix * modelMatrix; // u_modelViewMatrix is for one eye only
+#else
+    mat4 modelViewMatrix = u_modelViewMatrix;
+#endif
+#endif
+
+    vec4 worldPosition = modelMatrix * vec4(inPosition, 1.0);
     gl_Position = u_viewProjMatrix * worldPosition;
-    v_view_space_position = (u_modelViewMatrix * vec4(inPosition, 1.0)).xyz;
-    v_normal = normalize((u_modelMatrixIT * vec4(inNormal, 0)).xyz);
+
+#ifdef SINGLE_PASS_STEREO
+    // Squeeze into this eye's half of the side-by-side target and clip at the seam
+    float eyeSide = float(STEREO_EYE) * 2.0 - 1.0;
+    gl_Position.x = gl_Position.x * 0.5 + eyeSide * 0.5 * gl_Position.w;
+    gl_ClipDistance[0] = eyeSide * gl_Position.x;
+#endif
+
+    v_view_space_position = (modelViewMatrix * vec4(inPosition, 1.0)).xyz;
+    v_normal = normalize((modelMatrixIT * vec4(inNormal, 0)).xyz);
     v_world_position = worldPosition.xyz;
+#ifdef BINDLESS_MATERIALS
+    v_texcoord = inTexCoord * u_materials[uint(u_objects[objectIndex].params.y)].lighting.zw;
+#else
     v_texcoord = inTexCoord * u_texCoordScale;
-    v_tangent = (u_modelMatrixIT * vec4(inTangent, 0)).xyz;
-    v_bitangent = (u_modelMatrixIT * vec4(inBitangent, 0)).xyz;
+#endif
+    v_tangent = (modelMatrixIT * vec4(inTangent, 0)).xyz;
+    v_bitangent = (modelMatrixIT * vec4(inBitangent, 0)).xyz;
     v_color = inColor;
 }
\ No newline at end of file
@@ -1,9 +1,18 @@
-#version 450
+#include "renderer_common.glsl"
 
 layout(location = 0) in vec3 inPosition;
-uniform mat4 u_modelShadowMatrix;
+
+// Casters drawn into the current cascade, grouped by mesh. Each group is one instanced draw whose
+// instances start at u_baseInstance.
+layout(binding = 8, std430) readonly buffer ShadowInstanceArray
+{
+    mat4 u_shadowInstances[];
+};
+
+uniform mat4 u_cascadeViewProj;
+uniform int u_baseInstance;
 
 void main()
 {
-    gl_Position = u_modelShadowMatrix * vec4(inPosition, 1);
-}
\ No newline at end of file
+    gl_Position = u_cascadeViewProj * u_shadowInstances[u_baseInstance + gl_InstanceID] * vec4(inPosition, 1);
+}
@@ -16,8 +16,7 @@ vec3 HosekWilkie(float cos_theta, float gamma, float cos_gamma)
 
 // clean this up to use shader include
 
-const int MAX_POINT_LIGHTS = 4;
-const int NUM_CASCADES = 2;
+const int MAX_CASCADES = 4;
 
 struct DirectionalLight
 {
@@ -26,25 +25,19 @@ struct DirectionalLight
     float amount;
 }; 
 
-struct PointLight
-{
-    vec3 color;
-    vec3 position;
-    float radius;
-};
-
 layout(binding = 0, std140) uniform PerScene
 {
     DirectionalLight u_directionalLight;
-    PointLight u_pointLights[MAX_POINT_LIGHTS];
     float u_time;
-    int u_activePointLights;
+    int u_activeLights;
+    int sunlightActive;
+    int u_cascadeCount;
     vec2 resolution;
     vec2 invResolution;
-    vec4 u_cascadesPlane[NUM_CASCADES];
-    mat4 u_cascadesMatrix[NUM_CASCADES];
-    float u_cascadesNear[NUM_CASCADES];
-    float u_cascadesFar[NUM_CASCADES];
+    vec4 u_cascadesPlane[MAX_CASCADES];
+    mat4 u_cascadesMatrix[MAX_CASCADES];
+    float u_cascadesNear[MAX_CASCADES];
+    float u_cascadesFar[MAX_CASCADES];
 };
 
 // Source: http://alex.vlachos.com/graphics/Alex_Vlachos_Advanced_VR_Rendering_GDC2015.pdf
@@ -9,6 +9,8 @@
 #include "geometry.hpp"
 #include "logging.hpp"
 #include <unordered_map>
+#include <atomic>
+#include <mutex>
 
 namespace polymer
 {
@@ -26,14 +28,27 @@ namespace polymer
     // are constructed on the heap at runtime, they are loaned out as references. 
     // Assets stored with the system must be default constructable; this is primarily done for
     // prototyping since it is far more tedious than the alternative of an extensive resolve mechanism.
-    // Asset handles are not thread safe, but safety can be added with relative ease. 
+    // Systems tick concurrently and resolve handles from several threads, so the table and each handle's
+    // cached pointer are only written under `table_mutex`. A resolved handle is published through `resolved`,
+    // so get() on a handle that has already been looked up does not take the lock. Assigning a new asset while
+    // another thread reads the same one is still the caller's problem.
     template<typename T>
     class asset_handle
     {
         static std::unordered_map<std::string, std::shared_ptr<polymer_unique_asset<T>>> table;
+        static std::mutex table_mutex;
         mutable std::shared_ptr<polymer_unique_asset<T>> handle{ nullptr };
+        mutable std::atomic<polymer_unique_asset<T> *> resolved{ nullptr };
+
         // Private constructor for the static list() method below.
-        asset_handle(const::std::string & id, std::shared_ptr<polymer_unique_asset<T>> h) : name(id), handle(h) {}
+        asset_handle(const::std::string & id, std::shared_ptr<polymer_unique_asset<T>> h) : name(id), handle(h), resolved(h.get()) {}
+
+        // Caller holds table_mutex
+        void publish(const std::shared_ptr<polymer_unique_asset<T>> & a) const
+        {
+            handle = a;
+            resolved.store(a.get(), std::memory_order_release);
+        }
 
     public:
 
@@ -50,21 +65,36 @@ namespace polymer
 
         asset_handle(const asset_handle & r)
         {
-            handle = r.handle;
+            std::lock_guard<std::mutex> guard(table_mutex);
+            publish(r.handle);
+            name = r.name;
+        }
+
+        asset_handle & operator = (const asset_handle & r)
+        {
+            if (this == &r) return *this;
+            std::lock_guard<std::mutex> guard(table_mutex);
+            publish(r.handle);
             name = r.name;
+            return *this;
         }
 
         // Return reference to underlying resource. 
         T & get() const
         {
             // Check if this handle has a cached asset. 
-            if (handle)
+            if (polymer_unique_asset<T> * cached = resolved.load(std::memory_order_acquire))
             {
-                return handle->asset;
+                return cached->asset;
             }
             // Lazy load
             else
             {
+                std::lock_guard<std::mutex> guard(table_mutex);
+
+                // Another thread may have resolved this handle while we waited on the lock
+                if (handle) return handle->asset;
+
                 // If not, this is a virgin handle and we should lookup from the static table.
                 auto & a = table[name];
 
@@ -80,7 +110,7 @@ namespace polymer
                     a->assigned = false;
                     log::get()->engine_log->info("asset type {} ({}) was default constructed", typeid(T).name(), name);
                 }
-                handle = a;
+                publish(a);
 
                 return handle->asset;
             }
@@ -88,6 +118,7 @@ namespace polymer
 
         T & assign(T && asset)
         {
+            std::lock_guard<std::mutex> guard(table_mutex);
             auto & a = table[name];
 
             // New asset
@@ -97,7 +128,7 @@ namespace polymer
                 a->timestamp = system_time_ns();
             }
 
-            handle = a;
+            publish(a);
             handle->asset = std::move(asset);
             handle->assigned = name.empty() || name == "empty" ? false : true;
             handle->timestamp = system_time_ns();
@@ -109,13 +140,15 @@ namespace polymer
 
         bool assigned() const
         {
-            if (handle && handle->assigned) return true;
+            const polymer_unique_asset<T> * cached = resolved.load(std::memory_order_acquire);
+            if (cached && cached->assigned) return true;
 
             // Search for it, but don't default construct
+            std::lock_guard<std::mutex> guard(table_mutex);
             auto itr = table.find(name);
             if (itr != table.end())
             {
-                handle = itr->second;
+                publish(itr->second);
                 return handle->assigned;
             }
             return false;
@@ -124,8 +157,15 @@ namespace polymer
         // List will return all the asset_handles of type T.
         static std::vector<asset_handle> list()
         {
+            // Snapshot the table first; copying handles into `results` takes the lock again
+            std::vector<std::pair<std::string, std::shared_ptr<polymer_unique_asset<T>>>> entries;
+            {
+                std::lock_guard<std::mutex> guard(table_mutex);
+                entries.assign(table.begin(), table.end());
+            }
+
             std::vector<asset_handle> results;
-            for (const auto & a : table)
+            for (const auto & a : entries)
             {
                 results.push_back(asset_handle<T>(a.first, a.second));
             }
@@ -134,6 +174,7 @@ namespace polymer
 
         static bool destroy(const std::string & asset_id)
         {
+            std::lock_guard<std::mutex> guard(table_mutex);
             auto iter = table.find(asset_id);
             if (iter != table.end())
             {
@@ -148,6 +189,9 @@ namespace polymer
     template<class T>
     std::unordered_map<std::string, std::shared_ptr<polymer_unique_asset<T>>> asset_handle<T>::table;
 
+    template<class T>
+    std::mutex asset_handle<T>::table_mutex;
+
 } // end namespace polymer
 
 #endif // end polymer_asset_handle_hpp
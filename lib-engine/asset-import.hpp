@@ -5,6 +5,7 @@
 
 #include "environment.hpp"
 #include "asset-resolver.hpp"
+#include "gl-texture-cooker.hpp"
 
 namespace polymer
 {
@@ -34,6 +35,25 @@ namespace polymer
         return e;
     }
 
+    // Source images are cooked to a BC7 .dds beside the original, which asset_resolver prefers on later loads, and
+    // the cooked copy is what gets imported. Falls back to the source image if the driver can't produce the container.
+    inline gl_texture_2d import_texture(const std::string & path)
+    {
+        const std::string cooked_path = replace_extension(path, ".dds");
+
+        try
+        {
+            if (cook_texture(path, cooked_path, texture_compression::bc7)) return load_cooked_texture(cooked_path, texture_compression::bc7);
+            log::get()->engine_log->info("driver could not encode {} as bc7, importing the source image", path);
+        }
+        catch (const std::exception & e)
+        {
+            log::get()->engine_log->info("failed to cook {}: {}", path, e.what());
+        }
+
+        return load_image(path, false);
+    }
+
     inline std::vector<entity> import_asset_runtime(const std::string & filepath,
         environment & env,
         entity_orchestrator & orch)
@@ -50,6 +70,12 @@ namespace polymer
 
         // Handle image/texture types. No entities are directly created.
         if (ext == "png" || ext == "tga" || ext == "jpg")
+        {
+            create_handle_for_asset(name_no_ext.c_str(), import_texture(path));
+            return {};
+        }
+
+        if (is_container_image_extension(ext))
         {
             create_handle_for_asset(name_no_ext.c_str(), load_image(path, false));
             return {};
@@ -11,8 +11,8 @@
  * (todo) Presently we assume that all handle identifiers refer to unique assets, however this is a weak
  * assumption and is likely untrue in practice and should be fixed.
  *
- * (todo) The asset_resolver is single-threaded and called on the main thread because it may also
- * touch GPU resources. This must be changed to load asynchronously. 
+ * Loading is asynchronous: file IO and decoding happen on worker threads, while GPU uploads are 
+ * rationed per frame by asset_resolver::update() on the thread that owns the GL context.
  */
 
 #pragma once
@@ -22,15 +22,22 @@
 
 #include "asset-handle.hpp"
 #include "asset-handle-utils.hpp"
+#include "asset-upload-queue.hpp"
 #include "string_utils.hpp"
 #include "renderer-pbr.hpp"
 #include "system-collision.hpp"
 #include "environment.hpp"
 #include "system-render.hpp"
 
+#include "thread-pool.hpp"
+#include "gl-loaders.hpp"
+
 #include "../lib-model-io/model-io.hpp"
 #include "json.hpp"
 
+#include <mutex>
+#include <unordered_set>
+
 namespace polymer
 {
 
@@ -52,23 +59,144 @@ namespace polymer
 
     // The purpose of an asset resolver is to match an asset_handle to an asset on disk. This is done
     // for scene objects (meshes, geometry) and materials (shaders, textures). 
+    //
+    // resolve() returns immediately. The directory walk, image decoding and model import run as jobs on 
+    // a work_stealing_pool; decoded assets queue up until update() is called on the GL thread, which 
+    // uploads them within a per-frame byte budget. Texture pixels are staged through a persistently 
+    // mapped ring buffer bound as GL_PIXEL_UNPACK_BUFFER. Until an asset arrives, texture handles 
+    // hold a 1x1 placeholder chosen by the role of the texture and mesh handles stay empty.
     class asset_resolver
     {
-        // Unresolved asset names
-        std::vector<std::string> mesh_names;
+        // Produced on a worker, consumed on the GL thread
+        struct decoded_asset
+        {
+            std::string name;                                       // texture name, or the file root of `root/submesh` mesh handles
+            bool is_model{ false };
+            int width{ 0 }, height{ 0 }, channels{ 0 };
+            std::vector<uint8_t> pixels;
+            gli::texture2d container;                               // cooked DDS/KTX texture, uploaded with its own mips
+            std::unordered_map<std::string, runtime_mesh> meshes;
+            size_t bytes{ 0 };                                      // counted against the upload budget
+        };
+
+        // Names collected on the main thread by resolve(), read by the directory walk job
+        struct resolve_request
+        {
+            std::string root;
+            std::unordered_set<std::string> mesh_roots;
+            std::unordered_set<std::string> textures;
+        };
+
         std::vector<std::string> shader_names;
         std::vector<std::string> material_names;
-        std::vector<std::string> texture_names;
 
-        // fixme - what to do if we find multiples? 
-        void walk_directory(path root)
+        std::unique_ptr<work_stealing_pool> owned_pool;
+        work_stealing_pool * pool{ nullptr };
+        job_counter outstanding_jobs{ 0 };
+
+        asset_upload_queue<decoded_asset> ready;
+
+        std::mutex fbx_mutex; // the fbx sdk is not documented as thread-safe
+
+        gl_ring_buffer staging;
+        size_t upload_budget;
+
+        // Decoding and the directory walk run on pool workers, where an uncaught exception would terminate the
+        // process. A file that fails to load is logged and skipped instead, and its job still completes so
+        // that outstanding_jobs drains.
+        template<typename F>
+        static void run_guarded(const std::string & path, F && f)
+        {
+            try
+            {
+                f();
+            }
+            catch (const std::exception & e)
+            {
+                log::get()->engine_log->info("failed to resolve {}: {}", path, e.what());
+            }
+            catch (...)
+            {
+                log::get()->engine_log->info("failed to resolve {}", path);
+            }
+        }
+
+        void decode_image(const std::string & path, const std::string & name)
+        {
+            auto binary_file = read_file_binary(path);
+
+            std::unique_ptr<decoded_asset> asset(new decoded_asset());
+            asset->name = name;
+
+            uint8_t * data = stbi_load_from_memory(binary_file.data(), (int)binary_file.size(), &asset->width, &asset->height, &asset->channels, 0);
+            if (!data)
+            {
+                log::get()->engine_log->info("failed to decode {}", path);
+                return;
+            }
+
+            asset->pixels.assign(data, data + size_t(asset->width) * asset->height * asset->channels);
+            asset->bytes = asset->pixels.size();
+            stbi_image_free(data);
+            ready.push(std::move(asset));
+        }
+
+        void decode_container(const std::string & path, const std::string & name)
+        {
+            auto binary_file = read_file_binary(path);
+
+            std::unique_ptr<decoded_asset> asset(new decoded_asset());
+            asset->name = name;
+            asset->container = gli::texture2d(gli::load(reinterpret_cast<const char *>(binary_file.data()), binary_file.size()));
+
+            if (asset->container.empty())
+            {
+                log::get()->engine_log->info("failed to decode {}", path);
+                return;
+            }
+
+            for (size_t level = 0; level < asset->container.levels(); ++level) asset->bytes += asset->container.size(level);
+            ready.push(std::move(asset));
+        }
+
+        void decode_model(const std::string & path, const std::string & name)
+        {
+            std::unique_ptr<decoded_asset> asset(new decoded_asset());
+            asset->name = name;
+            asset->is_model = true;
+
+            std::string ext = get_extension(path);
+            std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+            if (ext == "fbx")
+            {
+                std::lock_guard<std::mutex> guard(fbx_mutex);
+                asset->meshes = import_model(path);
+            }
+            else asset->meshes = import_model(path);
+
+            for (auto & m : asset->meshes)
+            {
+                rescale_geometry(m.second, 1.f);
+                asset->bytes += m.second.vertices.size() * (sizeof(float3) * 4 + sizeof(float4) + sizeof(float2));
+                asset->bytes += m.second.faces.size() * sizeof(uint3);
+            }
+
+            ready.push(std::move(asset));
+        }
+
+        // Runs as a job. Matches files against the requested names (hash lookups rather than a scan of 
+        // every name per file) and submits one decode job per match.
+        void walk_directory(std::shared_ptr<resolve_request> request)
         {
-            scoped_timer t("load + resolve");
+            scoped_timer t("walk " + request->root);
 
-            for (auto & entry : recursive_directory_iterator(root))
+            // Cooked containers win over source images of the same name, whichever the walk finds first
+            std::unordered_map<std::string, std::string> texture_paths;
+
+            for (auto & entry : recursive_directory_iterator(request->root))
             {
-                const size_t root_len = root.string().length(), ext_len = entry.path().extension().string().length();
-                auto path = entry.path().string(), name = path.substr(root_len + 1, path.size() - root_len - ext_len - 1);
+                auto path = entry.path().string();
                 for (auto & chr : path) if (chr == '\\') chr = '/';
 
                 std::string ext = get_extension(path);
@@ -77,70 +205,147 @@ namespace polymer
                 std::string filename_no_ext = get_filename_without_extension(path);
                 std::transform(filename_no_ext.begin(), filename_no_ext.end(), filename_no_ext.begin(), ::tolower);
 
-                if (ext == "png" || ext == "tga" || ext == "jpg" || ext == "jpeg")
+                if (ext == "png" || ext == "tga" || ext == "jpg" || ext == "jpeg" || is_container_image_extension(ext))
                 {
-                    for (const auto & name : texture_names)
+                    if (request->textures.count(filename_no_ext))
                     {
-                        if (name == filename_no_ext)
-                        {
-                            create_handle_for_asset(name.c_str(), load_image(path, false));
-                            log::get()->engine_log->info("resolved {} ({})", name, typeid(gl_texture_2d).name());
-                        }
+                        auto existing = texture_paths.find(filename_no_ext);
+                        if (existing == texture_paths.end() || is_container_image_extension(ext)) texture_paths[filename_no_ext] = path;
                     }
                 }
                 else if (ext == "obj" || ext == "fbx")
                 {
-                    // Name could either be something like "my_mesh" or "my_mesh/sub_component"
-                    // `mesh_names` contains both CPU and GPU geometry handle ids
-                    for (const auto & name : mesh_names)
+                    // "my_mesh/sub_component" should match to "my_mesh.obj" or similar
+                    if (request->mesh_roots.count(filename_no_ext))
                     {
-                        std::cout << "Looking for: " << name << std::endl;
-
-                        // "my_mesh/sub_component" should match to "my_mesh.obj" or similar
-                        if (find_root(name) == filename_no_ext)
-                        {
-                            std::unordered_map<std::string, runtime_mesh> imported_models = import_model(path);
+                        auto job = std::make_shared<std::pair<std::string, std::string>>(path, filename_no_ext);
+                        pool->submit(outstanding_jobs, [this, job]() { run_guarded(job->first, [&]() { decode_model(job->first, job->second); }); });
+                    }
+                }
+            }
 
-                            for (auto & m : imported_models)
-                            {
-                                auto & mesh = m.second;
-                                rescale_geometry(mesh, 1.f);
+            for (auto & texture : texture_paths)
+            {
+                auto job = std::make_shared<std::pair<std::string, std::string>>(texture.second, texture.first);
+                if (is_container_image_extension(get_extension(texture.second))) pool->submit(outstanding_jobs, [this, job]() { run_guarded(job->first, [&]() { decode_container(job->first, job->second); }); });
+                else pool->submit(outstanding_jobs, [this, job]() { run_guarded(job->first, [&]() { decode_image(job->first, job->second); }); });
+            }
+        }
 
-                                const std::string handle_id = filename_no_ext + "/" + m.first;
+        void upload(decoded_asset & asset)
+        {
+            if (asset.is_model)
+            {
+                for (auto & m : asset.meshes)
+                {
+                    const std::string handle_id = asset.name + "/" + m.first;
+                    create_handle_for_asset(handle_id.c_str(), make_mesh_from_geometry(m.second));
+                    create_handle_for_asset(handle_id.c_str(), std::move(m.second));
+                    log::get()->engine_log->info("resolved {} ({})", handle_id, typeid(gl_mesh).name());
+                }
+                return;
+            }
 
-                                create_handle_for_asset(handle_id.c_str(), make_mesh_from_geometry(mesh));
-                                create_handle_for_asset(handle_id.c_str(), std::move(mesh));
+            if (!asset.container.empty())
+            {
+                const GLsizeiptr bytes = static_cast<GLsizeiptr>(asset.bytes);
+                gl_texture_2d tex;
 
-                                log::get()->engine_log->info("resolved {} ({})", handle_id, typeid(gl_mesh).name());
-                            }
-                        }
-                    }
+                // Levels are contiguous in gli storage, so the whole chain stages as one region
+                if (bytes <= staging.bytes_per_frame())
+                {
+                    const gl_ring_buffer::allocation region = staging.write(asset.container.data(), bytes);
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.handle());
+                    tex = load_image(asset.container, reinterpret_cast<const GLvoid *>(region.offset));
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
                 }
+                else tex = load_image(asset.container);
+
+                create_handle_for_asset(asset.name.c_str(), std::move(tex));
+                log::get()->engine_log->info("resolved {} ({})", asset.name, typeid(gl_texture_2d).name());
+                return;
+            }
+
+            GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE;
+            switch (asset.channels)
+            {
+            case 1: format = GL_RED; break;
+            case 2: format = GL_RED; type = GL_UNSIGNED_SHORT; break; // matches load_image()
+            case 3: format = GL_RGB; break;
+            case 4: format = GL_RGBA; break;
+            default: log::get()->engine_log->info("{} has an unsupported number of channels", asset.name); return;
+            }
+
+            gl_texture_2d tex;
+            const GLsizeiptr bytes = static_cast<GLsizeiptr>(asset.pixels.size());
+
+            // Images larger than a frame's staging region go straight from client memory
+            if (bytes <= staging.bytes_per_frame())
+            {
+                const gl_ring_buffer::allocation region = staging.write(asset.pixels.data(), bytes);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.handle());
+                tex.setup(asset.width, asset.height, format, format, type, reinterpret_cast<const GLvoid *>(region.offset), true);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
             }
+            else tex.setup(asset.width, asset.height, format, format, type, asset.pixels.data(), true);
+
+            create_handle_for_asset(asset.name.c_str(), std::move(tex));
+            log::get()->engine_log->info("resolved {} ({})", asset.name, typeid(gl_texture_2d).name());
+        }
+
+        // A 1x1 texture that reads as a neutral value for the role the texture plays in a material
+        static void assign_placeholder(const texture_handle & handle, const uint8_t r, const uint8_t g, const uint8_t b)
+        {
+            if (handle.name.empty() || handle.name == "empty" || handle.assigned()) return;
+            const uint8_t texel[4] = { r, g, b, 255 };
+            gl_texture_2d tex;
+            tex.setup(1, 1, GL_RGBA, GL_RGBA, GL_UNSIGNED_BYTE, texel, false);
+            create_handle_for_asset(handle.name.c_str(), std::move(tex));
         }
 
     public:
 
+        // If |jobs| is null the resolver creates its own pool. |upload_budget_bytes| bounds the data 
+        // uploaded by each call to update().
+        asset_resolver(work_stealing_pool * jobs = nullptr, const size_t upload_budget_bytes = 32 * 1024 * 1024)
+            : pool(jobs), staging(static_cast<GLsizeiptr>(upload_budget_bytes), GL_NONE), upload_budget(upload_budget_bytes)
+        {
+            if (!pool)
+            {
+                owned_pool.reset(new work_stealing_pool(std::max<size_t>(1, std::thread::hardware_concurrency() / 2)));
+                pool = owned_pool.get();
+            }
+        }
+
+        ~asset_resolver()
+        {
+            pool->wait(outstanding_jobs);
+        }
+
+        // Begins resolving every handle referenced by the scene and material library. Must be called on 
+        // the GL thread (placeholders are created here); returns without waiting for any file IO.
         void resolve(const std::string & asset_dir, environment * scene, material_library * library)
         {
             assert(scene != nullptr);
             assert(library != nullptr);
             assert(asset_dir.size() > 1);
 
+            auto request = std::make_shared<resolve_request>();
+            request->root = asset_dir;
+
             // Material Names
             for (auto & m : scene->render_system->materials)
-                material_names.push_back(m.second.material.name);
+                material_names.push_back(m.material.name);
 
             // GPU Geometry
             for (auto & m : scene->render_system->meshes)
-                mesh_names.push_back(m.second.mesh.name);
+                request->mesh_roots.insert(find_root(m.mesh.name));
 
             // CPU Geometry (same list as GPU)
             for (auto & m : scene->collision_system->meshes)
-                mesh_names.push_back(m.second.geom.name);
+                request->mesh_roots.insert(find_root(m.geom.name));
 
             remove_duplicates(material_names);
-            remove_duplicates(mesh_names);
 
             for (auto & mat : library->instances)
             {
@@ -148,28 +353,58 @@ namespace polymer
                 {
                     shader_names.push_back(pbr->shader.name);
 
-                    texture_names.push_back(pbr->albedo.name);
-                    texture_names.push_back(pbr->normal.name);
-                    texture_names.push_back(pbr->metallic.name);
-                    texture_names.push_back(pbr->roughness.name);
-                    texture_names.push_back(pbr->emissive.name);
-                    texture_names.push_back(pbr->height.name);
-                    texture_names.push_back(pbr->occlusion.name);
+                    assign_placeholder(pbr->albedo, 255, 255, 255);
+                    assign_placeholder(pbr->normal, 128, 128, 255);
+                    assign_placeholder(pbr->metallic, 0, 0, 0);
+                    assign_placeholder(pbr->roughness, 255, 255, 255);
+                    assign_placeholder(pbr->emissive, 0, 0, 0);
+                    assign_placeholder(pbr->height, 0, 0, 0);
+                    assign_placeholder(pbr->occlusion, 255, 255, 255);
+
+                    for (auto * t : { &pbr->albedo, &pbr->normal, &pbr->metallic, &pbr->roughness, &pbr->emissive, &pbr->height, &pbr->occlusion })
+                    {
+                        request->textures.insert(t->name);
+                    }
                 }
 
                 if (auto * phong = dynamic_cast<polymer_blinn_phong_standard*>(mat.second.get()))
                 {
                     shader_names.push_back(phong->shader.name);
 
-                    texture_names.push_back(phong->diffuse.name);
-                    texture_names.push_back(phong->normal.name);
+                    assign_placeholder(phong->diffuse, 255, 255, 255);
+                    assign_placeholder(phong->normal, 128, 128, 255);
+
+                    request->textures.insert(phong->diffuse.name);
+                    request->textures.insert(phong->normal.name);
                 }
             }
 
             remove_duplicates(shader_names);
-            remove_duplicates(texture_names);
 
-            walk_directory(asset_dir);
+            pool->submit(outstanding_jobs, [this, request]() { run_guarded(request->root, [&]() { walk_directory(request); }); });
+        }
+
+        // Call once per frame on the GL thread. Uploads decoded assets in the order they finished until 
+        // the budget is spent (at least one asset is always uploaded so large files make progress). 
+        // Returns true while any decoding or uploading is still outstanding.
+        bool update()
+        {
+            ready.drain(upload_budget, [this](decoded_asset & asset) { upload(asset); });
+            staging.end_frame();
+            return busy();
+        }
+
+        // Blocks until every outstanding asset has been decoded and uploaded
+        void flush()
+        {
+            pool->wait(outstanding_jobs);
+            while (update()) {}
+        }
+
+        bool busy()
+        {
+            if (outstanding_jobs.load(std::memory_order_acquire) != 0) return true;
+            return !ready.empty();
         }
     };
 
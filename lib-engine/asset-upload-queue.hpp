@@ -0,0 +1,77 @@
+/*
+ * File: lib-engine/asset-upload-queue.hpp
+ * The hand-off between the worker jobs that decode assets and the thread that uploads them. Decode jobs
+ * push assets as they finish; the GL thread drains them once per frame in the same order, stopping when
+ * the frame's byte budget is spent. Nothing here touches GL, so the scheduling is testable on its own.
+ */
+
+#pragma once
+
+#ifndef polymer_asset_upload_queue_hpp
+#define polymer_asset_upload_queue_hpp
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace polymer
+{
+
+    // T must expose a `size_t bytes` member, the amount it counts against the upload budget
+    template<typename T>
+    class asset_upload_queue
+    {
+        std::mutex ready_mutex;
+        std::deque<std::unique_ptr<T>> ready;
+
+    public:
+
+        // Safe to call from any thread
+        void push(std::unique_ptr<T> asset)
+        {
+            std::lock_guard<std::mutex> guard(ready_mutex);
+            ready.push_back(std::move(asset));
+        }
+
+        // Passes assets to |consume| in the order they were pushed until the next one would take the total
+        // past |budget_bytes|. At least one asset is consumed so files larger than the budget still make
+        // progress. |consume| runs without the lock held. Returns the number of bytes consumed.
+        template<typename F>
+        size_t drain(const size_t budget_bytes, F && consume)
+        {
+            size_t consumed = 0;
+
+            for (;;)
+            {
+                std::unique_ptr<T> asset;
+                {
+                    std::lock_guard<std::mutex> guard(ready_mutex);
+                    if (ready.empty()) break;
+                    if (consumed > 0 && consumed + ready.front()->bytes > budget_bytes) break;
+                    asset = std::move(ready.front());
+                    ready.pop_front();
+                }
+
+                consume(*asset);
+                consumed += asset->bytes;
+            }
+
+            return consumed;
+        }
+
+        bool empty()
+        {
+            std::lock_guard<std::mutex> guard(ready_mutex);
+            return ready.empty();
+        }
+
+        size_t size()
+        {
+            std::lock_guard<std::mutex> guard(ready_mutex);
+            return ready.size();
+        }
+    };
+
+} // end namespace polymer
+
+#endif // end polymer_asset_upload_queue_hpp
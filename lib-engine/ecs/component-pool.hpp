@@ -10,6 +10,7 @@
 #define polymer_component_pool_hpp
 
 #include <assert.h>
+#include <limits>
 #include <memory>
 #include <type_traits>
 #include <unordered_map>
@@ -66,7 +67,8 @@ namespace polymer
             // element being added or because the "back" array is full.
             if (objects.empty() || objects.back().size() == page_size)
             {
-                objects.emplace_back(page_size);
+                objects.emplace_back();
+                objects.back().reserve(page_size);
             }
 
             // Add the element to the "end" of the ArrayVector.
@@ -135,7 +137,7 @@ namespace polymer
 
         template<typename Fn> void for_each(Fn && func) const
         {
-            for (T & object : *this) func(object);
+            for (const T & object : *this) func(object);
         }
 
         size_t size() const
@@ -308,8 +310,192 @@ namespace polymer
         };
     };
 
+    /// A sparse set of [entity] to [Object], keyed by the index half of a generational entity handle.
+    ///
+    /// Objects are stored densely in a single packed array alongside a parallel array of
+    /// the entities that own them, so iteration walks contiguous memory. A paged sparse
+    /// array maps an entity index to its slot in the packed array, which makes get()
+    /// a pair of array reads rather than a hash table probe. The full entity handle
+    /// (index and version) is compared on lookup so stale handles return nullptr.
+    ///
+    /// Objects are removed with the same swap-and-pop scheme as unordered_vector_map, so
+    /// no order is guaranteed. Unlike unordered_vector_map, the packed array may reallocate
+    /// on emplace(): pointers returned by emplace() or get() are only valid until the next
+    /// insertion or removal. This container is not thread safe.
+
+    template <typename T, typename KeyFunctionT = component_hash>
+    class sparse_component_pool
+    {
+        static constexpr uint32_t kSparsePageBits = 12;
+        static constexpr uint32_t kSparsePageSize = 1u << kSparsePageBits;
+        static constexpr uint32_t kInvalidSlot = std::numeric_limits<uint32_t>::max();
+
+        using SparsePage = std::vector<uint32_t>;
+
+        std::vector<T> dense;                 // Packed objects
+        std::vector<entity> dense_entities;   // Owning entity of each packed object, parallel to |dense|
+        std::vector<SparsePage> sparse;       // Entity index -> slot in |dense|, allocated one page at a time
+
+        uint32_t find_slot(const entity e) const
+        {
+            const uint32_t idx = get_entity_index(e);
+            const uint32_t page = idx >> kSparsePageBits;
+            if (page >= sparse.size() || sparse[page].empty()) return kInvalidSlot;
+            const uint32_t slot = sparse[page][idx & (kSparsePageSize - 1)];
+            if (slot == kInvalidSlot || dense_entities[slot] != e) return kInvalidSlot;
+            return slot;
+        }
+
+        uint32_t & assure_slot(const entity e)
+        {
+            const uint32_t idx = get_entity_index(e);
+            const uint32_t page = idx >> kSparsePageBits;
+            if (page >= sparse.size()) sparse.resize(page + 1);
+            if (sparse[page].empty()) sparse[page].assign(size_t(kSparsePageSize), uint32_t(kInvalidSlot)); // copies avoid odr-use of the constants
+            return sparse[page][idx & (kSparsePageSize - 1)];
+        }
+
+        // Swap-and-pop the object in |slot|, patching the sparse entry of the object moved into its place.
+        void destroy_slot(const uint32_t slot)
+        {
+            const uint32_t last = static_cast<uint32_t>(dense.size() - 1);
+            const entity removed = dense_entities[slot];
+
+            if (slot != last)
+            {
+                dense[slot] = std::move(dense[last]);
+                dense_entities[slot] = dense_entities[last];
+                assure_slot(dense_entities[slot]) = slot;
+            }
+
+            dense.pop_back();
+            dense_entities.pop_back();
+            assure_slot(removed) = kInvalidSlot;
+        }
+
+    public:
+
+        using iterator = typename std::vector<T>::iterator;
+        using const_iterator = typename std::vector<T>::const_iterator;
+
+        // The |reserve_size| pre-allocates storage for this many objects in the packed array.
+        explicit sparse_component_pool(size_t reserve_size)
+        {
+            dense.reserve(reserve_size);
+            dense_entities.reserve(reserve_size);
+        }
+
+        sparse_component_pool(const sparse_component_pool & rhs) = delete;
+        sparse_component_pool & operator = (const sparse_component_pool & rhs) = delete;
+
+        // Emplaces an object at the end of the packed array and returns a pointer to it. Returns
+        // nullptr if the entity already owns an object in this pool, or if the object in its slot
+        // belongs to a newer version of the same entity index. An object owned by an older version
+        // is considered stale and is replaced.
+        template<typename... Args> T * emplace(Args &&... args)
+        {
+            dense.emplace_back(std::forward<Args>(args)...);
+
+            KeyFunctionT key_fn;
+            const entity key = key_fn(dense.back());
+
+            uint32_t & slot = assure_slot(key);
+            if (slot != kInvalidSlot)
+            {
+                if (get_entity_version(dense_entities[slot]) >= get_entity_version(key))
+                {
+                    dense.pop_back();
+                    return nullptr;
+                }
+
+                // Stale version of this index; drop it before taking over the sparse entry.
+                T fresh = std::move(dense.back());
+                dense.pop_back();
+                destroy_slot(slot);
+                dense.emplace_back(std::move(fresh));
+            }
+
+            dense_entities.push_back(key);
+            assure_slot(key) = static_cast<uint32_t>(dense.size() - 1);
+            return &dense.back();
+        }
+
+        // Associates a copy of |obj| with |key|, overwriting any object |key| already owns. The 
+        // stored object is re-keyed to |key|, so components copied from another entity are safe to pass.
+        T * assign(const entity key, T obj)
+        {
+            static_cast<base_component &>(obj).e = key;
+            if (T * existing = get(key))
+            {
+                *existing = std::move(obj);
+                return existing;
+            }
+            return emplace(std::move(obj));
+        }
+
+        // Destroys the object associated with |key| by swapping it with the last packed object.
+        void destroy(const entity & key)
+        {
+            const uint32_t slot = find_slot(key);
+            if (slot != kInvalidSlot) destroy_slot(slot);
+        }
+
+        // Returns true if an object is associated with the |key|.
+        bool contains(const entity & key) const
+        {
+            return find_slot(key) != kInvalidSlot;
+        }
+
+        // Returns a pointer to the object associated with |key|, or nullptr.
+        T * get(const entity & key)
+        {
+            const uint32_t slot = find_slot(key);
+            return (slot != kInvalidSlot) ? &dense[slot] : nullptr;
+        }
+
+        // Returns a pointer to the object associated with |key|, or nullptr.
+        const T * get(const entity & key) const
+        {
+            const uint32_t slot = find_slot(key);
+            return (slot != kInvalidSlot) ? &dense[slot] : nullptr;
+        }
+
+        // Iterates over all objects in packed order, passing them to the given function |Fn|.
+        template<typename Fn> void for_each(Fn && func)
+        {
+            for (T & object : dense) func(object);
+        }
+
+        template<typename Fn> void for_each(Fn && func) const
+        {
+            for (const T & object : dense) func(object);
+        }
+
+        // Direct access to the packed arrays. entities()[i] owns data()[i].
+        T * data() { return dense.data(); }
+        const T * data() const { return dense.data(); }
+        const std::vector<entity> & entities() const { return dense_entities; }
+
+        size_t size() const
+        {
+            return dense.size();
+        }
+
+        void clear()
+        {
+            dense.clear();
+            dense_entities.clear();
+            sparse.clear();
+        }
+
+        iterator begin() { return dense.begin(); }
+        const_iterator begin() const { return dense.begin(); }
+        iterator end() { return dense.end(); }
+        const_iterator end() const { return dense.end(); }
+    };
+
     template <typename T>
-    using polymer_component_pool = unordered_vector_map<entity, T, component_hash, std::hash<entity>>;
+    using polymer_component_pool = sparse_component_pool<T, component_hash>;
 
 } // end namespace polymer
 
@@ -11,7 +11,11 @@
 
 #include <unordered_map>
 #include <limits>
+#include <vector>
+#include <algorithm>
+#include <assert.h>
 #include "typeid.hpp"
+#include "thread-pool.hpp"
 
 namespace polymer
 {
@@ -19,21 +23,33 @@ namespace polymer
     //   Entity   //
     ////////////////
 
-    // An entity is an uniquely identifiable object in the Polymer runtime.
+    // An entity is an uniquely identifiable object in the Polymer runtime. It is a generational
+    // handle: the low 32 bits are an index that is recycled once the entity is destroyed, and
+    // the high 32 bits are a version that is bumped on every recycle so stale handles can be detected.
     using entity = uint64_t;
     constexpr entity kInvalidEntity = 0;
     constexpr entity kAllEntities = std::numeric_limits<uint64_t>::max();
 
+    constexpr uint32_t kEntityIndexBits = 32;
+    constexpr uint64_t kEntityIndexMask = 0xFFFFFFFF;
+
+    inline constexpr uint32_t get_entity_index(const entity e) { return static_cast<uint32_t>(e & kEntityIndexMask); }
+    inline constexpr uint32_t get_entity_version(const entity e) { return static_cast<uint32_t>(e >> kEntityIndexBits); }
+    inline constexpr entity make_entity(const uint32_t index, const uint32_t version) { return (static_cast<uint64_t>(version) << kEntityIndexBits) | index; }
+
     ////////////////////////
     //   Base Component   //
     ////////////////////////
 
+    template <typename T, typename KeyFunctionT> class sparse_component_pool;
+
     // Provide a consistent way to retrieve an entity to which a component belongs. 
     class base_component
     {
         entity e;
         friend struct component_hash;
         friend class environment; // for serialization to modify e directly
+        template <typename T, typename KeyFunctionT> friend class sparse_component_pool; // for re-keying components on assignment
     public:
         explicit base_component(entity e = kInvalidEntity) : e(e) { }
         entity get_entity() const { return e; }
@@ -64,12 +80,42 @@ namespace polymer
         // Destroys all of an entity's associated components
         virtual void destroy(entity e) {};
 
+        // Per-frame work, run by entity_orchestrator::tick(). Systems without per-frame work leave this empty.
+        virtual void tick(const double dt) {};
+
+        // Component types touched by tick(). The orchestrator runs systems concurrently when neither writes 
+        // a type the other reads or writes. A system that declares nothing is assumed to touch everything.
+        template <typename C> void declare_read() { component_reads.push_back(get_typeid<C>()); }
+        template <typename C> void declare_write() { component_writes.push_back(get_typeid<C>()); }
+        const std::vector<poly_typeid> & get_reads() const { return component_reads; }
+        const std::vector<poly_typeid> & get_writes() const { return component_writes; }
+        bool has_declared_access() const { return !component_reads.empty() || !component_writes.empty(); }
+
         // Helper function to signal to the entity orchestrator that this system operates on these types of components
         template <typename S>
         void register_system_for_type(S * system, poly_typeid component_type) { register_system_for_type(get_typeid<S>(), component_type); }
         void register_system_for_type(poly_typeid system_type, poly_typeid component_type);
+
+    private:
+
+        std::vector<poly_typeid> component_reads;
+        std::vector<poly_typeid> component_writes;
     };
 
+    // True if two systems cannot safely tick at the same time
+    inline bool systems_conflict(const base_system & a, const base_system & b)
+    {
+        if (!a.has_declared_access() || !b.has_declared_access()) return true;
+
+        auto overlaps = [](const std::vector<poly_typeid> & x, const std::vector<poly_typeid> & y)
+        {
+            for (const auto & t : x) if (std::find(y.begin(), y.end(), t) != y.end()) return true;
+            return false;
+        };
+
+        return overlaps(a.get_writes(), b.get_writes()) || overlaps(a.get_writes(), b.get_reads()) || overlaps(b.get_writes(), a.get_reads());
+    }
+
     /////////////////////////////
     //   Entity Orchestrator   //
     /////////////////////////////
@@ -79,7 +125,11 @@ namespace polymer
         std::mutex createMutex;
         std::unordered_map<poly_typeid, poly_typeid> system_type_map; // system-to-component-type
         std::unordered_map<poly_typeid, std::unique_ptr<base_system>> systems;
-        entity entity_counter{ 0 }; // an autoincrementing value to generate unique ids
+        std::vector<poly_typeid> system_order; // creation order, used to order conflicting systems in tick()
+        std::vector<std::vector<base_system *>> schedule; // phases of mutually non-conflicting systems
+        bool schedule_dirty{ true };
+        std::vector<uint32_t> entity_versions{ 0 }; // current version per entity index; index 0 is reserved for kInvalidEntity
+        std::vector<uint32_t> free_indices; // indices of destroyed entities available for reuse
 
     public:
 
@@ -100,16 +150,98 @@ namespace polymer
         entity create_entity()
         {
             std::lock_guard<std::mutex> guard(createMutex);
-            const entity e = ++entity_counter;
-            return e;
+            if (!free_indices.empty())
+            {
+                const uint32_t index = free_indices.back();
+                free_indices.pop_back();
+                return make_entity(index, entity_versions[index]);
+            }
+            const uint32_t index = static_cast<uint32_t>(entity_versions.size());
+            assert(index != get_entity_index(kAllEntities));
+            entity_versions.push_back(0);
+            return make_entity(index, 0);
+        }
+
+        // Retires an entity handle. Its index is recycled by a later create_entity() under a new 
+        // version, so any handle still referring to |e| will fail is_alive() and component lookups.
+        // Components must be destroyed by their owning systems before the entity is retired.
+        void destroy_entity(const entity e)
+        {
+            std::lock_guard<std::mutex> guard(createMutex);
+            const uint32_t index = get_entity_index(e);
+            if (index == 0 || index >= entity_versions.size() || entity_versions[index] != get_entity_version(e)) return;
+            ++entity_versions[index];
+            free_indices.push_back(index);
+        }
+
+        bool is_alive(const entity e)
+        {
+            std::lock_guard<std::mutex> guard(createMutex);
+            const uint32_t index = get_entity_index(e);
+            return index != 0 && index < entity_versions.size() && entity_versions[index] == get_entity_version(e);
         }
 
         void add_system(const poly_typeid system_type, std::unique_ptr<base_system> system)
         {
             if (!system) return;
             auto itr = systems.find(system_type);
-            if (itr == systems.end()) systems.emplace(system_type, std::move(system)); // new
+            if (itr == systems.end())
+            {
+                systems.emplace(system_type, std::move(system)); // new
+                system_order.push_back(system_type);
+            }
             else itr->second = std::move(system); // replace
+            schedule_dirty = true;
+        }
+
+        // Builds phases from the declared component access of each system. A system is placed one phase after
+        // the latest earlier-created system it conflicts with, so conflicting systems keep their creation order.
+        const std::vector<std::vector<base_system *>> & get_schedule()
+        {
+            if (!schedule_dirty) return schedule;
+
+            schedule.clear();
+            std::vector<std::pair<base_system *, size_t>> placed;
+
+            for (const auto & type : system_order)
+            {
+                base_system * s = systems[type].get();
+
+                size_t phase = 0;
+                for (const auto & p : placed) if (systems_conflict(*s, *p.first)) phase = std::max(phase, p.second + 1);
+
+                if (phase >= schedule.size()) schedule.resize(phase + 1);
+                schedule[phase].push_back(s);
+                placed.push_back({ s, phase });
+            }
+
+            schedule_dirty = false;
+            return schedule;
+        }
+
+        // Runs tick() on every system. Phases run in order; the systems within a phase run concurrently 
+        // on |pool| with the calling thread taking the first one and then helping with the rest. 
+        // Without a pool everything runs serially.
+        void tick(const double dt, work_stealing_pool * pool = nullptr)
+        {
+            for (auto & phase : get_schedule())
+            {
+                if (!pool || phase.size() == 1)
+                {
+                    for (base_system * s : phase) s->tick(dt);
+                    continue;
+                }
+
+                job_counter pending{ 0 };
+                for (size_t i = 1; i < phase.size(); ++i)
+                {
+                    base_system * s = phase[i];
+                    pool->submit(pending, [s, dt]() { s->tick(dt); });
+                }
+
+                phase[0]->tick(dt);
+                pool->wait(pending);
+            }
         }
 
         base_system * get_system(const poly_typeid system_type)
@@ -51,6 +51,12 @@ void environment::copy(entity src, entity dest)
     log::get()->engine_log->info("[environment] copied entity {} to {}", src, dest);
 
 }
+void environment::retire_entity(entity e)
+{
+    // Hand the index back to the orchestrator so it can be recycled under a new version
+    if (xform_system && xform_system->orchestrator) xform_system->orchestrator->destroy_entity(e);
+}
+
 void environment::destroy(entity e)
 {
     if (e == kInvalidEntity) return;
@@ -64,6 +70,7 @@ void environment::destroy(entity e)
             {
                 if (system_pointer) system_pointer->destroy(active);
             });
+            retire_entity(active);
         }
         active_entities.clear();
         log::get()->engine_log->info("[environment] destroyed all entities");
@@ -77,6 +84,7 @@ void environment::destroy(entity e)
         {
             if (system_pointer) system_pointer->destroy(e);
         });
+        retire_entity(e);
 
         log::get()->engine_log->info("[environment] destroyed single entity {}", e);
     }
@@ -95,7 +103,7 @@ void environment::import_environment(const std::string & import_path, entity_orc
     // Remap
     for (auto entityIterator = env_doc.begin(); entityIterator != env_doc.end(); ++entityIterator)
     {
-        const entity parsed_entity = std::atoi(entityIterator.key().c_str());
+        const entity parsed_entity = std::stoull(entityIterator.key());
         const entity new_entity = track_entity(o.create_entity());
         remap_table[parsed_entity] = new_entity; // remap old entity to new (used for transform system)
         std::cout << "Remapping: " << parsed_entity << " to " << new_entity << std::endl;
@@ -103,7 +111,7 @@ void environment::import_environment(const std::string & import_path, entity_orc
 
     for (auto entityIterator = env_doc.begin(); entityIterator != env_doc.end(); ++entityIterator)
     {
-        const entity parsed_entity = std::atoi(entityIterator.key().c_str());
+        const entity parsed_entity = std::stoull(entityIterator.key());
         const entity new_entity = remap_table[parsed_entity];
 
         const json & comp = entityIterator.value();
@@ -153,6 +161,12 @@ void environment::import_environment(const std::string & import_path, entity_orc
                             c.e = new_entity;
                             if (system_pointer->create(new_entity, id, &c)) std::cout << "Created " << type_name << " on " << system_name << std::endl;
                         }
+                        else if (type_name == get_typename<spot_light_component>())
+                        {
+                            spot_light_component c = componentIterator.value();
+                            c.e = new_entity;
+                            if (system_pointer->create(new_entity, id, &c)) std::cout << "Created " << type_name << " on " << system_name << std::endl;
+                        }
                         else if (type_name == get_typename<directional_light_component>())
                         {
                             directional_light_component c = componentIterator.value();
@@ -151,7 +151,18 @@ namespace polymer
         mesh_component(entity e) : base_component(e) {}
         mesh_component(entity e, gpu_mesh_handle handle) : base_component(e), mesh(handle) {}
         void set_mesh_render_mode(const GLenum mode) { if (mode != GL_TRIANGLE_STRIP) mesh.get().set_non_indexed(mode); }
-        void draw() const { mesh.get().draw_elements(); }
+        void draw(const uint32_t lod = 0) const { mesh.get().draw_elements_lod(lod); }
+
+        // Picks a level of detail from |screen_size|, the fraction of the viewport height covered by the mesh's
+        // bounding sphere. Full detail is kept down to half the viewport; below that, each halving of the size
+        // moves to the next level, which has about half the triangles.
+        uint32_t select_lod(const float screen_size) const
+        {
+            const uint32_t count = mesh.get().get_lod_count();
+            if (count == 1 || screen_size >= 0.5f) return 0;
+            if (screen_size <= 0.f) return count - 1;
+            return std::min(count - 1, static_cast<uint32_t>(std::log2(0.5f / screen_size)));
+        }
     };
     POLYMER_SETUP_TYPEID(mesh_component);
 
@@ -258,6 +269,38 @@ namespace polymer
         });
     };
 
+    //////////////////////////////
+    //   spot_light_component   //
+    //////////////////////////////
+
+    struct spot_light_component : public base_component
+    {
+        bool enabled{ true };
+        uniforms::spot_light data;
+        spot_light_component() {};
+        spot_light_component(entity e) : base_component(e) {}
+    };
+    POLYMER_SETUP_TYPEID(spot_light_component);
+
+    template<class F> void visit_fields(spot_light_component & o, F f) {
+        f("enabled", o.enabled);
+        f("position", o.data.position);
+        f("direction", o.data.direction);
+        f("color", o.data.color);
+        f("attenuation", o.data.attenuation);
+        f("cutoff", o.data.cutoff);
+    }
+
+    inline void to_json(json & j, const spot_light_component & p) {
+        visit_fields(const_cast<spot_light_component&>(p), [&j](const char * name, auto & field, auto... metadata) { j.push_back({ name, field }); });
+    }
+
+    inline void from_json(const json & archive, spot_light_component & m) {
+        visit_fields(m, [&archive](const char * name, auto & field, auto... metadata) {
+            field = archive.at(name).get<std::remove_reference_t<decltype(field)>>();
+        });
+    };
+
     /////////////////////////////////////
     //   directional_light_component   //
     /////////////////////////////////////
@@ -327,6 +370,7 @@ namespace polymer
         world_transform_component() {};
         world_transform_component(entity e) : base_component(e) {}
         polymer::transform world_pose;
+        uint64_t revision{ 0 }; // transform_system::get_revision() when world_pose was last computed
     };
     POLYMER_SETUP_TYPEID(world_transform_component);
 
@@ -364,6 +408,7 @@ namespace polymer
     class environment
     {
         std::vector<entity> active_entities;
+        void retire_entity(entity e);
 
     public:
 
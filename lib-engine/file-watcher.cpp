@@ -0,0 +1,226 @@
+#include "file-watcher.hpp"
+
+#include <algorithm>
+
+#if defined(__linux__)
+    #include <sys/inotify.h>
+    #include <poll.h>
+    #include <unistd.h>
+#endif
+
+using namespace polymer;
+using namespace std::chrono;
+namespace fs = std::experimental::filesystem;
+
+static const milliseconds polling_interval{ 250 };
+
+file_watcher::file_watcher(const milliseconds debounce, const backend requested) : debounce(debounce)
+{
+#if defined(__linux__)
+    if (requested == backend::native) inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+    watch_thread = std::thread([this]() { watch_thread_main(); });
+}
+
+file_watcher::~file_watcher()
+{
+    watch_should_exit = true;
+    if (watch_thread.joinable()) watch_thread.join();
+
+#if defined(__linux__)
+    if (inotify_fd >= 0) close(inotify_fd);
+#endif
+}
+
+std::string file_watcher::normalize(const std::string & path)
+{
+    std::error_code ec;
+    const fs::path canonical_path = fs::canonical(path, ec);
+
+    std::string result = ec ? path : canonical_path.string();
+    for (auto & chr : result) if (chr == '\\') chr = '/';
+    return result;
+}
+
+file_watcher::watch_id file_watcher::watch(const std::string & path, callback_t callback)
+{
+    const std::string key = normalize(path);
+
+    std::lock_guard<std::mutex> guard(watch_mutex);
+
+    const watch_id id = next_id++;
+    auto & entries = index[key];
+    const bool first_watch = entries.empty();
+    entries.push_back({ id, std::move(callback) });
+
+    if (first_watch)
+    {
+        bool has_inotify_watch = false;
+
+    #if defined(__linux__)
+        if (inotify_fd >= 0)
+        {
+            const size_t slash = key.find_last_of('/');
+            const std::string directory = (slash == std::string::npos) ? "." : key.substr(0, slash);
+
+            // inotify returns the existing descriptor if the directory is already watched
+            const int wd = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY);
+            if (wd >= 0)
+            {
+                watched_directory & d = watched_directories[wd];
+                d.path = directory;
+                d.file_count++;
+                file_directories[key] = wd;
+                has_inotify_watch = true;
+            }
+        }
+    #endif
+
+        if (!has_inotify_watch)
+        {
+            std::error_code ec;
+            polled_files[key] = fs::last_write_time(key, ec);
+        }
+    }
+
+    return id;
+}
+
+void file_watcher::unwatch(const watch_id id)
+{
+    std::lock_guard<std::mutex> guard(watch_mutex);
+
+    for (auto itr = index.begin(); itr != index.end(); ++itr)
+    {
+        auto & entries = itr->second;
+        auto entry = std::find_if(entries.begin(), entries.end(), [id](const watch_entry & e) { return e.id == id; });
+        if (entry == entries.end()) continue;
+
+        entries.erase(entry);
+        if (entries.empty())
+        {
+        #if defined(__linux__)
+            auto wd = file_directories.find(itr->first);
+            if (wd != file_directories.end())
+            {
+                auto directory = watched_directories.find(wd->second);
+                if (directory != watched_directories.end() && --directory->second.file_count == 0)
+                {
+                    inotify_rm_watch(inotify_fd, wd->second);
+                    watched_directories.erase(directory);
+                }
+                file_directories.erase(wd);
+            }
+        #endif
+
+            polled_files.erase(itr->first);
+            pending.erase(itr->first);
+            index.erase(itr);
+        }
+        return;
+    }
+}
+
+void file_watcher::poll()
+{
+    std::vector<std::pair<std::string, callback_t>> ready;
+
+    {
+        std::lock_guard<std::mutex> guard(watch_mutex);
+        const auto now = steady_clock::now();
+
+        for (auto itr = pending.begin(); itr != pending.end();)
+        {
+            if (now - itr->second < debounce) { ++itr; continue; }
+
+            auto entries = index.find(itr->first);
+            if (entries != index.end())
+            {
+                for (auto & e : entries->second) ready.emplace_back(itr->first, e.callback);
+            }
+            itr = pending.erase(itr);
+        }
+    }
+
+    // Outside the lock, callbacks are free to (un)watch
+    for (auto & r : ready) r.second(r.first);
+}
+
+void file_watcher::poll_write_times()
+{
+    std::vector<std::string> files;
+    {
+        std::lock_guard<std::mutex> guard(watch_mutex);
+        if (polled_files.empty()) return;
+        files.reserve(polled_files.size());
+        for (auto & f : polled_files) files.push_back(f.first);
+    }
+
+    std::vector<std::pair<std::string, fs::file_time_type>> times;
+    times.reserve(files.size());
+    for (auto & f : files)
+    {
+        std::error_code ec;
+        times.emplace_back(f, fs::last_write_time(f, ec));
+    }
+
+    std::lock_guard<std::mutex> guard(watch_mutex);
+    const auto now = steady_clock::now();
+    for (auto & t : times)
+    {
+        auto itr = polled_files.find(t.first);
+        if (itr == polled_files.end() || itr->second == t.second) continue;
+        itr->second = t.second;
+        pending[t.first] = now;
+    }
+}
+
+void file_watcher::watch_thread_main()
+{
+    auto last_poll = steady_clock::now();
+
+    while (!watch_should_exit)
+    {
+    #if defined(__linux__)
+        if (inotify_fd >= 0)
+        {
+            pollfd pfd = { inotify_fd, POLLIN, 0 };
+            if (::poll(&pfd, 1, 100) > 0)
+            {
+                alignas(inotify_event) char buffer[4096];
+
+                ssize_t length;
+                while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+                {
+                    const auto now = steady_clock::now();
+                    std::lock_guard<std::mutex> guard(watch_mutex);
+
+                    for (ssize_t offset = 0; offset < length;)
+                    {
+                        const inotify_event * event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                        offset += sizeof(inotify_event) + event->len;
+                        if (event->len == 0) continue;
+
+                        auto directory = watched_directories.find(event->wd);
+                        if (directory == watched_directories.end()) continue;
+
+                        const std::string path = directory->second.path + "/" + event->name;
+                        if (index.find(path) != index.end()) pending[path] = now;
+                    }
+                }
+            }
+        }
+        else std::this_thread::sleep_for(milliseconds(50));
+    #else
+        std::this_thread::sleep_for(milliseconds(50));
+    #endif
+
+        // Files that couldn't be given an inotify watch (or every file, without inotify)
+        if (steady_clock::now() - last_poll >= polling_interval)
+        {
+            poll_write_times();
+            last_poll = steady_clock::now();
+        }
+    }
+}
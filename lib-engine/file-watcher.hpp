@@ -0,0 +1,92 @@
+/*
+ * File: lib-engine/file-watcher.hpp
+ * A change-notification service for individual files, used for shader hot-reload and usable by any other
+ * asset type that wants to reload from disk. Interest is registered per file and kept in an index from the
+ * normalized path to its dependents, so a change costs a single lookup regardless of how many assets exist.
+ *
+ * On Linux a background thread blocks on inotify for the directories that contain watched files (whole
+ * directories are watched so that editors which save through a rename are still picked up). Elsewhere, if
+ * inotify cannot be initialized, or if the polling backend is requested, the thread periodically stats only the
+ * watched files. Either way, changes are debounced and delivered by file_watcher::poll() on the caller's
+ * thread, so callbacks may safely touch GL state.
+ */
+
+#pragma once
+
+#ifndef polymer_file_watcher_hpp
+#define polymer_file_watcher_hpp
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+
+namespace polymer
+{
+    class file_watcher
+    {
+    public:
+
+        using watch_id = uint64_t;
+        using callback_t = std::function<void(const std::string & path)>;
+
+    private:
+
+        struct watch_entry
+        {
+            watch_id id;
+            callback_t callback;
+        };
+
+        std::unordered_map<std::string, std::vector<watch_entry>> index;                                    // normalized path -> dependents
+        std::unordered_map<std::string, std::chrono::steady_clock::time_point> pending;                     // changed, waiting out the debounce
+        std::unordered_map<std::string, std::experimental::filesystem::file_time_type> polled_files;        // files without an inotify watch
+        std::unordered_map<std::string, int> file_directories;                                             // file -> inotify descriptor of its directory
+
+        struct watched_directory
+        {
+            std::string path;
+            uint32_t file_count{ 0 };   // watched files inside; the inotify watch is removed when this reaches zero
+        };
+        std::unordered_map<int, watched_directory> watched_directories;                                    // inotify descriptor -> directory
+
+        std::chrono::milliseconds debounce;
+        watch_id next_id{ 1 };
+        int inotify_fd{ -1 };
+
+        std::mutex watch_mutex;
+        std::thread watch_thread;
+        std::atomic<bool> watch_should_exit{ false };
+
+        void watch_thread_main();
+        void poll_write_times();
+
+    public:
+
+        enum class backend { native, polling };
+
+        // `native` uses inotify where available and falls back to polling elsewhere
+        file_watcher(const std::chrono::milliseconds debounce = std::chrono::milliseconds(100), const backend requested = backend::native);
+        ~file_watcher();
+
+        file_watcher(const file_watcher &) = delete;
+        file_watcher & operator = (const file_watcher &) = delete;
+
+        // Invoke `callback` from poll() whenever `path` is written. Safe to call from within a callback.
+        watch_id watch(const std::string & path, callback_t callback);
+        void unwatch(const watch_id id);
+
+        // Call this regularly; delivers notifications for files that have been quiet for the debounce interval
+        void poll();
+
+        // Canonical path with forward slashes, or the input with forward slashes if the file doesn't exist
+        static std::string normalize(const std::string & path);
+    };
+}
+
+#endif // end polymer_file_watcher_hpp
@@ -9,6 +9,8 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <cstring>
+#include <algorithm>
 
 namespace
 {
@@ -179,10 +181,157 @@ struct gl_buffer : public gl_buffer_object
     gl_buffer() = default;
     void set_buffer_data(const GLsizeiptr s, const GLvoid * data, const GLenum usage) { this->size = s; glNamedBufferDataEXT(*this, size, data, usage);  }
     void set_buffer_data(const std::vector<GLubyte> & bytes, const GLenum usage) { set_buffer_data(bytes.size(), bytes.data(), usage); }
+    void set_buffer_storage(const GLsizeiptr s, const GLvoid * data, const GLbitfield flags = 0) { this->size = s; glNamedBufferStorageEXT(*this, size, data, flags); } // immutable; the handle can't be respecified afterwards
     void set_buffer_sub_data(const GLsizeiptr s, const GLintptr offset, const GLvoid * data) { glNamedBufferSubDataEXT(*this, offset, s, data);  }
     void set_buffer_sub_data(const std::vector<GLubyte> & bytes, const GLintptr offset, const GLenum usage) { set_buffer_sub_data(bytes.size(), offset, bytes.data()); }
 };
 
+////////////////////////
+//   gl_ring_buffer   //
+////////////////////////
+
+// A persistently mapped buffer divided into one region per frame in flight. Allocations are carved 
+// linearly out of the current region and written directly through the mapping; end_frame() fences 
+// the region and moves on, and the first allocation in a region waits for its previous fence. This 
+// replaces orphaning a buffer with glBufferData for each small upload. Allocations are bound with 
+// glBindBufferRange (uniforms) or used as an offset into handle() (vertex/instance data).
+class gl_ring_buffer
+{
+    gl_buffer buffer;
+    std::vector<gl_buffer> retired;
+    uint8_t * mapped{ nullptr };
+    std::vector<GLsync> fences;
+    GLsizeiptr regionSize{ 0 };
+    GLsizeiptr head{ 0 };
+    GLint alignment{ 0 };
+    GLenum alignmentQuery{ GL_NONE };
+    uint32_t region{ 0 };
+    bool regionAcquired{ false };
+
+    void wait_for_region(const uint32_t r)
+    {
+        if (!fences[r]) return;
+        GLenum result = glClientWaitSync(fences[r], 0, 0);
+        while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED)
+        {
+            result = glClientWaitSync(fences[r], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+        }
+        glDeleteSync(fences[r]);
+        fences[r] = nullptr;
+    }
+
+    void release()
+    {
+        for (auto & f : fences) if (f) { glDeleteSync(f); f = nullptr; }
+        if (mapped) glUnmapNamedBuffer(buffer);
+        mapped = nullptr;
+        buffer = {};
+        retired.clear();
+    }
+
+    // (Re)creates immutable storage for all regions. A buffer being replaced mid-frame is kept 
+    // until end_frame() so that ranges already bound from it stay valid for the rest of the frame.
+    void create(const GLsizeiptr bytesPerRegion)
+    {
+        if (!alignment)
+        {
+            if (alignmentQuery != GL_NONE) glGetIntegerv(alignmentQuery, &alignment);
+            alignment = std::max<GLint>(alignment, 16);
+        }
+
+        for (auto & f : fences) if (f) { glDeleteSync(f); f = nullptr; }
+        if (mapped)
+        {
+            glUnmapNamedBuffer(buffer);
+            retired.push_back(std::move(buffer));
+            buffer.size = 0;
+            mapped = nullptr;
+        }
+
+        regionSize = ((bytesPerRegion + alignment - 1) / alignment) * alignment;
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        buffer.size = regionSize * static_cast<GLsizeiptr>(fences.size());
+        glNamedBufferStorage(buffer, buffer.size, nullptr, flags);
+        mapped = static_cast<uint8_t *>(glMapNamedBufferRange(buffer, 0, buffer.size, flags));
+        if (!mapped) throw std::runtime_error("failed to map gl_ring_buffer");
+
+        region = 0;
+        head = 0;
+        regionAcquired = true; // fresh storage has nothing in flight
+    }
+
+public:
+
+    struct allocation
+    {
+        GLintptr offset{ 0 };
+        GLsizeiptr size{ 0 };
+        void * data{ nullptr };
+    };
+
+    // |alignment_query| is the implementation limit offsets must respect, e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    // or GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT. Use GL_NONE for vertex data (16 byte alignment).
+    gl_ring_buffer(const GLsizeiptr bytes_per_frame, const GLenum alignment_query = GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, const uint32_t frames_in_flight = 3)
+        : fences(std::max<uint32_t>(1, frames_in_flight), nullptr), regionSize(bytes_per_frame), alignmentQuery(alignment_query) {}
+
+    ~gl_ring_buffer() { release(); }
+
+    gl_ring_buffer(const gl_ring_buffer &) = delete;
+    gl_ring_buffer & operator = (const gl_ring_buffer &) = delete;
+
+    // Reserves |size| bytes in the current frame's region. If the region is exhausted the whole 
+    // buffer is recreated at twice the size, so allocations never alias memory still in use.
+    allocation allocate(const GLsizeiptr size)
+    {
+        if (!mapped) create(std::max(regionSize, size));
+
+        if (!regionAcquired)
+        {
+            wait_for_region(region);
+            regionAcquired = true;
+        }
+
+        const GLsizeiptr aligned = ((size + alignment - 1) / alignment) * alignment;
+        if (head + aligned > regionSize) create(std::max(regionSize * 2, aligned));
+
+        allocation a;
+        a.offset = static_cast<GLintptr>(region * regionSize + head);
+        a.size = size;
+        a.data = mapped + a.offset;
+        head += aligned;
+        return a;
+    }
+
+    allocation write(const void * data, const GLsizeiptr size)
+    {
+        allocation a = allocate(size);
+        std::memcpy(a.data, data, static_cast<size_t>(size));
+        return a;
+    }
+
+    template<class T> allocation write(const T & value) { return write(&value, sizeof(T)); }
+
+    void bind_range(const GLenum target, const GLuint index, const allocation & a) const
+    {
+        glBindBufferRange(target, index, buffer, a.offset, a.size);
+    }
+
+    // Call once all commands reading this frame's allocations have been issued
+    void end_frame()
+    {
+        if (!mapped || !regionAcquired) return;
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % static_cast<uint32_t>(fences.size());
+        head = 0;
+        regionAcquired = false;
+        retired.clear();
+    }
+
+    GLuint handle() const { return buffer; }
+    GLsizeiptr bytes_per_frame() const { return regionSize; }
+};
+
 struct gl_renderbuffer : public gl_renderbuffer_object
 {
     float width{ 0 }, height{ 0 };
@@ -278,6 +427,9 @@ public:
 
     gl_shader() = default;
 
+    // Takes ownership of a program that has already been linked (or loaded with glProgramBinary)
+    explicit gl_shader(const GLuint linked_program) : program(linked_program) {}
+
     gl_shader(const GLuint type, const std::string & src)
     {
         program = glCreateProgram();
@@ -534,10 +686,27 @@ class gl_mesh
 
     std::unordered_map<int, submesh> indexBuffers;
 
+public:
+
+    // A level of detail is a range of the submesh 0 index buffer. Level 0 is the full mesh and starts at index 0.
+    struct lod_range
+    {
+        GLuint first{ 0 };
+        GLsizei count{ 0 };
+    };
+
+private:
+
+    std::vector<lod_range> lodRanges;
+
     GLenum drawMode = GL_TRIANGLES;
     GLenum indexType = 0;
     GLsizei vertexStride = 0, instanceStride = 0;
 
+    // Object-space bounds, recorded when the mesh is built from cpu-side geometry
+    linalg::aliases::float3 boundsMin{ 0, 0, 0 }, boundsMax{ 0, 0, 0 };
+    bool hasBounds{ false };
+
 public:
      
     gl_mesh() = default;
@@ -553,6 +722,7 @@ public:
         drawMode = newMode;
         indexType = 0;
         indexBuffers.clear();
+        lodRanges.clear();
     }
     
     void draw_elements(int instances = 0, int submesh_index = 0)
@@ -578,6 +748,56 @@ public:
         }
     }
 
+    // Issues |drawCount| indexed draws of a submesh, reading DrawElementsIndirectCommand structs from 
+    // the buffer currently bound to GL_DRAW_INDIRECT_BUFFER starting at |offset|.
+    void draw_elements_indirect(GLintptr offset, GLsizei drawCount, int submesh_index = 0)
+    {
+        auto itr = indexBuffers.find(submesh_index);
+        if (!vertexBuffer.size || itr == indexBuffers.end() || !itr->second.count) return;
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, itr->second.indexBuffer);
+        glMultiDrawElementsIndirect(drawMode, indexType, (const GLvoid *) offset, drawCount, 0);
+        glBindVertexArray(0);
+    }
+
+    // Draws one level of detail of submesh 0; levels past the coarsest draw the coarsest
+    void draw_elements_lod(const uint32_t lod, int instances = 0)
+    {
+        if (lod == 0 || lodRanges.empty()) { draw_elements(instances); return; }
+        if (!vertexBuffer.size) return;
+
+        const lod_range & range = lodRanges[std::min<size_t>(lod, lodRanges.size() - 1)];
+        const GLvoid * offset = reinterpret_cast<const GLvoid *>(range.first * gl_size_bytes(indexType));
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffers[0].indexBuffer);
+        if (instances) glDrawElementsInstanced(drawMode, range.count, indexType, offset, instances);
+        else glDrawElements(drawMode, range.count, indexType, offset);
+        glBindVertexArray(0);
+    }
+
+    // Describes the levels of detail packed into the submesh 0 index buffer, which must already be set. Plain draws
+    // of submesh 0 only cover the first level.
+    void set_lod_ranges(std::vector<lod_range> ranges)
+    {
+        lodRanges = std::move(ranges);
+        if (!lodRanges.empty()) indexBuffers[0].count = lodRanges[0].count;
+    }
+
+    uint32_t get_lod_count() const { return std::max<uint32_t>(1, static_cast<uint32_t>(lodRanges.size())); }
+    lod_range get_lod_range(const uint32_t lod) const 
+    { 
+        if (lodRanges.empty()) return { 0, get_index_count() };
+        return lodRanges[std::min<size_t>(lod, lodRanges.size() - 1)];
+    }
+
+    bool is_indexed(int submesh_index = 0) const { auto itr = indexBuffers.find(submesh_index); return itr != indexBuffers.end() && itr->second.count > 0; }
+    GLsizei get_index_count(int submesh_index = 0) const { auto itr = indexBuffers.find(submesh_index); return (itr != indexBuffers.end()) ? itr->second.count : 0; }
+
+    void set_bounds(const linalg::aliases::float3 & min, const linalg::aliases::float3 & max) { boundsMin = min; boundsMax = max; hasBounds = true; }
+    bool get_bounds(linalg::aliases::float3 & min, linalg::aliases::float3 & max) const { min = boundsMin; max = boundsMax; return hasBounds; }
+
     void set_vertex_data(GLsizeiptr size, const GLvoid * data, GLenum usage) { vertexBuffer.set_buffer_data(size, data, usage); }
     gl_buffer & get_vertex_data_buffer() { return vertexBuffer; };
 
@@ -592,6 +812,7 @@ public:
         submesh & idx = indexBuffers[submesh_index];
         idx.count = count;
         idx.indexBuffer = {};
+        if (submesh_index == 0) lodRanges.clear();
         idx.indexBuffer.set_buffer_data(size * count, data, usage);
     }
 
@@ -4,10 +4,14 @@
 #define gl_loaders_hpp
 
 #include "file_io.hpp"
+#include "string_utils.hpp"
 #include "gl-api.hpp"
 #include "stb/stb_image.h" 
 #include "gli/gli.hpp"
 
+#include <cmath>
+#include <algorithm>
+
 namespace polymer
 {
 
@@ -38,8 +42,74 @@ namespace polymer
         return d;
     }
 
+    // Uploads every level of a gli texture (DDS/KTX/KMG) into immutable storage. Block-compressed formats go to the
+    // driver as-is, so a cooked texture costs a single copy and no runtime mip generation. If |source| is non-null it
+    // stands in for tex.data() as the base address of the level data, e.g. an offset into a bound GL_PIXEL_UNPACK_BUFFER.
+    inline gl_texture_2d load_image(const gli::texture2d & tex, const GLvoid * source = nullptr)
+    {
+        gli::gl GL(gli::gl::PROFILE_GL33);
+        const gli::gl::format fmt = GL.translate(tex.format(), tex.swizzles());
+        const bool compressed = gli::is_compressed(tex.format());
+
+        const GLsizei width = GLsizei(tex.extent().x), height = GLsizei(tex.extent().y);
+        const GLsizei levels = GLsizei(tex.levels());
+
+        // Uncompressed containers without a mip chain get one generated, like load_image(path)
+        const bool generateMipmaps = !compressed && levels == 1;
+        const GLsizei storageLevels = generateMipmaps ? GLsizei(std::floor(std::log2(std::max(width, height)))) + 1 : levels;
+
+        gl_texture_2d t;
+        glTextureStorage2DEXT(t, GL_TEXTURE_2D, storageLevels, fmt.Internal, width, height);
+
+        const uint8_t * base = static_cast<const uint8_t *>(tex.data());
+        const uint8_t * upload_base = source ? static_cast<const uint8_t *>(source) : base;
+
+        for (GLsizei level = 0; level < levels; ++level)
+        {
+            const auto extent = tex.extent(level);
+            const size_t offset = static_cast<const uint8_t *>(tex.data(0, 0, level)) - base;
+
+            if (compressed)
+            {
+                glCompressedTextureSubImage2DEXT(t, GL_TEXTURE_2D, level, 0, 0, GLsizei(extent.x), GLsizei(extent.y), fmt.Internal, GLsizei(tex.size(level)), upload_base + offset);
+            }
+            else
+            {
+                glTextureSubImage2DEXT(t, GL_TEXTURE_2D, level, 0, 0, GLsizei(extent.x), GLsizei(extent.y), fmt.External, fmt.Type, upload_base + offset);
+            }
+        }
+
+        if (generateMipmaps) glGenerateTextureMipmapEXT(t, GL_TEXTURE_2D);
+
+        glTextureParameterivEXT(t, GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, &fmt.Swizzles[0]);
+        glTextureParameteriEXT(t, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteriEXT(t, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, storageLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTextureParameteriEXT(t, GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteriEXT(t, GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        gl_check_error(__FILE__, __LINE__);
+
+        t.width = static_cast<float>(width);
+        t.height = static_cast<float>(height);
+        return t;
+    }
+
+    inline bool is_container_image_extension(std::string ext)
+    {
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        return ext == "dds" || ext == "ktx" || ext == "kmg";
+    }
+
+    // Cooked containers (see gl-texture-cooker.hpp) are uploaded with their stored mips; |flip| only applies
+    // to images decoded by stb, since compressed blocks can't be flipped cheaply at load time.
     inline gl_texture_2d load_image(const std::string & path, bool flip = false)
     {
+        if (is_container_image_extension(get_extension(path)))
+        {
+            const gli::texture2d tex(gli::load(path));
+            if (tex.empty()) throw std::runtime_error("could not load texture container " + path);
+            return load_image(tex);
+        }
+
         auto binaryFile = polymer::read_file_binary(path);
 
         if (flip) stbi_set_flip_vertically_on_load(1);
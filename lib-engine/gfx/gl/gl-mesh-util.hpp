@@ -7,6 +7,7 @@
 #include "file_io.hpp"
 #include "gl-loaders.hpp"
 #include "geometry.hpp"
+#include "../lib-model-io/model-io.hpp"
 
 #include <sstream>
 #include <vector>
@@ -114,11 +115,113 @@ namespace polymer
         if (tanOffset) m.set_attribute(4, 3, GL_FLOAT, GL_FALSE, components * sizeof(float), ((float*)0) + tanOffset);
         if (bitanOffset) m.set_attribute(5, 3, GL_FLOAT, GL_FALSE, components * sizeof(float), ((float*)0) + bitanOffset);
 
-        if (geometry.faces.size() > 0)
+        if (geometry.faces.size() > 0 && geometry.lods.size() > 0)
+        {
+            // Every level of detail shares one index buffer
+            std::vector<gl_mesh::lod_range> ranges;
+            std::vector<uint3> faces = geometry.faces;
+            ranges.push_back({ 0, static_cast<GLsizei>(faces.size() * 3) });
+            for (auto & lod : geometry.lods)
+            {
+                ranges.push_back({ static_cast<GLuint>(faces.size() * 3), static_cast<GLsizei>(lod.size() * 3) });
+                faces.insert(faces.end(), lod.begin(), lod.end());
+            }
+            m.set_elements(faces, usage);
+            m.set_lod_ranges(std::move(ranges));
+        }
+        else if (geometry.faces.size() > 0)
         {
             m.set_elements(geometry.faces, usage);
         }
 
+        const aabb_3d bounds = compute_bounds(geometry);
+        m.set_bounds(bounds.min(), bounds.max());
+
+        return m;
+    }
+
+    // Builds a mesh directly from a mapped *.mesh file. When the streams are stored unencoded, the contiguous vertex
+    // range of the file is handed to the driver in a single immutable allocation with no intermediate copy or interleave,
+    // and quantized streams are bound with their own types. Encoded files are decoded on the cpu instead.
+    inline gl_mesh make_mesh_from_binary(const runtime_mesh_binary_view & view)
+    {
+        const runtime_mesh_binary_stream & positions = view.get_stream(mesh_stream::positions);
+        const runtime_mesh_binary_stream & faces = view.get_stream(mesh_stream::faces);
+        assert(positions.count > 0);
+
+        if (view.has_encoded_streams() || faces.count == 0) return make_mesh_from_geometry(import_mesh_binary(view));
+
+        gl_mesh m;
+
+        // Vertex streams are laid out first, so [positions.offset, faces.offset) covers all of them
+        const uint64_t first = positions.offset;
+        uint64_t last = first;
+        for (uint32_t s = 0; s < static_cast<uint32_t>(mesh_stream::faces); ++s)
+        {
+            const runtime_mesh_binary_stream & stream = view.get_stream(static_cast<mesh_stream>(s));
+            if (stream.count) last = std::max(last, stream.offset + stream.bytes);
+        }
+
+        m.get_vertex_data_buffer().set_buffer_storage(static_cast<GLsizeiptr>(last - first), view.get_stream_data(mesh_stream::positions));
+
+        auto bind_stream = [&](const GLuint index, const mesh_stream s, const GLint size)
+        {
+            const runtime_mesh_binary_stream & stream = view.get_stream(s);
+            if (stream.count != positions.count) return;
+
+            GLenum type = GL_FLOAT;
+            GLboolean normalized = GL_FALSE;
+            if (stream.format == mesh_stream_format::float16) type = GL_HALF_FLOAT;
+            else if (stream.format == mesh_stream_format::snorm16) { type = GL_SHORT; normalized = GL_TRUE; }
+
+            m.set_attribute(index, size, type, normalized, stream.stride(), (const GLvoid *)(stream.offset - first));
+        };
+
+        bind_stream(0, mesh_stream::positions, 3);
+        bind_stream(1, mesh_stream::normals, 3);
+        bind_stream(2, mesh_stream::colors, 3);
+        bind_stream(3, mesh_stream::texcoord0, 2);
+        bind_stream(4, mesh_stream::tangents, 3);
+        bind_stream(5, mesh_stream::bitangents, 3);
+
+        const runtime_mesh_binary_stream & lodFaces = view.get_stream(mesh_stream::lod_faces);
+        const runtime_mesh_binary_stream & lodFaceCounts = view.get_stream(mesh_stream::lod_face_counts);
+
+        if (lodFaces.count == 0)
+        {
+            m.set_index_data(GL_TRIANGLES, GL_UNSIGNED_INT, faces.count * 3, view.get_stream_data(mesh_stream::faces), GL_STATIC_DRAW);
+        }
+        else
+        {
+            std::vector<gl_mesh::lod_range> ranges;
+            ranges.push_back({ 0, static_cast<GLsizei>(faces.count * 3) });
+
+            // Same check as import_mesh_binary: the levels must fit inside the lod face stream
+            const uint32_t * counts = reinterpret_cast<const uint32_t *>(view.get_stream_data(mesh_stream::lod_face_counts));
+            uint64_t lodFacesUsed = 0;
+            for (uint32_t i = 0; i < lodFaceCounts.count; ++i)
+            {
+                if (lodFacesUsed + counts[i] > lodFaces.count) throw std::runtime_error("corrupt mesh lod stream");
+                ranges.push_back({ static_cast<GLuint>((faces.count + lodFacesUsed) * 3), static_cast<GLsizei>(counts[i] * 3) });
+                lodFacesUsed += counts[i];
+            }
+
+            // Full detail faces followed by every level of detail, in one index buffer
+            m.set_index_data(GL_TRIANGLES, GL_UNSIGNED_INT, (faces.count + lodFaces.count) * 3, nullptr, GL_STATIC_DRAW);
+            m.get_index_data_buffer().set_buffer_sub_data(faces.bytes, 0, view.get_stream_data(mesh_stream::faces));
+            m.get_index_data_buffer().set_buffer_sub_data(lodFaces.bytes, faces.bytes, view.get_stream_data(mesh_stream::lod_faces));
+            m.set_lod_ranges(std::move(ranges));
+        }
+
+        const float3 * p = reinterpret_cast<const float3 *>(view.get_stream_data(mesh_stream::positions));
+        float3 bmin = p[0], bmax = p[0];
+        for (uint32_t i = 1; i < positions.count; ++i)
+        {
+            bmin = linalg::min(bmin, p[i]);
+            bmax = linalg::max(bmax, p[i]);
+        }
+        m.set_bounds(bmin, bmax);
+
         return m;
     }
 
@@ -0,0 +1,120 @@
+#pragma once
+
+#ifndef gl_texture_cooker_hpp
+#define gl_texture_cooker_hpp
+
+#include "gl-loaders.hpp"
+
+namespace polymer
+{
+
+    // bc1: opaque color (4 bpp). bc3: color + alpha (8 bpp). bc5: two channel data such as tangent-space normals (8 bpp).
+    // bc7: high quality color + alpha (8 bpp).
+    enum class texture_compression
+    {
+        bc1,
+        bc3,
+        bc5,
+        bc7
+    };
+
+    inline gli::format get_compressed_format(const texture_compression compression, const bool srgb)
+    {
+        switch (compression)
+        {
+        case texture_compression::bc1: return srgb ? gli::FORMAT_RGB_DXT1_SRGB_BLOCK8 : gli::FORMAT_RGB_DXT1_UNORM_BLOCK8;
+        case texture_compression::bc3: return srgb ? gli::FORMAT_RGBA_DXT5_SRGB_BLOCK16 : gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16;
+        case texture_compression::bc5: return gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+        case texture_compression::bc7: return srgb ? gli::FORMAT_RGBA_BP_SRGB_BLOCK16 : gli::FORMAT_RGBA_BP_UNORM_BLOCK16;
+        }
+        return gli::FORMAT_UNDEFINED;
+    }
+
+    // Offline texture cooking. Decodes |source_path| with stb, builds the mip chain on the GPU, has the driver encode
+    // every level to |compression| and writes the blocks to a DDS or KTX container (picked by the extension of
+    // |output_path|) that load_image() and asset_resolver upload directly. Needs a current GL context; intended for
+    // tools and import steps rather than the frame loop. Returns false if the driver could not encode the format.
+    inline bool cook_texture(const std::string & source_path, const std::string & output_path, const texture_compression compression, const bool srgb = false)
+    {
+        auto binaryFile = polymer::read_file_binary(source_path);
+
+        int width, height, nBytes;
+        stbi_set_flip_vertically_on_load(0);
+        uint8_t * data = stbi_load_from_memory(binaryFile.data(), (int)binaryFile.size(), &width, &height, &nBytes, 4);
+        if (!data) return false;
+
+        const gli::format format = get_compressed_format(compression, srgb);
+        gli::texture2d cooked(format, gli::texture2d::extent_type(width, height));
+
+        gli::gl GL(gli::gl::PROFILE_GL33);
+        const gli::gl::format fmt = GL.translate(format, cooked.swizzles());
+
+        // Filter the chain from uncompressed data so that every level is encoded from full precision texels
+        gl_texture_2d rgba;
+        rgba.setup(width, height, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, data, true);
+        stbi_image_free(data);
+
+        std::vector<uint8_t> level_texels;
+        bool success = true;
+
+        for (size_t level = 0; level < cooked.levels() && success; ++level)
+        {
+            const auto extent = cooked.extent(level);
+            level_texels.resize(size_t(extent.x) * extent.y * 4);
+            glGetTextureImageEXT(rgba, GL_TEXTURE_2D, GLint(level), GL_RGBA, GL_UNSIGNED_BYTE, level_texels.data());
+
+            // Specifying the image with a compressed internal format makes the driver encode it
+            gl_texture_2d encoder;
+            glTextureImage2DEXT(encoder, GL_TEXTURE_2D, 0, fmt.Internal, GLsizei(extent.x), GLsizei(extent.y), 0, GL_RGBA, GL_UNSIGNED_BYTE, level_texels.data());
+
+            GLint is_compressed = GL_FALSE, compressed_size = 0;
+            glGetTextureLevelParameterivEXT(encoder, GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &is_compressed);
+            glGetTextureLevelParameterivEXT(encoder, GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressed_size);
+
+            if (is_compressed != GL_TRUE || size_t(compressed_size) != cooked.size(level))
+            {
+                success = false;
+                break;
+            }
+
+            glGetCompressedTextureImageEXT(encoder, GL_TEXTURE_2D, 0, cooked.data(0, 0, level));
+        }
+
+        gl_check_error(__FILE__, __LINE__);
+
+        return success && gli::save(cooked, output_path);
+    }
+
+    // Reads a container written by cook_texture() back through load_image(gli::texture2d) and checks that the driver
+    // stored every level in the |compression| format at the size the container declares. Throws if the file is
+    // missing or any level doesn't match, so a bad cook is caught when it is imported rather than when it is drawn.
+    inline gl_texture_2d load_cooked_texture(const std::string & path, const texture_compression compression, const bool srgb = false)
+    {
+        const gli::texture2d tex(gli::load(path));
+        if (tex.empty()) throw std::runtime_error("could not load cooked texture " + path);
+        if (tex.format() != get_compressed_format(compression, srgb)) throw std::runtime_error("cooked texture has an unexpected format " + path);
+
+        gl_texture_2d t = load_image(tex);
+
+        gli::gl GL(gli::gl::PROFILE_GL33);
+        const GLint expected_format = GLint(GL.translate(tex.format(), tex.swizzles()).Internal);
+
+        for (size_t level = 0; level < tex.levels(); ++level)
+        {
+            GLint internal_format = 0, compressed_size = 0;
+            glGetTextureLevelParameterivEXT(t, GL_TEXTURE_2D, GLint(level), GL_TEXTURE_INTERNAL_FORMAT, &internal_format);
+            glGetTextureLevelParameterivEXT(t, GL_TEXTURE_2D, GLint(level), GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &compressed_size);
+
+            if (internal_format != expected_format || size_t(compressed_size) != tex.size(level))
+            {
+                throw std::runtime_error("cooked texture level " + std::to_string(level) + " did not upload as stored in " + path);
+            }
+        }
+
+        gl_check_error(__FILE__, __LINE__);
+        return t;
+    }
+
+} // end namespace polymer
+
+#endif // gl_texture_cooker_hpp
@@ -30,6 +30,7 @@
 #include "system-render.hpp"
 
 #include "renderer-pbr.hpp"
+#include "renderer-clusters.hpp"
 #include "renderer-debug.hpp"
 #include "renderer-util.hpp"
 
@@ -45,6 +46,7 @@
 #include "gl-procedural-sky.hpp"
 #include "gl-renderable-grid.hpp"
 #include "gl-renderable-meshline.hpp"
+#include "gl-texture-cooker.hpp"
 #include "gl-texture-view.hpp"
 
 #include "glfw-app.hpp"
@@ -24,10 +24,14 @@ void polymer_default_material::use()
 
 void polymer_default_material::resolve_variants()
 {
-    if (!compiled_shader)
+    std::vector<std::string> processed_defines;
+    if (gpu_driven) processed_defines.push_back("GPU_DRIVEN_SUBMISSION");
+    if (single_pass_stereo) processed_defines.push_back("SINGLE_PASS_STEREO");
+
+    std::shared_ptr<gl_shader_asset> asset = shader.get();
+    if (!compiled_shader || compiled_shader->hash != asset->hash(processed_defines))
     {
-        std::shared_ptr<gl_shader_asset> asset = shader.get();
-        compiled_shader = asset->get_variant();
+        compiled_shader = asset->get_variant(processed_defines);
     }
 }
 
@@ -111,7 +115,6 @@ void polymer_blinn_phong_standard::resolve_variants()
 
     // Required Features
     processed_defines.push_back("ENABLE_SHADOWS");
-    processed_defines.push_back("TWO_CASCADES");
     processed_defines.push_back("USE_PCF_3X3");
     processed_defines.push_back("USE_IMAGE_BASED_LIGHTING");
 
@@ -119,6 +122,10 @@ void polymer_blinn_phong_standard::resolve_variants()
     if (diffuse.assigned()) processed_defines.push_back("HAS_DIFFUSE_MAP");
     if (normal.assigned()) processed_defines.push_back("HAS_NORMAL_MAP");
 
+    // Renderer features
+    if (gpu_driven) processed_defines.push_back("GPU_DRIVEN_SUBMISSION");
+    if (single_pass_stereo) processed_defines.push_back("SINGLE_PASS_STEREO");
+
     const auto variant_hash = shader.get()->hash(processed_defines);
 
     // First time
@@ -185,17 +192,24 @@ void polymer_pbr_standard::resolve_variants()
 
     // Required Features
     processed_defines.push_back("ENABLE_SHADOWS");
-    processed_defines.push_back("TWO_CASCADES");
     processed_defines.push_back("USE_PCF_3X3");
     processed_defines.push_back("USE_IMAGE_BASED_LIGHTING");
 
-    // Material slots
-    if (albedo.assigned()) processed_defines.push_back("HAS_ALBEDO_MAP");
-    if (roughness.assigned()) processed_defines.push_back("HAS_ROUGHNESS_MAP");
-    if (metallic.assigned()) processed_defines.push_back("HAS_METALNESS_MAP");
-    if (normal.assigned()) processed_defines.push_back("HAS_NORMAL_MAP");
-    if (occlusion.assigned()) processed_defines.push_back("HAS_OCCLUSION_MAP");
-    if (emissive.assigned()) processed_defines.push_back("HAS_EMISSIVE_MAP");
+    // Material slots; the bindless variant checks each slot at runtime so every material shares it
+    if (gpu_driven && bindless) processed_defines.push_back("BINDLESS_MATERIALS");
+    else
+    {
+        if (albedo.assigned()) processed_defines.push_back("HAS_ALBEDO_MAP");
+        if (roughness.assigned()) processed_defines.push_back("HAS_ROUGHNESS_MAP");
+        if (metallic.assigned()) processed_defines.push_back("HAS_METALNESS_MAP");
+        if (normal.assigned()) processed_defines.push_back("HAS_NORMAL_MAP");
+        if (occlusion.assigned()) processed_defines.push_back("HAS_OCCLUSION_MAP");
+        if (emissive.assigned()) processed_defines.push_back("HAS_EMISSIVE_MAP");
+    }
+
+    // Renderer features
+    if (gpu_driven) processed_defines.push_back("GPU_DRIVEN_SUBMISSION");
+    if (single_pass_stereo) processed_defines.push_back("SINGLE_PASS_STEREO");
 
     const auto variant_hash = shader.get()->hash(processed_defines);
 
@@ -29,6 +29,13 @@ namespace polymer
         virtual void use() {}                               // generic interface for binding the program
         virtual void resolve_variants() = 0;                // all overridden functions need to call this to cache the shader
         virtual uint32_t id() = 0;                          // returns the gl handle, used for sorting materials by type to minimize state changes in the renderer
+        virtual bool supports_gpu_driven() const { return false; } // true if the program can read per-object data from the renderer's storage buffer
+        virtual bool supports_single_pass_stereo() const { return false; } // true if the program can draw both eyes from one instanced draw
+        virtual bool supports_bindless() const { return false; }   // true if the program can read parameters and textures from the renderer's material buffer
+        virtual bool is_transparent() const { return false; }      // transparent materials are blended back-to-front after all opaque draws
+        bool gpu_driven{ false };                           // set by the renderer to select the GPU_DRIVEN_SUBMISSION variant
+        bool single_pass_stereo{ false };                   // set by the renderer to select the SINGLE_PASS_STEREO variant
+        bool bindless{ false };                             // set by the renderer with gpu_driven to select the BINDLESS_MATERIALS variant
     };
 
     //////////////////////////////////
@@ -41,6 +48,8 @@ namespace polymer
         virtual void use() override final;
         virtual void resolve_variants() override final;
         virtual uint32_t id() override final;
+        virtual bool supports_gpu_driven() const override final { return true; }
+        virtual bool supports_single_pass_stereo() const override final { return true; }
     };
     POLYMER_SETUP_TYPEID(polymer_default_material);
 
@@ -98,6 +107,8 @@ namespace polymer
         virtual void resolve_variants() override final;
         virtual uint32_t id() override final;
         virtual void update_uniforms() override final;
+        virtual bool supports_gpu_driven() const override final { return true; }
+        virtual bool supports_single_pass_stereo() const override final { return true; }
 
         float2 texcoordScale{ 1.f, 1.f };
 
@@ -152,6 +163,10 @@ namespace polymer
         virtual void use() override final;
         virtual void resolve_variants() override final;
         virtual uint32_t id() override final;
+        virtual bool supports_gpu_driven() const override final { return true; }
+        virtual bool supports_single_pass_stereo() const override final { return true; }
+        virtual bool supports_bindless() const override final { return true; }
+        virtual bool is_transparent() const override final { return opacity < 1.f; }
 
         void update_uniforms_shadow(GLuint handle);
         void update_uniforms_ibl(GLuint irradiance, GLuint radiance);
@@ -0,0 +1,254 @@
+/*
+ * File: renderer-clusters.hpp
+ * Clustered light culling for the forward renderer. A view frustum is divided into a grid of cells
+ * (screen tiles in x/y, exponentially spaced slices in depth). Each point and spot light is tested only
+ * against the cells covered by its projected bounds, and the per-cell light lists are packed into one
+ * index buffer with a counting sort. The shader finds its cell from gl_FragCoord and view depth and shades
+ * only the lights in that cell, so cost scales with local light density rather than the size of the scene.
+ * Reference: Olsson, Billeter, Assarsson, "Clustered Deferred and Forward Shading" (HPG 2012).
+ */
+
+#pragma once
+
+#ifndef polymer_renderer_clusters_hpp
+#define polymer_renderer_clusters_hpp
+
+#include "math-core.hpp"
+#include "uniforms.hpp"
+
+#include <vector>
+
+namespace polymer
+{
+    // The shader evaluates point lights with point_light_attenuation(radius, 2.0, 0.1, dist), which
+    // reaches zero at radius * sqrt(intensity / cutoff).
+    inline float point_light_range(const float radius) { return radius * std::sqrt(2.f / 0.1f); }
+
+    // Distance at which 1 / (c + l*d + q*d^2) falls to 1/256; the shader windows spot lights to zero there.
+    inline float spot_light_range(const float3 & attenuation, const float fallback)
+    {
+        const float c = attenuation.x, l = attenuation.y, q = attenuation.z;
+        const float target = 256.f - c;
+        if (target <= 0.f) return 0.f;
+        if (q > 0.f) return (-l + std::sqrt(l * l + 4.f * q * target)) / (2.f * q);
+        if (l > 0.f) return target / l;
+        return fallback;
+    }
+
+    inline uniforms::light_gpu make_gpu_light(const uniforms::point_light & p)
+    {
+        uniforms::light_gpu l = {};
+        l.positionRange = float4(p.position, point_light_range(p.radius));
+        l.colorType = float4(p.color, float(uniforms::light_type_point));
+        l.attenuation = float4(p.radius, 0, 0, 0);
+        return l;
+    }
+
+    inline uniforms::light_gpu make_gpu_light(const uniforms::spot_light & s, const float max_range)
+    {
+        uniforms::light_gpu l = {};
+        l.positionRange = float4(s.position, spot_light_range(s.attenuation, max_range));
+        l.colorType = float4(s.color, float(uniforms::light_type_spot));
+        l.directionAngle = float4(safe_normalize(s.direction), s.cutoff);
+        l.attenuation = float4(s.attenuation, 0);
+        return l;
+    }
+
+    // World-space sphere enclosing a light's volume of influence. Spot lights use the tightest sphere
+    // around their cone, which is much smaller than the full range for narrow cones.
+    inline float4 light_bounding_sphere(const uniforms::light_gpu & l)
+    {
+        const float3 position = l.positionRange.xyz();
+        const float range = l.positionRange.w;
+        if (l.colorType.w != float(uniforms::light_type_spot)) return float4(position, range);
+
+        const float3 direction = l.directionAngle.xyz();
+        const float cos_angle = clamp(l.directionAngle.w, 0.f, 1.f);
+        if (cos_angle <= 0.70710678f) // wider than 45 degrees: the cap's circle bounds the cone
+        {
+            const float sin_angle = std::sqrt(1.f - cos_angle * cos_angle);
+            return float4(position + direction * (range * cos_angle), range * sin_angle);
+        }
+        const float r = range / (2.f * cos_angle);
+        return float4(position + direction * r, r);
+    }
+
+    ////////////////////////////
+    //   light_cluster_grid   //
+    ////////////////////////////
+
+    class light_cluster_grid
+    {
+        static constexpr uint32_t dim_x = uniforms::CLUSTER_GRID_X;
+        static constexpr uint32_t dim_y = uniforms::CLUSTER_GRID_Y;
+        static constexpr uint32_t dim_z = uniforms::CLUSTER_GRID_Z;
+
+        float4x4 cachedProjection;
+        float nearClip{ 0.f };
+        float farClip{ 0.f };
+        float depthScale{ 0.f };
+        float depthBias{ 0.f };
+
+        std::vector<aabb_3d> clusterBounds;     // view space, rebuilt when the projection changes
+        std::vector<float> sliceDepths;         // dim_z + 1 view-space depths bounding the slices
+
+        std::vector<uint32_t> hitCluster;       // (cluster, light) pairs from the last assign()
+        std::vector<uint32_t> hitLight;
+
+        uint32_t slice_for_depth(const float depth) const
+        {
+            const float s = std::log(std::max(depth, nearClip)) * depthScale + depthBias;
+            return std::min(static_cast<uint32_t>(std::max(s, 0.f)), dim_z - 1);
+        }
+
+        uint32_t tile_for_ndc(const float ndc, const uint32_t dim) const
+        {
+            const float t = (ndc * 0.5f + 0.5f) * float(dim);
+            return static_cast<uint32_t>(clamp(t, 0.f, float(dim - 1)));
+        }
+
+        static float sq_distance(const aabb_3d & box, const float3 & p)
+        {
+            const float3 d = max(max(box._min - p, p - box._max), float3(0.f));
+            return dot(d, d);
+        }
+
+    public:
+
+        std::vector<uniforms::cluster_range> ranges;   // one per cluster, x fastest then y, then z
+        std::vector<uint32_t> indices;                 // light indices referenced by the ranges
+
+        static uint32_t cluster_index(const uint32_t x, const uint32_t y, const uint32_t z) { return (z * dim_y + y) * dim_x + x; }
+
+        // Scale and bias such that slice = log(view depth) * x + y; uploaded with the per-view uniforms
+        float2 get_depth_scale_bias() const { return float2(depthScale, depthBias); }
+
+        const aabb_3d & get_cluster_bounds(const uint32_t idx) const { return clusterBounds[idx]; }
+
+        // Rebuilds the view-space bounds of every cluster for a perspective projection. This only does
+        // work when the projection differs from the previous call.
+        void update_projection(const float4x4 & projection)
+        {
+            if (projection == cachedProjection && !clusterBounds.empty()) return;
+            cachedProjection = projection;
+
+            near_far_clip_from_projection(projection, nearClip, farClip);
+            const float log_ratio = std::log(farClip / nearClip);
+            depthScale = float(dim_z) / log_ratio;
+            depthBias = -float(dim_z) * std::log(nearClip) / log_ratio;
+
+            sliceDepths.resize(dim_z + 1);
+            for (uint32_t z = 0; z <= dim_z; ++z) sliceDepths[z] = nearClip * std::pow(farClip / nearClip, float(z) / float(dim_z));
+
+            // A point on the near plane for every tile corner; points at depth d lie along the same ray from the eye
+            const float4x4 inverse_projection = inverse(projection);
+            std::vector<float3> corners((dim_x + 1) * (dim_y + 1));
+            for (uint32_t y = 0; y <= dim_y; ++y)
+            {
+                for (uint32_t x = 0; x <= dim_x; ++x)
+                {
+                    const float4 ndc(-1.f + 2.f * x / float(dim_x), -1.f + 2.f * y / float(dim_y), -1.f, 1.f);
+                    const float4 p = inverse_projection * ndc;
+                    const float3 v = p.xyz() / p.w;
+                    corners[y * (dim_x + 1) + x] = v / -v.z; // at unit depth
+                }
+            }
+
+            clusterBounds.resize(uniforms::NUM_CLUSTERS);
+            for (uint32_t z = 0; z < dim_z; ++z)
+            {
+                for (uint32_t y = 0; y < dim_y; ++y)
+                {
+                    for (uint32_t x = 0; x < dim_x; ++x)
+                    {
+                        float3 bmin(std::numeric_limits<float>::max()), bmax(std::numeric_limits<float>::lowest());
+                        for (const float depth : { sliceDepths[z], sliceDepths[z + 1] })
+                        {
+                            for (const uint32_t c : { y * (dim_x + 1) + x, y * (dim_x + 1) + x + 1, (y + 1) * (dim_x + 1) + x, (y + 1) * (dim_x + 1) + x + 1 })
+                            {
+                                const float3 p = corners[c] * depth;
+                                bmin = min(bmin, p);
+                                bmax = max(bmax, p);
+                            }
+                        }
+                        clusterBounds[cluster_index(x, y, z)] = aabb_3d(bmin, bmax);
+                    }
+                }
+            }
+        }
+
+        // Builds the per-cluster light lists for one view. update_projection() must have been called.
+        void assign(const float4x4 & view, const std::vector<uniforms::light_gpu> & lights)
+        {
+            assert(!clusterBounds.empty());
+
+            hitCluster.clear();
+            hitLight.clear();
+
+            for (uint32_t i = 0; i < static_cast<uint32_t>(lights.size()); ++i)
+            {
+                const float4 world_sphere = light_bounding_sphere(lights[i]);
+                const float radius = world_sphere.w;
+                if (radius <= 0.f) continue;
+
+                const float3 center = (view * float4(world_sphere.xyz(), 1.f)).xyz();
+                const float depth = -center.z;
+                if (depth + radius < nearClip || depth - radius > farClip) continue;
+
+                const uint32_t z0 = slice_for_depth(depth - radius);
+                const uint32_t z1 = slice_for_depth(depth + radius);
+
+                // Screen-space extent of the sphere's view-space box. If the box crosses the near plane
+                // the projection is unbounded, so every tile is a candidate.
+                uint32_t x0 = 0, x1 = dim_x - 1, y0 = 0, y1 = dim_y - 1;
+                if (depth - radius > nearClip)
+                {
+                    float2 ndc_min(std::numeric_limits<float>::max()), ndc_max(std::numeric_limits<float>::lowest());
+                    for (int c = 0; c < 8; ++c)
+                    {
+                        const float3 corner = center + float3((c & 1) ? radius : -radius, (c & 2) ? radius : -radius, (c & 4) ? radius : -radius);
+                        const float4 clip = cachedProjection * float4(corner, 1.f);
+                        const float2 ndc = clip.xy() / clip.w;
+                        ndc_min = min(ndc_min, ndc);
+                        ndc_max = max(ndc_max, ndc);
+                    }
+                    if (ndc_max.x < -1.f || ndc_min.x > 1.f || ndc_max.y < -1.f || ndc_min.y > 1.f) continue;
+                    x0 = tile_for_ndc(ndc_min.x, dim_x); x1 = tile_for_ndc(ndc_max.x, dim_x);
+                    y0 = tile_for_ndc(ndc_min.y, dim_y); y1 = tile_for_ndc(ndc_max.y, dim_y);
+                }
+
+                const float radius_sq = radius * radius;
+                for (uint32_t z = z0; z <= z1; ++z)
+                {
+                    for (uint32_t y = y0; y <= y1; ++y)
+                    {
+                        for (uint32_t x = x0; x <= x1; ++x)
+                        {
+                            const uint32_t cluster = cluster_index(x, y, z);
+                            if (sq_distance(clusterBounds[cluster], center) > radius_sq) continue;
+                            hitCluster.push_back(cluster);
+                            hitLight.push_back(i);
+                        }
+                    }
+                }
+            }
+
+            // Counting sort of the hits by cluster. Lights were visited in order, so each list stays sorted by light index.
+            ranges.assign(uniforms::NUM_CLUSTERS, { 0, 0 });
+            for (const uint32_t c : hitCluster) ranges[c].count++;
+
+            uint32_t offset = 0;
+            for (auto & r : ranges) { r.offset = offset; offset += r.count; r.count = 0; }
+
+            indices.resize(hitCluster.size());
+            for (size_t h = 0; h < hitCluster.size(); ++h)
+            {
+                uniforms::cluster_range & r = ranges[hitCluster[h]];
+                indices[r.offset + r.count++] = hitLight[h];
+            }
+        }
+    };
+
+} // end namespace polymer
+
+#endif // end polymer_renderer_clusters_hpp
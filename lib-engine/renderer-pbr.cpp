@@ -6,31 +6,182 @@
 
 #include <execution>
 
+// Frustum-culls every indirect draw command against the planes of the current view, then tests the 
+// survivors against the hierarchical-z pyramids of the previous frame. Commands are never compacted; 
+// culled draws have their instance count set to zero.
+static const char s_gpuCullComputeShader[] = R"(#version 450
+    layout(local_size_x = 64) in;
+
+    struct ObjectData
+    {
+        mat4 modelMatrix;
+        mat4 modelMatrixIT;
+        vec4 boundingSphere;
+        vec4 params;
+    };
+
+    struct DrawCommand
+    {
+        uint count;
+        uint instanceCount;
+        uint firstIndex;
+        int baseVertex;
+        uint baseInstance;
+    };
+
+    layout(binding = 3, std430) readonly buffer PerObjectArray { ObjectData objects[]; };
+    layout(binding = 4, std430) buffer DrawCommandArray { DrawCommand commands[]; };
+
+    layout(binding = 0) uniform sampler2D s_hiZ[2];
+
+    uniform vec4 u_frustumPlanes[6];
+    uniform int u_numCommands;
+    uniform int u_instanceCount; // 2 when both eyes are drawn by one command
+    uniform int u_hiZCount;      // pyramids to test against; 0 disables occlusion culling
+    uniform mat4 u_hiZViewProj[2];
+    uniform vec2 u_hiZSize;
+    uniform int u_hiZLevels;
+
+    // True if the sphere's bounds are entirely behind the farthest depth stored under them
+    bool occluded(vec4 sphere, int view)
+    {
+        vec3 ndcMin = vec3(1);
+        vec3 ndcMax = vec3(-1);
+        for (int c = 0; c < 8; ++c)
+        {
+            vec3 corner = sphere.xyz + sphere.w * vec3((c & 1) != 0 ? 1 : -1, (c & 2) != 0 ? 1 : -1, (c & 4) != 0 ? 1 : -1);
+            vec4 clip = u_hiZViewProj[view] * vec4(corner, 1);
+            if (clip.w <= 0.0) return false; // crosses the eye plane
+            vec3 ndc = clip.xyz / clip.w;
+            ndcMin = min(ndcMin, ndc);
+            ndcMax = max(ndcMax, ndc);
+        }
+
+        vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+        vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+        float nearestDepth = ndcMin.z * 0.5 + 0.5;
+
+        // The level where the bounds span at most 2x2 texels
+        vec2 extent = (uvMax - uvMin) * u_hiZSize;
+        int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, u_hiZLevels - 1);
+
+        ivec2 levelSize = textureSize(s_hiZ[view], level);
+        ivec2 t0 = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+        ivec2 t1 = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+        float farthest = max(max(texelFetch(s_hiZ[view], t0, level).r, texelFetch(s_hiZ[view], ivec2(t1.x, t0.y), level).r),
+                             max(texelFetch(s_hiZ[view], ivec2(t0.x, t1.y), level).r, texelFetch(s_hiZ[view], t1, level).r));
+        return nearestDepth > farthest;
+    }
+
+    void main()
+    {
+        uint idx = gl_GlobalInvocationID.x;
+        if (idx >= uint(u_numCommands)) return;
+
+        vec4 sphere = objects[commands[idx].baseInstance].boundingSphere;
+
+        uint visible = 1;
+        for (int p = 0; p < 6; ++p)
+        {
+            if (dot(u_frustumPlanes[p].xyz, sphere.xyz) + u_frustumPlanes[p].w <= -sphere.w) visible = 0;
+        }
+
+        // Unbounded objects carry a huge radius and are never occlusion tested. An object is only
+        // rejected if every view's pyramid hides it.
+        if (visible == 1 && u_hiZCount > 0 && sphere.w < 1e30)
+        {
+            bool hidden = true;
+            for (int v = 0; v < u_hiZCount; ++v) hidden = hidden && occluded(sphere, v);
+            if (hidden) visible = 0;
+        }
+
+        commands[idx].instanceCount = visible * uint(u_instanceCount);
+    }
+)";
+
+// Reduces a depth texture into a max-depth mip chain, one level per dispatch. Level 0 copies the
+// depth texture; each later level takes the farthest of the 2x2 texels under it, plus the extra row 
+// or column of an odd-sized source so no texel is dropped. Out-of-range image loads return 0.
+static const char s_hiZBuildComputeShader[] = R"(#version 450
+    layout(local_size_x = 8, local_size_y = 8) in;
+
+    layout(binding = 0) uniform sampler2D s_depth;
+    layout(binding = 0, r32f) readonly uniform image2D u_source;
+    layout(binding = 1, r32f) writeonly uniform image2D u_dest;
+
+    uniform ivec2 u_sourceSize;
+    uniform ivec2 u_destSize;
+    uniform int u_copyDepth;
+
+    void main()
+    {
+        ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+        if (any(greaterThanEqual(p, u_destSize))) return;
+
+        if (u_copyDepth != 0)
+        {
+            imageStore(u_dest, p, vec4(texelFetch(s_depth, p, 0).r));
+            return;
+        }
+
+        ivec2 s = p * 2;
+        float d = max(max(imageLoad(u_source, s).r, imageLoad(u_source, s + ivec2(1, 0)).r),
+                      max(imageLoad(u_source, s + ivec2(0, 1)).r, imageLoad(u_source, s + ivec2(1, 1)).r));
+
+        bool extraColumn = (u_sourceSize.x & 1) != 0 && p.x == u_destSize.x - 1;
+        bool extraRow = (u_sourceSize.y & 1) != 0 && p.y == u_destSize.y - 1;
+        if (extraColumn) d = max(d, max(imageLoad(u_source, s + ivec2(2, 0)).r, imageLoad(u_source, s + ivec2(2, 1)).r));
+        if (extraRow) d = max(d, max(imageLoad(u_source, s + ivec2(0, 2)).r, imageLoad(u_source, s + ivec2(1, 2)).r));
+        if (extraColumn && extraRow) d = max(d, imageLoad(u_source, s + ivec2(2, 2)).r);
+
+        imageStore(u_dest, p, vec4(d));
+    }
+)";
+
 ////////////////////////////////////////////////
 //   stable_cascaded_shadows implementation   //
 ////////////////////////////////////////////////
 
 stable_cascaded_shadows::stable_cascaded_shadows()
 {
-    const GLsizei size = static_cast<GLsizei>(resolution);
-    shadowArrayDepth.setup(GL_TEXTURE_2D_ARRAY, size, size, uniforms::NUM_CASCADES, GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glNamedFramebufferTextureEXT(shadowArrayFramebuffer, GL_DEPTH_ATTACHMENT, shadowArrayDepth, 0);
-    shadowArrayFramebuffer.check_complete();
+    allocate();
     gl_check_error(__FILE__, __LINE__);
 }
 
+// Resolution and cascade count are editable at runtime; the depth array is reallocated when they change
+void stable_cascaded_shadows::allocate()
+{
+    cascadeCount = clamp(cascadeCount, 1, uniforms::MAX_CASCADES);
+
+    const int size = static_cast<int>(resolution);
+    if (size == allocatedResolution && cascadeCount == allocatedCascades) return;
+
+    shadowArrayDepth = {};
+    shadowArrayDepth.setup(GL_TEXTURE_2D_ARRAY, size, size, cascadeCount, GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    allocatedResolution = size;
+    allocatedCascades = cascadeCount;
+    invalidate();
+}
+
 void stable_cascaded_shadows::update_cascades(const float4x4 & view, const float near, const float far, const float aspectRatio, const float vfov, const float3 & lightDir)
 {
-    nearPlanes.clear();
-    farPlanes.clear();
-    splitPlanes.clear();
-    viewMatrices.clear();
-    projMatrices.clear();
-    shadowMatrices.clear();
+    cascadeCount = clamp(cascadeCount, 1, uniforms::MAX_CASCADES);
 
-    for (size_t C = 0; C < uniforms::NUM_CASCADES; ++C)
+    if (cascadeState.size() != static_cast<size_t>(cascadeCount))
     {
-        const float splitIdx = uniforms::NUM_CASCADES;
+        cascadeState.assign(cascadeCount, {});
+        nearPlanes.resize(cascadeCount);
+        farPlanes.resize(cascadeCount);
+        splitPlanes.resize(cascadeCount);
+        viewMatrices.resize(cascadeCount);
+        projMatrices.resize(cascadeCount);
+        shadowMatrices.resize(cascadeCount);
+    }
+
+    for (int C = 0; C < cascadeCount; ++C)
+    {
+        const float splitIdx = static_cast<float>(cascadeCount);
 
         // Find the split planes using GPU Gem 3. Chap 10 "Practical Split Scheme".
         // http://http.developer.nvidia.com/GPUGems3/gpugems3_ch10.html
@@ -40,6 +191,8 @@ void stable_cascaded_shadows::update_cascades(const float4x4 & view, const float
         const float splitFar = C < splitIdx - 1 ? mix(near + (static_cast<float>(C + 1) / splitIdx) * (far - near),
             near * pow(far / near, static_cast<float>(C + 1) / splitIdx), splitLambda) : far;
 
+        splitPlanes[C] = float2(splitNear, splitFar);
+
         const float4x4 splitProjectionMatrix = make_projection_matrix(vfov, aspectRatio, splitNear, splitFar);
 
         // Extract the frustum points
@@ -72,6 +225,16 @@ void stable_cascaded_shadows::update_cascades(const float4x4 & view, const float
             sphereRadius = std::max(sphereRadius, dist);
         }
 
+        // A cached cascade keeps its matrices while the split's bounding sphere stays inside the sphere it was built from
+        cascade_state & state = cascadeState[C];
+        const bool cached = C >= firstCachedCascade;
+        if (cached && state.radius > 0.f && state.lightDir == lightDir && length(frustumCentroid - state.centroid) + sphereRadius <= state.radius)
+        {
+            state.matricesChanged = false;
+            continue;
+        }
+
+        if (cached) sphereRadius *= cachedCascadeMargin;
         sphereRadius = (std::ceil(sphereRadius * 32.0f) / 32.0f);
 
         const float3 maxExtents = float3(sphereRadius, sphereRadius, sphereRadius);
@@ -96,37 +259,65 @@ void stable_cascaded_shadows::update_cascades(const float4x4 & view, const float
 
         const float4x4 theShadowMatrix = (shadowProjectionMatrix * splitViewMatrix);
 
-        viewMatrices.push_back(splitViewMatrix);
-        projMatrices.push_back(shadowProjectionMatrix);
-        shadowMatrices.push_back(theShadowMatrix);
-        splitPlanes.push_back(float2(splitNear, splitFar));
-        nearPlanes.push_back(-maxExtents.z);
-        farPlanes.push_back(-minExtents.z);
+        // Texel snapping keeps the matrix identical while the camera is still, so uncached cascades can skip redraws too
+        state.matricesChanged = !state.rendered || theShadowMatrix != shadowMatrices[C];
+        state.centroid = frustumCentroid;
+        state.lightDir = lightDir;
+        state.radius = sphereRadius;
+
+        viewMatrices[C] = splitViewMatrix;
+        projMatrices[C] = shadowProjectionMatrix;
+        shadowMatrices[C] = theShadowMatrix;
+        nearPlanes[C] = -maxExtents.z;
+        farPlanes[C] = -minExtents.z;
     }
 }
 
+void stable_cascaded_shadows::invalidate()
+{
+    for (auto & state : cascadeState) state = {};
+}
+
 void stable_cascaded_shadows::pre_draw()
 {
+    allocate();
+
     glEnable(GL_DEPTH_TEST);
 
     glEnable(GL_CULL_FACE);
     glCullFace(GL_FRONT);
 
     glBindFramebuffer(GL_FRAMEBUFFER, shadowArrayFramebuffer);
-    glViewport(0, 0, static_cast<GLsizei>(resolution), static_cast<GLsizei>(resolution));
-    glClear(GL_DEPTH_BUFFER_BIT);
+    glViewport(0, 0, allocatedResolution, allocatedResolution);
 
     auto & shader = program.get()->get_variant()->shader;
-
     shader.bind();
-    shader.uniform("u_cascadeViewMatrixArray", uniforms::NUM_CASCADES, viewMatrices);
-    shader.uniform("u_cascadeProjMatrixArray", uniforms::NUM_CASCADES, projMatrices);
 }
 
-void stable_cascaded_shadows::update_shadow_matrix(const float4x4 & shadowModelMatrix)
+// Returns false if the cascade's contents from a previous frame are still valid. Otherwise the
+// cascade's layer is bound and cleared, ready for draw_instances().
+bool stable_cascaded_shadows::begin_cascade(const int cascade, const uint64_t casterSignature)
+{
+    cascade_state & state = cascadeState[cascade];
+    if (state.rendered && !state.matricesChanged && state.casterSignature == casterSignature) return false;
+
+    state.rendered = true;
+    state.casterSignature = casterSignature;
+
+    glNamedFramebufferTextureLayerEXT(shadowArrayFramebuffer, GL_DEPTH_ATTACHMENT, shadowArrayDepth, 0, cascade);
+    shadowArrayFramebuffer.check_complete();
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    auto & shader = program.get()->get_variant()->shader;
+    shader.uniform("u_cascadeViewProj", shadowMatrices[cascade]);
+    return true;
+}
+
+void stable_cascaded_shadows::draw_instances(gl_mesh & mesh, const uint32_t firstInstance, const uint32_t instanceCount)
 {
     auto & shader = program.get()->get_variant()->shader;
-    shader.uniform("u_modelShadowMatrix", shadowModelMatrix);
+    shader.uniform("u_baseInstance", static_cast<int>(firstInstance));
+    mesh.draw_elements(static_cast<int>(instanceCount));
 }
 
 void stable_cascaded_shadows::post_draw()
@@ -147,14 +338,14 @@ GLuint stable_cascaded_shadows::get_output_texture() const
 //   pbr_renderer implementation   //
 /////////////////////////////////////
 
-void pbr_renderer::update_per_object_uniform_buffer(const transform & p, const float3 & scale, const bool recieveShadow, const view_data & d)
+void pbr_renderer::update_per_object_uniform_buffer(const render_component * r, const render_payload & scene, const view_data & d)
 {
     uniforms::per_object object = {};
-    object.modelMatrix = p.matrix() * make_scaling_matrix(scale);
-    object.modelMatrixIT = inverse(transpose(object.modelMatrix));
+    object.modelMatrix = get_model_matrix(r, scene);
+    object.modelMatrixIT = get_normal_matrix(r, scene);
     object.modelViewMatrix = d.viewMatrix * object.modelMatrix;
-    object.receiveShadow = static_cast<float>(recieveShadow);
-    perObject.set_buffer_data(sizeof(object), &object, GL_STREAM_DRAW);
+    object.receiveShadow = static_cast<float>(r->material->receive_shadow);
+    uniformStream.bind_range(GL_UNIFORM_BUFFER, uniforms::per_object::binding, uniformStream.write(object));
 }
 
 void pbr_renderer::run_stencil_prepass(const view_data & view, const render_payload & scene)
@@ -228,7 +419,7 @@ stable_cascaded_shadows * pbr_renderer::get_shadow_pass() const
     return nullptr;
 }
 
-void pbr_renderer::run_depth_prepass(const view_data & view, const render_payload & scene)
+void pbr_renderer::run_depth_prepass(const std::vector<const render_component *> & render_queue, const view_data & view, const render_payload & scene)
 {
     GLboolean colorMask[4];
     glGetBooleanv(GL_COLOR_WRITEMASK, &colorMask[0]);
@@ -238,13 +429,39 @@ void pbr_renderer::run_depth_prepass(const view_data & view, const render_payloa
     glDepthMask(GL_TRUE);       // Need depth mask on
     glColorMask(0, 0, 0, 0);    // Do not write any color
 
-    auto & shader = renderPassEarlyZ.get()->get_variant()->shader;
+    // Depth only needs the vertex stage, so every object can be drawn for both eyes at once
+    const int instances = singlePassStereo ? 2 : 0;
+
+    if (settings.gpuDrivenSubmission)
+    {
+        std::vector<std::string> defines = { "GPU_DRIVEN_SUBMISSION" };
+        if (singlePassStereo) defines.push_back("SINGLE_PASS_STEREO");
+
+        auto & indirect_shader = renderPassEarlyZ.get()->get_variant(defines)->shader;
+        indirect_shader.bind();
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, uniforms::per_object_gpu::binding, gpuObjectBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gpuCommandBuffer);
+        for (const indirect_batch & batch : indirectBatches)
+        {
+            batch.mesh->draw_elements_indirect(batch.first_command * sizeof(uniforms::draw_elements_indirect_command), batch.command_count);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        indirect_shader.unbind();
+    }
+
+    std::vector<std::string> defines;
+    if (singlePassStereo) defines.push_back("SINGLE_PASS_STEREO");
+
+    auto & shader = renderPassEarlyZ.get()->get_variant(defines)->shader;
     shader.bind();
 
-    for (const render_component & r : scene.render_components)
+    const std::vector<const render_component *> & queue = settings.gpuDrivenSubmission ? indirectFallbackQueue : render_queue;
+    for (const render_component * r : queue)
     {
-        update_per_object_uniform_buffer(r.world_transform->world_pose, r.local_transform->local_scale, r.material->receive_shadow, view);
-        r.mesh->draw();
+        update_per_object_uniform_buffer(r, scene, view);
+        r->mesh->mesh.get().draw_elements_lod(get_draw_lod(r, scene), instances);
     }
 
     shader.unbind();
@@ -292,13 +509,62 @@ void pbr_renderer::run_shadow_pass(const view_data & view, const render_payload
 
     shadow->pre_draw();
 
-    for (const render_component & r : scene.render_components)
+    for (int c = 0; c < shadow->cascadeCount; ++c)
     {
-        if (r.material->cast_shadow)
+        // Each cascade only draws the casters that touch its own orthographic frustum
+        const frustum cascadeFrustum(shadow->shadowMatrices[c]);
+        mark_visible(&cascadeFrustum, 1, scene);
+        shadowQueue.clear();
+        append_visible(scene, opaqueQueue, shadowQueue);
+        append_visible(scene, transparentQueue, shadowQueue);
+
+        shadowQueue.erase(std::remove_if(shadowQueue.begin(), shadowQueue.end(), [](const render_component * r) { return !r->material->cast_shadow; }), shadowQueue.end());
+        std::stable_sort(shadowQueue.begin(), shadowQueue.end(), [](const render_component * a, const render_component * b)
+        {
+            return &a->mesh->mesh.get() < &b->mesh->mesh.get();
+        });
+
+        // One instanced draw per mesh. The signature covers every caster's mesh and transform, so a cached 
+        // cascade is redrawn when anything inside it moves, appears, or disappears.
+        shadowInstances.clear();
+        shadowBatches.clear();
+        uint64_t signature = 0xcbf29ce484222325ull;
+        auto hash_bytes = [&signature](const void * data, const size_t size) // fnv-1a over 32-bit words
+        {
+            const uint8_t * bytes = static_cast<const uint8_t *>(data);
+            for (size_t i = 0; i + 4 <= size; i += 4)
+            {
+                uint32_t word;
+                std::memcpy(&word, bytes + i, 4);
+                signature = (signature ^ word) * 0x100000001b3ull;
+            }
+        };
+
+        for (const render_component * r : shadowQueue)
+        {
+            gl_mesh * mesh = &r->mesh->mesh.get();
+            if (shadowBatches.empty() || shadowBatches.back().mesh != mesh)
+            {
+                const GLsizeiptr vertexBytes = mesh->get_vertex_data_buffer().size; // changes when an async load fills the mesh
+                hash_bytes(&mesh, sizeof(mesh));
+                hash_bytes(&vertexBytes, sizeof(vertexBytes));
+                shadowBatches.push_back({ mesh, static_cast<uint32_t>(shadowInstances.size()), 0 });
+            }
+
+            uniforms::shadow_instance instance;
+            instance.modelMatrix = get_model_matrix(r, scene);
+            hash_bytes(&instance.modelMatrix, sizeof(float4x4));
+            shadowInstances.push_back(instance);
+            shadowBatches.back().instance_count++;
+        }
+
+        if (!shadow->begin_cascade(c, signature)) continue; // the cached layer is still valid
+        if (shadowInstances.empty()) continue;
+
+        storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::shadow_instance::binding, storageStream.write(shadowInstances.data(), shadowInstances.size() * sizeof(uniforms::shadow_instance)));
+        for (const shadow_batch & batch : shadowBatches)
         {
-            const float4x4 modelMatrix = (r.world_transform->world_pose.matrix() * make_scaling_matrix(r.local_transform->local_scale));
-            shadow->update_shadow_matrix(modelMatrix);
-            r.mesh->draw();
+            shadow->draw_instances(*batch.mesh, batch.first_instance, batch.instance_count);
         }
     }
 
@@ -307,6 +573,121 @@ void pbr_renderer::run_shadow_pass(const view_data & view, const render_payload
     gl_check_error(__FILE__, __LINE__);
 }
 
+void pbr_renderer::build_render_queues(const render_payload & scene, const view_data & view)
+{
+    const size_t count = scene.render_components.size();
+    const float3 & eyePosition = view.pose.position;
+    drawKeys.resize(count);
+    drawIndices.resize(count);
+    drawLods.assign(count, 0);
+    materialSlots.clear();
+    objectRotations.resize(count);
+    objectPositions.resize(count);
+    objectScales.resize(count);
+
+    // Keys are built once per object, so the asset handle lookups and distance computations that a
+    // comparison sort would repeat O(n log n) times happen only n times.
+    for (uint32_t i = 0; i < static_cast<uint32_t>(count); ++i)
+    {
+        const render_component & r = scene.render_components[i];
+        material_interface * mat = r.material->material.get().get();
+
+        auto slot = materialSlots.find(mat);
+        if (slot == materialSlots.end()) slot = materialSlots.insert({ mat, static_cast<uint32_t>(materialSlots.size()) }).first;
+
+        const draw_bucket bucket = mat->is_transparent() ? draw_bucket::transparent : draw_bucket::opaque;
+        const float depth = distance(eyePosition, r.world_transform->world_pose.position);
+
+        drawKeys[i] = make_draw_key(bucket, mat->id(), slot->second, depth);
+        drawIndices[i] = i;
+
+        objectRotations.set(i, r.world_transform->world_pose.orientation);
+        objectPositions.set(i, r.world_transform->world_pose.position);
+        objectScales.set(i, r.local_transform->local_scale);
+
+        // Level of detail from the projected size of the bounding sphere
+        const gl_mesh & mesh = r.mesh->mesh.get();
+        float3 bounds_min, bounds_max;
+        if (settings.meshLod && mesh.get_lod_count() > 1 && mesh.get_bounds(bounds_min, bounds_max))
+        {
+            const float3 & scale = r.local_transform->local_scale;
+            const float radius = length(bounds_max - bounds_min) * 0.5f * maxelem(abs(scale));
+            const float3 center = r.world_transform->world_pose.transform_coord((bounds_min + bounds_max) * 0.5f * scale);
+            const float centerDistance = distance(eyePosition, center);
+            const float screenSize = (centerDistance > radius) ? radius * view.projectionMatrix[1][1] / centerDistance : 1.f;
+            drawLods[i] = static_cast<uint8_t>(r.mesh->select_lod(screenSize));
+        }
+    }
+
+    // Every pass reads these rather than rebuilding the matrices per draw, per eye and per cascade
+    batch_make_matrices(objectRotations, objectPositions, objectScales, objectMatrices);
+    batch_inverse(objectMatrices, objectInverseMatrices);
+
+    drawKeySorter.sort(drawKeys.data(), drawIndices.data(), count, jobPool);
+
+    opaqueQueue.clear();
+    transparentQueue.clear();
+    for (size_t i = 0; i < count; ++i)
+    {
+        const render_component * r = &scene.render_components[drawIndices[i]];
+        if (get_draw_bucket(drawKeys[i]) == draw_bucket::opaque) opaqueQueue.push_back(r);
+        else transparentQueue.push_back(r);
+    }
+}
+
+void pbr_renderer::mark_visible(const frustum * frustums, const uint32_t frustumCount, const render_payload & scene)
+{
+    if (!settings.frustumCulling || !scene.visibility)
+    {
+        visibleSet.assign(scene.render_components.size(), 1);
+        return;
+    }
+
+    // Flag every renderable whose bounds touch any of the frustums
+    visibleSet.assign(scene.render_components.size(), 0);
+    for (const uint32_t idx : scene.visibility->unbounded) visibleSet[idx] = 1;
+    for (uint32_t f = 0; f < frustumCount; ++f)
+    {
+        scene.visibility->tree.query(frustums[f], [this](const int32_t, const uint32_t idx) { visibleSet[idx] = 1; });
+    }
+}
+
+void pbr_renderer::append_visible(const render_payload & scene, const std::vector<const render_component *> & in, std::vector<const render_component *> & out) const
+{
+    const render_component * first = scene.render_components.data();
+    for (const render_component * r : in)
+    {
+        if (visibleSet[r - first]) out.push_back(r);
+    }
+}
+
+// Selects the material's variant, uploads its uniforms and textures along with the renderer-owned shadow 
+// and IBL textures, and leaves its program bound. The variant flags are cleared again once it is bound.
+void pbr_renderer::bind_material(material_interface * mat, const bool gpuDriven, const bool stereo, const render_payload & scene)
+{
+    mat->gpu_driven = gpuDriven;
+    mat->single_pass_stereo = stereo;
+    mat->bindless = gpuDriven && bindlessActive && mat->supports_bindless();
+    mat->update_uniforms();
+
+    // @todo - handle other specific material requirements here
+    if (auto * mr = dynamic_cast<polymer_pbr_standard*>(mat))
+    {
+        if (settings.shadowsEnabled)
+        {
+            // @todo - ideally compile this out from the shader if not using shadows
+            mr->update_uniforms_shadow(shadow->get_output_texture());
+        }
+
+        mr->update_uniforms_ibl(scene.ibl_irradianceCubemap.get(), scene.ibl_radianceCubemap.get());
+    }
+    mat->use();
+
+    mat->gpu_driven = false;
+    mat->single_pass_stereo = false;
+    mat->bindless = false;
+}
+
 void pbr_renderer::run_forward_pass(std::vector<const render_component *> & render_queue, const view_data & view, const render_payload & scene)
 {
     if (settings.useDepthPrepass)
@@ -316,35 +697,418 @@ void pbr_renderer::run_forward_pass(std::vector<const render_component *> & rend
         glDepthMask(GL_FALSE); // depth already comes from the prepass
     }
 
+    // Queues are sorted by program then material, so a run of draws sharing a material only binds it once
+    material_interface * boundMaterial = nullptr;
+
     for (const render_component * r : render_queue)
     {
-        update_per_object_uniform_buffer(r->world_transform->world_pose, r->local_transform->local_scale, r->material->receive_shadow, view);
+        update_per_object_uniform_buffer(r, scene, view);
 
         // Lookup the material component (materials[e]), .get() the asset_handle, and then .get() since 
         // materials instances are stored as shared pointers. 
         material_interface * mat = r->material->material.get().get();
-        mat->update_uniforms();
+        const bool stereoDraw = singlePassStereo && mat->supports_single_pass_stereo();
+
+        if (mat != boundMaterial)
+        {
+            bind_material(mat, false, stereoDraw, scene);
+            boundMaterial = mat;
+        }
+
+        if (!singlePassStereo) r->mesh->draw(get_draw_lod(r, scene));
+        else if (stereoDraw) r->mesh->mesh.get().draw_elements_lod(get_draw_lod(r, scene), 2);
+        else draw_per_eye(r, scene);
+    }
+
+    if (settings.useDepthPrepass)
+    {
+        glDepthMask(GL_TRUE); // cleanup state
+    }
+}
+
+// Programs without a SINGLE_PASS_STEREO variant are drawn once per eye, each restricted to that eye's half of the target
+void pbr_renderer::draw_per_eye(const render_component * r, const render_payload & scene)
+{
+    glDisable(GL_CLIP_DISTANCE0);
+
+    for (uint32_t eye = 0; eye < 2; ++eye)
+    {
+        const view_data & view = scene.views[eye];
+
+        uniforms::per_view v = {};
+        v.view = view.viewMatrix;
+        v.viewProj = view.viewProjMatrix;
+        v.eyePos = float4(view.pose.position, 1);
+        v.clusterDepth = float4(lightClusters[eye].get_depth_scale_bias(), 0, 0);
+        uniformStream.bind_range(GL_UNIFORM_BUFFER, uniforms::per_view::binding, uniformStream.write(v));
+        update_per_object_uniform_buffer(r, scene, view);
+
+        glViewport(static_cast<GLint>(eye) * settings.renderSize.x, 0, settings.renderSize.x, settings.renderSize.y);
+        r->mesh->draw(get_draw_lod(r, scene));
+    }
+
+    // Restore the stereo view data and full target for the draws that follow
+    uniformStream.bind_range(GL_UNIFORM_BUFFER, uniforms::per_view_stereo::binding, uniformStream.write(stereoViewData));
+    glViewport(0, 0, settings.renderSize.x * 2, settings.renderSize.y);
+    glEnable(GL_CLIP_DISTANCE0);
+}
+
+void pbr_renderer::run_transparent_pass(std::vector<const render_component *> & render_queue, const view_data & view, const render_payload & scene)
+{
+    if (render_queue.empty()) return;
+
+    const GLboolean wasBlendingEnabled = glIsEnabled(GL_BLEND);
+    GLint previousDepthFunc;
+    glGetIntegerv(GL_DEPTH_FUNC, &previousDepthFunc);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Test against opaque depth, but do not write it, so overlapping transparent surfaces all blend
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+
+    run_forward_pass(render_queue, view, scene);
+
+    glDepthMask(GL_TRUE);
+    glDepthFunc(previousDepthFunc);
+    if (!wasBlendingEnabled) glDisable(GL_BLEND);
+}
+
+// Index of a material in this frame's material buffer, packing it on first use. Handles are fetched 
+// every frame since streamed textures replace their placeholders with new texture objects.
+uint32_t pbr_renderer::get_gpu_material_slot(material_interface * mat)
+{
+    auto slot = gpuMaterialSlots.find(mat);
+    if (slot != gpuMaterialSlots.end()) return slot->second;
+
+    auto resident_handle = [](const texture_handle & t) -> uint64_t
+    {
+        if (!t.assigned()) return 0;
+        const GLuint64 handle = glGetTextureHandleARB(t.get());
+        if (!glIsTextureHandleResidentARB(handle)) glMakeTextureHandleResidentARB(handle);
+        return handle;
+    };
+
+    uniforms::material_gpu m = {};
+    if (auto * pbr = dynamic_cast<polymer_pbr_standard *>(mat))
+    {
+        m.albedoOpacity = float4(pbr->baseAlbedo, pbr->opacity);
+        m.emissive = float4(pbr->baseEmissive, pbr->emissiveStrength);
+        m.surface = float4(pbr->roughnessFactor, pbr->metallicFactor, pbr->specularLevel, pbr->occlusionStrength);
+        m.lighting = float4(pbr->ambientStrength, pbr->shadowOpacity, pbr->texcoordScale.x, pbr->texcoordScale.y);
+        m.textures[uniforms::material_texture_albedo] = resident_handle(pbr->albedo);
+        m.textures[uniforms::material_texture_normal] = resident_handle(pbr->normal);
+        m.textures[uniforms::material_texture_roughness] = resident_handle(pbr->roughness);
+        m.textures[uniforms::material_texture_metallic] = resident_handle(pbr->metallic);
+        m.textures[uniforms::material_texture_emissive] = resident_handle(pbr->emissive);
+        m.textures[uniforms::material_texture_occlusion] = resident_handle(pbr->occlusion);
+    }
+
+    const uint32_t index = static_cast<uint32_t>(gpuMaterials.size());
+    gpuMaterials.push_back(m);
+    gpuMaterialSlots[mat] = index;
+    return index;
+}
+
+void pbr_renderer::build_indirect_batches(const std::vector<const render_component *> & render_queue, const render_payload & scene)
+{
+    gpuObjects.clear();
+    gpuCommands.clear();
+    indirectBatches.clear();
+    indirectFallbackQueue.clear();
+    gpuMaterials.clear();
+    gpuMaterialSlots.clear();
+
+    bindlessActive = settings.bindlessMaterials && GLAD_GL_ARB_bindless_texture;
+
+    // Group by material instance and mesh. Batches are ordered by first appearance in the sorted
+    // queue, which keeps programs together and preserves front-to-back order within a batch. With
+    // bindless materials every material sharing a shader reads its parameters from the material 
+    // buffer, so those are grouped by shader and mesh instead.
+    std::map<std::pair<const void *, gl_mesh *>, size_t> batch_lookup;
+    std::vector<std::vector<const render_component *>> batch_members;
+
+    for (const render_component * r : render_queue)
+    {
+        material_interface * mat = r->material->material.get().get();
+        gl_mesh * mesh = &r->mesh->mesh.get();
+
+        if (!mat->supports_gpu_driven() || !mesh->is_indexed() || (singlePassStereo && !mat->supports_single_pass_stereo()))
+        {
+            indirectFallbackQueue.push_back(r);
+            continue;
+        }
+
+        const void * key = (bindlessActive && mat->supports_bindless()) ? static_cast<const void *>(mat->shader.get().get()) : mat;
+        auto itr = batch_lookup.find({ key, mesh });
+        if (itr == batch_lookup.end())
+        {
+            itr = batch_lookup.insert({ { key, mesh }, indirectBatches.size() }).first;
+            indirectBatches.push_back({ mat, mesh, 0, 0 });
+            batch_members.emplace_back();
+        }
+        batch_members[itr->second].push_back(r);
+    }
+
+    for (size_t b = 0; b < indirectBatches.size(); ++b)
+    {
+        indirect_batch & batch = indirectBatches[b];
+        batch.first_command = static_cast<uint32_t>(gpuCommands.size());
+        batch.command_count = static_cast<uint32_t>(batch_members[b].size());
+
+        float3 bounds_min, bounds_max;
+        const bool has_bounds = batch.mesh->get_bounds(bounds_min, bounds_max);
 
-        // @todo - handle other specific material requirements here
-        if (auto * mr = dynamic_cast<polymer_pbr_standard*>(mat))
+        for (const render_component * r : batch_members[b])
         {
-            if (settings.shadowsEnabled)
+            const float3 & scale = r->local_transform->local_scale;
+
+            uniforms::per_object_gpu object = {};
+            object.modelMatrix = get_model_matrix(r, scene);
+            object.modelMatrixIT = get_normal_matrix(r, scene);
+            object.params = float4(static_cast<float>(r->material->receive_shadow), 0, 0, 0);
+
+            material_interface * mat = r->material->material.get().get();
+            if (bindlessActive && mat->supports_bindless()) object.params.y = static_cast<float>(get_gpu_material_slot(mat));
+
+            // Meshes without recorded bounds are never culled
+            if (has_bounds)
             {
-                // @todo - ideally compile this out from the shader if not using shadows
-                mr->update_uniforms_shadow(shadow->get_output_texture());
+                const float radius = length(bounds_max - bounds_min) * 0.5f * maxelem(abs(scale));
+                object.boundingSphere = float4(transform_coord(object.modelMatrix, (bounds_min + bounds_max) * 0.5f), radius);
             }
+            else
+            {
+                object.boundingSphere = float4(r->world_transform->world_pose.position, std::numeric_limits<float>::max());
+            }
+
+            // Levels of detail share the mesh's index buffer, so each command selects its own range
+            const gl_mesh::lod_range lod = batch.mesh->get_lod_range(get_draw_lod(r, scene));
+
+            uniforms::draw_elements_indirect_command cmd = {};
+            cmd.count = static_cast<uint32_t>(lod.count);
+            cmd.firstIndex = lod.first;
+            cmd.instanceCount = singlePassStereo ? 2 : 1;
+            cmd.baseInstance = static_cast<uint32_t>(gpuObjects.size());
+
+            gpuObjects.push_back(object);
+            gpuCommands.push_back(cmd);
+        }
+    }
+
+    if (!gpuMaterials.empty())
+    {
+        storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::material_gpu::binding, storageStream.write(gpuMaterials.data(), gpuMaterials.size() * sizeof(uniforms::material_gpu)));
+    }
+
+    if (gpuObjects.empty()) return;
+
+    // Immutable storage is reallocated only when the scene outgrows it
+    if (gpuObjects.size() > gpuBufferCapacity)
+    {
+        gpuBufferCapacity = std::max<size_t>(1024, gpuBufferCapacity);
+        while (gpuBufferCapacity < gpuObjects.size()) gpuBufferCapacity *= 2;
+
+        gpuObjectBuffer = {};
+        gpuObjectBuffer.size = gpuBufferCapacity * sizeof(uniforms::per_object_gpu);
+        glNamedBufferStorage(gpuObjectBuffer, gpuObjectBuffer.size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+        gpuCommandBuffer = {};
+        gpuCommandBuffer.size = gpuBufferCapacity * sizeof(uniforms::draw_elements_indirect_command);
+        glNamedBufferStorage(gpuCommandBuffer, gpuCommandBuffer.size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    }
+
+    gpuObjectBuffer.set_buffer_sub_data(gpuObjects.size() * sizeof(uniforms::per_object_gpu), 0, gpuObjects.data());
+    gpuCommandBuffer.set_buffer_sub_data(gpuCommands.size() * sizeof(uniforms::draw_elements_indirect_command), 0, gpuCommands.data());
+}
+
+void pbr_renderer::run_gpu_culling_pass(const view_data & view)
+{
+    if (gpuCommands.empty()) return;
+
+    if (!gpuCullProgram) gpuCullProgram.reset(new gl_shader_compute(s_gpuCullComputeShader));
+
+    const frustum view_frustum(view.viewProjMatrix);
+    std::vector<float4> planes(6);
+    for (int p = 0; p < 6; ++p) planes[p] = view_frustum.planes[p].equation;
+
+    gpuCullProgram->uniform("u_frustumPlanes", 6, planes);
+    gpuCullProgram->uniform("u_numCommands", static_cast<int>(gpuCommands.size()));
+    gpuCullProgram->uniform("u_instanceCount", singlePassStereo ? 2 : 1);
+
+    // Occlusion is tested against the pyramids built from the previous frame's depth. Single-pass stereo 
+    // culls once for both eyes, so a draw is only rejected if both eyes' pyramids hide it.
+    int hiZCount = 0;
+    if (settings.occlusionCulling)
+    {
+        const uint32_t first = singlePassStereo ? 0 : view.index;
+        const uint32_t count = singlePassStereo ? 2 : 1;
+
+        float4x4 viewProjs[2];
+        uint32_t valid = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (!hiZValid[first + i]) break;
+            glBindTextureUnit(i, hiZTextures[first + i]);
+            viewProjs[i] = hiZViewProj[first + i];
+            ++valid;
+        }
 
-            mr->update_uniforms_ibl(scene.ibl_irradianceCubemap.get(), scene.ibl_radianceCubemap.get());
+        if (valid == count)
+        {
+            hiZCount = static_cast<int>(count);
+            glProgramUniformMatrix4fv(gpuCullProgram->handle(), gpuCullProgram->get_uniform_location("u_hiZViewProj"), hiZCount, GL_FALSE, viewProjs[0].data());
+            gpuCullProgram->uniform("u_hiZSize", float2(settings.renderSize));
+            gpuCullProgram->uniform("u_hiZLevels", hiZLevels);
+        }
+    }
+    gpuCullProgram->uniform("u_hiZCount", hiZCount);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, uniforms::per_object_gpu::binding, gpuObjectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, uniforms::draw_elements_indirect_command::binding, gpuCommandBuffer);
+    gpuCullProgram->dispatch((static_cast<GLuint>(gpuCommands.size()) + 63) / 64, 1, 1);
+    glUseProgram(0);
+
+    // Make the instance counts visible to the indirect draws that follow
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void pbr_renderer::build_hiz_pyramid(const view_data & view)
+{
+    if (!hiZBuildProgram) hiZBuildProgram.reset(new gl_shader_compute(s_hiZBuildComputeShader));
+
+    gl_texture_2d & pyramid = hiZTextures[view.index];
+    const int2 size = settings.renderSize;
+
+    // Immutable storage for the full mip chain, allocated on first use
+    if (!hiZLevels) hiZLevels = static_cast<int>(std::floor(std::log2(static_cast<float>(std::max(size.x, size.y))))) + 1;
+    if (pyramid.width == 0)
+    {
+        glTextureStorage2DEXT(pyramid, GL_TEXTURE_2D, hiZLevels, GL_R32F, size.x, size.y);
+        glTextureParameteriEXT(pyramid, GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTextureParameteriEXT(pyramid, GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        pyramid.width = static_cast<float>(size.x);
+        pyramid.height = static_cast<float>(size.y);
+    }
+
+    int2 sourceSize = size;
+    for (int level = 0; level < hiZLevels; ++level)
+    {
+        const int2 destSize = { std::max(size.x >> level, 1), std::max(size.y >> level, 1) };
+
+        if (level == 0) glBindTextureUnit(0, eyeDepthTextures[view.index]);
+        else glBindImageTexture(0, pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+        glProgramUniform2i(hiZBuildProgram->handle(), hiZBuildProgram->get_uniform_location("u_sourceSize"), sourceSize.x, sourceSize.y);
+        glProgramUniform2i(hiZBuildProgram->handle(), hiZBuildProgram->get_uniform_location("u_destSize"), destSize.x, destSize.y);
+        hiZBuildProgram->uniform("u_copyDepth", level == 0 ? 1 : 0);
+        hiZBuildProgram->dispatch((destSize.x + 7) / 8, (destSize.y + 7) / 8, 1);
+
+        // Each level reads the one written before it
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        sourceSize = destSize;
+    }
+
+    glUseProgram(0);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    hiZViewProj[view.index] = view.viewProjMatrix;
+    hiZValid[view.index] = 1;
+}
+
+void pbr_renderer::run_forward_pass_indirect(const view_data & view, const render_payload & scene)
+{
+    if (settings.useDepthPrepass)
+    {
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE); // depth already comes from the prepass
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, uniforms::per_object_gpu::binding, gpuObjectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gpuCommandBuffer);
+
+    material_interface * boundMaterial = nullptr;
+    for (const indirect_batch & batch : indirectBatches)
+    {
+        if (batch.material != boundMaterial)
+        {
+            bind_material(batch.material, true, singlePassStereo, scene);
+            boundMaterial = batch.material;
         }
-        mat->use();
 
-        r->mesh->draw();
+        batch.mesh->draw_elements_indirect(batch.first_command * sizeof(uniforms::draw_elements_indirect_command), batch.command_count);
     }
 
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
     if (settings.useDepthPrepass)
     {
         glDepthMask(GL_TRUE); // cleanup state
     }
+
+    // Anything the indirect path cannot draw goes through the regular per-object path
+    if (!indirectFallbackQueue.empty()) run_forward_pass(indirectFallbackQueue, view, scene);
+}
+
+void pbr_renderer::upload_lights(const render_payload & scene, const float maxLightRange)
+{
+    gpuLights.clear();
+    for (auto & light : scene.point_lights)
+    {
+        if (light->enabled) gpuLights.push_back(make_gpu_light(light->data));
+    }
+    for (auto & light : scene.spot_lights)
+    {
+        if (light->enabled) gpuLights.push_back(make_gpu_light(light->data, maxLightRange));
+    }
+
+    // Bound ranges cannot be empty; with no lights every cluster has a count of zero and nothing is read
+    const uniforms::light_gpu unused = {};
+    if (gpuLights.empty()) storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::light_gpu::binding, storageStream.write(unused));
+    else storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::light_gpu::binding, storageStream.write(gpuLights.data(), gpuLights.size() * sizeof(uniforms::light_gpu)));
+}
+
+void pbr_renderer::run_light_culling_pass(const view_data & view, uniforms::per_view & v)
+{
+    light_cluster_grid & grid = lightClusters[view.index];
+    grid.update_projection(view.projectionMatrix);
+    grid.assign(view.viewMatrix, gpuLights);
+
+    v.clusterDepth = float4(grid.get_depth_scale_bias(), 0, 0);
+
+    const uint32_t unused = 0;
+    storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::cluster_range::binding, storageStream.write(grid.ranges.data(), grid.ranges.size() * sizeof(uniforms::cluster_range)));
+    if (grid.indices.empty()) storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::CLUSTER_LIGHT_INDEX_BINDING, storageStream.write(unused));
+    else storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::CLUSTER_LIGHT_INDEX_BINDING, storageStream.write(grid.indices.data(), grid.indices.size() * sizeof(uint32_t)));
+}
+
+void pbr_renderer::run_light_culling_pass_stereo(const render_payload & scene, uniforms::per_view_stereo & v)
+{
+    // Both grids are bound as one list; the right eye's ranges follow the left eye's and point past its indices
+    stereoClusterRanges.clear();
+    stereoClusterIndices.clear();
+
+    for (uint32_t eye = 0; eye < 2; ++eye)
+    {
+        light_cluster_grid & grid = lightClusters[eye];
+        grid.update_projection(scene.views[eye].projectionMatrix);
+        grid.assign(scene.views[eye].viewMatrix, gpuLights);
+
+        v.views[eye].clusterDepth = float4(grid.get_depth_scale_bias(), 0, 0);
+
+        const uint32_t baseIndex = static_cast<uint32_t>(stereoClusterIndices.size());
+        for (const uniforms::cluster_range & r : grid.ranges) stereoClusterRanges.push_back({ r.offset + baseIndex, r.count });
+        stereoClusterIndices.insert(stereoClusterIndices.end(), grid.indices.begin(), grid.indices.end());
+    }
+
+    const uint32_t unused = 0;
+    storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::cluster_range::binding, storageStream.write(stereoClusterRanges.data(), stereoClusterRanges.size() * sizeof(uniforms::cluster_range)));
+    if (stereoClusterIndices.empty()) storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::CLUSTER_LIGHT_INDEX_BINDING, storageStream.write(unused));
+    else storageStream.bind_range(GL_SHADER_STORAGE_BUFFER, uniforms::CLUSTER_LIGHT_INDEX_BINDING, storageStream.write(stereoClusterIndices.data(), stereoClusterIndices.size() * sizeof(uint32_t)));
 }
 
 void pbr_renderer::run_post_pass(const view_data & view, const render_payload & scene)
@@ -379,11 +1143,19 @@ pbr_renderer::pbr_renderer(const renderer_settings settings) : settings(settings
     eyeFramebuffers.resize(settings.cameraCount);
     eyeTextures.resize(settings.cameraCount);
     eyeDepthTextures.resize(settings.cameraCount);
+    lightClusters.resize(settings.cameraCount);
+    hiZTextures.resize(settings.cameraCount);
+    hiZViewProj.resize(settings.cameraCount);
+    hiZValid.resize(settings.cameraCount, 0);
+
+    // Single-pass stereo draws both eyes side by side into the multisample target
+    singlePassStereo = settings.singlePassStereo && settings.cameraCount == 2;
+    const int multisampleWidth = singlePassStereo ? settings.renderSize.x * 2 : settings.renderSize.x;
 
     // Generate multisample render buffers for color and depth, attach to multi-sampled framebuffer target
-    glNamedRenderbufferStorageMultisampleEXT(multisampleRenderbuffers[0], settings.msaaSamples, GL_RGBA, settings.renderSize.x, settings.renderSize.y);
+    glNamedRenderbufferStorageMultisampleEXT(multisampleRenderbuffers[0], settings.msaaSamples, GL_RGBA, multisampleWidth, settings.renderSize.y);
     glNamedFramebufferRenderbufferEXT(multisampleFramebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, multisampleRenderbuffers[0]);
-    glNamedRenderbufferStorageMultisampleEXT(multisampleRenderbuffers[1], settings.msaaSamples, GL_DEPTH24_STENCIL8, settings.renderSize.x, settings.renderSize.y);
+    glNamedRenderbufferStorageMultisampleEXT(multisampleRenderbuffers[1], settings.msaaSamples, GL_DEPTH24_STENCIL8, multisampleWidth, settings.renderSize.y);
     glNamedFramebufferRenderbufferEXT(multisampleFramebuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, multisampleRenderbuffers[1]);
 
     multisampleFramebuffer.check_complete();
@@ -444,6 +1216,123 @@ pbr_renderer::~pbr_renderer()
     timer.stop();
 }
 
+void pbr_renderer::render_views_stereo(const render_payload & scene, const view_data & cullingView)
+{
+    const int2 eyeSize = settings.renderSize;
+
+    // Both eyes' view data is uploaded once and indexed by instance in the shaders
+    for (uint32_t eye = 0; eye < 2; ++eye)
+    {
+        stereoViewData.views[eye].view = scene.views[eye].viewMatrix;
+        stereoViewData.views[eye].viewProj = scene.views[eye].viewProjMatrix;
+        stereoViewData.views[eye].eyePos = float4(scene.views[eye].pose.position, 1);
+    }
+
+    cpuProfiler.begin("run_light_culling_pass");
+    run_light_culling_pass_stereo(scene, stereoViewData);
+    cpuProfiler.end("run_light_culling_pass");
+
+    uniformStream.bind_range(GL_UNIFORM_BUFFER, uniforms::per_view_stereo::binding, uniformStream.write(stereoViewData));
+
+    GLfloat defaultColor[] = { scene.clear_color.x, scene.clear_color.y, scene.clear_color.z, scene.clear_color.w };
+    GLfloat defaultDepth = 1.f;
+    GLuint  defaultStencil = 0;
+
+    // Render both eyes into the double-width multisampled fbo
+    glEnable(GL_MULTISAMPLE);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, multisampleFramebuffer);
+    glClearNamedFramebufferfv(multisampleFramebuffer, GL_COLOR, 0, &defaultColor[0]);
+    glClearNamedFramebufferfv(multisampleFramebuffer, GL_DEPTH, 0, &defaultDepth);
+    if (using_stencil_mask) glClearNamedFramebufferuiv(multisampleFramebuffer, GL_STENCIL, 0, &defaultStencil);
+
+    // Draw lists hold everything visible to either eye; the gpu-driven path culls opaque draws against the combined frustum
+    {
+        cpuProfiler.begin("cull_render_queues");
+        const frustum eyeFrustums[2] = { frustum(scene.views[0].viewProjMatrix), frustum(scene.views[1].viewProjMatrix) };
+        mark_visible(eyeFrustums, 2, scene);
+        viewQueue.clear();
+        viewTransparentQueue.clear();
+        if (!settings.gpuDrivenSubmission) append_visible(scene, opaqueQueue, viewQueue);
+        append_visible(scene, transparentQueue, viewTransparentQueue);
+        cpuProfiler.end("cull_render_queues");
+    }
+
+    if (settings.gpuDrivenSubmission)
+    {
+        gpuProfiler.begin("run_gpu_culling_pass");
+        run_gpu_culling_pass(cullingView);
+        gpuProfiler.end("run_gpu_culling_pass");
+    }
+
+    glViewport(0, 0, eyeSize.x * 2, eyeSize.y);
+    glEnable(GL_CLIP_DISTANCE0); // keeps each eye's instance out of the other half
+
+    if (settings.useDepthPrepass)
+    {
+        gpuProfiler.begin("depth-prepass");
+        run_depth_prepass(viewQueue, cullingView, scene);
+        gpuProfiler.end("depth-prepass");
+    }
+
+    // The hidden area mesh and skybox are full-screen draws without a stereo variant, issued once per half
+    glDisable(GL_CLIP_DISTANCE0);
+    for (uint32_t eye = 0; eye < 2; ++eye)
+    {
+        glViewport(static_cast<GLint>(eye) * eyeSize.x, 0, eyeSize.x, eyeSize.y);
+
+        if (using_stencil_mask)
+        {
+            cpuProfiler.begin("run_stencil_prepass-" + std::to_string(eye));
+            gpuProfiler.begin("run_stencil_prepass-" + std::to_string(eye));
+            run_stencil_prepass(scene.views[eye], scene);
+            gpuProfiler.end("run_stencil_prepass-" + std::to_string(eye));
+            cpuProfiler.end("run_stencil_prepass-" + std::to_string(eye));
+        }
+
+        gpuProfiler.begin("run_skybox_pass-" + std::to_string(eye));
+        cpuProfiler.begin("run_skybox_pass-" + std::to_string(eye));
+        run_skybox_pass(scene.views[eye], scene);
+        cpuProfiler.end("run_skybox_pass-" + std::to_string(eye));
+        gpuProfiler.end("run_skybox_pass-" + std::to_string(eye));
+    }
+
+    glViewport(0, 0, eyeSize.x * 2, eyeSize.y);
+    glEnable(GL_CLIP_DISTANCE0);
+
+    gpuProfiler.begin("run_forward_pass");
+    cpuProfiler.begin("run_forward_pass");
+    if (settings.gpuDrivenSubmission) run_forward_pass_indirect(cullingView, scene);
+    else run_forward_pass(viewQueue, cullingView, scene);
+    cpuProfiler.end("run_forward_pass");
+    gpuProfiler.end("run_forward_pass");
+
+    gpuProfiler.begin("run_transparent_pass");
+    cpuProfiler.begin("run_transparent_pass");
+    run_transparent_pass(viewTransparentQueue, cullingView, scene);
+    cpuProfiler.end("run_transparent_pass");
+    gpuProfiler.end("run_transparent_pass");
+
+    glDisable(GL_CLIP_DISTANCE0);
+    glDisable(GL_MULTISAMPLE);
+
+    // Resolve each half of the multisample target into its eye's framebuffer
+    gpuProfiler.begin("blit");
+    for (uint32_t eye = 0; eye < 2; ++eye)
+    {
+        const GLint x0 = static_cast<GLint>(eye) * eyeSize.x;
+        glBlitNamedFramebuffer(multisampleFramebuffer, eyeFramebuffers[eye], x0, 0, x0 + eyeSize.x, eyeSize.y, 0, 0, eyeSize.x, eyeSize.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBlitNamedFramebuffer(multisampleFramebuffer, eyeFramebuffers[eye], x0, 0, x0 + eyeSize.x, eyeSize.y, 0, 0, eyeSize.x, eyeSize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+    gpuProfiler.end("blit");
+
+    if (settings.gpuDrivenSubmission && settings.occlusionCulling)
+    {
+        gpuProfiler.begin("build_hiz_pyramid");
+        for (uint32_t eye = 0; eye < 2; ++eye) build_hiz_pyramid(scene.views[eye]);
+        gpuProfiler.end("build_hiz_pyramid");
+    }
+}
+
 void pbr_renderer::render_frame(const render_payload & scene)
 {
     assert(settings.cameraCount == scene.views.size());
@@ -455,16 +1344,11 @@ void pbr_renderer::render_frame(const render_payload & scene)
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_FRAMEBUFFER_SRGB);
 
-    glBindBufferBase(GL_UNIFORM_BUFFER, uniforms::per_scene::binding, perScene);
-    glBindBufferBase(GL_UNIFORM_BUFFER, uniforms::per_view::binding, perView);
-    glBindBufferBase(GL_UNIFORM_BUFFER, uniforms::per_object::binding, perObject);
-
     // Update per-scene uniform buffer
     uniforms::per_scene b = {};
     b.time = timer.milliseconds().count() / 1000.f; // expressed in seconds
     b.resolution = float2(settings.renderSize);
     b.invResolution = 1.f / b.resolution;
-    b.activePointLights = static_cast<int>(scene.point_lights.size());
     b.sunlightActive = 0;
 
     if (scene.sunlight)
@@ -475,15 +1359,6 @@ void pbr_renderer::render_frame(const render_payload & scene)
         b.directional_light.amount = scene.sunlight->data.amount;
     }
 
-    assert(scene.point_lights.size() <= uniforms::MAX_POINT_LIGHTS);
-    uint32_t lightIdx = 0;
-    for (auto & light : scene.point_lights)
-    {
-        if (!light->enabled) continue;
-        b.point_lights[lightIdx] = light->data;
-        lightIdx++;
-    }
-
     GLfloat defaultColor[] = { scene.clear_color.x, scene.clear_color.y, scene.clear_color.z, scene.clear_color.w };
     GLfloat defaultDepth = 1.f;
     GLuint  defaultStencil = 0;
@@ -508,6 +1383,11 @@ void pbr_renderer::render_frame(const render_payload & scene)
         near_far_clip_from_projection(shadowAndCullingView.projectionMatrix, shadowAndCullingView.nearClip, shadowAndCullingView.farClip);
     }
 
+    // We follow the sorting strategy outlined here: http://realtimecollisiondetection.net/blog/?p=86
+    cpuProfiler.begin("build_render_queues");
+    build_render_queues(scene, shadowAndCullingView);
+    cpuProfiler.end("build_render_queues");
+
     // Shadow pass can only run if we've configured a directional sunlight
 
     if (settings.shadowsEnabled && scene.sunlight)
@@ -518,7 +1398,8 @@ void pbr_renderer::render_frame(const render_payload & scene)
         gpuProfiler.end("run_shadow_pass");
         cpuProfiler.end("run_shadow_pass");
 
-        for (int c = 0; c < uniforms::NUM_CASCADES; c++)
+        b.cascadeCount = shadow->cascadeCount;
+        for (int c = 0; c < shadow->cascadeCount; c++)
         {
             b.cascadesPlane[c] = float4(shadow->splitPlanes[c].x, shadow->splitPlanes[c].y, 0, 0);
             b.cascadesMatrix[c] = shadow->shadowMatrices[c];
@@ -527,42 +1408,41 @@ void pbr_renderer::render_frame(const render_payload & scene)
         }
     }
 
-    // Per-scene can be uploaded now that the shadow pass has completed
-    perScene.set_buffer_data(sizeof(b), &b, GL_STREAM_DRAW);
-
-    // We follow the sorting strategy outlined here: http://realtimecollisiondetection.net/blog/?p=86
-    auto materialSortFunc = [this, scene, shadowAndCullingView](const render_component * lhs, const render_component * rhs)
-    {
-        // Sort by material (expensive shader state change)
-        // @fixme - why is this so expensive? Adds an additional ~2ms to the sort
-        auto lid = lhs->material->material.get()->id();
-        auto rid = rhs->material->material.get()->id();
-        if (lid != rid) return lid > rid;
+    cpuProfiler.begin("upload_lights");
+    upload_lights(scene, shadowAndCullingView.farClip);
+    b.activeLights = static_cast<int>(gpuLights.size());
+    cpuProfiler.end("upload_lights");
 
-        const float lDist = distance(shadowAndCullingView.pose.position, lhs->world_transform->world_pose.position);
-        const float rDist = distance(shadowAndCullingView.pose.position, rhs->world_transform->world_pose.position);
+    // Per-scene can be uploaded now that the shadow pass has completed
+    uniformStream.bind_range(GL_UNIFORM_BUFFER, uniforms::per_scene::binding, uniformStream.write(b));
 
-        // Otherwise sort by distance
-        return lDist < rDist;
-    };
+    // Pyramids left over from before occlusion culling was last disabled are stale
+    if (!settings.gpuDrivenSubmission || !settings.occlusionCulling) std::fill(hiZValid.begin(), hiZValid.end(), 0);
 
-    cpuProfiler.begin("sort-render_queue_material");
-    std::vector<const render_component *> render_queue_material(scene.render_components.size());
-    for (int i = 0; i < scene.render_components.size(); ++i) 
-    { 
-        render_queue_material[i] = (&(scene.render_components[i]));
+    if (settings.gpuDrivenSubmission)
+    {
+        cpuProfiler.begin("build_indirect_batches");
+        build_indirect_batches(opaqueQueue, scene);
+        cpuProfiler.end("build_indirect_batches");
     }
-    std::sort(render_queue_material.begin(), render_queue_material.end(), materialSortFunc);
-    cpuProfiler.end("sort-render_queue_material");
 
-    for (uint32_t camIdx = 0; camIdx < settings.cameraCount; ++camIdx)
+    if (singlePassStereo)
+    {
+        render_views_stereo(scene, shadowAndCullingView);
+    }
+    else for (uint32_t camIdx = 0; camIdx < settings.cameraCount; ++camIdx)
     {
         // Update per-view uniform buffer
         uniforms::per_view v = {};
         v.view = scene.views[camIdx].viewMatrix;
         v.viewProj = scene.views[camIdx].viewProjMatrix;
         v.eyePos = float4(scene.views[camIdx].pose.position, 1);
-        perView.set_buffer_data(sizeof(v), &v, GL_STREAM_DRAW);
+
+        cpuProfiler.begin("run_light_culling_pass-" + std::to_string(camIdx));
+        run_light_culling_pass(scene.views[camIdx], v);
+        cpuProfiler.end("run_light_culling_pass-" + std::to_string(camIdx));
+
+        uniformStream.bind_range(GL_UNIFORM_BUFFER, uniforms::per_view::binding, uniformStream.write(v));
 
         // Render into multisampled fbo
         glEnable(GL_MULTISAMPLE);
@@ -572,10 +1452,29 @@ void pbr_renderer::render_frame(const render_payload & scene)
         glClearNamedFramebufferfv(multisampleFramebuffer, GL_DEPTH, 0, &defaultDepth);
         if (using_stencil_mask) glClearNamedFramebufferuiv(multisampleFramebuffer, GL_STENCIL, 0, &defaultStencil);
 
+        // Build this view's draw lists; the gpu-driven path culls opaque draws on the gpu instead
+        {
+            cpuProfiler.begin("cull_render_queues-" + std::to_string(camIdx));
+            const frustum viewFrustum(scene.views[camIdx].viewProjMatrix);
+            mark_visible(&viewFrustum, 1, scene);
+            viewQueue.clear();
+            viewTransparentQueue.clear();
+            if (!settings.gpuDrivenSubmission) append_visible(scene, opaqueQueue, viewQueue);
+            append_visible(scene, transparentQueue, viewTransparentQueue);
+            cpuProfiler.end("cull_render_queues-" + std::to_string(camIdx));
+        }
+
+        if (settings.gpuDrivenSubmission)
+        {
+            gpuProfiler.begin("run_gpu_culling_pass-" + std::to_string(camIdx));
+            run_gpu_culling_pass(scene.views[camIdx]);
+            gpuProfiler.end("run_gpu_culling_pass-" + std::to_string(camIdx));
+        }
+
         if (settings.useDepthPrepass)
         {
             gpuProfiler.begin("depth-prepass-" + std::to_string(camIdx));
-            run_depth_prepass(scene.views[camIdx], scene);
+            run_depth_prepass(viewQueue, scene.views[camIdx], scene);
             gpuProfiler.end("depth-prepass-" + std::to_string(camIdx));
         }
 
@@ -598,10 +1497,17 @@ void pbr_renderer::render_frame(const render_payload & scene)
 
         gpuProfiler.begin("run_forward_pass-" + std::to_string(camIdx));
         cpuProfiler.begin("run_forward_pass-" + std::to_string(camIdx));
-        run_forward_pass(render_queue_material, scene.views[camIdx], scene);
+        if (settings.gpuDrivenSubmission) run_forward_pass_indirect(scene.views[camIdx], scene);
+        else run_forward_pass(viewQueue, scene.views[camIdx], scene);
         cpuProfiler.end("run_forward_pass-" + std::to_string(camIdx));
         gpuProfiler.end("run_forward_pass-" + std::to_string(camIdx));
 
+        gpuProfiler.begin("run_transparent_pass-" + std::to_string(camIdx));
+        cpuProfiler.begin("run_transparent_pass-" + std::to_string(camIdx));
+        run_transparent_pass(viewTransparentQueue, scene.views[camIdx], scene);
+        cpuProfiler.end("run_transparent_pass-" + std::to_string(camIdx));
+        gpuProfiler.end("run_transparent_pass-" + std::to_string(camIdx));
+
         glDisable(GL_MULTISAMPLE);
 
         // Resolve multisample into per-view framebuffer
@@ -620,6 +1526,13 @@ void pbr_renderer::render_frame(const render_payload & scene)
 
             gpuProfiler.end("blit-" + std::to_string(camIdx));
         }
+
+        if (settings.gpuDrivenSubmission && settings.occlusionCulling)
+        {
+            gpuProfiler.begin("build_hiz_pyramid-" + std::to_string(camIdx));
+            build_hiz_pyramid(scene.views[camIdx]);
+            gpuProfiler.end("build_hiz_pyramid-" + std::to_string(camIdx));
+        }
     }
 
     // Execute the post passes after having resolved the multisample framebuffers
@@ -635,6 +1548,11 @@ void pbr_renderer::render_frame(const render_payload & scene)
     }
 
     glDisable(GL_FRAMEBUFFER_SRGB);
+
+    // All draws reading this frame's uniforms and lights have been issued
+    uniformStream.end_frame();
+    storageStream.end_frame();
+
     cpuProfiler.end("render_frame");
 
     gl_check_error(__FILE__, __LINE__);
@@ -9,6 +9,9 @@
 #include "queue-circular.hpp"
 #include "human_time.hpp"
 #include "profiling.hpp"
+#include "aabb-tree.hpp"
+#include "radix_sort.hpp"
+#include "renderer-clusters.hpp"
 
 #include "gl-camera.hpp"
 #include "gl-async-gpu-timer.hpp"
@@ -33,10 +36,31 @@ namespace polymer
         gl_framebuffer shadowArrayFramebuffer;
         shader_handle program = { "cascaded-shadows" };
 
+        int allocatedResolution{ 0 };   // size and layer count of shadowArrayDepth
+        int allocatedCascades{ 0 };
+
+        // Cascades at or beyond firstCachedCascade keep their matrices while the camera's split stays 
+        // inside them. A cascade is only redrawn when its matrix or the signature of its casters changes.
+        struct cascade_state
+        {
+            float3 centroid;
+            float3 lightDir;
+            float radius{ 0.f };
+            uint64_t casterSignature{ 0 };
+            bool matricesChanged{ true };
+            bool rendered{ false };
+        };
+        std::vector<cascade_state> cascadeState;
+
+        void allocate();
+
     public:
 
-        float resolution = 4096;        // cascade resolution
-        float splitLambda = 0.675f;     // frustum split constant
+        int cascadeCount = 2;               // up to uniforms::MAX_CASCADES
+        float resolution = 4096;            // cascade resolution
+        float splitLambda = 0.675f;         // frustum split constant
+        int firstCachedCascade = 1;         // cascades from this index on are cached; >= cascadeCount disables caching
+        float cachedCascadeMargin = 1.25f;  // cached cascades are enlarged so the camera can move before they are rebuilt
 
         std::vector<float2> splitPlanes;
         std::vector<float> nearPlanes;
@@ -49,9 +73,11 @@ namespace polymer
         stable_cascaded_shadows();
 
         void update_cascades(const float4x4 & view, const float near, const float far, const float aspectRatio, const float vfov, const float3 & lightDir);
-        void update_shadow_matrix(const float4x4 & shadowModelMatrix);
         void pre_draw();
+        bool begin_cascade(const int cascade, const uint64_t casterSignature);
+        void draw_instances(gl_mesh & mesh, const uint32_t firstInstance, const uint32_t instanceCount);
         void post_draw();
+        void invalidate();
 
         GLuint get_output_texture() const;
     };
@@ -59,7 +85,10 @@ namespace polymer
     template<class F> void visit_fields(stable_cascaded_shadows & o, F f)
     {
         f("shadowmap_resolution", o.resolution);
+        f("cascade_count", o.cascadeCount, range_metadata<int>{ 1, uniforms::MAX_CASCADES });
         f("cascade_split", o.splitLambda, range_metadata<float>{ 0.1f, 1.0f });
+        f("first_cached_cascade", o.firstCachedCascade, range_metadata<int>{ 0, uniforms::MAX_CASCADES });
+        f("cached_cascade_margin", o.cachedCascadeMargin, range_metadata<float>{ 1.0f, 2.0f });
     }
 
     ////////////////////////////////////////
@@ -75,6 +104,12 @@ namespace polymer
         bool useDepthPrepass{ false };
         bool tonemapEnabled{ true };
         bool shadowsEnabled{ true };
+        bool gpuDrivenSubmission{ false };
+        bool frustumCulling{ true };
+        bool singlePassStereo{ false }; // with two cameras, draw both eyes in one instanced pass
+        bool occlusionCulling{ false }; // hierarchical-z culling of gpu-driven draws against the previous frame's depth
+        bool bindlessMaterials{ false }; // gpu-driven pbr draws read parameters and GL_ARB_bindless_texture handles from one buffer
+        bool meshLod{ true }; // draw simplified levels of detail of meshes that cover less of the screen
     };
 
     struct view_data
@@ -98,19 +133,52 @@ namespace polymer
         }
     };
 
+    // World-space bounds for the renderables of a render_payload. Leaves store an index into 
+    // render_payload::render_components. Maintained incrementally by the render_system.
+    struct render_visibility
+    {
+        dynamic_aabb_tree<uint32_t> tree{ 0.1f };
+        std::vector<uint32_t> unbounded; // renderables whose mesh has no bounds; never culled
+    };
+
     class render_system;
     struct render_payload
     {
         std::vector<view_data> views;
         std::vector<render_component> render_components;
         std::vector<point_light_component *> point_lights;
+        std::vector<spot_light_component *> spot_lights;
         directional_light_component * sunlight;
         float4 clear_color{ 1, 0, 0, 1 };
         texture_handle ibl_radianceCubemap;
         texture_handle ibl_irradianceCubemap;
         gl_procedural_sky * skybox{ nullptr };
+        const render_visibility * visibility{ nullptr }; // if null, nothing is culled on the cpu
     };
 
+    ///////////////////
+    //   draw keys   //
+    ///////////////////
+
+    // Render queue entries are sorted by a 64-bit key built once per object, most significant bits first:
+    //   opaque:      [bucket:2][program:14][material:16][depth:32]   state changes first, then front-to-back
+    //   transparent: [bucket:2][~depth:32][program:14][material:16]  back-to-front
+    // Depth is the distance to the viewer; non-negative IEEE-754 floats order the same as their bit patterns.
+    enum class draw_bucket : uint64_t { opaque = 0, transparent = 1 };
+
+    inline uint64_t make_draw_key(const draw_bucket bucket, const uint32_t program, const uint32_t material, const float depth)
+    {
+        const float d = std::max(depth, 0.f);
+        uint32_t depth_bits;
+        std::memcpy(&depth_bits, &d, sizeof(float));
+
+        const uint64_t state = (uint64_t(program & 0x3fff) << 16) | uint64_t(material & 0xffff);
+        if (bucket == draw_bucket::opaque) return (uint64_t(bucket) << 62) | (state << 32) | depth_bits;
+        return (uint64_t(bucket) << 62) | (uint64_t(~depth_bits) << 30) | state;
+    }
+
+    inline draw_bucket get_draw_bucket(const uint64_t key) { return static_cast<draw_bucket>(key >> 62); }
+
     //////////////////////
     //   pbr_renderer   //
     //////////////////////
@@ -119,9 +187,24 @@ namespace polymer
     {
         simple_cpu_timer timer;
 
-        gl_buffer perScene;
-        gl_buffer perView;
-        gl_buffer perObject;
+        // Per-scene, per-view and per-object uniform blocks are streamed through one persistently
+        // mapped ring and bound with glBindBufferRange; it grows if a frame needs more than this.
+        gl_ring_buffer uniformStream{ 1024 * 1024 };
+
+        // Storage buffers streamed each frame: lights and per-cluster light lists for clustered lighting, 
+        // and shadow caster instances. Point and spot lights are uploaded once per frame, then each view 
+        // assigns them to its cluster grid.
+        gl_ring_buffer storageStream{ 256 * 1024, GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT };
+        std::vector<uniforms::light_gpu> gpuLights;
+        std::vector<light_cluster_grid> lightClusters; // one per camera
+        std::vector<uniforms::cluster_range> stereoClusterRanges; // both eyes' grids, bound together for single-pass stereo
+        std::vector<uint32_t> stereoClusterIndices;
+
+        // Single-pass stereo: both eyes are drawn side by side into one double-width multisample target
+        // with two instances per draw, then each half is resolved into its eye's framebuffer. Decided at
+        // construction since it changes the size of the multisample target.
+        bool singlePassStereo{ false };
+        uniforms::per_view_stereo stereoViewData;
 
         // MSAA Targets
         gl_renderbuffer multisampleRenderbuffers[2]; // color, depth/stencil
@@ -134,6 +217,70 @@ namespace polymer
         std::unique_ptr<stable_cascaded_shadows> shadow;
         gl_mesh post_quad;
 
+        // GPU-driven submission: per-object data for the whole frame is uploaded once into a storage 
+        // buffer, a compute pass frustum-culls by writing instanceCount into the draw commands, and 
+        // each (material, mesh) batch is submitted with one glMultiDrawElementsIndirect.
+        struct indirect_batch
+        {
+            material_interface * material;
+            gl_mesh * mesh;
+            uint32_t first_command;
+            uint32_t command_count;
+        };
+
+        gl_buffer gpuObjectBuffer;
+        gl_buffer gpuCommandBuffer;
+        size_t gpuBufferCapacity{ 0 };
+        std::unique_ptr<gl_shader_compute> gpuCullProgram;
+        std::vector<uniforms::per_object_gpu> gpuObjects;
+        std::vector<uniforms::draw_elements_indirect_command> gpuCommands;
+        std::vector<indirect_batch> indirectBatches;
+        std::vector<const render_component *> indirectFallbackQueue; // unindexed meshes or unsupported materials
+
+        // Bindless materials: parameters and texture handles of every material in the indirect batches, 
+        // indexed per object, so one batch covers all materials that share a shader and mesh.
+        bool bindlessActive{ false };
+        std::vector<uniforms::material_gpu> gpuMaterials;
+        std::unordered_map<material_interface *, uint32_t> gpuMaterialSlots;
+
+        // Hierarchical-z occlusion culling: after a view is resolved, its depth is reduced into a max-depth 
+        // mip chain. The next frame's culling pass projects each draw's bounds with the matrix the pyramid 
+        // was built with and rejects draws behind it, so newly disoccluded objects can appear a frame late.
+        std::vector<gl_texture_2d> hiZTextures;
+        std::vector<float4x4> hiZViewProj;
+        std::vector<uint8_t> hiZValid;
+        int hiZLevels{ 0 };
+        std::unique_ptr<gl_shader_compute> hiZBuildProgram;
+
+        // Render queues: a draw key per renderable is radix sorted once per frame, then split into
+        // opaque (front-to-back) and transparent (back-to-front) queues.
+        radix_sort drawKeySorter;
+        std::vector<uint64_t> drawKeys;
+        std::vector<uint32_t> drawIndices;
+        std::vector<uint8_t> drawLods; // per renderable; picked once per frame so every pass draws the same level
+        float4_array objectRotations;
+        float3_array objectPositions, objectScales;
+        float3x4_array objectMatrices, objectInverseMatrices; // per renderable; shared by every pass that draws it
+        std::unordered_map<material_interface *, uint32_t> materialSlots;
+        std::vector<const render_component *> opaqueQueue;
+        std::vector<const render_component *> transparentQueue;
+
+        // Per-view and per-cascade draw lists. The sorted queues are filtered so each list keeps the sort order.
+        std::vector<uint8_t> visibleSet;
+        std::vector<const render_component *> viewQueue;
+        std::vector<const render_component *> viewTransparentQueue;
+        std::vector<const render_component *> shadowQueue;
+
+        // Shadow casters for one cascade, grouped by mesh for instanced submission
+        struct shadow_batch
+        {
+            gl_mesh * mesh;
+            uint32_t first_instance;
+            uint32_t instance_count;
+        };
+        std::vector<uniforms::shadow_instance> shadowInstances;
+        std::vector<shadow_batch> shadowBatches;
+
         gl_mesh left_stencil_mask, right_stencil_mask;
         bool using_stencil_mask{ false };
 
@@ -141,14 +288,37 @@ namespace polymer
         shader_handle renderPassTonemap = { "post-tonemap" };
         shader_handle no_op = { "no-op" };
 
-        void update_per_object_uniform_buffer(const transform & p, const float3 & scale, const bool receiveShadow, const view_data & d);
+        void update_per_object_uniform_buffer(const render_component * r, const render_payload & scene, const view_data & d);
         void run_stencil_prepass(const view_data & view, const render_payload & scene);
-        void run_depth_prepass(const view_data & view, const render_payload & scene);
+        void run_depth_prepass(const std::vector<const render_component *> & render_queue, const view_data & view, const render_payload & scene);
         void run_skybox_pass(const view_data & view, const render_payload & scene);
         void run_shadow_pass(const view_data & view, const render_payload & scene);
         void run_forward_pass(std::vector<const render_component *> & render_queue, const view_data & view, const render_payload & scene);
+        void run_transparent_pass(std::vector<const render_component *> & render_queue, const view_data & view, const render_payload & scene);
         void run_post_pass(const view_data & view, const render_payload & scene);
 
+        void upload_lights(const render_payload & scene, const float maxLightRange);
+        void run_light_culling_pass(const view_data & view, uniforms::per_view & v);
+        void run_light_culling_pass_stereo(const render_payload & scene, uniforms::per_view_stereo & v);
+
+        void render_views_stereo(const render_payload & scene, const view_data & cullingView);
+        void draw_per_eye(const render_component * r, const render_payload & scene);
+
+        void build_render_queues(const render_payload & scene, const view_data & view);
+        uint32_t get_draw_lod(const render_component * r, const render_payload & scene) const { return drawLods[r - scene.render_components.data()]; }
+        float4x4 get_model_matrix(const render_component * r, const render_payload & scene) const { return objectMatrices.get(r - scene.render_components.data()); }
+        float4x4 get_normal_matrix(const render_component * r, const render_payload & scene) const { return transpose(objectInverseMatrices.get(r - scene.render_components.data())); }
+        void mark_visible(const frustum * frustums, const uint32_t frustumCount, const render_payload & scene);
+        void append_visible(const render_payload & scene, const std::vector<const render_component *> & in, std::vector<const render_component *> & out) const;
+
+        void bind_material(material_interface * mat, const bool gpuDriven, const bool stereo, const render_payload & scene);
+
+        uint32_t get_gpu_material_slot(material_interface * mat);
+        void build_indirect_batches(const std::vector<const render_component *> & render_queue, const render_payload & scene);
+        void run_gpu_culling_pass(const view_data & view);
+        void build_hiz_pyramid(const view_data & view);
+        void run_forward_pass_indirect(const view_data & view, const render_payload & scene);
+
     public:
 
         std::vector<gl_framebuffer> postFramebuffers;
@@ -158,6 +328,8 @@ namespace polymer
         profiler<simple_cpu_timer> cpuProfiler;
         profiler<gl_gpu_timer> gpuProfiler;
 
+        work_stealing_pool * jobPool{ nullptr }; // optional; used to parallelize render queue sorting
+
         pbr_renderer(const renderer_settings settings);
         ~pbr_renderer();
 
@@ -179,6 +351,12 @@ namespace polymer
         f("depth_prepass", o.settings.useDepthPrepass);
         f("tonemap_pass", o.settings.tonemapEnabled);
         f("shadow_pass", o.settings.shadowsEnabled);
+        f("gpu_driven_submission", o.settings.gpuDrivenSubmission);
+        f("frustum_culling", o.settings.frustumCulling);
+        f("occlusion_culling", o.settings.occlusionCulling);
+        f("bindless_materials", o.settings.bindlessMaterials);
+        f("mesh_lod", o.settings.meshLod);
+        f("single_pass_stereo", o.settings.singlePassStereo, editor_hidden{});
     }
 
 }
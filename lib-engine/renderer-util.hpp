@@ -11,10 +11,14 @@
 namespace polymer
 {
 
-    void load_required_renderer_assets(const std::string & base_path, gl_shader_monitor & monitor)
+    // Watches the renderer's shaders and compiles the variants it is known to request so the first frame that
+    // uses one does not stall. Stereo variants are only worth building for applications that render to an hmd.
+    void load_required_renderer_assets(const std::string & base_path, gl_shader_monitor & monitor, const bool precompile_stereo = false)
     {
         try
         {
+            monitor.enable_program_binary_cache(base_path + "/shader-cache");
+
             monitor.watch("sky-hosek",
                 base_path + "/shaders/sky_vert.glsl",
                 base_path + "/shaders/sky_hosek_frag.glsl");
@@ -43,7 +47,6 @@ namespace polymer
             monitor.watch("cascaded-shadows",
                 base_path + "/shaders/renderer/shadowcascade_vert.glsl",
                 base_path + "/shaders/renderer/shadowcascade_frag.glsl",
-                base_path + "/shaders/renderer/shadowcascade_geom.glsl",
                 base_path + "/shaders/renderer");
 
             monitor.watch("phong-forward-lighting",
@@ -59,6 +62,41 @@ namespace polymer
             monitor.watch("post-tonemap",
                 base_path + "/shaders/renderer/post_tonemap_vert.glsl",
                 base_path + "/shaders/renderer/post_tonemap_frag.glsl");
+
+            // Define lists must match the order the materials and renderer build them in (see resolve_variants)
+            const std::vector<std::string> lighting = { "ENABLE_SHADOWS", "USE_PCF_3X3", "USE_IMAGE_BASED_LIGHTING" };
+            const std::vector<std::string> phong_maps = { "HAS_DIFFUSE_MAP", "HAS_NORMAL_MAP" };
+            const std::vector<std::string> pbr_maps = { "HAS_ALBEDO_MAP", "HAS_ROUGHNESS_MAP", "HAS_METALNESS_MAP", "HAS_NORMAL_MAP", "HAS_OCCLUSION_MAP", "HAS_EMISSIVE_MAP" };
+
+            std::vector<std::vector<std::string>> features = { {}, { "GPU_DRIVEN_SUBMISSION" } };
+            if (precompile_stereo)
+            {
+                features.push_back({ "SINGLE_PASS_STEREO" });
+                features.push_back({ "GPU_DRIVEN_SUBMISSION", "SINGLE_PASS_STEREO" });
+            }
+
+            auto concat = [](std::vector<std::string> a, const std::vector<std::string> & b)
+            {
+                a.insert(a.end(), b.begin(), b.end());
+                return a;
+            };
+
+            std::unordered_map<std::string, std::vector<std::vector<std::string>>> variants;
+            for (const char * name : { "sky-hosek", "ibl", "renderer-wireframe", "cascaded-shadows", "post-tonemap" }) variants[name].push_back({});
+
+            for (auto & f : features)
+            {
+                variants["depth-prepass"].push_back(f);
+                variants["default-shader"].push_back(f);
+                variants["phong-forward-lighting"].push_back(concat(concat(lighting, phong_maps), f));
+                variants["pbr-forward-lighting"].push_back(concat(lighting, f));
+                variants["pbr-forward-lighting"].push_back(concat(concat(lighting, pbr_maps), f));
+
+                // Bindless pbr materials share one variant, only used by gpu-driven submission
+                if (!f.empty() && f[0] == "GPU_DRIVEN_SUBMISSION") variants["pbr-forward-lighting"].push_back(concat(concat(lighting, { "BINDLESS_MATERIALS" }), f));
+            }
+
+            monitor.precompile(variants);
         }
         catch (const std::exception & e)
         {
@@ -5,125 +5,159 @@ using namespace polymer;
 using namespace std::experimental::filesystem;
 using namespace std::chrono;
 
-system_clock::time_point write_time(const std::string & file_path)
-{
-    try { return last_write_time(path(file_path)); }
-    catch (...) { return system_clock::time_point::min(); };
-}
-
 gl_shader_monitor::gl_shader_monitor(const std::string & root_path) : root_path(root_path)
 {
-    watch_thread = std::thread([this, root_path]()
-    {
-        while (!watch_should_exit)
-        {
-            try
-            {
-                std::lock_guard<std::mutex> guard(watch_mutex);
-                walk_asset_dir();
-            }
-            catch (const std::exception & e)
-            {
-                //@todo use logger
-                std::cout << "Filesystem error: " << e.what() << std::endl;
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(250));
-        }
-    });
+    // Let the driver use as many background compiler threads as it likes
+    if (GLAD_GL_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
 }
 
 gl_shader_monitor::~gl_shader_monitor()
 {
-    watch_should_exit = true;
-    if (watch_thread.joinable()) watch_thread.join();
+    // Handles can outlive the monitor
+    for (auto & asset : assets) asset.second->onVariantCompiled = nullptr;
+
+    for (auto & asset : watched_files)
+    {
+        for (auto & file : asset.second) watcher.unwatch(file.second);
+    }
 }
 
-void gl_shader_monitor::watch(const std::string & name, const std::string & vert_path, const std::string & frag_path)
+void gl_shader_monitor::add_asset(const std::string & name, std::shared_ptr<gl_shader_asset> asset)
 {
     std::lock_guard<std::mutex> guard(watch_mutex);
-    auto asset = std::make_shared<gl_shader_asset>(name, vert_path, frag_path);
+
+    // Re-watching a name replaces the asset along with the files it depended on
+    for (auto & file : watched_files[name]) watcher.unwatch(file.second);
+    watched_files[name].clear();
+
+    asset->binaryCachePath = binary_cache_path;
+
+    // get_variant() compiles on first use, outside of precompile() and handle_recompile(); watch whatever
+    // that compile included now rather than after the next recompile. Neither of those passes calls it,
+    // so the lock is never already held here.
+    asset->onVariantCompiled = [this, name]()
+    {
+        std::lock_guard<std::mutex> guard(watch_mutex);
+        if (assets.count(name)) watch_dependencies(name);
+    };
+
+    if (auto previous = assets[name]) previous->onVariantCompiled = nullptr;
     assets[name] = asset;
+    watch_dependencies(name);
     create_handle_for_asset(name.c_str(), std::move(asset));
 }
 
+void gl_shader_monitor::watch_dependencies(const std::string & name)
+{
+    const gl_shader_asset & asset = *assets[name];
+    auto & files = watched_files[name];
+
+    std::vector<std::string> dependencies = { asset.vertexPath, asset.fragmentPath, asset.geomPath };
+    dependencies.insert(dependencies.end(), asset.includes.begin(), asset.includes.end());
+
+    for (const std::string & file : dependencies)
+    {
+        if (file.empty() || files.count(file)) continue;
+
+        files[file] = watcher.watch(file, [this, name](const std::string & path)
+        {
+            auto itr = assets.find(name);
+            if (itr == assets.end()) return;
+            itr->second->shouldRecompile = true;
+
+            //@todo use logger
+            std::cout << "Processed Asset: " << name << " (" << path << ")" << std::endl;
+        });
+    }
+}
+
+void gl_shader_monitor::watch(const std::string & name, const std::string & vert_path, const std::string & frag_path)
+{
+    add_asset(name, std::make_shared<gl_shader_asset>(name, vert_path, frag_path));
+}
+
 void gl_shader_monitor::watch(const std::string & name, const std::string & vert_path, const std::string & frag_path, const std::string & include_path)
 {
-    std::lock_guard<std::mutex> guard(watch_mutex);
-    auto asset = std::make_shared<gl_shader_asset>(name, vert_path, frag_path, "", include_path);
-    assets[name] = asset;
-    create_handle_for_asset(name.c_str(), std::move(asset));
+    add_asset(name, std::make_shared<gl_shader_asset>(name, vert_path, frag_path, "", include_path));
 }
 
 void gl_shader_monitor::watch(const std::string & name, const std::string & vert_path, const std::string & frag_path, const std::string & geom_path, const std::string & include_path)
 {
+    add_asset(name, std::make_shared<gl_shader_asset>(name, vert_path, frag_path, geom_path, include_path));
+}
+
+void gl_shader_monitor::enable_program_binary_cache(const std::string & cache_path)
+{
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount == 0) return; // driver can't serialize programs
+
+    try { create_directories(path(cache_path)); }
+    catch (const std::exception & e)
+    {
+        //@todo use logger
+        std::cout << "Could not create shader cache: " << e.what() << std::endl;
+        return;
+    }
+
     std::lock_guard<std::mutex> guard(watch_mutex);
-    auto asset = std::make_shared<gl_shader_asset>(name, vert_path, frag_path, geom_path, include_path);
-    assets[name] = asset;
-    create_handle_for_asset(name.c_str(), std::move(asset));
+    binary_cache_path = cache_path;
+    for (auto & asset : assets) asset.second->binaryCachePath = binary_cache_path;
 }
 
-void gl_shader_monitor::walk_asset_dir()
+void gl_shader_monitor::precompile(const std::unordered_map<std::string, std::vector<std::vector<std::string>>> & variants)
 {
-    const path root = root_path;
+    std::lock_guard<std::mutex> guard(watch_mutex);
 
-    for (auto & entry : recursive_directory_iterator(root))
+    std::vector<std::pair<gl_shader_asset *, std::vector<pending_variant>>> in_flight;
+
+    for (auto & entry : variants)
     {
-        const size_t root_len = root.string().length(), ext_len = entry.path().extension().string().length();
-        auto path = entry.path().string(), name = path.substr(root_len + 1, path.size() - root_len - ext_len - 1);
-        for (auto & chr : path) if (chr == '\\') chr = '/';
+        auto itr = assets.find(entry.first);
+        if (itr == assets.end()) continue;
 
-        for (auto & asset : assets)
-        {
-            // Compare file names + extension instead of paths directly
-            const auto scanned_file = get_filename_with_extension(path);
-
-            // Regular shader assets
-            if (scanned_file == get_filename_with_extension(asset.second->vertexPath)   || 
-                scanned_file == get_filename_with_extension(asset.second->fragmentPath) ||
-                scanned_file == get_filename_with_extension(asset.second->geomPath))
-            {
-                auto writeTime = duration_cast<seconds>(write_time(path).time_since_epoch()).count();
-                if (writeTime > asset.second->writeTime)
-                {
-                    asset.second->writeTime = writeTime;
-                    asset.second->shouldRecompile = true;
-                    //@todo use logger
-                    std::cout << "Processed Asset: " << asset.first << std::endl;
-                }
-            }
-
-            // Each shader keeps a list of the files it includes. gl_shader_monitor watches a base path,
-            // so we should be able to recompile shaders dependent on common includes
-            for (std::string includePath : asset.second->includes)
-            {
-                if (get_filename_with_extension(path) == get_filename_with_extension(includePath))
-                {
-                    auto writeTime = duration_cast<seconds>(write_time(path).time_since_epoch()).count();
-                    if (writeTime > asset.second->writeTime)
-                    {
-                        asset.second->writeTime = writeTime;
-                        asset.second->shouldRecompile = true;
-
-                        //@todo use logger
-                        std::cout << "Processed Include: " << includePath << std::endl;
-                        break;
-                    }
-                }
-            }
+        gl_shader_asset & asset = *itr->second;
 
+        // Include the default variant, which handle_recompile() would otherwise build on the first frame
+        std::vector<std::vector<std::string>> wanted = entry.second;
+        wanted.push_back({});
+
+        std::vector<std::vector<std::string>> missing;
+        for (auto & defines : wanted)
+        {
+            if (asset.shaders.find(asset.hash(defines)) != asset.shaders.end()) continue;
+            if (std::find(missing.begin(), missing.end(), defines) != missing.end()) continue;
+            missing.push_back(defines);
         }
+
+        in_flight.emplace_back(&asset, asset.begin_variants(missing));
+    }
+
+    for (auto & batch : in_flight)
+    {
+        gl_shader_asset & asset = *batch.first;
+        asset.end_variants(batch.second);
+        watch_dependencies(asset.name);
+
+        // Everything was just built from the current sources, so there's nothing for the first frame to redo
+        asset.shouldRecompile = false;
     }
 }
 
 void gl_shader_monitor::handle_recompile()
 {
     try_locker locker(watch_mutex);
+    if (!locker.is_locked()) return;
+
+    watcher.poll();
+
     for (auto & asset : assets)
     {
         if (asset.second->shouldRecompile)
         {
             asset.second->recompile_all();
             asset.second->shouldRecompile = false;
+            watch_dependencies(asset.first);
         }
     }
 }
\ No newline at end of file
@@ -8,8 +8,8 @@
 #include "string_utils.hpp"
 #include "gl-loaders.hpp"
 #include "shader.hpp"
+#include "file-watcher.hpp"
 
-#include <regex>
 #include <unordered_map>
 #include <chrono>
 #include <filesystem>
@@ -24,12 +24,14 @@ namespace polymer
     class gl_shader_monitor
     {
         std::unordered_map<std::string, std::shared_ptr<gl_shader_asset>> assets;
+        std::unordered_map<std::string, std::unordered_map<std::string, file_watcher::watch_id>> watched_files; // asset name -> source/include path -> watch
         std::string root_path;
-        std::thread watch_thread;
+        std::string binary_cache_path;
+        file_watcher watcher;
         std::mutex watch_mutex;
-        std::atomic<bool> watch_should_exit{ false };
 
-        void walk_asset_dir();
+        void add_asset(const std::string & name, std::shared_ptr<gl_shader_asset> asset);
+        void watch_dependencies(const std::string & name); // picks up includes discovered by the last compile
 
     public:
 
@@ -37,9 +39,17 @@ namespace polymer
         gl_shader_monitor(const std::string & asset_path);
         ~gl_shader_monitor();
 
-        // Call this regularly on the gl thread
+        // Call this regularly on the gl thread. Recompiles shaders whose sources or includes changed on disk.
         void handle_recompile();
 
+        // Persist linked program binaries under `cache_path` and load them instead of compiling on later runs.
+        // Binaries are keyed by the preprocessed source and the driver, so edits and driver updates simply miss.
+        void enable_program_binary_cache(const std::string & cache_path);
+
+        // Compile the listed define sets of each watched shader up front. All programs are submitted before any
+        // is waited on, so drivers exposing GL_KHR_parallel_shader_compile link them concurrently.
+        void precompile(const std::unordered_map<std::string, std::vector<std::vector<std::string>>> & variants);
+
         // Watch vertex and fragment
         void watch(const std::string & name, const std::string & vert_path, const std::string & frag_path);
 
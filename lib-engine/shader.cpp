@@ -1,106 +1,265 @@
 #include "shader.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
 using namespace polymer;
 
 ////////////////////////////////////////
 //   Shader Preprocessing Functions   //
 ////////////////////////////////////////
 
+// Returns the path between the quotes or angle brackets of an `#include` line, or an empty string for any other line
+std::string parse_include_directive(const std::string & line)
+{
+    size_t i = line.find_first_not_of(" \t");
+    if (i == std::string::npos || line[i] != '#') return {};
+
+    i = line.find_first_not_of(" \t", i + 1);
+    if (i == std::string::npos || line.compare(i, 7, "include") != 0) return {};
+
+    const size_t open = line.find_first_of("\"<", i + 7);
+    if (open == std::string::npos) return {};
+
+    const size_t close = line.find_first_of("\">", open + 1);
+    if (close == std::string::npos) return {};
+
+    return line.substr(open + 1, close - open - 1);
+}
+
 std::string process_includes_recursive(const std::string & source, const std::string & includeSearchPath, std::vector<std::string> & includes, int depth)
 {
     if (depth > 4) throw std::runtime_error("exceeded max include recursion depth");
 
-    static const std::regex re("^[ ]*#[ ]*include[ ]+[\"<](.*)[\">].*");
-    std::stringstream input;
-    std::stringstream output;
-
-    input << source;
+    std::string output;
+    output.reserve(source.size() * 2);
 
     size_t lineNumber = 1;
-    std::smatch matches;
-    std::string line;
+    size_t lineBegin = 0;
 
-    while (std::getline(input, line))
+    while (lineBegin < source.size())
     {
-        if (std::regex_search(line, matches, re))
+        size_t lineEnd = source.find('\n', lineBegin);
+        if (lineEnd == std::string::npos) lineEnd = source.size();
+        const std::string line = source.substr(lineBegin, lineEnd - lineBegin);
+
+        const std::string includeFile = parse_include_directive(line);
+        if (!includeFile.empty())
         {
-            std::string includeFile = matches[1];
-            std::string includeString = read_file_text(includeSearchPath + "/" + includeFile);
+            const std::string includeFilePath = includeSearchPath + "/" + includeFile;
+            const std::string includeString = read_file_text(includeFilePath);
 
-            if (!includeFile.empty())
-            {
-                includes.push_back(includeSearchPath + "/" + includeFile);
-                output << process_includes_recursive(includeString, includeSearchPath, includes, depth++) << std::endl;
-            }
+            if (std::find(includes.begin(), includes.end(), includeFilePath) == includes.end()) includes.push_back(includeFilePath);
+            output += process_includes_recursive(includeString, includeSearchPath, includes, depth + 1);
+            output += '\n';
         }
         else
         {
-            output << "#line " << lineNumber << std::endl;
-            output << line << std::endl;
+            output += "#line " + std::to_string(lineNumber) + "\n";
+            output += line;
+            output += '\n';
         }
+
+        lineBegin = lineEnd + 1;
         ++lineNumber;
     }
-    return output.str();
+    return output;
 }
 
 std::string preprocess_version(const std::string & source)
 {
-    std::stringstream input;
-    std::stringstream output;
-
-    input << source;
-
-    size_t lineNumber = 1;
-    std::string line;
     std::string version;
+    std::string output;
+    output.reserve(source.size());
 
-    while (std::getline(input, line))
+    size_t lineBegin = 0;
+
+    while (lineBegin < source.size())
     {
+        size_t lineEnd = source.find('\n', lineBegin);
+        if (lineEnd == std::string::npos) lineEnd = source.size();
+        const std::string line = source.substr(lineBegin, lineEnd - lineBegin);
+
         if (line.find("#version") != std::string::npos) version = line;
-        else output << line << std::endl;
-        ++lineNumber;
+        else
+        {
+            output += line;
+            output += '\n';
+        }
+
+        lineBegin = lineEnd + 1;
     }
 
-    std::stringstream result;
-    result << version << std::endl << output.str();
-    return result.str();
+    return version + "\n" + output;
 }
 
-gl_shader preprocess(const std::string & vertexShader,
-    const std::string & fragmentShader,
-    const std::string & geomShader,
+std::string preprocess(const std::string & source,
     const std::string & includeSearchPath,
     const std::vector<std::string> & defines,
     std::vector<std::string> & includes)
 {
-    std::stringstream vertex;
-    std::stringstream fragment;
-    std::stringstream geom;
+    if (source.empty()) return {};
+    if (defines.empty() && includeSearchPath.empty()) return source;
+
+    std::string result;
+    for (const auto & define : defines) result += "#define " + define + "\n";
+    result += source;
+
+    return preprocess_version(process_includes_recursive(result, includeSearchPath, includes, 0));
+}
+
+/////////////////////////////////
+//   Program Binary Utilities   //
+/////////////////////////////////
+
+static const uint64_t fnv1aBase64 = 0xCBF29CE484222325ull;
+static const uint64_t fnv1aPrime64 = 0x00000100000001B3ull;
 
-    for (const auto define : defines)
+// 64 bit FNV-1a, chained through `seed`. Each string is terminated so that {"AB", "C"} and {"A", "BC"} hash differently.
+uint64_t hash_fnv1a_64(const std::string & str, uint64_t seed)
+{
+    for (auto & c : str)
     {
-        if (vertexShader.size()) vertex << "#define " << define << std::endl;
-        if (fragmentShader.size()) fragment << "#define " << define << std::endl;
-        if (geomShader.size()) geom << "#define " << define << std::endl;
+        seed ^= static_cast<uint8_t>(c);
+        seed *= fnv1aPrime64;
     }
+    seed ^= 0xFFu;
+    seed *= fnv1aPrime64;
+    return seed;
+}
+
+// Binaries are only valid for the driver that produced them, so the driver identity is part of every key
+uint64_t program_binary_key(const std::string & vertex, const std::string & fragment, const std::string & geom)
+{
+    static const uint64_t driverHash = []()
+    {
+        uint64_t h = fnv1aBase64;
+        for (const GLenum e : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            const char * str = reinterpret_cast<const char *>(glGetString(e));
+            h = hash_fnv1a_64(str ? str : "", h);
+        }
+        return h;
+    }();
+
+    return hash_fnv1a_64(geom, hash_fnv1a_64(fragment, hash_fnv1a_64(vertex, driverHash)));
+}
+
+std::string program_binary_path(const std::string & cachePath, const uint64_t key)
+{
+    char filename[32];
+    snprintf(filename, sizeof(filename), "%016llx.bin", static_cast<unsigned long long>(key));
+    return cachePath + "/" + filename;
+}
+
+// Cache files hold the GLenum binary format followed by the driver's program binary. Returns 0 on a miss
+// or when the driver rejects the binary (e.g. after a driver update), in which case the caller recompiles.
+GLuint load_program_binary(const std::string & path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return 0;
 
-    if (vertexShader.size()) vertex << vertexShader;
-    if (fragmentShader.size()) fragment << fragmentShader;
-    if (geomShader.size()) geom << geomShader;
+    const std::vector<char> bytes = { (std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>() };
+    if (bytes.size() <= sizeof(GLenum)) return 0;
 
-    if (geomShader.size())
+    GLenum format;
+    std::memcpy(&format, bytes.data(), sizeof(GLenum));
+
+    const GLuint program = glCreateProgram();
+    glProgramBinary(program, format, bytes.data() + sizeof(GLenum), static_cast<GLsizei>(bytes.size() - sizeof(GLenum)));
+
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE)
     {
-        return gl_shader(
-            preprocess_version(process_includes_recursive(vertex.str(), includeSearchPath, includes, 0)),
-            preprocess_version(process_includes_recursive(fragment.str(), includeSearchPath, includes, 0)),
-            preprocess_version(process_includes_recursive(geom.str(), includeSearchPath, includes, 0)));
+        glDeleteProgram(program);
+        return 0;
     }
-    else
+    return program;
+}
+
+void save_program_binary(const std::string & path, const GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> bytes(sizeof(GLenum) + length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, bytes.data() + sizeof(GLenum));
+    std::memcpy(bytes.data(), &format, sizeof(GLenum));
+
+    // Write to a temporary and rename so an interrupted write never leaves a truncated binary behind
+    const std::string tempPath = path + ".tmp";
     {
-        return gl_shader(
-            preprocess_version(process_includes_recursive(vertex.str(), includeSearchPath, includes, 0)),
-            preprocess_version(process_includes_recursive(fragment.str(), includeSearchPath, includes, 0)));
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return;
+        file.write(bytes.data(), sizeof(GLenum) + length);
     }
+    std::remove(path.c_str());
+    std::rename(tempPath.c_str(), path.c_str());
+}
+
+// Issues compile and link without querying any status, so the driver is free to work on it in the background
+GLuint begin_program_link(const std::string & vertex, const std::string & fragment, const std::string & geom)
+{
+    const GLuint program = glCreateProgram();
+    glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_FALSE);
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    auto attach = [program](const GLenum type, const std::string & source)
+    {
+        const GLchar * str = source.c_str();
+        const GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &str, nullptr);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        glDeleteShader(shader); // released once detached in finish_program_link
+    };
+
+    attach(GL_VERTEX_SHADER, vertex);
+    attach(GL_FRAGMENT_SHADER, fragment);
+    if (geom.length() != 0) attach(GL_GEOMETRY_SHADER, geom);
+
+    glLinkProgram(program);
+    return program;
+}
+
+// Blocks until the link has completed, then reports any compile or link errors
+bool finish_program_link(const GLuint program)
+{
+    GLint status, length;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+    GLuint attached[3];
+    GLsizei attachedCount = 0;
+    glGetAttachedShaders(program, 3, &attachedCount, attached);
+
+    if (status == GL_FALSE)
+    {
+        for (GLsizei i = 0; i < attachedCount; ++i)
+        {
+            GLint compiled;
+            glGetShaderiv(attached[i], GL_COMPILE_STATUS, &compiled);
+            if (compiled == GL_TRUE) continue;
+
+            glGetShaderiv(attached[i], GL_INFO_LOG_LENGTH, &length);
+            std::vector<GLchar> buffer(length + 1);
+            glGetShaderInfoLog(attached[i], (GLsizei)buffer.size(), nullptr, buffer.data());
+            std::cerr << "GL Compile Error: " << buffer.data() << std::endl;
+        }
+
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::vector<GLchar> buffer(length + 1);
+        glGetProgramInfoLog(program, (GLsizei)buffer.size(), nullptr, buffer.data());
+        std::cerr << "GL Link Error: " << buffer.data() << std::endl;
+    }
+
+    for (GLsizei i = 0; i < attachedCount; ++i) glDetachShader(program, attached[i]);
+
+    return status == GL_TRUE;
 }
 
 ///////////////////////////////////////
@@ -112,9 +271,10 @@ gl_shader_asset::gl_shader_asset(const std::string & n, const std::string & v, c
 
 uint64_t gl_shader_asset::hash(const std::vector<std::string> & defines)
 {
-    uint64_t sumOfHashes = 0;
-    for (auto & define : defines) sumOfHashes += poly_hash_fnv1a(define);
-    return sumOfHashes;
+    // Order-sensitive, since the defines are emitted into the source in this order
+    uint64_t result = fnv1aBase64;
+    for (auto & define : defines) result = hash_fnv1a_64(define, result);
+    return result;
 }
 
 std::shared_ptr<shader_variant> gl_shader_asset::get_variant(const std::vector<std::string> defines)
@@ -127,58 +287,125 @@ std::shared_ptr<shader_variant> gl_shader_asset::get_variant(const std::vector<s
     if (itr != shaders.end()) return itr->second;
 
     // Create if not
-    auto newVariant = std::make_shared<shader_variant>();
-    newVariant->shader = std::move(compile_variant(defines));
-    newVariant->defines = defines;
-    newVariant->hash = theHash;
-    shaders[theHash] = newVariant;
-    return newVariant;
+    precompile({ defines });
+    return shaders[theHash];
 }
 
 gl_shader & gl_shader_asset::get()
 {
-    std::shared_ptr<shader_variant> theDefault;
-    if (shaders.size() == 0) theDefault = get_variant();
-    else theDefault = shaders[0];
-    return theDefault->shader;
+    return get_variant()->shader;
 }
 
-void gl_shader_asset::recompile_all()
+void gl_shader_asset::precompile(const std::vector<std::vector<std::string>> & variants)
 {
-    // Compile at least the default variant with no includes defined... 
-    if (shaders.empty())
+    std::vector<std::vector<std::string>> missing;
+    for (auto & defines : variants)
     {
-        auto newVariant = std::make_shared<shader_variant>();
-        newVariant->shader = std::move(compile_variant({}));
-        shaders[0] = newVariant;
+        if (shaders.find(hash(defines)) == shaders.end()) missing.push_back(defines);
     }
+    if (missing.empty()) return;
+
+    std::vector<pending_variant> pending = begin_variants(missing);
+    end_variants(pending);
+    if (onVariantCompiled) onVariantCompiled();
+}
 
+void gl_shader_asset::recompile_all()
+{
+    // Compile at least the default variant with no includes defined... 
+    std::vector<std::vector<std::string>> variants = { {} };
     for (auto & variant : shaders)
     {
-        variant.second->shader = compile_variant(variant.second->defines);
+        if (!variant.second->defines.empty()) variants.push_back(variant.second->defines);
     }
+
+    std::vector<pending_variant> pending = begin_variants(variants);
+    end_variants(pending);
 }
 
-gl_shader gl_shader_asset::compile_variant(const std::vector<std::string> defines)
+std::vector<pending_variant> gl_shader_asset::begin_variants(const std::vector<std::vector<std::string>> & variants)
 {
-    gl_shader variant;
+    std::vector<pending_variant> pending(variants.size());
 
-    try
+    for (size_t i = 0; i < variants.size(); ++i)
     {
-        if (defines.size() > 0 || includePath.size() > 0)
+        pending_variant & p = pending[i];
+        p.defines = variants[i];
+
+        try
         {
-            variant = preprocess(read_file_text(vertexPath), read_file_text(fragmentPath), read_file_text(geomPath), includePath, defines, includes);
+            const std::string vertex = preprocess(read_file_text(vertexPath), includePath, p.defines, includes);
+            const std::string fragment = preprocess(read_file_text(fragmentPath), includePath, p.defines, includes);
+            const std::string geom = preprocess(read_file_text(geomPath), includePath, p.defines, includes);
+
+            if (!binaryCachePath.empty())
+            {
+                p.binaryKey = program_binary_key(vertex, fragment, geom);
+                p.program = load_program_binary(program_binary_path(binaryCachePath, p.binaryKey));
+                p.fromBinary = (p.program != 0);
+            }
+
+            if (!p.program) p.program = begin_program_link(vertex, fragment, geom);
         }
-        else
+        catch (const std::exception & e)
         {
-            variant = gl_shader(read_file_text(vertexPath), read_file_text(fragmentPath), read_file_text(geomPath));
+            //@todo use logger
+            std::cout << "Shader recompilation error: " << e.what() << std::endl;
         }
     }
-    catch (const std::exception & e)
+
+    return pending;
+}
+
+gl_shader gl_shader_asset::finish_variant(pending_variant & p)
+{
+    gl_shader variant;
+    if (!p.program) return variant;
+
+    if (p.fromBinary || finish_program_link(p.program))
+    {
+        if (!p.fromBinary && !binaryCachePath.empty()) save_program_binary(program_binary_path(binaryCachePath, p.binaryKey), p.program);
+        variant = gl_shader(p.program);
+    }
+    else
     {
+        glDeleteProgram(p.program);
         //@todo use logger
-        std::cout << "Shader recompilation error: " << e.what() << std::endl;
+        std::cout << "Shader recompilation error: GLSL Link Failure (" << name << ")" << std::endl;
     }
 
-    return std::move(variant);
-}
\ No newline at end of file
+    p.program = 0;
+    return variant;
+}
+
+void gl_shader_asset::end_variants(std::vector<pending_variant> & pending)
+{
+    for (auto & p : pending)
+    {
+        gl_shader program = finish_variant(p);
+
+        // Existing variants are updated in place since materials hold on to them
+        const uint64_t theHash = hash(p.defines);
+        auto itr = shaders.find(theHash);
+        if (itr != shaders.end())
+        {
+            itr->second->shader = std::move(program);
+        }
+        else
+        {
+            auto newVariant = std::make_shared<shader_variant>();
+            newVariant->shader = std::move(program);
+            newVariant->defines = p.defines;
+            newVariant->hash = theHash;
+            shaders[theHash] = newVariant;
+        }
+    }
+}
+
+gl_shader gl_shader_asset::compile_variant(const std::vector<std::string> defines)
+{
+    std::vector<pending_variant> pending = begin_variants({ defines });
+    gl_shader variant = finish_variant(pending[0]);
+    if (onVariantCompiled) onVariantCompiled();
+    return variant;
+}
@@ -8,8 +8,8 @@
 #include "string_utils.hpp"
 #include "gl-loaders.hpp"
 
-#include <regex>
 #include <unordered_map>
+#include <functional>
 #include <chrono>
 #include <filesystem>
 #include <atomic>
@@ -26,16 +26,31 @@ namespace polymer
         bool enabled(const std::string & define) { for (auto & d : defines) if (d == define) return true; return false; }
     };
 
+    // A variant whose program has been handed to the driver but whose link status has not been queried yet.
+    // Keeping several of these in flight lets GL_KHR_parallel_shader_compile link them concurrently.
+    struct pending_variant
+    {
+        std::vector<std::string> defines;
+        uint64_t binaryKey{ 0 };
+        GLuint program{ 0 };
+        bool fromBinary{ false };
+    };
+
     class gl_shader_asset
     {
         std::string name;
         std::string vertexPath, fragmentPath, geomPath, includePath;
+        std::string binaryCachePath; // empty if program binaries should not be persisted
         std::vector<std::string> includes;
         std::unordered_map<uint64_t, std::shared_ptr<shader_variant>> shaders;
         bool shouldRecompile{ true };
-        int64_t writeTime{ 0 };
+        std::function<void()> onVariantCompiled; // set by gl_shader_monitor to watch includes found by lazy compiles
         friend class gl_shader_monitor;
 
+        std::vector<pending_variant> begin_variants(const std::vector<std::vector<std::string>> & variants);
+        void end_variants(std::vector<pending_variant> & pending);
+        gl_shader finish_variant(pending_variant & pending);
+
     public:
 
         gl_shader_asset(const std::string & n, const std::string & v, const std::string & f, const std::string & g = "", const std::string & inc = "");
@@ -43,6 +58,7 @@ namespace polymer
         std::shared_ptr<shader_variant> get_variant(const std::vector<std::string> defines = {});
         gl_shader & get(); // returns compiled shader, assumes no defines
         uint64_t hash(const std::vector<std::string> & defines);
+        void precompile(const std::vector<std::vector<std::string>> & variants); // compiles any variants not already present
         void recompile_all();
     };
 }
@@ -4,9 +4,12 @@
 #define polymer_collision_system_hpp
 
 #include "geometry.hpp"
+#include "mesh-bvh.hpp"
+#include "aabb-tree.hpp"
 #include "asset-handle-utils.hpp"
 #include "ecs/typeid.hpp"
 #include "ecs/core-ecs.hpp"
+#include "ecs/component-pool.hpp"
 #include "system-transform.hpp"
 #include "environment.hpp"
 
@@ -24,23 +27,68 @@ namespace polymer
     };
 
     // todo - need to support proxy mesh (sphere or box)
-    // todo - accelerate using spatial data structure (use existing octree?)
     class collision_system final : public base_system
     {
-        std::unordered_map<entity, geometry_component> meshes;
+        polymer_component_pool<geometry_component> meshes{ 256 };
         transform_system * xform_system{ nullptr };
 
-        template<class F> friend void visit_components(entity e, collision_system * system, F f);
-        friend class asset_resolver;
+        // Local bounds and the raycast bvh are cached per runtime_mesh, shared by every entity that references the
+        // mesh. Both are recomputed if the mesh's storage changes, as it does when an asset is reloaded; the bvh is
+        // only built the first time a mesh raycast reaches the mesh.
+        struct cached_mesh
+        {
+            aabb_3d bounds;
+            mesh_bvh bvh;
+            bool hasBvh{ false };
+            const float3 * vertices{ nullptr };
+            const uint3 * faces{ nullptr };
+            size_t vertexCount{ 0 };
+            size_t faceCount{ 0 };
+        };
+        std::unordered_map<const runtime_mesh *, cached_mesh> meshCache;
 
-    public:
+        // Broadphase over the world-space bounds of every entity with geometry and a transform. Only the leaves of 
+        // entities the transform system reports as moved since the last update are refit, and nothing is touched 
+        // while its revision is unchanged. Entities whose mesh has not been resolved yet are kept aside and 
+        // retried on each update.
+        struct broadphase_proxy { int32_t proxy; uint64_t revision; aabb_3d bounds; };
+        dynamic_aabb_tree<entity> broadphase;
+        std::unordered_map<entity, broadphase_proxy> broadphaseProxies;
+        std::vector<entity> unbounded;
+        std::vector<entity> moved;
+        uint64_t broadphaseRevision{ 0 };
+        bool broadphaseDirty{ true };
 
-        collision_system(entity_orchestrator * orch) : base_system(orch)
+        // raycast_batch() scratch: a sort key in the high bits and the ray index in the low bits, reused across calls
+        std::vector<uint64_t> batchOrder;
+
+        cached_mesh & get_cached_mesh(const runtime_mesh & mesh)
         {
-            register_system_for_type(this, get_typeid<geometry_component>());
+            cached_mesh & cached = meshCache[&mesh];
+            if (cached.vertices != mesh.vertices.data() || cached.faces != mesh.faces.data() || cached.vertexCount != mesh.vertices.size() || cached.faceCount != mesh.faces.size())
+            {
+                cached.bounds = compute_bounds(mesh);
+                cached.hasBvh = false;
+                cached.vertices = mesh.vertices.data();
+                cached.faces = mesh.faces.data();
+                cached.vertexCount = mesh.vertices.size();
+                cached.faceCount = mesh.faces.size();
+            }
+            return cached;
         }
 
-        entity_hit_result raycast(const ray & world_ray, const raycast_type type = raycast_type::mesh)
+        const mesh_bvh & get_bvh(const runtime_mesh & mesh)
+        {
+            cached_mesh & cached = get_cached_mesh(mesh);
+            if (!cached.hasBvh)
+            {
+                cached.bvh.build(mesh);
+                cached.hasBvh = true;
+            }
+            return cached.bvh;
+        }
+
+        transform_system * get_xform_system()
         {
             // Potential cross-orchestrator issues here
             if (!xform_system)
@@ -49,123 +97,345 @@ namespace polymer
                 xform_system = dynamic_cast<transform_system *>(xform_base);
                 assert(xform_system != nullptr);
             }
+            return xform_system;
+        }
+
+        void remove_proxy(entity e)
+        {
+            auto it = broadphaseProxies.find(e);
+            if (it == broadphaseProxies.end()) return;
+            broadphase.remove(it->second.proxy);
+            broadphaseProxies.erase(it);
+        }
 
-            auto raycast_mesh = [&](entity e) -> raycast_result
+        // Inserts or refits the leaf of `e`. Returns false, leaving it out of the tree, if it has no transform or its mesh is empty.
+        bool update_proxy(entity e, const bool force)
+        {
+            const world_transform_component * world = xform_system->get_world_transform(e);
+            const local_transform_component * local = xform_system->get_local_transform(e);
+            const geometry_component * component = meshes.get(e);
+            if (!world || !local || !component || component->geom.get().vertices.empty())
             {
-                if (!xform_system->has_transform(e)) return {};
-                const runtime_mesh & geometry = meshes[e].geom.get();
-                if (geometry.vertices.empty()) return {};
+                remove_proxy(e);
+                return false;
+            }
+
+            auto it = broadphaseProxies.find(e);
+            if (it != broadphaseProxies.end() && !force && it->second.revision == world->revision) return true;
 
-                const transform meshPose = xform_system->get_world_transform(e)->world_pose;
-                const float3 meshScale = xform_system->get_local_transform(e)->local_scale;
+            const float4x4 model = world->world_pose.matrix() * make_scaling_matrix(local->local_scale);
+            const aabb_3d world_bounds = transform_aabb(model, get_cached_mesh(component->geom.get()).bounds);
+
+            if (it == broadphaseProxies.end())
+            {
+                const int32_t proxy = broadphase.insert(world_bounds, e);
+                broadphaseProxies[e] = { proxy, world->revision, world_bounds };
+            }
+            else
+            {
+                broadphase.update(it->second.proxy, world_bounds);
+                it->second.revision = world->revision;
+                it->second.bounds = world_bounds;
+            }
+            return true;
+        }
+
+        // Brings the cached bounds (and for mesh raycasts, the bvh) of an entity's mesh up to date
+        void prepare_mesh(entity e, const raycast_type type)
+        {
+            const runtime_mesh & geometry = meshes.get(e)->geom.get();
+            if (type == raycast_type::mesh) get_bvh(geometry);
+            else get_cached_mesh(geometry);
+        }
+
+        // Narrowphase against a single broadphase candidate, after prepare_mesh(). Only reads cached state,
+        // so it is safe to call concurrently.
+        raycast_result raycast_entity(entity e, const ray & world_ray, const raycast_type type, const float max_t) const
+        {
+            const runtime_mesh & geometry = meshes.get(e)->geom.get();
+            auto cached = meshCache.find(&geometry);
+            if (cached == meshCache.end()) return {};
+
+            const transform meshPose = xform_system->get_world_transform(e)->world_pose;
+            const float3 meshScale = xform_system->get_local_transform(e)->local_scale;
+
+            ray localRay = meshPose.inverse() * world_ray;
+            localRay.origin /= meshScale;
+            localRay.direction /= meshScale;
+
+            if (type == raycast_type::mesh)
+            {
+                if (!cached->second.hasBvh) return {};
+                const mesh_bvh_hit hit = cached->second.bvh.intersect(localRay, max_t);
+                if (!hit.hit()) return {};
 
-                ray localRay = meshPose.inverse() * world_ray;
-                localRay.origin /= meshScale;
-                localRay.direction /= meshScale;
-                float outT = 0.0f;
                 float3 outNormal = { 0, 0, 0 };
                 float2 outUv = { -1, -1 };
-                const bool hit = intersect_ray_mesh(localRay, geometry, &outT, &outNormal, &outUv);
-                return { hit, outT, outNormal, outUv };
-            };
+                get_ray_mesh_hit_attributes(geometry, geometry.faces[hit.face], hit.uv, &outNormal, &outUv);
+                return { true, hit.t, outNormal, outUv };
+            }
+
+            const aabb_3d & mesh_bounds = cached->second.bounds;
+            float outMinT, outMaxT;
+            const bool hit = intersect_ray_box(localRay, mesh_bounds.min(), mesh_bounds.max(), &outMinT, &outMaxT);
+            return raycast_result(hit, outMaxT, {}, {});
+        }
 
-            auto raycast_box = [&](entity e) -> raycast_result
+        template<class F> friend void visit_components(entity e, collision_system * system, F f);
+        friend class asset_resolver;
+
+    public:
+
+        collision_system(entity_orchestrator * orch) : base_system(orch)
+        {
+            register_system_for_type(this, get_typeid<geometry_component>());
+            declare_read<geometry_component>();
+            declare_read<world_transform_component>();
+            declare_read<local_transform_component>();
+        }
+
+        // Brings the broadphase up to date with the transform system. Queries call this themselves; it is also
+        // run from tick() so that the refit cost lands in the system update rather than the first query of a frame.
+        void update_broadphase()
+        {
+            get_xform_system();
+
+            const uint64_t revision = xform_system->get_revision();
+            moved.clear();
+
+            // Everything is rescanned after an invalidation, or if the transform system no longer remembers 
+            // what moved since the last update
+            if (broadphaseDirty || (revision != broadphaseRevision && !xform_system->get_moved_since(broadphaseRevision, moved)))
             {
-                if (!xform_system->has_transform(e)) return {};
-                const runtime_mesh & geometry = meshes[e].geom.get();
-                if (geometry.vertices.empty()) return {};
+                unbounded.clear();
+                for (const entity e : meshes.entities())
+                {
+                    if (e == kInvalidEntity) continue;
+                    if (!update_proxy(e, broadphaseDirty)) unbounded.push_back(e);
+                }
+            }
+            else
+            {
+                for (const entity e : moved)
+                {
+                    if (!meshes.contains(e)) continue;
+                    if (!update_proxy(e, false) && std::find(unbounded.begin(), unbounded.end(), e) == unbounded.end()) unbounded.push_back(e);
+                }
+                unbounded.erase(std::remove_if(unbounded.begin(), unbounded.end(), [this](const entity e) { return update_proxy(e, false); }), unbounded.end());
+            }
 
-                const transform meshPose = xform_system->get_world_transform(e)->world_pose; // store bounds?
-                const float3 meshScale = xform_system->get_local_transform(e)->local_scale;
+            broadphaseRevision = revision;
+            broadphaseDirty = false;
+        }
 
-                ray r = meshPose.inverse() * world_ray;
-                r.origin /= meshScale;
-                r.direction /= meshScale;
+        void tick(const double dt) override final { update_broadphase(); }
 
-                const aabb_3d mesh_bounds = compute_bounds(geometry);
-                float outMinT, outMaxT;
-                const bool hit = intersect_ray_box(r, mesh_bounds.min(), mesh_bounds.max(), &outMinT, &outMaxT);
-                return raycast_result(hit, outMaxT, {}, {});
-            };
+        entity_hit_result raycast(const ray & world_ray, const raycast_type type = raycast_type::mesh)
+        {
+            update_broadphase();
 
             float best_t = std::numeric_limits<float>::max();
             entity hit_entity = kInvalidEntity;
             raycast_result out_result;
 
-            // fixme - we really need an environment-wide spatial data structure for this
-            if (type == raycast_type::mesh)
+            // Local rays keep the world ray's parameterization, so hit distances compare directly against the 
+            // world-space leaf boxes. Every hit distance is at least the entry distance of its leaf, which makes
+            // clipping the traversal to the best hit safe for box hits (reported at the exit) as well.
+            broadphase.raycast(world_ray, best_t, [&](int32_t, entity e, float)
             {
-                for (const auto & mesh : meshes)
+                prepare_mesh(e, type);
+                const raycast_result res = raycast_entity(e, world_ray, type, best_t);
+                if (res.hit && res.distance < best_t)
                 {
-                    if (mesh.first == kInvalidEntity) continue;
-
-                    raycast_result res = raycast_mesh(mesh.first);
-                    if (res.hit)
-                    {
-                        if (res.distance < best_t)
-                        {
-                            best_t = res.distance;
-                            hit_entity = mesh.first;
-                            out_result = res;
-                        }
-                    }
+                    best_t = res.distance;
+                    hit_entity = e;
+                    out_result = res;
                 }
+                return best_t;
+            });
+
+            if (out_result.hit) { return { hit_entity, out_result }; }
+            else return { kInvalidEntity, raycast_result() };
+        }
+
+        // Writes the closest hit of rays[i] to results[i], or a miss with kInvalidEntity; `results` must hold
+        // rays.size() entries and nothing is allocated for them. Rays with similar origins and directions share
+        // one broadphase traversal per packet, and packets are spread across the workers of `pool` when one is
+        // given. Any mesh bvh that has not been built yet is built on the calling thread before the rays are cast.
+        void raycast_batch(const std::vector<ray> & rays, entity_hit_result * results, const raycast_type type = raycast_type::mesh, work_stealing_pool * pool = nullptr)
+        {
+            if (rays.empty()) return;
+            update_broadphase();
+
+            // After this, casting only reads cached state and can run on any thread
+            for (const auto & p : broadphaseProxies) prepare_mesh(p.first, type);
+
+            // Packets are formed from rays sorted by the cube face of their direction, then a Morton code that
+            // interleaves a 16^3 cell of their origin (within the bounds of all origins) with a 16x16 cell of their
+            // direction on that face. Rays that would walk the same part of the tree end up traversed together,
+            // whether they share an origin (one agent's line-of-sight checks) or a direction.
+            aabb_3d origin_bounds(rays[0].origin, rays[0].origin);
+            for (const ray & r : rays) origin_bounds = origin_bounds.add(aabb_3d(r.origin, r.origin));
+            const float3 origin_scale = 15.f / max(origin_bounds.size(), float3(1e-6f));
+
+            batchOrder.resize(rays.size());
+            for (size_t i = 0; i < rays.size(); ++i)
+            {
+                const float3 cell = (rays[i].origin - origin_bounds._min) * origin_scale;
+                const float3 d = rays[i].direction;
+                const float3 a = abs(d);
+                const int axis = (a.x >= a.y && a.x >= a.z) ? 0 : (a.y >= a.z ? 1 : 2);
+                const float major = a[axis] > 0.f ? a[axis] : 1.f;
+                const float u = d[(axis + 1) % 3] / major, v = d[(axis + 2) % 3] / major; // in [-1, 1] on the face
+                const uint64_t face = axis * 2 + (d[axis] < 0.f ? 1 : 0);
+
+                const uint64_t cells[5] = { uint64_t(cell.x), uint64_t(cell.y), uint64_t(cell.z),
+                    std::min<uint64_t>(15, uint64_t((u + 1.f) * 8.f)), std::min<uint64_t>(15, uint64_t((v + 1.f) * 8.f)) };
+                uint64_t key = face;
+                for (int bit = 3; bit >= 0; --bit) for (int c = 0; c < 5; ++c) key = key << 1 | ((cells[c] >> bit) & 1);
+                batchOrder[i] = key << 32 | uint64_t(i);
             }
-            else if (type == raycast_type::box)
+            std::sort(batchOrder.begin(), batchOrder.end());
+
+            const size_t packet_size = dynamic_aabb_tree<entity>::max_packet_size;
+            const size_t packet_count = (rays.size() + packet_size - 1) / packet_size;
+
+            auto cast_packet = [&](const size_t packet)
             {
-                for (const auto & mesh : meshes)
+                const size_t first = packet * packet_size;
+                const uint32_t count = static_cast<uint32_t>(std::min(packet_size, rays.size() - first));
+
+                ray packet_rays[packet_size];
+                uint32_t index[packet_size];
+                float best_t[packet_size];
+                for (uint32_t i = 0; i < count; ++i)
                 {
-                    if (mesh.first == kInvalidEntity) continue;
+                    index[i] = static_cast<uint32_t>(batchOrder[first + i]);
+                    packet_rays[i] = rays[index[i]];
+                    best_t[i] = std::numeric_limits<float>::max();
+                    results[index[i]] = { kInvalidEntity, raycast_result() };
+                }
 
-                    raycast_result res = raycast_box(mesh.first);
-                    if (res.hit)
+                broadphase.raycast_packet(packet_rays, count, best_t, [&](int32_t, entity e, const uint32_t i)
+                {
+                    const raycast_result res = raycast_entity(e, packet_rays[i], type, best_t[i]);
+                    if (res.hit && res.distance < best_t[i])
                     {
-                        if (res.distance < best_t)
-                        {
-                            best_t = res.distance;
-                            hit_entity = mesh.first;
-                            out_result = res;
-                        }
+                        best_t[i] = res.distance;
+                        results[index[i]] = { e, res };
                     }
+                });
+            };
+
+            if (pool) pool->parallel_for(0, packet_count, 4, cast_packet);
+            else for (size_t p = 0; p < packet_count; ++p) cast_packet(p);
+        }
+
+        // Appends every entity whose world-space bounds intersect the sphere
+        void overlap_sphere(const sphere & s, std::vector<entity> & out)
+        {
+            update_broadphase();
+            const aabb_3d query_box(s.center - float3(s.radius), s.center + float3(s.radius));
+            broadphase.query(query_box, [&](int32_t, entity e)
+            {
+                const aabb_3d & bounds = broadphaseProxies[e].bounds;
+                const float3 d = max(max(bounds._min - s.center, s.center - bounds._max), float3(0.f));
+                if (dot(d, d) <= s.radius * s.radius) out.push_back(e);
+            });
+        }
+
+        // Appends every entity whose world-space bounds intersect `box`
+        void overlap_box(const aabb_3d & box, std::vector<entity> & out)
+        {
+            update_broadphase();
+            broadphase.query(box, [&](int32_t, entity e)
+            {
+                const aabb_3d & bounds = broadphaseProxies[e].bounds;
+                if (bounds._max.x < box._min.x || bounds._min.x > box._max.x) return;
+                if (bounds._max.y < box._min.y || bounds._min.y > box._max.y) return;
+                if (bounds._max.z < box._min.z || bounds._min.z > box._max.z) return;
+                out.push_back(e);
+            });
+        }
+
+        // Appends up to `k` entities within `max_distance` of `point`, nearest first, measured to their world-space bounds
+        void nearest(const float3 & point, const uint32_t k, std::vector<entity> & out, const float max_distance = std::numeric_limits<float>::max())
+        {
+            if (k == 0) return;
+            update_broadphase();
+
+            // Max-heap on distance holding the best k so far
+            std::vector<std::pair<float, entity>> best;
+            broadphase.nearest(point, max_distance, [&](int32_t, entity e, float)
+            {
+                const aabb_3d & bounds = broadphaseProxies[e].bounds;
+                const float distance = length(max(max(bounds._min - point, point - bounds._max), float3(0.f)));
+                if (distance <= max_distance && (best.size() < k || distance < best.front().first))
+                {
+                    if (best.size() == k) { std::pop_heap(best.begin(), best.end()); best.pop_back(); }
+                    best.push_back({ distance, e });
+                    std::push_heap(best.begin(), best.end());
                 }
-            }
+                return (best.size() == k) ? best.front().first : max_distance;
+            });
 
-            if (out_result.hit) { return { hit_entity, out_result }; }
-            else return { kInvalidEntity, raycast_result() };
+            std::sort_heap(best.begin(), best.end());
+            for (auto & b : best) out.push_back(b.second);
+        }
+
+        // Drops the cached bounds and bvh of a mesh whose vertices or faces were modified in place, and refits
+        // every broadphase leaf on the next query
+        void invalidate_mesh(const runtime_mesh & mesh)
+        {
+            meshCache.erase(&mesh);
+            broadphaseDirty = true;
         }
 
         virtual bool create(entity e, poly_typeid hash, void * data) override final 
         { 
             if (hash != get_typeid<geometry_component>()) { return false; }
-            meshes[e] = *static_cast<geometry_component *>(data);
+            meshes.assign(e, *static_cast<geometry_component *>(data));
+            remove_proxy(e);
+            unbounded.push_back(e);
             return true;
         }
         
         bool create(entity e, geometry_component && c)
         {
-            meshes[e] = std::move(c);
+            meshes.assign(e, std::move(c));
+            remove_proxy(e);
+            unbounded.push_back(e);
             return true;
         }
 
         geometry_component * get_component(entity e)
         {
-            auto iter = meshes.find(e);
-            if (iter != meshes.end()) return &iter->second;
-            return nullptr;
+            return meshes.get(e);
         }
 
         virtual void destroy(entity e) override final 
         {
-            auto iter = meshes.find(e);
-            if (iter != meshes.end()) meshes.erase(e);
+            if (e == kAllEntities)
+            {
+                meshes.clear();
+                meshCache.clear();
+                broadphase.clear();
+                broadphaseProxies.clear();
+                unbounded.clear();
+            }
+            else
+            {
+                meshes.destroy(e);
+                remove_proxy(e);
+                unbounded.erase(std::remove(unbounded.begin(), unbounded.end(), e), unbounded.end());
+            }
         }
     };
     POLYMER_SETUP_TYPEID(collision_system);
 
     template<class F> void visit_components(entity e, collision_system * system, F f)
     {
-        auto iter = system->meshes.find(e);
-        if (iter != system->meshes.end()) f("geometry component", iter->second);
+        if (auto ptr = system->meshes.get(e)) f("geometry component", *ptr);
     }
 
 } // end namespace polymer
@@ -5,6 +5,7 @@
 
 #include "ecs/typeid.hpp"
 #include "ecs/core-ecs.hpp"
+#include "ecs/component-pool.hpp"
 #include "environment.hpp"
 
 ////////////////////////
@@ -16,7 +17,7 @@ namespace polymer
 
     class identifier_system final : public base_system
     {
-        std::unordered_map<entity, identifier_component> entity_to_name_;
+        polymer_component_pool<identifier_component> entity_to_name_{ 256 };
         std::unordered_map<entity, poly_hash_value> entity_to_hash_;
         std::unordered_map<poly_hash_value, entity> hash_to_entity_;
 
@@ -27,6 +28,7 @@ namespace polymer
         identifier_system(entity_orchestrator * orch) : base_system(orch)
         {
             register_system_for_type(this, get_typeid<identifier_component>());
+            declare_read<identifier_component>();
         }
 
         ~identifier_system() override {}
@@ -55,14 +57,14 @@ namespace polymer
                 hash_to_entity_.erase(iter->second);
                 entity_to_hash_.erase(iter);
             }
-            entity_to_name_.erase(entity);
+            entity_to_name_.destroy(entity);
         }
 
         // Finds the name associated with the entity. Returns empty string if no name is found.
         std::string get_name(entity entity) const
         {
-            const auto iter = entity_to_name_.find(entity);
-            return iter != entity_to_name_.end() ? iter->second.id : "";
+            const identifier_component * c = entity_to_name_.get(entity);
+            return c ? c->id : "";
         }
 
         bool set_name(entity entity, const std::string & name)
@@ -82,7 +84,7 @@ namespace polymer
             hash_to_entity_.erase(hash(existing_name.c_str()));
             hash_to_entity_[h] = entity;
 
-            entity_to_name_[entity] = identifier_component(entity, name);
+            entity_to_name_.assign(entity, identifier_component(entity, name));
             entity_to_hash_[entity] = h;
 
             return true;
@@ -103,8 +105,7 @@ namespace polymer
 
     template<class F> void visit_components(entity e, identifier_system * system, F f)
     {
-        auto iter = system->entity_to_name_.find(e);
-        if (iter != system->entity_to_name_.end()) f("identifier component", iter->second);
+        if (auto ptr = system->entity_to_name_.get(e)) f("identifier component", *ptr);
     }
 
 } // end namespace polymer
@@ -8,6 +8,7 @@
 
 #include "ecs/typeid.hpp"
 #include "ecs/core-ecs.hpp"
+#include "ecs/component-pool.hpp"
 #include "system-transform.hpp"
 #include "system-identifier.hpp"
 #include "environment.hpp"
@@ -22,10 +23,11 @@ namespace polymer
 
     class render_system final : public base_system
     {
-        std::unordered_map<entity, mesh_component> meshes;
-        std::unordered_map<entity, material_component> materials;
-        std::unordered_map<entity, point_light_component> point_lights;
-        std::unordered_map<entity, directional_light_component> directional_lights;
+        polymer_component_pool<mesh_component> meshes{ 256 };
+        polymer_component_pool<material_component> materials{ 256 };
+        polymer_component_pool<point_light_component> point_lights{ 16 };
+        polymer_component_pool<spot_light_component> spot_lights{ 16 };
+        polymer_component_pool<directional_light_component> directional_lights{ 4 };
 
         renderer_settings settings;
         std::unique_ptr<pbr_renderer> renderer;
@@ -33,6 +35,26 @@ namespace polymer
         std::unique_ptr<polymer::gl_procedural_sky> skybox;
         entity sunlight;
 
+        // Renderables and lights gathered by the most recent tick()
+        std::vector<render_component> frame_renderables;
+        std::vector<point_light_component *> frame_point_lights;
+        std::vector<spot_light_component *> frame_spot_lights;
+
+        // Bounding volume hierarchy over renderable entities. Leaves persist across frames and are only
+        // reinserted when an entity leaves its fattened bounds; entities that stop being submitted are 
+        // swept out at the end of update_visibility().
+        struct visibility_proxy { int32_t proxy; uint64_t frame; };
+        render_visibility frame_visibility;
+        std::unordered_map<entity, visibility_proxy> visibility_proxies;
+        uint64_t visibility_frame{ 0 };
+
+        // Per-frame SoA scratch for the bounded renderables, so world bounds are computed with batch kernels
+        std::vector<uint32_t> visibility_indices;
+        float4_array visibility_rotation;
+        float3_array visibility_position, visibility_scale, visibility_local_min, visibility_local_max;
+        float3_array visibility_world_min, visibility_world_max;
+        float3x4_array visibility_models;
+
         friend class asset_resolver; // for private access to the components
 
     public:
@@ -44,8 +66,16 @@ namespace polymer
             register_system_for_type(this, get_typeid<mesh_component>());
             register_system_for_type(this, get_typeid<material_component>());
             register_system_for_type(this, get_typeid<point_light_component>());
+            register_system_for_type(this, get_typeid<spot_light_component>());
             register_system_for_type(this, get_typeid<directional_light_component>());
 
+            declare_read<mesh_component>();
+            declare_read<material_component>();
+            declare_read<point_light_component>();
+            declare_read<spot_light_component>();
+            declare_read<world_transform_component>();
+            declare_read<local_transform_component>();
+
             skybox.reset(new gl_hosek_sky());
             renderer.reset(new pbr_renderer(settings));
 
@@ -54,6 +84,7 @@ namespace polymer
 
             transform_system * transform_sys = dynamic_cast<transform_system *>(orchestrator->get_system(get_typeid<transform_system>()));
             identifier_system * identifier_sys = dynamic_cast<identifier_system *>(orchestrator->get_system(get_typeid<identifier_system>()));
+            xform_system = transform_sys;
 
             transform_sys->create(sunlight, transform(), {});
             identifier_sys->create(sunlight, "implict skybox");
@@ -82,63 +113,180 @@ namespace polymer
             renderer.reset(new pbr_renderer(settings));
         }
 
-        mesh_component * get_mesh_component(entity e)
+        mesh_component * get_mesh_component(entity e) { return meshes.get(e); }
+        material_component * get_material_component(entity e) { return materials.get(e); }
+        point_light_component * get_point_light_component(entity e) { return point_lights.get(e); }
+        spot_light_component * get_spot_light_component(entity e) { return spot_lights.get(e); }
+        directional_light_component * get_directional_light_component(entity e) { return directional_lights.get(e); }
+
+        // Walks the packed material pool and appends a render_component for every entity that also
+        // has a mesh and a transform. Pointers in the output are valid until components are next created or destroyed. 
+        void gather_renderables(std::vector<render_component> & out)
+        {
+            const std::vector<entity> & owners = materials.entities();
+            material_component * material_data = materials.data();
+
+            for (size_t i = 0; i < owners.size(); ++i)
+            {
+                const entity e = owners[i];
+
+                mesh_component * mesh_c = meshes.get(e);
+                if (!mesh_c) continue; // for the case that we just created a material component and haven't set a mesh yet
+
+                const world_transform_component * world_c = xform_system->get_world_transform(e);
+                const local_transform_component * local_c = xform_system->get_local_transform(e);
+                if (!world_c || !local_c) continue;
+
+                render_component r(e);
+                r.material = &material_data[i];
+                r.mesh = mesh_c;
+                r.world_transform = world_c;
+                r.local_transform = local_c;
+                out.push_back(r);
+            }
+        }
+
+        // Refits the visibility tree to the world-space bounds of `renderables` and points each leaf at its
+        // index in that list, so the result must be submitted alongside the same vector as render_payload::visibility.
+        const render_visibility * update_visibility(const std::vector<render_component> & renderables)
         {
-            auto iter = meshes.find(e);
-            if (iter != meshes.end()) return &iter->second;
-            return nullptr;
+            ++visibility_frame;
+            frame_visibility.unbounded.clear();
+            visibility_indices.clear();
+
+            const size_t capacity = renderables.size();
+            visibility_rotation.resize(capacity);
+            visibility_position.resize(capacity);
+            visibility_scale.resize(capacity);
+            visibility_local_min.resize(capacity);
+            visibility_local_max.resize(capacity);
+
+            for (uint32_t i = 0; i < static_cast<uint32_t>(renderables.size()); ++i)
+            {
+                const render_component & r = renderables[i];
+
+                float3 bmin, bmax;
+                if (!r.mesh->mesh.get().get_bounds(bmin, bmax))
+                {
+                    frame_visibility.unbounded.push_back(i);
+                    continue;
+                }
+
+                const size_t n = visibility_indices.size();
+                visibility_rotation.set(n, r.world_transform->world_pose.orientation);
+                visibility_position.set(n, r.world_transform->world_pose.position);
+                visibility_scale.set(n, r.local_transform->local_scale);
+                visibility_local_min.set(n, bmin);
+                visibility_local_max.set(n, bmax);
+                visibility_indices.push_back(i);
+            }
+
+            const size_t bounded = visibility_indices.size();
+            visibility_rotation.resize(bounded);
+            visibility_position.resize(bounded);
+            visibility_scale.resize(bounded);
+            visibility_local_min.resize(bounded);
+            visibility_local_max.resize(bounded);
+            batch_make_matrices(visibility_rotation, visibility_position, visibility_scale, visibility_models);
+            batch_transform_bounds(visibility_models, visibility_local_min, visibility_local_max, visibility_world_min, visibility_world_max);
+
+            for (size_t k = 0; k < bounded; ++k)
+            {
+                const uint32_t i = visibility_indices[k];
+                const render_component & r = renderables[i];
+                const aabb_3d world_bounds(visibility_world_min.get(k), visibility_world_max.get(k));
+
+                auto it = visibility_proxies.find(r.get_entity());
+                if (it == visibility_proxies.end())
+                {
+                    const int32_t proxy = frame_visibility.tree.insert(world_bounds, i);
+                    visibility_proxies[r.get_entity()] = { proxy, visibility_frame };
+                }
+                else
+                {
+                    frame_visibility.tree.update(it->second.proxy, world_bounds);
+                    frame_visibility.tree.get_data(it->second.proxy) = i;
+                    it->second.frame = visibility_frame;
+                }
+            }
+
+            for (auto it = visibility_proxies.begin(); it != visibility_proxies.end();)
+            {
+                if (it->second.frame != visibility_frame)
+                {
+                    frame_visibility.tree.remove(it->second.proxy);
+                    it = visibility_proxies.erase(it);
+                }
+                else ++it;
+            }
+
+            return &frame_visibility;
         }
 
-        material_component * get_material_component(entity e)
+        // Appends every point light in the packed pool
+        void gather_point_lights(std::vector<point_light_component *> & out)
         {
-            auto iter = materials.find(e);
-            if (iter != materials.end()) return &iter->second;
-            return nullptr;
+            point_lights.for_each([&out](point_light_component & c) { out.push_back(&c); });
         }
 
-        point_light_component * get_point_light_component(entity e)
+        // Appends every spot light in the packed pool
+        void gather_spot_lights(std::vector<spot_light_component *> & out)
         {
-            auto iter = point_lights.find(e);
-            if (iter != point_lights.end()) return &iter->second;
-            return nullptr;
+            spot_lights.for_each([&out](spot_light_component & c) { out.push_back(&c); });
         }
 
-        directional_light_component * get_directional_light_component(entity e)
+        // Gathers this frame's renderables and lights so the caller can submit them from the main thread
+        void tick(const double dt) override final
         {
-            auto iter = directional_lights.find(e);
-            if (iter != directional_lights.end()) return &iter->second;
-            return nullptr;
+            frame_renderables.clear();
+            frame_point_lights.clear();
+            frame_spot_lights.clear();
+            gather_renderables(frame_renderables);
+            gather_point_lights(frame_point_lights);
+            gather_spot_lights(frame_spot_lights);
+            update_visibility(frame_renderables);
         }
 
+        const std::vector<render_component> & get_frame_renderables() const { return frame_renderables; }
+        const std::vector<point_light_component *> & get_frame_point_lights() const { return frame_point_lights; }
+        const std::vector<spot_light_component *> & get_frame_spot_lights() const { return frame_spot_lights; }
+        const render_visibility * get_frame_visibility() const { return &frame_visibility; }
+
         virtual bool create(entity e, poly_typeid hash, void * data) override final 
         { 
             if (hash == get_typeid<mesh_component>()) 
             {
-                meshes[e] = *static_cast<mesh_component *>(data);
+                meshes.assign(e, *static_cast<mesh_component *>(data));
                 return true;
             }
             else if (hash == get_typeid<material_component>()) 
             { 
-                materials[e] = *static_cast<material_component *>(data); 
+                materials.assign(e, *static_cast<material_component *>(data));
                 return true;
             }
             else if (hash == get_typeid<point_light_component>()) 
             { 
-                point_lights[e] = *static_cast<point_light_component *>(data); 
+                point_lights.assign(e, *static_cast<point_light_component *>(data));
+                return true;
+            }
+            else if (hash == get_typeid<spot_light_component>()) 
+            { 
+                spot_lights.assign(e, *static_cast<spot_light_component *>(data));
                 return true;
             }
             else if (hash == get_typeid<directional_light_component>()) 
             { 
-                directional_lights[e] = *static_cast<directional_light_component *>(data); 
+                directional_lights.assign(e, *static_cast<directional_light_component *>(data));
                 return true; 
             }
             return false;
         }
 
-        mesh_component * create(entity e, mesh_component && c) { meshes[e] = std::move(c); return &meshes[e]; }
-        material_component * create(entity e, material_component && c) { materials[e] = std::move(c); return &materials[e]; }
-        point_light_component * create(entity e, point_light_component && c) { point_lights[e] = std::move(c); return &point_lights[e]; }
-        directional_light_component * create(entity e, directional_light_component && c) { directional_lights[e] = std::move(c); return &directional_lights[e]; }
+        mesh_component * create(entity e, mesh_component && c) { return meshes.assign(e, std::move(c)); }
+        material_component * create(entity e, material_component && c) { return materials.assign(e, std::move(c)); }
+        point_light_component * create(entity e, point_light_component && c) { return point_lights.assign(e, std::move(c)); }
+        spot_light_component * create(entity e, spot_light_component && c) { return spot_lights.assign(e, std::move(c)); }
+        directional_light_component * create(entity e, directional_light_component && c) { return directional_lights.assign(e, std::move(c)); }
 
         virtual void destroy(entity e) override final 
         {
@@ -147,21 +295,19 @@ namespace polymer
                 meshes.clear();
                 materials.clear();
                 point_lights.clear();
+                spot_lights.clear();
                 directional_lights.clear();
+                frame_visibility.tree.clear();
+                frame_visibility.unbounded.clear();
+                visibility_proxies.clear();
                 return;
             }
 
-            auto meshIter = meshes.find(e);
-            if (meshIter != meshes.end()) meshes.erase(meshIter);
-
-            auto matIter = materials.find(e);
-            if (matIter != materials.end()) materials.erase(matIter);
-
-            auto ptLightIter = point_lights.find(e);
-            if (ptLightIter != point_lights.end()) point_lights.erase(ptLightIter);
-
-            auto dirLightIter = directional_lights.find(e);
-            if (dirLightIter != directional_lights.end()) directional_lights.erase(dirLightIter);
+            meshes.destroy(e);
+            materials.destroy(e);
+            point_lights.destroy(e);
+            spot_lights.destroy(e);
+            directional_lights.destroy(e);
         }
     };
     POLYMER_SETUP_TYPEID(render_system);
@@ -178,6 +324,13 @@ namespace polymer
             ptr->data.position = pt_light_xform->world_pose.position;
             f("point light component", *ptr);
         }
+        if (auto ptr = system->get_spot_light_component(e))
+        {
+            transform_system * transform_sys = dynamic_cast<transform_system *>(system->orchestrator->get_system(get_typeid<transform_system>()));
+            auto spot_light_xform = transform_sys->get_world_transform(e);
+            ptr->data.position = spot_light_xform->world_pose.position;
+            f("spot light component", *ptr);
+        }
         if (auto ptr = system->get_directional_light_component(e)) f("directional light component", *ptr);
     }
 
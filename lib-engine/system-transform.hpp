@@ -6,6 +6,7 @@
 #include "ecs/typeid.hpp"
 #include "ecs/core-ecs.hpp"
 #include "ecs/component-pool.hpp"
+#include "thread-pool.hpp"
 #include "serialization.hpp"
 #include "environment.hpp"
 
@@ -17,31 +18,95 @@ namespace polymer
 
     class transform_system final : public base_system
     {
-        void recalculate_world_transform(entity child)
+        // When enabled, setters only record the edited node and world poses are 
+        // recomputed in a single batched pass by update().
+        bool deferred{ false };
+        std::vector<entity> dirty_nodes;
+
+        // A dirty node paired with its depth in the hierarchy (roots are depth 0)
+        struct dirty_root { entity e; uint32_t depth; };
+
+        // Bumped by every pass that recomputes world poses, and stamped onto the world transforms it touches
+        uint64_t world_revision{ 0 };
+
+        // Entities recomputed or destroyed by each pass, in revision order. Once it outgrows the number of world
+        // transforms the oldest half is dropped; history at or before |moved_log_floor| is no longer complete.
+        struct moved_entry { uint64_t revision; entity e; };
+        std::vector<moved_entry> moved_log;
+        uint64_t moved_log_floor{ 0 };
+
+        void log_moved(const std::vector<entity> & moved, const uint64_t revision)
         {
-            auto node = scene_graph_transforms.get(child);
-            auto world_xform = world_transforms.get(child);
+            for (const entity e : moved) moved_log.push_back({ revision, e });
 
+            if (moved_log.size() > 2 * world_transforms.size() + 1024)
+            {
+                const uint64_t cut = moved_log[moved_log.size() / 2].revision;
+                moved_log.erase(moved_log.begin(), std::lower_bound(moved_log.begin(), moved_log.end(), cut, 
+                    [](const moved_entry & m, const uint64_t r) { return m.revision < r; }));
+                moved_log_floor = cut - 1;
+            }
+        }
+
+        transform compute_world_pose(const local_transform_component & node, const transform & current_world_pose) const
+        {
             // If the node has a parent then we can compute a new world transform.
             // Note that during deserialization we might not have created the parent yet
             // so we are allowed to no-op given a null parent node
-            if (node->parent != kInvalidEntity)
+            if (node.parent != kInvalidEntity)
             {
-                auto parent_node = scene_graph_transforms.get(node->parent);
+                if (auto parent_world = world_transforms.get(node.parent)) return parent_world->world_pose * node.local_pose;
+                return current_world_pose;
+            }
 
-                if (parent_node)
+            // If the node has no parent, it should be considered already in world space.
+            return node.local_pose;
+        }
+
+        // Recomputes world poses breadth-first. |roots| must be disjoint subtrees sorted by depth; each 
+        // root joins the frontier at its own depth so every level is processed as one flat array. Every 
+        // entity whose world transform was recomputed is appended to |moved|.
+        void propagate(const dirty_root * roots, const size_t count, const uint64_t revision, std::vector<entity> & moved)
+        {
+            std::vector<entity> level, next_level;
+            size_t next_root = 0;
+            uint32_t depth = (count > 0) ? roots[0].depth : 0;
+
+            while (next_root < count || !level.empty())
+            {
+                while (next_root < count && roots[next_root].depth == depth) level.push_back(roots[next_root++].e);
+
+                next_level.clear();
+                for (const entity e : level)
                 {
-                    world_xform->world_pose = parent_node->local_pose * node->local_pose;
+                    const local_transform_component * node = scene_graph_transforms.get(e);
+                    world_transform_component * world = world_transforms.get(e);
+                    if (!node || !world) continue;
+
+                    world->world_pose = compute_world_pose(*node, world->world_pose);
+                    world->revision = revision;
+                    moved.push_back(e);
+                    next_level.insert(next_level.end(), node->children.begin(), node->children.end());
                 }
+
+                std::swap(level, next_level);
+                ++depth;
             }
-            else
-            {
-                // If the node has no parent, it should be considered already in world space.
-                world_xform->world_pose = node->local_pose;
-            }
+        }
 
-            // For each child, calculate its new world transform
-            for (auto c : node->children) recalculate_world_transform(c);
+        void recalculate_world_transform(entity child)
+        {
+            const dirty_root root = { child, 0 };
+            const uint64_t revision = ++world_revision;
+            std::vector<entity> moved;
+            propagate(&root, 1, revision, moved);
+            log_moved(moved, revision);
+        }
+
+        void mark_dirty(entity e)
+        {
+            if (deferred) dirty_nodes.push_back(e);
+            else recalculate_world_transform(e);
         }
 
         void destroy_recursive(entity child)
@@ -54,6 +119,7 @@ namespace polymer
 
             // Erase world transform
             world_transforms.destroy(child);
+            log_moved({ child }, ++world_revision);
 
             // Erase itself after all children are gone
             scene_graph_transforms.destroy(child);
@@ -89,8 +155,13 @@ namespace polymer
         transform_system(entity_orchestrator * f) : base_system(f)
         {
             register_system_for_type(this, get_typeid<local_transform_component>());
+            declare_read<local_transform_component>();
+            declare_write<world_transform_component>();
         }
 
+        // Flushes edits recorded in deferred mode
+        void tick(const double dt) override final { update(); }
+
         ~transform_system() override { }
 
         bool create(entity e, poly_typeid hash, void * data) override final 
@@ -116,7 +187,7 @@ namespace polymer
                 node->local_scale = local_scale;
                 node->children = children;
                 node->parent = parent;
-                recalculate_world_transform(e);
+                mark_dirty(e);
                 return true;
             }
             return false;
@@ -137,7 +208,7 @@ namespace polymer
 
             scene_graph_transforms.get(parent)->children.push_back(child);
             scene_graph_transforms.get(child)->parent = parent;
-            recalculate_world_transform(parent);
+            mark_dirty(child);
             return true;
         }
 
@@ -163,7 +234,7 @@ namespace polymer
             if (auto * node = scene_graph_transforms.get(e))
             {
                 node->local_pose = new_transform;
-                recalculate_world_transform(e);
+                mark_dirty(e);
                 return true;
             }
             return false;
@@ -204,7 +275,7 @@ namespace polymer
                 auto parent_node = scene_graph_transforms.get(child_node->parent);
                 parent_node->children.erase(std::remove(parent_node->children.begin(), parent_node->children.end(), child), parent_node->children.end());
                 child_node->parent = kInvalidEntity;
-                recalculate_world_transform(child);
+                mark_dirty(child);
             }
         }
 
@@ -217,11 +288,90 @@ namespace polymer
 
         void refresh()
         {
-           scene_graph_transforms.for_each([&](local_transform_component & t) 
-           { 
-               const auto entity = t.get_entity();
-               if (entity != kInvalidEntity) recalculate_world_transform(entity);
-           });
+            // Every parentless node is a root, so seeding them all covers the full hierarchy once
+            scene_graph_transforms.for_each([&](local_transform_component & t) 
+            { 
+                const auto entity = t.get_entity();
+                if (entity != kInvalidEntity && t.parent == kInvalidEntity) dirty_nodes.push_back(entity);
+            });
+            update();
+        }
+
+        // Switches between immediate propagation (the default, where every setter recomputes the edited 
+        // subtree before returning) and deferred propagation, where world transforms are stale until update().
+        void set_deferred(const bool enabled)
+        {
+            deferred = enabled;
+            if (!deferred) update();
+        }
+
+        bool is_deferred() const { return deferred; }
+
+        // Changes whenever a world transform is recomputed or destroyed. Systems that cache world-space 
+        // state compare this against the value they last saw, then ask get_moved_since() for what moved.
+        uint64_t get_revision() const { return world_revision; }
+
+        // Appends every entity whose world transform was recomputed or destroyed after revision |since|, possibly 
+        // more than once. Returns false, appending nothing, if that history has been dropped; the caller should 
+        // then rescan everything it tracks.
+        bool get_moved_since(const uint64_t since, std::vector<entity> & out) const
+        {
+            if (since < moved_log_floor) return false;
+            auto first = std::upper_bound(moved_log.begin(), moved_log.end(), since, 
+                [](const uint64_t r, const moved_entry & m) { return r < m.revision; });
+            for (; first != moved_log.end(); ++first) out.push_back(first->e);
+            return true;
+        }
+
+        // Recomputes the world transform of every subtree edited since the last update. Dirty nodes 
+        // with a dirty ancestor are dropped, the remainder are sorted by depth, and each level of 
+        // the hierarchy is walked as a flat array. If a thread pool is provided, the disjoint 
+        // subtrees are split evenly across its workers.
+        void update(work_stealing_pool * pool = nullptr)
+        {
+            if (dirty_nodes.empty()) return;
+
+            std::sort(dirty_nodes.begin(), dirty_nodes.end());
+            dirty_nodes.erase(std::unique(dirty_nodes.begin(), dirty_nodes.end()), dirty_nodes.end());
+
+            std::vector<dirty_root> roots;
+            roots.reserve(dirty_nodes.size());
+
+            for (const entity e : dirty_nodes)
+            {
+                if (!scene_graph_transforms.contains(e)) continue; // destroyed since it was marked
+
+                uint32_t depth = 0;
+                bool covered_by_ancestor = false;
+                for (entity p = get_parent(e); p != kInvalidEntity; p = get_parent(p))
+                {
+                    if (std::binary_search(dirty_nodes.begin(), dirty_nodes.end(), p)) covered_by_ancestor = true;
+                    ++depth;
+                }
+                if (!covered_by_ancestor) roots.push_back({ e, depth });
+            }
+            dirty_nodes.clear();
+
+            std::stable_sort(roots.begin(), roots.end(), [](const dirty_root & a, const dirty_root & b) { return a.depth < b.depth; });
+
+            const size_t num_workers = pool ? std::min(pool->size(), roots.size()) : 1;
+            const uint64_t revision = ++world_revision;
+
+            if (num_workers <= 1)
+            {
+                std::vector<entity> moved;
+                propagate(roots.data(), roots.size(), revision, moved);
+                log_moved(moved, revision);
+                return;
+            }
+
+            // Round-robin keeps each worker's slice sorted by depth and spreads shallow roots evenly
+            std::vector<std::vector<dirty_root>> slices(num_workers);
+            for (size_t i = 0; i < roots.size(); ++i) slices[i % num_workers].push_back(roots[i]);
+
+            std::vector<std::vector<entity>> moved(num_workers);
+            pool->parallel_for(0, slices.size(), 1, [this, &slices, &moved, revision](const size_t i) { propagate(slices[i].data(), slices[i].size(), revision, moved[i]); });
+            for (const auto & m : moved) log_moved(m, revision);
         }
     };
 
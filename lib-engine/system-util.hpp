@@ -19,6 +19,7 @@ namespace polymer
         f(get_typename<material_component>(), get_typeid<material_component>());
         f(get_typename<geometry_component>(), get_typeid<geometry_component>());
         f(get_typename<point_light_component>(), get_typeid<point_light_component>());
+        f(get_typename<spot_light_component>(), get_typeid<spot_light_component>());
         f(get_typename<directional_light_component>(), get_typeid<directional_light_component>());
         f(get_typename<local_transform_component>(), get_typeid<local_transform_component>());
     }
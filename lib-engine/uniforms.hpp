@@ -10,8 +10,14 @@ using namespace polymer;
 
 namespace uniforms
 {
-    static const int MAX_POINT_LIGHTS = 4;
-    static const int NUM_CASCADES = 2;
+    static const int MAX_CASCADES = 4; // stable_cascaded_shadows::cascadeCount may be anything up to this
+
+    // Clustered light culling divides each view frustum into a grid of cells ("froxels"): screen
+    // tiles in x/y and exponentially spaced slices in depth. Mirrored in renderer_common.glsl.
+    static const int CLUSTER_GRID_X = 16;
+    static const int CLUSTER_GRID_Y = 9;
+    static const int CLUSTER_GRID_Z = 24;
+    static const int NUM_CLUSTERS = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
 
     struct point_light
     {
@@ -32,24 +38,24 @@ namespace uniforms
         ALIGNED(16) float3    color;
         ALIGNED(16) float3    direction;
         ALIGNED(16) float3    position;
-        ALIGNED(16) float3    attenuation; // constant, linear, quadratic
-        float                 cutoff;
+        ALIGNED(16) float3    attenuation{ 1.f, 0.f, 1.f }; // constant, linear, quadratic
+        float                 cutoff{ 0.9f }; // cosine of the cone half-angle
     };
 
     struct per_scene
     {
         static const int      binding = 0;
         directional_light     directional_light;
-        point_light           point_lights[MAX_POINT_LIGHTS];
         float                 time;
-        int                   activePointLights;
+        int                   activeLights;
         int                   sunlightActive;
+        int                   cascadeCount;
         ALIGNED(8)  float2    resolution;
         ALIGNED(8)  float2    invResolution;
-        ALIGNED(16) float4    cascadesPlane[NUM_CASCADES];
-        ALIGNED(16) float4x4  cascadesMatrix[NUM_CASCADES];
-        float                 cascadesNear[NUM_CASCADES];
-        float                 cascadesFar[NUM_CASCADES];
+        ALIGNED(16) float4    cascadesPlane[MAX_CASCADES];
+        ALIGNED(16) float4x4  cascadesMatrix[MAX_CASCADES];
+        float                 cascadesNear[MAX_CASCADES];
+        float                 cascadesFar[MAX_CASCADES];
     };
 
     struct per_view
@@ -58,6 +64,14 @@ namespace uniforms
         ALIGNED(16) float4x4  view;
         ALIGNED(16) float4x4  viewProj;
         ALIGNED(16) float4    eyePos;
+        ALIGNED(16) float4    clusterDepth; // x: scale, y: bias mapping log(view depth) to a cluster slice
+    };
+
+    // Single-pass stereo binds both eyes' view data in place of per_view (SINGLE_PASS_STEREO in renderer_common.glsl)
+    struct per_view_stereo
+    {
+        static const int      binding = 1;
+        per_view              views[2];
     };
 
     struct per_object
@@ -69,6 +83,78 @@ namespace uniforms
         ALIGNED(16) float     receiveShadow;
     };
 
+    // std430 element of the per-object storage buffer used by gpu-driven submission. The
+    // modelview matrix is rebuilt in the vertex shader from u_viewMatrix.
+    struct per_object_gpu
+    {
+        static const int      binding = 3;
+        ALIGNED(16) float4x4  modelMatrix;
+        ALIGNED(16) float4x4  modelMatrixIT;
+        ALIGNED(16) float4    boundingSphere; // world-space center (xyz) and radius (w)
+        ALIGNED(16) float4    params;         // x: receive shadow, y: index into the material buffer (bindless only)
+    };
+
+    enum material_texture_slot : int 
+    { 
+        material_texture_albedo = 0, material_texture_normal, material_texture_roughness, 
+        material_texture_metallic, material_texture_emissive, material_texture_occlusion, 
+        material_texture_count 
+    };
+
+    // std430 element of the material storage buffer read by the BINDLESS_MATERIALS variant of the pbr 
+    // material. Textures are GL_ARB_bindless_texture handles; a zero handle is an unassigned slot.
+    struct material_gpu
+    {
+        static const int      binding = 9;
+        ALIGNED(16) float4    albedoOpacity;  // base albedo (xyz), opacity (w)
+        ALIGNED(16) float4    emissive;       // base emissive (xyz), emissive strength (w)
+        ALIGNED(16) float4    surface;        // roughness, metallic, specular level, occlusion strength
+        ALIGNED(16) float4    lighting;       // ambient strength, shadow opacity, texcoord scale (zw)
+        uint64_t              textures[8];    // indexed by material_texture_slot
+    };
+
+    enum light_type : int { light_type_point = 0, light_type_spot = 1 };
+
+    // std430 element of the light storage buffer. Point and spot lights share one array so that each 
+    // cluster references its lights with a single list of indices.
+    struct light_gpu
+    {
+        static const int      binding = 5;
+        ALIGNED(16) float4    positionRange;  // world-space position (xyz), distance beyond which the light has no effect (w)
+        ALIGNED(16) float4    colorType;      // color (xyz), light_type (w)
+        ALIGNED(16) float4    directionAngle; // spot: direction (xyz), cosine of the cone half-angle (w)
+        ALIGNED(16) float4    attenuation;    // point: radius (x); spot: constant, linear, quadratic (xyz)
+    };
+
+    // std430 element of the cluster storage buffer: a range of the cluster light index buffer
+    struct cluster_range
+    {
+        static const int      binding = 6;
+        uint32_t              offset;
+        uint32_t              count;
+    };
+
+    static const int CLUSTER_LIGHT_INDEX_BINDING = 7;
+
+    // std430 element of the shadow caster buffer. Casters drawn into a cascade are grouped by mesh and 
+    // each group is one instanced draw that indexes this array from a base instance.
+    struct shadow_instance
+    {
+        static const int      binding = 8;
+        ALIGNED(16) float4x4  modelMatrix;
+    };
+
+    // Matches the layout consumed by glMultiDrawElementsIndirect
+    struct draw_elements_indirect_command
+    {
+        static const int      binding = 4;
+        uint32_t              count;
+        uint32_t              instanceCount;
+        uint32_t              firstIndex;
+        int32_t               baseVertex;
+        uint32_t              baseInstance;
+    };
+
 }
 
 #endif // end polymer_scene_uniforms
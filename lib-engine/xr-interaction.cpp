@@ -141,7 +141,7 @@ xr_controller_system::xr_controller_system(entity_orchestrator * orch, environme
     env->identifier_system->create(pointer, "vr-pointer");
     env->xform_system->create(pointer, transform(float3(0, 0, 0)), { 1.f, 1.f, 1.f });
     env->render_system->create(pointer, material_component(pointer, material_handle("laser-pointer-mat")));
-    pointer_mesh_component = env->render_system->create(pointer, polymer::mesh_component(pointer, gpu_mesh_handle("vr-pointer")));
+    env->render_system->create(pointer, polymer::mesh_component(pointer, gpu_mesh_handle("vr-pointer")));
 
     // Setup left controller
     left_controller = env->track_entity(orch->create_entity());
@@ -231,7 +231,7 @@ void xr_controller_system::handle_event(const xr_input_event & event)
 
 void xr::xr_controller_system::update_laser_geometry(const float distance)
 {
-    auto & m = pointer_mesh_component->mesh.get();
+    auto & m = env->render_system->get_mesh_component(pointer)->mesh.get(); // pooled components may move; don't cache the pointer
     m = make_mesh_from_geometry(make_plane(laser_line_thickness, distance, 4, 24, true), GL_STREAM_DRAW);
 
     if (auto * tc = env->xform_system->get_local_transform(pointer))
@@ -308,7 +308,7 @@ void xr_controller_system::process(const float dt)
                 laser_alpha_on_teleport = laser_alpha;
                 if (laser_alpha_on_teleport < 1.f) laser_alpha = 1.0;
 
-                auto & m = pointer_mesh_component->mesh.get();
+                auto & m = env->render_system->get_mesh_component(pointer)->mesh.get(); // pooled components may move; don't cache the pointer
                 m = make_mesh_from_geometry(make_parabolic_geometry(arc_curve, arc_pointer.forward, 0.1f, float3(laser_line_thickness)), GL_STREAM_DRAW);
                 target_location = arc_curve.back(); // world-space hit point
                 if (auto * tc = env->xform_system->get_local_transform(pointer))
@@ -70,8 +70,8 @@ namespace xr {
 
     /// The input processor polls the openvr system directly for updated controller input.
     /// This system dispatches `vr_input_events` through the environment's event manager
-    /// with respect to button presses, releases, and focus events. Entity focus is presently 
-    /// expensive because there is no scene-wide acceleration structure used for raycasting. 
+    /// with respect to button presses, releases, and focus events. Entity focus is found with
+    /// raycasts against the collision system's broadphase, refined by the per-mesh bvh.
     /// This class is also an abstraction over all input handling in `openvr_hmd` and should
     /// be used instead of an `openvr_hmd` instance directly.
 
@@ -121,7 +121,6 @@ namespace xr {
 
         std::shared_ptr<polymer_fx_material> laser_pointer_material;
         simple_animator animator;
-        mesh_component * pointer_mesh_component{ nullptr };
         entity pointer, left_controller, right_controller;
         arc_pointer_data arc_pointer;
         std::vector<float3> arc_curve;
@@ -10,6 +10,20 @@
 #include "string_utils.hpp"
 #include <fstream>
 #include <ostream>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
 
 using namespace polymer;
 
@@ -50,6 +64,12 @@ std::unordered_map<std::string, runtime_mesh> polymer::import_model(const std::s
         compute_tangents(m.second);
     }
 
+    // *.mesh files are optimized when they are exported
+    if (ext != "mesh")
+    {
+        for (auto & m : models) optimize_model(m.second);
+    }
+
     return models;
 }
 
@@ -162,78 +182,548 @@ std::unordered_map<std::string, runtime_mesh> polymer::import_obj_model(const st
     return meshes;
 }
 
-void polymer::optimize_model(runtime_mesh & input)
+void polymer::optimize_model(runtime_mesh & input, const uint32_t max_lods)
 {
-    // todo 
+    const size_t vertexCount = input.vertices.size();
+    if (input.faces.empty() || vertexCount == 0) return;
+
+    const size_t faceCount = input.faces.size();
+    const bool hasMaterials = (input.material.size() == faceCount);
+
+    // Group faces by material so that each group can be reordered on its own without breaking the face -> material mapping
+    if (hasMaterials)
+    {
+        std::vector<uint32_t> order(faceCount);
+        for (uint32_t f = 0; f < faceCount; ++f) order[f] = f;
+        std::stable_sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b) { return input.material[a] < input.material[b]; });
+
+        std::vector<uint3> faces(faceCount);
+        std::vector<uint32_t> material(faceCount);
+        for (size_t f = 0; f < faceCount; ++f)
+        {
+            faces[f] = input.faces[order[f]];
+            material[f] = input.material[order[f]];
+        }
+        input.faces = std::move(faces);
+        input.material = std::move(material);
+    }
+
+    // Vertex cache, then overdraw (which keeps most of the cache efficiency given a threshold of 1.05)
+    std::vector<uint3> scratch(faceCount);
+    for (size_t first = 0; first < faceCount;)
+    {
+        size_t last = first + 1;
+        if (hasMaterials) while (last < faceCount && input.material[last] == input.material[first]) ++last;
+        else last = faceCount;
+
+        uint32_t * indices = &input.faces[first].x;
+        uint32_t * temp = &scratch[first].x;
+        const size_t indexCount = (last - first) * 3;
+
+        meshopt_optimizeVertexCache(temp, indices, indexCount, vertexCount);
+        meshopt_optimizeOverdraw(indices, temp, indexCount, &input.vertices[0].x, vertexCount, sizeof(float3), 1.05f);
+
+        first = last;
+    }
+
+    // Each level targets half the faces of the one before, stopping once simplification stops making progress
+    // or the mesh is already too coarse for a simpler version to matter
+    const size_t minimumLodFaces = 32;
+
+    input.lods.clear();
+    const std::vector<uint3> * previous = &input.faces;
+    for (uint32_t lod = 0; lod < max_lods; ++lod)
+    {
+        const size_t previousIndexCount = previous->size() * 3;
+        const size_t targetIndexCount = (previous->size() / 2) * 3;
+        if (targetIndexCount < minimumLodFaces * 3) break;
+
+        std::vector<uint3> simplified(previous->size());
+        const size_t indexCount = meshopt_simplify(&simplified[0].x, &(*previous)[0].x, previousIndexCount, &input.vertices[0].x, vertexCount, sizeof(float3), targetIndexCount);
+        if (indexCount == 0 || indexCount > previousIndexCount * 3 / 4) break;
+
+        simplified.resize(indexCount / 3);
+        meshopt_optimizeVertexCache(&simplified[0].x, &simplified[0].x, indexCount, vertexCount);
+
+        input.lods.push_back(std::move(simplified));
+        previous = &input.lods.back();
+    }
+
+    // Vertex fetch order follows the full detail faces; vertices only referenced by the levels of detail come last
+    std::vector<uint32_t> combined(&input.faces[0].x, &input.faces[0].x + faceCount * 3);
+    for (auto & lod : input.lods) combined.insert(combined.end(), &lod[0].x, &lod[0].x + lod.size() * 3);
+
+    std::vector<uint32_t> remap(vertexCount);
+    const size_t uniqueVertexCount = meshopt_optimizeVertexFetchRemap(remap.data(), combined.data(), combined.size(), vertexCount);
+
+    auto remap_stream = [&](auto & stream)
+    {
+        if (stream.size() != vertexCount) return;
+        typename std::remove_reference<decltype(stream)>::type remapped(uniqueVertexCount);
+        meshopt_remapVertexBuffer(remapped.data(), stream.data(), vertexCount, sizeof(stream[0]), remap.data());
+        stream = std::move(remapped);
+    };
+
+    remap_stream(input.vertices);
+    remap_stream(input.normals);
+    remap_stream(input.colors);
+    remap_stream(input.texcoord0);
+    remap_stream(input.texcoord1);
+    remap_stream(input.tangents);
+    remap_stream(input.bitangents);
+
+    meshopt_remapIndexBuffer(&input.faces[0].x, &input.faces[0].x, faceCount * 3, remap.data());
+    for (auto & lod : input.lods) meshopt_remapIndexBuffer(&lod[0].x, &lod[0].x, lod.size() * 3, remap.data());
 }
 
-runtime_mesh polymer::import_mesh_binary(const std::string & path)
+///////////////////////////////
+//   *.mesh Binary Format   //
+///////////////////////////////
+
+namespace
 {
-    std::ifstream file(path, std::ios::binary | std::ios::ate);
-    if (!file.good()) throw std::runtime_error("couldn't open");
+    // Read-only mapping of an entire file. Pages are faulted in on access rather than copied through a stream.
+    struct file_mapping
+    {
+        const uint8_t * data{ nullptr };
+        size_t size{ 0 };
 
-    file.seekg(0, std::ios::end);
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    #if defined(_WIN32)
+        HANDLE file{ INVALID_HANDLE_VALUE };
+        HANDLE mapping{ nullptr };
 
-    runtime_mesh_binary_header h;
-    file.read((char*)&h, sizeof(runtime_mesh_binary_header));
+        explicit file_mapping(const std::string & path)
+        {
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("couldn't open " + path);
 
-    assert(h.headerVersion == runtime_mesh_binary_version);
-    if (h.compressionVersion > 0) assert(h.compressionVersion == runtime_mesh_compression_version);
+            // The destructor doesn't run if the constructor throws, so each failure releases what was opened so far
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+            {
+                release();
+                throw std::runtime_error("couldn't map " + path);
+            }
+            size = static_cast<size_t>(fileSize.QuadPart);
 
-    runtime_mesh mesh;
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping)
+            {
+                release();
+                throw std::runtime_error("couldn't map " + path);
+            }
+
+            data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            if (!data)
+            {
+                release();
+                throw std::runtime_error("couldn't map " + path);
+            }
+        }
+
+        ~file_mapping()
+        {
+            release();
+        }
+
+        void release()
+        {
+            if (data) UnmapViewOfFile(data);
+            if (mapping) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+            data = nullptr;
+            mapping = nullptr;
+            file = INVALID_HANDLE_VALUE;
+        }
+    #else
+        explicit file_mapping(const std::string & path)
+        {
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) throw std::runtime_error("couldn't open " + path);
+
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size == 0)
+            {
+                close(fd);
+                throw std::runtime_error("couldn't map " + path);
+            }
+            size = static_cast<size_t>(info.st_size);
+
+            void * ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd); // the mapping keeps its own reference to the file
+            if (ptr == MAP_FAILED) throw std::runtime_error("couldn't map " + path);
+
+            madvise(ptr, size, MADV_WILLNEED);
+            data = static_cast<const uint8_t *>(ptr);
+        }
+
+        ~file_mapping()
+        {
+            if (data) munmap(const_cast<uint8_t *>(data), size);
+        }
+    #endif
+
+        file_mapping(const file_mapping &) = delete;
+        file_mapping & operator = (const file_mapping &) = delete;
+    };
+
+    inline float half_to_float(const uint16_t h)
+    {
+        const uint32_t sign = uint32_t(h & 0x8000) << 16;
+        const uint32_t exponent = (h >> 10) & 0x1f;
+        const uint32_t mantissa = h & 0x3ff;
+
+        uint32_t bits;
+        if (exponent == 0)
+        {
+            // zero or subnormal
+            const float f = std::ldexp(float(mantissa), -24);
+            std::memcpy(&bits, &f, sizeof(float));
+            bits |= sign;
+        }
+        else if (exponent == 31) bits = sign | 0x7f800000 | (mantissa << 13);
+        else bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+        float result;
+        std::memcpy(&result, &bits, sizeof(float));
+        return result;
+    }
+
+    // Writes |count| elements of |components| floats from |src| into a stream of the requested storage format
+    std::vector<uint8_t> pack_float_stream(const float * src, const size_t count, const uint32_t components, runtime_mesh_binary_stream & stream)
+    {
+        std::vector<uint8_t> bytes(size_t(stream.stride()) * count);
+
+        switch (stream.format)
+        {
+        case mesh_stream_format::float32:
+        {
+            std::memcpy(bytes.data(), src, bytes.size());
+            break;
+        }
+        case mesh_stream_format::float16:
+        {
+            uint16_t * dst = reinterpret_cast<uint16_t *>(bytes.data());
+            for (size_t i = 0; i < count; ++i)
+            {
+                for (uint32_t c = 0; c < stream.components; ++c)
+                {
+                    dst[i * stream.components + c] = (c < components) ? meshopt_quantizeHalf(src[i * components + c]) : 0;
+                }
+            }
+            break;
+        }
+        case mesh_stream_format::snorm16:
+        {
+            int16_t * dst = reinterpret_cast<int16_t *>(bytes.data());
+            for (size_t i = 0; i < count; ++i)
+            {
+                for (uint32_t c = 0; c < stream.components; ++c)
+                {
+                    dst[i * stream.components + c] = (c < components) ? int16_t(meshopt_quantizeSnorm(src[i * components + c], 16)) : 0;
+                }
+            }
+            break;
+        }
+        default: break;
+        }
+
+        return bytes;
+    }
+
+    // Decodes a stream into |components| floats per element
+    template<typename T>
+    void unpack_stream(const runtime_mesh_binary_view & view, const mesh_stream s, std::vector<T> & out)
+    {
+        const runtime_mesh_binary_stream & stream = view.get_stream(s);
+        out.resize(stream.count);
+        if (stream.count == 0) return;
+
+        const uint8_t * src = view.get_stream_data(s);
+        const size_t decodedBytes = size_t(stream.count) * stream.stride();
+
+        // Encoded streams are expanded into scratch memory; everything else is read straight from the mapping
+        std::vector<uint8_t> scratch;
+        if (stream.codec == mesh_stream_codec::meshopt_vertex)
+        {
+            scratch.resize(decodedBytes);
+            if (meshopt_decodeVertexBuffer(scratch.data(), stream.count, stream.stride(), src, size_t(stream.bytes)) != 0) throw std::runtime_error("corrupt mesh vertex stream");
+            src = scratch.data();
+        }
+        else if (stream.codec == mesh_stream_codec::meshopt_index)
+        {
+            scratch.resize(decodedBytes);
+            if (meshopt_decodeIndexBuffer(reinterpret_cast<uint32_t *>(scratch.data()), size_t(stream.count) * stream.components, src, size_t(stream.bytes)) != 0) throw std::runtime_error("corrupt mesh index stream");
+            src = scratch.data();
+        }
+
+        constexpr uint32_t components = sizeof(T) / sizeof(float);
+        float * dst = reinterpret_cast<float *>(out.data());
+
+        const bool is16bit = (stream.format == mesh_stream_format::float16 || stream.format == mesh_stream_format::snorm16);
+        if (is16bit && stream.components < components) throw std::runtime_error("corrupt mesh stream");
+
+        switch (stream.format)
+        {
+        case mesh_stream_format::float32:
+        case mesh_stream_format::uint32:
+        {
+            // Version 1 files may record fewer bytes than count * sizeof(T) (see colors)
+            const size_t available = (stream.codec == mesh_stream_codec::none) ? size_t(stream.bytes) : decodedBytes;
+            std::memcpy(out.data(), src, std::min<size_t>(available, out.size() * sizeof(T)));
+            break;
+        }
+        case mesh_stream_format::float16:
+        {
+            const uint16_t * h = reinterpret_cast<const uint16_t *>(src);
+            for (size_t i = 0; i < stream.count; ++i)
+            {
+                for (uint32_t c = 0; c < components; ++c) dst[i * components + c] = half_to_float(h[i * stream.components + c]);
+            }
+            break;
+        }
+        case mesh_stream_format::snorm16:
+        {
+            const int16_t * q = reinterpret_cast<const int16_t *>(src);
+            for (size_t i = 0; i < stream.count; ++i)
+            {
+                for (uint32_t c = 0; c < components; ++c) dst[i * components + c] = std::max(q[i * stream.components + c] / 32767.f, -1.f);
+            }
+            break;
+        }
+        }
+    }
+}
+
+runtime_mesh_binary_view::runtime_mesh_binary_view(const std::string & path)
+{
+    auto file = std::make_shared<file_mapping>(path);
+    base = file->data;
+    size = file->size;
+    mapping = file;
+
+    uint32_t version = 0;
+    if (size >= sizeof(uint32_t)) std::memcpy(&version, base, sizeof(uint32_t));
+
+    if (version == 1)
+    {
+        if (size < sizeof(runtime_mesh_binary_header)) throw std::runtime_error("truncated mesh " + path);
+
+        runtime_mesh_binary_header h;
+        std::memcpy(&h, base, sizeof(runtime_mesh_binary_header));
+        if (h.compressionVersion > 0 && h.compressionVersion != runtime_mesh_compression_version) throw std::runtime_error("unknown mesh compression " + path);
+
+        // Version 1 streams are raw and tightly packed after the header
+        uint64_t offset = sizeof(runtime_mesh_binary_header);
+        auto describe = [&](const mesh_stream s, const mesh_stream_format format, const uint32_t components, const uint32_t elementBytes, const uint32_t bytes)
+        {
+            runtime_mesh_binary_stream & stream = header[s];
+            stream.format = format;
+            stream.components = components;
+            stream.count = bytes / elementBytes;
+            stream.offset = offset;
+            stream.bytes = bytes;
+            offset += bytes;
+        };
+
+        describe(mesh_stream::positions, mesh_stream_format::float32, 3, sizeof(float3), h.verticesBytes);
+        describe(mesh_stream::normals, mesh_stream_format::float32, 3, sizeof(float3), h.normalsBytes);
+        describe(mesh_stream::colors, mesh_stream_format::float32, 4, sizeof(float3), h.colorsBytes); // written as float3-sized elements of float4 data
+        describe(mesh_stream::texcoord0, mesh_stream_format::float32, 2, sizeof(float2), h.texcoord0Bytes);
+        describe(mesh_stream::texcoord1, mesh_stream_format::float32, 2, sizeof(float2), h.texcoord1Bytes);
+        describe(mesh_stream::tangents, mesh_stream_format::float32, 3, sizeof(float3), h.tangentsBytes);
+        describe(mesh_stream::bitangents, mesh_stream_format::float32, 3, sizeof(float3), h.bitangentsBytes);
+        describe(mesh_stream::faces, mesh_stream_format::uint32, 3, sizeof(uint3), h.facesBytes);
+        describe(mesh_stream::materials, mesh_stream_format::uint32, 1, sizeof(uint32_t), h.materialsBytes);
+
+        // The v1 writer never actually compressed anything
+        header.compressionVersion = 0;
+    }
+    else if (version == 2 || version == runtime_mesh_binary_version)
+    {
+        const size_t tableOffset = offsetof(runtime_mesh_binary_header_v2, streams);
+        if (size < tableOffset) throw std::runtime_error("truncated mesh " + path);
+        std::memcpy(&header, base, tableOffset);
+
+        // Version 2 files end their table before the lod streams, which then stay empty
+        const uint32_t expectedStreams = static_cast<uint32_t>(version == 2 ? mesh_stream::lod_faces : mesh_stream::count);
+
+        if (header.compressionVersion > 0 && header.compressionVersion != runtime_mesh_compression_version) throw std::runtime_error("unknown mesh compression " + path);
+        if (header.streamCount != expectedStreams) throw std::runtime_error("unknown mesh layout " + path);
+
+        const size_t tableBytes = sizeof(runtime_mesh_binary_stream) * header.streamCount;
+        if (size < tableOffset + tableBytes) throw std::runtime_error("truncated mesh " + path);
+        std::memcpy(header.streams, base + tableOffset, tableBytes);
+    }
+    else throw std::runtime_error("unknown mesh version " + path);
+
+    // Readers trust each stream's count, format and components, including make_mesh_from_binary(), which hands
+    // unencoded streams from the mapping straight to GL. Anything that would read past the mapping is rejected here.
+    for (uint32_t i = 0; i < static_cast<uint32_t>(mesh_stream::count); ++i)
+    {
+        const mesh_stream s = static_cast<mesh_stream>(i);
+        const runtime_mesh_binary_stream & stream = header[s];
+        if (stream.count == 0) continue;
+
+        if (stream.format > mesh_stream_format::uint32 || stream.codec > mesh_stream_codec::meshopt_index) throw std::runtime_error("unknown mesh stream encoding " + path);
+        if (stream.components == 0 || stream.components > 4) throw std::runtime_error("corrupt mesh " + path);
 
-    mesh.vertices.resize(h.verticesBytes / sizeof(float3));
-    mesh.normals.resize(h.normalsBytes / sizeof(float3));
-    mesh.colors.resize(h.colorsBytes / sizeof(float3));
-    mesh.texcoord0.resize(h.texcoord0Bytes / sizeof(float2));
-    mesh.texcoord1.resize(h.texcoord1Bytes / sizeof(float2));
-    mesh.tangents.resize(h.tangentsBytes / sizeof(float3));
-    mesh.bitangents.resize(h.bitangentsBytes / sizeof(float3));
-    mesh.faces.resize(h.facesBytes / sizeof(uint3));
-    mesh.material.resize(h.materialsBytes / sizeof(uint32_t));
-
-    file.read((char*)mesh.vertices.data(), h.verticesBytes);
-    file.read((char*)mesh.normals.data(), h.normalsBytes);
-    file.read((char*)mesh.colors.data(), h.colorsBytes);
-    file.read((char*)mesh.texcoord0.data(), h.texcoord0Bytes);
-    file.read((char*)mesh.texcoord1.data(), h.texcoord1Bytes);
-    file.read((char*)mesh.tangents.data(), h.tangentsBytes);
-    file.read((char*)mesh.bitangents.data(), h.bitangentsBytes);
-    file.read((char*)mesh.faces.data(), h.facesBytes);
-    file.read((char*)mesh.material.data(), h.materialsBytes);
+        const bool indices = (s == mesh_stream::faces || s == mesh_stream::lod_faces);
+        const bool integers = indices || s == mesh_stream::materials || s == mesh_stream::lod_face_counts;
+        if (integers != (stream.format == mesh_stream_format::uint32)) throw std::runtime_error("corrupt mesh " + path);
+        if (integers && stream.components != (indices ? 3u : 1u)) throw std::runtime_error("corrupt mesh " + path);
+        if ((stream.codec == mesh_stream_codec::meshopt_index) != (indices && stream.codec != mesh_stream_codec::none)) throw std::runtime_error("corrupt mesh " + path);
+        if (stream.codec == mesh_stream_codec::meshopt_vertex && stream.stride() % 4 != 0) throw std::runtime_error("corrupt mesh " + path); // the codec works in 4-byte units
+
+        if (stream.bytes > size || stream.offset > size - stream.bytes) throw std::runtime_error("truncated mesh " + path);
+
+        // Version 1 colors are the one stream allowed to hold fewer bytes than it counts (see unpack_stream)
+        const bool short_colors = (version == 1 && s == mesh_stream::colors);
+        if (stream.codec == mesh_stream_codec::none && !short_colors && stream.bytes < uint64_t(stream.count) * stream.stride()) throw std::runtime_error("truncated mesh " + path);
+    }
+}
+
+runtime_mesh polymer::import_mesh_binary(const runtime_mesh_binary_view & view)
+{
+    runtime_mesh mesh;
+    unpack_stream(view, mesh_stream::positions, mesh.vertices);
+    unpack_stream(view, mesh_stream::normals, mesh.normals);
+    unpack_stream(view, mesh_stream::colors, mesh.colors);
+    unpack_stream(view, mesh_stream::texcoord0, mesh.texcoord0);
+    unpack_stream(view, mesh_stream::texcoord1, mesh.texcoord1);
+    unpack_stream(view, mesh_stream::tangents, mesh.tangents);
+    unpack_stream(view, mesh_stream::bitangents, mesh.bitangents);
+    unpack_stream(view, mesh_stream::faces, mesh.faces);
+    unpack_stream(view, mesh_stream::materials, mesh.material);
+
+    std::vector<uint3> lodFaces;
+    std::vector<uint32_t> lodFaceCounts;
+    unpack_stream(view, mesh_stream::lod_faces, lodFaces);
+    unpack_stream(view, mesh_stream::lod_face_counts, lodFaceCounts);
+
+    size_t first = 0;
+    for (const uint32_t count : lodFaceCounts)
+    {
+        if (first + count > lodFaces.size()) throw std::runtime_error("corrupt mesh lod stream");
+        mesh.lods.emplace_back(lodFaces.begin() + first, lodFaces.begin() + first + count);
+        first += count;
+    }
 
     return mesh;
 }
 
-void polymer::export_mesh_binary(const std::string & path, runtime_mesh & mesh, bool compressed)
+runtime_mesh polymer::import_mesh_binary(const std::string & path)
 {
-    auto file = std::ofstream(path, std::ios::out | std::ios::binary);
+    return import_mesh_binary(runtime_mesh_binary_view(path));
+}
 
-    runtime_mesh_binary_header header;
-    header.headerVersion = runtime_mesh_binary_version;
+void polymer::export_mesh_binary(const std::string & path, runtime_mesh & mesh, bool compressed, bool quantized)
+{
+    runtime_mesh_binary_header_v2 header;
     header.compressionVersion = (compressed) ? runtime_mesh_compression_version : 0;
-    header.verticesBytes = (uint32_t)mesh.vertices.size() * sizeof(float3);
-    header.normalsBytes = (uint32_t)mesh.normals.size() * sizeof(float3);
-    header.colorsBytes = (uint32_t)mesh.colors.size() * sizeof(float3);
-    header.texcoord0Bytes = (uint32_t)mesh.texcoord0.size() * sizeof(float2);
-    header.texcoord1Bytes = (uint32_t)mesh.texcoord1.size() * sizeof(float2);
-    header.tangentsBytes = (uint32_t)mesh.tangents.size() * sizeof(float3);
-    header.bitangentsBytes = (uint32_t)mesh.bitangents.size() * sizeof(float3);
-    header.facesBytes = (uint32_t)mesh.faces.size() * sizeof(uint3);
-    header.materialsBytes = (uint32_t)mesh.material.size() * sizeof(uint32_t);
-
-    file.write(reinterpret_cast<char*>(&header), sizeof(runtime_mesh_binary_header));
-    file.write(reinterpret_cast<char*>(mesh.vertices.data()), header.verticesBytes);
-    file.write(reinterpret_cast<char*>(mesh.normals.data()), header.normalsBytes);
-    file.write(reinterpret_cast<char*>(mesh.colors.data()), header.colorsBytes);
-    file.write(reinterpret_cast<char*>(mesh.texcoord0.data()), header.texcoord0Bytes);
-    file.write(reinterpret_cast<char*>(mesh.texcoord1.data()), header.texcoord1Bytes);
-    file.write(reinterpret_cast<char*>(mesh.tangents.data()), header.tangentsBytes);
-    file.write(reinterpret_cast<char*>(mesh.bitangents.data()), header.bitangentsBytes);
-    file.write(reinterpret_cast<char*>(mesh.faces.data()), header.facesBytes);
-    file.write(reinterpret_cast<char*>(mesh.material.data()), header.materialsBytes);
+
+    std::vector<uint8_t> payloads[static_cast<size_t>(mesh_stream::count)];
+
+    auto add_float_stream = [&](const mesh_stream s, const float * data, const size_t count, const uint32_t components, const mesh_stream_format quantizedFormat)
+    {
+        // Importers don't always normalize tangent frames; anything outside [-1, 1] falls back to half floats
+        mesh_stream_format format = quantizedFormat;
+        if (format == mesh_stream_format::snorm16 && std::any_of(data, data + count * components, [](const float x) { return std::abs(x) > 1.f; }))
+        {
+            format = mesh_stream_format::float16;
+        }
+
+        runtime_mesh_binary_stream & stream = header[s];
+        stream.format = (quantized) ? format : mesh_stream_format::float32;
+        const bool is16bit = (stream.format == mesh_stream_format::float16 || stream.format == mesh_stream_format::snorm16);
+        stream.components = (is16bit && components == 3) ? 4 : components;
+        stream.count = static_cast<uint32_t>(count);
+        if (count) payloads[static_cast<size_t>(s)] = pack_float_stream(data, count, components, stream);
+    };
+
+    add_float_stream(mesh_stream::positions, &mesh.vertices.data()->x, mesh.vertices.size(), 3, mesh_stream_format::float32);
+    add_float_stream(mesh_stream::normals, &mesh.normals.data()->x, mesh.normals.size(), 3, mesh_stream_format::snorm16);
+    add_float_stream(mesh_stream::colors, &mesh.colors.data()->x, mesh.colors.size(), 4, mesh_stream_format::float16);
+    add_float_stream(mesh_stream::texcoord0, &mesh.texcoord0.data()->x, mesh.texcoord0.size(), 2, mesh_stream_format::float16);
+    add_float_stream(mesh_stream::texcoord1, &mesh.texcoord1.data()->x, mesh.texcoord1.size(), 2, mesh_stream_format::float16);
+    add_float_stream(mesh_stream::tangents, &mesh.tangents.data()->x, mesh.tangents.size(), 3, mesh_stream_format::snorm16);
+    add_float_stream(mesh_stream::bitangents, &mesh.bitangents.data()->x, mesh.bitangents.size(), 3, mesh_stream_format::snorm16);
+
+    auto add_uint_stream = [&](const mesh_stream s, const uint32_t * data, const size_t count, const uint32_t components)
+    {
+        runtime_mesh_binary_stream & stream = header[s];
+        stream.format = mesh_stream_format::uint32;
+        stream.components = components;
+        stream.count = static_cast<uint32_t>(count);
+        payloads[static_cast<size_t>(s)].assign(reinterpret_cast<const uint8_t *>(data), reinterpret_cast<const uint8_t *>(data) + size_t(stream.stride()) * count);
+    };
+
+    add_uint_stream(mesh_stream::faces, &mesh.faces.data()->x, mesh.faces.size(), 3);
+    add_uint_stream(mesh_stream::materials, mesh.material.data(), mesh.material.size(), 1);
+
+    std::vector<uint3> lodFaces;
+    std::vector<uint32_t> lodFaceCounts;
+    for (auto & lod : mesh.lods)
+    {
+        lodFaces.insert(lodFaces.end(), lod.begin(), lod.end());
+        lodFaceCounts.push_back(static_cast<uint32_t>(lod.size()));
+    }
+    add_uint_stream(mesh_stream::lod_faces, &lodFaces.data()->x, lodFaces.size(), 3);
+    add_uint_stream(mesh_stream::lod_face_counts, lodFaceCounts.data(), lodFaceCounts.size(), 1);
+
+    if (compressed)
+    {
+        for (size_t i = 0; i < static_cast<size_t>(mesh_stream::count); ++i)
+        {
+            runtime_mesh_binary_stream & stream = header.streams[i];
+            if (stream.count == 0) continue;
+
+            std::vector<uint8_t> & payload = payloads[i];
+            std::vector<uint8_t> encoded;
+
+            if (static_cast<mesh_stream>(i) == mesh_stream::faces || static_cast<mesh_stream>(i) == mesh_stream::lod_faces)
+            {
+                const size_t indexCount = size_t(stream.count) * 3;
+                encoded.resize(meshopt_encodeIndexBufferBound(indexCount, mesh.vertices.size()));
+                encoded.resize(meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), reinterpret_cast<const uint32_t *>(payload.data()), indexCount));
+                stream.codec = mesh_stream_codec::meshopt_index;
+            }
+            else
+            {
+                encoded.resize(meshopt_encodeVertexBufferBound(stream.count, stream.stride()));
+                encoded.resize(meshopt_encodeVertexBuffer(encoded.data(), encoded.size(), payload.data(), stream.count, stream.stride()));
+                stream.codec = mesh_stream_codec::meshopt_vertex;
+            }
+
+            if (encoded.empty()) throw std::runtime_error("failed to encode mesh stream");
+            payload = std::move(encoded);
+        }
+    }
+
+    // Lay the streams out on aligned offsets behind the header
+    uint64_t offset = sizeof(runtime_mesh_binary_header_v2);
+    for (size_t i = 0; i < static_cast<size_t>(mesh_stream::count); ++i)
+    {
+        runtime_mesh_binary_stream & stream = header.streams[i];
+        offset = (offset + runtime_mesh_binary_alignment - 1) & ~uint64_t(runtime_mesh_binary_alignment - 1);
+        stream.offset = offset;
+        stream.bytes = payloads[i].size();
+        offset += stream.bytes;
+    }
+
+    auto file = std::ofstream(path, std::ios::out | std::ios::binary);
+    if (!file.good()) throw std::runtime_error("couldn't open " + path);
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(runtime_mesh_binary_header_v2));
+
+    const char padding[runtime_mesh_binary_alignment] = {};
+    uint64_t written = sizeof(runtime_mesh_binary_header_v2);
+    for (size_t i = 0; i < static_cast<size_t>(mesh_stream::count); ++i)
+    {
+        file.write(padding, static_cast<std::streamsize>(header.streams[i].offset - written));
+        file.write(reinterpret_cast<const char *>(payloads[i].data()), static_cast<std::streamsize>(payloads[i].size()));
+        written = header.streams[i].offset + header.streams[i].bytes;
+    }
 
     file.close();
 }
@@ -7,6 +7,7 @@
 #include "math-core.hpp"
 #include "geometry.hpp"
 #include <unordered_map>
+#include <memory>
 
 namespace polymer
 {
@@ -52,14 +53,16 @@ namespace polymer
         std::vector<float4> boneWeights;
     };
 
-    #define runtime_mesh_binary_version 1
-    #define runtime_mesh_compression_version 1
+    #define runtime_mesh_binary_version 3             // 2 is the same stream table without the lod streams
+    #define runtime_mesh_compression_version 1      // meshoptimizer vertex/index codec
+    #define runtime_mesh_binary_alignment 16        // every stream starts on this boundary, relative to the start of the file
 
+    // Version 1 layout: the header is followed by each stream, tightly packed, in declaration order.
     #pragma pack(push, 1)
     struct runtime_mesh_binary_header
     {
-        uint32_t headerVersion{ runtime_mesh_binary_version };
-        uint32_t compressionVersion{ runtime_mesh_compression_version };
+        uint32_t headerVersion{ 1 };
+        uint32_t compressionVersion{ 0 };
         uint32_t verticesBytes{ 0 };
         uint32_t normalsBytes{ 0 };
         uint32_t colorsBytes{ 0 };
@@ -72,13 +75,96 @@ namespace polymer
     };
     #pragma pack(pop)
 
+    // Streams of a version 2 or 3 file, in file order. Vertex streams come first so they form one contiguous range.
+    // New streams are only ever appended, so an older file's table is a prefix of this one.
+    enum class mesh_stream : uint32_t
+    {
+        positions,
+        normals,
+        colors,
+        texcoord0,
+        texcoord1,
+        tangents,
+        bitangents,
+        faces,
+        materials,
+        lod_faces,          // version 3: every level of detail after the first, concatenated
+        lod_face_counts,    // faces in each of those levels
+        count
+    };
+
+    enum class mesh_stream_format : uint32_t
+    {
+        float32,
+        float16,    // 16-bit three component streams are padded to 4 components (w = 0) to keep elements 4-byte aligned
+        snorm16,    // unit vectors
+        uint32
+    };
+
+    enum class mesh_stream_codec : uint32_t
+    {
+        none,
+        meshopt_vertex,
+        meshopt_index
+    };
+
+    #pragma pack(push, 1)
+    struct runtime_mesh_binary_stream
+    {
+        mesh_stream_format format{ mesh_stream_format::float32 };
+        uint32_t components{ 0 };
+        mesh_stream_codec codec{ mesh_stream_codec::none };
+        uint32_t count{ 0 };        // elements; 0 if the mesh doesn't have this stream
+        uint64_t offset{ 0 };       // from the start of the file
+        uint64_t bytes{ 0 };        // as stored; smaller than count * stride() when encoded
+
+        uint32_t stride() const { return components * (format == mesh_stream_format::float16 || format == mesh_stream_format::snorm16 ? 2 : 4); }
+    };
+
+    // Version 2 and 3 layout: this header, then each present stream at its recorded (aligned) offset. Unencoded streams
+    // can be used in place from a memory mapping, e.g. handed straight to glNamedBufferStorage. The table holds
+    // streamCount entries; version 2 files stop after materials.
+    struct runtime_mesh_binary_header_v2
+    {
+        uint32_t headerVersion{ runtime_mesh_binary_version };
+        uint32_t compressionVersion{ 0 };
+        uint32_t streamCount{ static_cast<uint32_t>(mesh_stream::count) };
+        uint32_t reserved{ 0 };
+        runtime_mesh_binary_stream streams[static_cast<size_t>(mesh_stream::count)];
+
+        const runtime_mesh_binary_stream & operator[](const mesh_stream s) const { return streams[static_cast<size_t>(s)]; }
+        runtime_mesh_binary_stream & operator[](const mesh_stream s) { return streams[static_cast<size_t>(s)]; }
+    };
+    #pragma pack(pop)
+
+    // A *.mesh file mapped read-only into memory. Older files are described by an equivalent current header, with
+    // the streams they predate left empty.
+    class runtime_mesh_binary_view
+    {
+        std::shared_ptr<const void> mapping;
+        const uint8_t * base{ nullptr };
+        size_t size{ 0 };
+        runtime_mesh_binary_header_v2 header;
+
+    public:
+
+        explicit runtime_mesh_binary_view(const std::string & path); // throws if the file can't be mapped or isn't a *.mesh
+
+        const runtime_mesh_binary_header_v2 & get_header() const { return header; }
+        const runtime_mesh_binary_stream & get_stream(const mesh_stream s) const { return header[s]; }
+        const uint8_t * get_stream_data(const mesh_stream s) const { return base + header[s].offset; }
+        bool has_encoded_streams() const { return header.compressionVersion != 0; }
+    };
+
     ///////////////////////
     //   File Format IO  //
     ///////////////////////
 
-    // Polymer's own runtime-optimized *.mesh file format
+    // Polymer's own runtime-optimized *.mesh file format. |quantized| stores normals, tangents and bitangents as
+    // snorm16 and texcoords and colors as half floats; |compressed| runs every stream through meshoptimizer's codecs.
     runtime_mesh import_mesh_binary(const std::string & path);
-    void export_mesh_binary(const std::string & path, runtime_mesh & mesh, bool compressed = false);
+    runtime_mesh import_mesh_binary(const runtime_mesh_binary_view & view);
+    void export_mesh_binary(const std::string & path, runtime_mesh & mesh, bool compressed = false, bool quantized = false);
 
     // Load an FBX model, assuming the path points to a valid *.fbx
     std::unordered_map<std::string, runtime_mesh> import_fbx_model(const std::string & path);
@@ -92,8 +178,10 @@ namespace polymer
     bool export_obj_model(const std::string & name, const std::string & filename, runtime_mesh & mesh);
     bool export_obj_multi_model(const std::vector<std::string> & names, const std::string & filename, std::vector<runtime_mesh *> & meshes);
 
-    // Currently a no-op
-    void optimize_model(runtime_mesh & input);
+    // Reorders faces for the post-transform vertex cache and for overdraw (within each run of faces sharing a material),
+    // then reorders every vertex stream into fetch order. Also builds up to |max_lods| simplified levels of detail, each
+    // with roughly half the faces of the previous one, into input.lods.
+    void optimize_model(runtime_mesh & input, const uint32_t max_lods = 4);
 
 } // end namespace polymer
 
@@ -0,0 +1,567 @@
+/*
+ * File: aabb-tree.hpp
+ * A dynamic bounding volume hierarchy of axis-aligned boxes, in the style of the broadphase trees
+ * found in Box2D and Bullet (btDbvt). Leaves are inserted, removed, and moved individually, so the
+ * hierarchy is maintained incrementally rather than rebuilt each frame. Each leaf stores a "fat" box
+ * expanded by a margin: an object that moves within its fat box does not touch the tree at all, and
+ * one that leaves it is removed and reinserted. Inserts descend by a surface-area cost heuristic and
+ * the path back to the root is rebalanced with tree rotations to bound the height. Besides frustum and
+ * box queries, the tree supports front-to-back ray traversal and best-first nearest-neighbor search.
+ * Nodes live in a flat array addressed by index (a proxy id), with a free list for reuse.
+ */
+
+#pragma once
+
+#ifndef polymer_aabb_tree_hpp
+#define polymer_aabb_tree_hpp
+
+#include "math-core.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <assert.h>
+#include <xmmintrin.h>
+
+namespace polymer
+{
+    template<typename T>
+    class dynamic_aabb_tree
+    {
+        static constexpr int32_t null_node = -1;
+        static constexpr int32_t packet_stack_size = 64; // rebalancing keeps the height far below this
+
+        struct node
+        {
+            aabb_3d box;
+            T data{};
+            int32_t parent{ null_node }; // doubles as the next pointer while on the free list
+            int32_t left{ null_node };
+            int32_t right{ null_node };
+            int32_t height{ -1 }; // 0 for leaves, -1 for free nodes
+            bool is_leaf() const { return left == null_node; }
+        };
+
+        std::vector<node> nodes;
+        int32_t root{ null_node };
+        int32_t free_list{ null_node };
+        uint32_t leaf_count{ 0 };
+        float margin;
+
+        mutable std::vector<int32_t> stack;
+
+        // Node paired with its entry distance, for the ordered ray and nearest-neighbor traversals
+        struct ordered_entry { int32_t id; float distance; };
+        mutable std::vector<ordered_entry> ordered;
+
+        static bool overlaps(const aabb_3d & a, const aabb_3d & b)
+        {
+            if (a._max.x < b._min.x || a._min.x > b._max.x) return false;
+            if (a._max.y < b._min.y || a._min.y > b._max.y) return false;
+            if (a._max.z < b._min.z || a._min.z > b._max.z) return false;
+            return true;
+        }
+
+        // Slab test against a ray given its reciprocal direction. Writes the entry distance, clamped to the origin.
+        static bool enters(const aabb_3d & box, const float3 & origin, const float3 & inv_dir, const float max_t, float & t_enter)
+        {
+            const float3 t0 = (box._min - origin) * inv_dir;
+            const float3 t1 = (box._max - origin) * inv_dir;
+            const float3 near_t = min(t0, t1);
+            const float3 far_t = max(t0, t1);
+            t_enter = std::max(std::max<float>(near_t.x, near_t.y), std::max<float>(near_t.z, 0.f));
+            const float t_exit = std::min(std::min<float>(far_t.x, far_t.y), std::min<float>(far_t.z, max_t));
+            return t_enter <= t_exit;
+        }
+
+        static float distance2(const aabb_3d & box, const float3 & point)
+        {
+            const float3 d = max(max(box._min - point, point - box._max), float3(0.f));
+            return dot(d, d);
+        }
+
+        static bool encloses(const aabb_3d & outer, const aabb_3d & inner)
+        {
+            return outer._min.x <= inner._min.x && outer._min.y <= inner._min.y && outer._min.z <= inner._min.z &&
+                   outer._max.x >= inner._max.x && outer._max.y >= inner._max.y && outer._max.z >= inner._max.z;
+        }
+
+        int32_t allocate_node()
+        {
+            if (free_list == null_node)
+            {
+                const int32_t base = static_cast<int32_t>(nodes.size());
+                nodes.resize(nodes.empty() ? 16 : nodes.size() * 2);
+                for (int32_t i = base; i < static_cast<int32_t>(nodes.size()) - 1; ++i) nodes[i].parent = i + 1;
+                nodes.back().parent = null_node;
+                free_list = base;
+            }
+
+            const int32_t id = free_list;
+            free_list = nodes[id].parent;
+            nodes[id] = node();
+            nodes[id].height = 0;
+            return id;
+        }
+
+        void free_node(const int32_t id)
+        {
+            nodes[id] = node();
+            nodes[id].parent = free_list;
+            free_list = id;
+        }
+
+        void insert_leaf(const int32_t leaf)
+        {
+            if (root == null_node)
+            {
+                root = leaf;
+                nodes[root].parent = null_node;
+                return;
+            }
+
+            // Descend towards the sibling that minimizes the increase in total surface area
+            const aabb_3d leaf_box = nodes[leaf].box;
+            int32_t index = root;
+            while (!nodes[index].is_leaf())
+            {
+                const node & n = nodes[index];
+                const float area = n.box.surface_area();
+                const float combined_area = n.box.add(leaf_box).surface_area();
+
+                // Cost of creating a new parent for this node and the new leaf, and the
+                // minimum cost of pushing the leaf further down the tree
+                const float cost = 2.f * combined_area;
+                const float inheritance_cost = 2.f * (combined_area - area);
+
+                auto child_cost = [&](const int32_t c)
+                {
+                    const float enlarged = nodes[c].box.add(leaf_box).surface_area();
+                    if (nodes[c].is_leaf()) return enlarged + inheritance_cost;
+                    return (enlarged - nodes[c].box.surface_area()) + inheritance_cost;
+                };
+
+                const float cost_left = child_cost(n.left);
+                const float cost_right = child_cost(n.right);
+
+                if (cost < cost_left && cost < cost_right) break;
+                index = (cost_left < cost_right) ? n.left : n.right;
+            }
+
+            const int32_t sibling = index;
+            const int32_t old_parent = nodes[sibling].parent;
+            const int32_t new_parent = allocate_node();
+            nodes[new_parent].parent = old_parent;
+            nodes[new_parent].box = leaf_box.add(nodes[sibling].box);
+            nodes[new_parent].height = nodes[sibling].height + 1;
+            nodes[new_parent].left = sibling;
+            nodes[new_parent].right = leaf;
+            nodes[sibling].parent = new_parent;
+            nodes[leaf].parent = new_parent;
+
+            if (old_parent != null_node)
+            {
+                if (nodes[old_parent].left == sibling) nodes[old_parent].left = new_parent;
+                else nodes[old_parent].right = new_parent;
+            }
+            else root = new_parent;
+
+            refit_ancestors(nodes[leaf].parent);
+        }
+
+        void remove_leaf(const int32_t leaf)
+        {
+            if (leaf == root)
+            {
+                root = null_node;
+                return;
+            }
+
+            const int32_t parent = nodes[leaf].parent;
+            const int32_t grand_parent = nodes[parent].parent;
+            const int32_t sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+
+            if (grand_parent != null_node)
+            {
+                if (nodes[grand_parent].left == parent) nodes[grand_parent].left = sibling;
+                else nodes[grand_parent].right = sibling;
+                nodes[sibling].parent = grand_parent;
+                free_node(parent);
+                refit_ancestors(grand_parent);
+            }
+            else
+            {
+                root = sibling;
+                nodes[sibling].parent = null_node;
+                free_node(parent);
+            }
+        }
+
+        void refit_ancestors(int32_t index)
+        {
+            while (index != null_node)
+            {
+                index = balance(index);
+                node & n = nodes[index];
+                n.height = 1 + std::max(nodes[n.left].height, nodes[n.right].height);
+                n.box = nodes[n.left].box.add(nodes[n.right].box);
+                index = n.parent;
+            }
+        }
+
+        // Promotes the taller grandchild when the subtree at `a` is out of balance by more than one
+        // level. Returns the index of the node that now roots the subtree.
+        int32_t balance(const int32_t a)
+        {
+            node & A = nodes[a];
+            if (A.is_leaf() || A.height < 2) return a;
+
+            const int32_t b = A.left;
+            const int32_t c = A.right;
+            const int32_t skew = nodes[c].height - nodes[b].height;
+
+            if (skew > 1) return rotate(a, c, b);
+            if (skew < -1) return rotate(a, b, c);
+            return a;
+        }
+
+        // Rotates `up` (a child of `a`) into a's place; `other` is a's remaining child.
+        int32_t rotate(const int32_t a, const int32_t up, const int32_t other)
+        {
+            node & A = nodes[a];
+            node & U = nodes[up];
+            const int32_t f = U.left;
+            const int32_t g = U.right;
+
+            U.left = a;
+            U.parent = A.parent;
+            A.parent = up;
+
+            if (U.parent != null_node)
+            {
+                if (nodes[U.parent].left == a) nodes[U.parent].left = up;
+                else nodes[U.parent].right = up;
+            }
+            else root = up;
+
+            // Keep the taller grandchild under `up` and hand the shorter one to `a`
+            const bool keep_f = nodes[f].height > nodes[g].height;
+            const int32_t keep = keep_f ? f : g;
+            const int32_t give = keep_f ? g : f;
+
+            U.right = keep;
+            if (A.left == up) A.left = give;
+            else A.right = give;
+            nodes[give].parent = a;
+
+            A.box = nodes[other].box.add(nodes[give].box);
+            A.height = 1 + std::max(nodes[other].height, nodes[give].height);
+            U.box = A.box.add(nodes[keep].box);
+            U.height = 1 + std::max(A.height, nodes[keep].height);
+            return up;
+        }
+
+        template<typename Visitor>
+        void visit_subtree(const int32_t index, Visitor && visit) const
+        {
+            const size_t base = stack.size();
+            stack.push_back(index);
+            while (stack.size() > base)
+            {
+                const int32_t id = stack.back();
+                stack.pop_back();
+                const node & n = nodes[id];
+                if (n.is_leaf()) visit(id, n.data);
+                else { stack.push_back(n.left); stack.push_back(n.right); }
+            }
+        }
+
+    public:
+
+        // `fat_margin` is added to every side of a leaf's box. Larger margins trade looser culling
+        // for fewer reinsertions of moving objects.
+        dynamic_aabb_tree(const float fat_margin = 0.1f) : margin(fat_margin) {}
+
+        int32_t insert(const aabb_3d & box, const T & data)
+        {
+            const int32_t id = allocate_node();
+            nodes[id].box = aabb_3d(box._min - float3(margin), box._max + float3(margin));
+            nodes[id].data = data;
+            insert_leaf(id);
+            ++leaf_count;
+            return id;
+        }
+
+        void remove(const int32_t proxy)
+        {
+            assert(proxy >= 0 && proxy < static_cast<int32_t>(nodes.size()) && nodes[proxy].is_leaf());
+            remove_leaf(proxy);
+            free_node(proxy);
+            --leaf_count;
+        }
+
+        // Returns true if the proxy was reinserted because `box` escaped its fat bounds.
+        bool update(const int32_t proxy, const aabb_3d & box)
+        {
+            assert(proxy >= 0 && proxy < static_cast<int32_t>(nodes.size()) && nodes[proxy].is_leaf());
+            if (encloses(nodes[proxy].box, box)) return false;
+
+            remove_leaf(proxy);
+            nodes[proxy].box = aabb_3d(box._min - float3(margin), box._max + float3(margin));
+            insert_leaf(proxy);
+            return true;
+        }
+
+        T & get_data(const int32_t proxy) { return nodes[proxy].data; }
+        const T & get_data(const int32_t proxy) const { return nodes[proxy].data; }
+        const aabb_3d & get_fat_bounds(const int32_t proxy) const { return nodes[proxy].box; }
+
+        uint32_t size() const { return leaf_count; }
+        bool empty() const { return leaf_count == 0; }
+        int32_t get_height() const { return (root == null_node) ? 0 : nodes[root].height; }
+
+        void clear()
+        {
+            nodes.clear();
+            root = null_node;
+            free_list = null_node;
+            leaf_count = 0;
+        }
+
+        // Calls visit(proxy, data) for every leaf whose fat box touches the frustum. Subtrees that are
+        // fully inside are accepted without testing their children.
+        template<typename Visitor>
+        void query(const frustum & f, Visitor && visit) const
+        {
+            if (root == null_node) return;
+            stack.clear();
+            stack.push_back(root);
+            while (!stack.empty())
+            {
+                const int32_t id = stack.back();
+                stack.pop_back();
+                const node & n = nodes[id];
+
+                const frustum_containment c = f.classify(n.box);
+                if (c == frustum_containment::outside) continue;
+                if (c == frustum_containment::inside) { visit_subtree(id, visit); continue; }
+
+                if (n.is_leaf()) visit(id, n.data);
+                else { stack.push_back(n.left); stack.push_back(n.right); }
+            }
+        }
+
+        // Calls visit(proxy, data) for every leaf whose fat box overlaps `box`.
+        template<typename Visitor>
+        void query(const aabb_3d & box, Visitor && visit) const
+        {
+            if (root == null_node) return;
+            stack.clear();
+            stack.push_back(root);
+            while (!stack.empty())
+            {
+                const int32_t id = stack.back();
+                stack.pop_back();
+                const node & n = nodes[id];
+                if (!overlaps(n.box, box)) continue;
+                if (n.is_leaf()) visit(id, n.data);
+                else { stack.push_back(n.left); stack.push_back(n.right); }
+            }
+        }
+
+        // Calls visit(proxy, data, max_t) for every leaf whose fat box the ray enters before `max_t`, nearer
+        // children first. The visitor returns the distance to search up to from then on, so clipping it to
+        // the closest hit found so far prunes everything behind that hit.
+        template<typename Visitor>
+        void raycast(const ray & r, float max_t, Visitor && visit) const
+        {
+            if (root == null_node) return;
+
+            const float3 inv_dir = r.inverse_direction();
+            float t_enter;
+            if (!enters(nodes[root].box, r.origin, inv_dir, max_t, t_enter)) return;
+
+            ordered.clear();
+            ordered.push_back({ root, t_enter });
+            while (!ordered.empty())
+            {
+                const ordered_entry entry = ordered.back();
+                ordered.pop_back();
+                if (entry.distance > max_t) continue;
+
+                const node & n = nodes[entry.id];
+                if (n.is_leaf())
+                {
+                    max_t = visit(entry.id, n.data, max_t);
+                    continue;
+                }
+
+                float t_left, t_right;
+                const bool hit_left = enters(nodes[n.left].box, r.origin, inv_dir, max_t, t_left);
+                const bool hit_right = enters(nodes[n.right].box, r.origin, inv_dir, max_t, t_right);
+
+                // Push the farther child first so the nearer one is popped next
+                if (hit_left && hit_right)
+                {
+                    if (t_left < t_right) { ordered.push_back({ n.right, t_right }); ordered.push_back({ n.left, t_left }); }
+                    else { ordered.push_back({ n.left, t_left }); ordered.push_back({ n.right, t_right }); }
+                }
+                else if (hit_left) ordered.push_back({ n.left, t_left });
+                else if (hit_right) ordered.push_back({ n.right, t_right });
+            }
+        }
+
+        static constexpr uint32_t max_packet_size = 16;
+
+        // Traverses the tree once for a packet of up to max_packet_size rays rather than once per ray, which
+        // pays off when the rays are coherent (similar origins and directions): each node is tested against
+        // four rays at a time with SSE, and only the rays that entered a node's parent. Calls visit(proxy, data, i)
+        // for each ray i that enters the leaf's fat box before max_t[i]; the caller owns |max_t| and may clip it
+        // from within the visitor. Unlike the other queries this keeps its traversal state on the stack, so
+        // packets can be traversed from several threads at once.
+        template<typename Visitor>
+        void raycast_packet(const ray * rays, const uint32_t count, const float * max_t, Visitor && visit) const
+        {
+            assert(count <= max_packet_size);
+            if (root == null_node || count == 0) return;
+            assert(nodes[root].height < packet_stack_size);
+
+            // Rays in SoA form; lanes past |count| repeat the last ray and are always masked off
+            const uint32_t group_count = (count + 3) / 4;
+            alignas(16) float ox[max_packet_size], oy[max_packet_size], oz[max_packet_size];
+            alignas(16) float ix[max_packet_size], iy[max_packet_size], iz[max_packet_size];
+            alignas(16) float t_limit[max_packet_size];
+            for (uint32_t i = 0; i < group_count * 4; ++i)
+            {
+                const ray & r = rays[std::min(i, count - 1)];
+                const float3 inv_dir = r.inverse_direction();
+                ox[i] = r.origin.x; oy[i] = r.origin.y; oz[i] = r.origin.z;
+                ix[i] = inv_dir.x; iy[i] = inv_dir.y; iz[i] = inv_dir.z;
+            }
+
+            // Each entry carries the rays that entered its parent, so a subtree only tests the rays that reached it
+            struct packet_entry { int32_t id; uint32_t mask; };
+            packet_entry pending[packet_stack_size];
+            int32_t top = 0;
+            pending[top++] = { root, (1u << count) - 1 };
+
+            const __m128 zero = _mm_setzero_ps();
+            while (top > 0)
+            {
+                const packet_entry entry = pending[--top];
+                const node & n = nodes[entry.id];
+
+                for (uint32_t i = 0; i < count; ++i) t_limit[i] = max_t[i];
+
+                const __m128 min_x = _mm_set1_ps(n.box._min.x), min_y = _mm_set1_ps(n.box._min.y), min_z = _mm_set1_ps(n.box._min.z);
+                const __m128 max_x = _mm_set1_ps(n.box._max.x), max_y = _mm_set1_ps(n.box._max.y), max_z = _mm_set1_ps(n.box._max.z);
+
+                uint32_t mask = 0;
+                for (uint32_t g = 0; g < group_count; ++g)
+                {
+                    const uint32_t lanes = (entry.mask >> (g * 4)) & 0xf;
+                    if (!lanes) continue;
+
+                    const __m128 o_x = _mm_load_ps(ox + g * 4), o_y = _mm_load_ps(oy + g * 4), o_z = _mm_load_ps(oz + g * 4);
+                    const __m128 i_x = _mm_load_ps(ix + g * 4), i_y = _mm_load_ps(iy + g * 4), i_z = _mm_load_ps(iz + g * 4);
+
+                    const __m128 tx0 = _mm_mul_ps(_mm_sub_ps(min_x, o_x), i_x), tx1 = _mm_mul_ps(_mm_sub_ps(max_x, o_x), i_x);
+                    const __m128 ty0 = _mm_mul_ps(_mm_sub_ps(min_y, o_y), i_y), ty1 = _mm_mul_ps(_mm_sub_ps(max_y, o_y), i_y);
+                    const __m128 tz0 = _mm_mul_ps(_mm_sub_ps(min_z, o_z), i_z), tz1 = _mm_mul_ps(_mm_sub_ps(max_z, o_z), i_z);
+
+                    const __m128 t_near = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), zero));
+                    const __m128 t_far = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_load_ps(t_limit + g * 4)));
+
+                    mask |= (_mm_movemask_ps(_mm_cmple_ps(t_near, t_far)) & lanes) << (g * 4);
+                }
+                if (mask == 0) continue;
+
+                uint32_t first = 0;
+                while (!(mask & (1u << first))) ++first;
+
+                if (n.is_leaf())
+                {
+                    for (uint32_t i = first, m = mask >> first; m; ++i, m >>= 1) if (m & 1) visit(entry.id, n.data, i);
+                    continue;
+                }
+
+                // Order the children front to back along the first active ray; push the farther one first
+                const float3 separation = nodes[n.left].box.center() - nodes[n.right].box.center();
+                const bool left_is_farther = dot(separation, rays[first].direction) > 0.f;
+                pending[top++] = { left_is_farther ? n.left : n.right, mask };
+                pending[top++] = { left_is_farther ? n.right : n.left, mask };
+            }
+        }
+
+        // Calls visit(proxy, data, distance) for leaves in order of increasing distance from `point` to their
+        // fat box. The visitor returns the radius to search within from then on; traversal stops once the
+        // closest remaining box lies beyond it. Shrinking the radius to the k-th best result gives a k-nearest query.
+        template<typename Visitor>
+        void nearest(const float3 & point, float max_distance, Visitor && visit) const
+        {
+            if (root == null_node) return;
+
+            auto further = [](const ordered_entry & a, const ordered_entry & b) { return a.distance > b.distance; };
+
+            float max_distance2 = max_distance * max_distance;
+            ordered.clear();
+            ordered.push_back({ root, distance2(nodes[root].box, point) });
+            while (!ordered.empty())
+            {
+                std::pop_heap(ordered.begin(), ordered.end(), further);
+                const ordered_entry entry = ordered.back();
+                ordered.pop_back();
+                if (entry.distance > max_distance2) break;
+
+                const node & n = nodes[entry.id];
+                if (n.is_leaf())
+                {
+                    const float radius = visit(entry.id, n.data, std::sqrt(entry.distance));
+                    max_distance2 = std::min(max_distance2, radius * radius);
+                    continue;
+                }
+
+                for (const int32_t child : { n.left, n.right })
+                {
+                    const float d2 = distance2(nodes[child].box, point);
+                    if (d2 > max_distance2) continue;
+                    ordered.push_back({ child, d2 });
+                    std::push_heap(ordered.begin(), ordered.end(), further);
+                }
+            }
+        }
+
+        // Checks parent links, cached heights, and that every parent box encloses its children.
+        bool validate() const
+        {
+            if (root == null_node) return leaf_count == 0;
+            if (nodes[root].parent != null_node) return false;
+
+            uint32_t leaves = 0;
+            std::vector<int32_t> pending = { root };
+            while (!pending.empty())
+            {
+                const int32_t id = pending.back();
+                pending.pop_back();
+                const node & n = nodes[id];
+                if (n.is_leaf())
+                {
+                    if (n.height != 0) return false;
+                    ++leaves;
+                    continue;
+                }
+                const node & l = nodes[n.left];
+                const node & r = nodes[n.right];
+                if (l.parent != id || r.parent != id) return false;
+                if (n.height != 1 + std::max(l.height, r.height)) return false;
+                if (!encloses(n.box, l.box) || !encloses(n.box, r.box)) return false;
+                pending.push_back(n.left);
+                pending.push_back(n.right);
+            }
+            return leaves == leaf_count;
+        }
+    };
+
+} // end namespace polymer
+
+#endif // end polymer_aabb_tree_hpp
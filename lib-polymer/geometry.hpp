@@ -19,23 +19,14 @@ namespace polymer
         std::vector<float3> bitangents;
         std::vector<uint3> faces;
         std::vector<uint32_t> material;
+        std::vector<std::vector<uint3>> lods; // progressively simplified versions of faces, indexing the same vertices
     };
 
     typedef runtime_mesh geometry;
 
     inline aabb_3d compute_bounds(const geometry & g)
     {
-        aabb_3d bounds;
-
-        bounds._min = float3(std::numeric_limits<float>::infinity());
-        bounds._max = -bounds.min();
-
-        for (const auto & vertex : g.vertices)
-        {
-            bounds._min = linalg::min(bounds.min(), vertex);
-            bounds._max = linalg::max(bounds.max(), vertex);
-        }
-        return bounds;
+        return batch_compute_bounds(g.vertices.data(), g.vertices.size());
     }
 
     // Lengyel, Eric. "Computing Tangent Space Basis Vectors for an Arbitrary Mesh".
@@ -220,6 +211,37 @@ namespace polymer
         return s;
     }
 
+    // Interpolated texcoord and face normal at barycentrics |uv| (from intersect_ray_triangle) of |face|
+    inline void get_ray_mesh_hit_attributes(const geometry & mesh, const uint3 & face, const float2 & uv, float3 * outFaceNormal, float2 * outTexcoord)
+    {
+        if (outTexcoord && mesh.texcoord0.size())
+        {
+            float u = uv.x;
+            float v = uv.y;
+            float w = 1.f - u - v;
+
+            float3 weight = { std::max(0.f, w), std::max(0.f, u), std::max(0.f, v) };
+
+            const float fDiv = 1.f / (weight.x + weight.y + weight.z);
+            weight *= fDiv;
+
+            const float2 tc_0 = mesh.texcoord0[face.x];
+            const float2 tc_1 = mesh.texcoord0[face.y];
+            const float2 tc_2 = mesh.texcoord0[face.z];
+
+            *outTexcoord = tc_0 * weight.x + tc_1 * weight.y + tc_2 * weight.z;
+        }
+
+        if (outFaceNormal)
+        {
+            const auto v0 = mesh.vertices[face.x];
+            const auto v1 = mesh.vertices[face.y];
+            const auto v2 = mesh.vertices[face.z];
+            *outFaceNormal = safe_normalize(cross(v1 - v0, v2 - v0));
+        }
+    }
+
+    // Tests every face; see mesh_bvh (mesh-bvh.hpp) for repeated queries against the same mesh
     inline bool intersect_ray_mesh(const ray & ray,
         const geometry & mesh,
         float * outRayT = nullptr,
@@ -229,7 +251,7 @@ namespace polymer
     {
         float best_t = std::numeric_limits<float>::infinity(), t;
         uint3 best_face = { 0, 0, 0 };
-        float2 outUv;
+        float2 outUv, best_uv;
 
         for (int f = 0; f < mesh.faces.size(); ++f)
         {
@@ -238,6 +260,7 @@ namespace polymer
             {
                 best_t = t;
                 best_face = mesh.faces[f];
+                best_uv = outUv;
             }
         }
 
@@ -248,31 +271,7 @@ namespace polymer
             *outRayT = best_t;
         }
 
-        if (outTexcoord && mesh.texcoord0.size())
-        {
-            float u = outUv.x;
-            float v = outUv.y;
-            float w = 1.f - u - v;
-
-            float3 weight = { std::max(0.f, w), std::max(0.f, u), std::max(0.f, v) };
-
-            const float fDiv = 1.f / (weight.x + weight.y + weight.z);
-            weight *= fDiv;
-
-            const float2 tc_0 = mesh.texcoord0[best_face.x];
-            const float2 tc_1 = mesh.texcoord0[best_face.y];
-            const float2 tc_2 = mesh.texcoord0[best_face.z];
-
-            *outTexcoord = tc_0 * weight.x + tc_1 * weight.y + tc_2 * weight.z;
-        }
-
-        if (outFaceNormal)
-        {
-            const auto v0 = mesh.vertices[best_face.x];
-            const auto v1 = mesh.vertices[best_face.y];
-            const auto v2 = mesh.vertices[best_face.z];
-            *outFaceNormal = safe_normalize(cross(v1 - v0, v2 - v0));
-        }
+        get_ray_mesh_hit_attributes(mesh, best_face, best_uv, outFaceNormal, outTexcoord);
 
         return true;
     }
@@ -31,6 +31,8 @@
 #include "parabolic_pointer.hpp"
 #include "one_euro.hpp"
 #include "octree.hpp"
+#include "aabb-tree.hpp"
+#include "mesh-bvh.hpp"
 #include "movement_tracker.hpp"
 #include "algo_misc.hpp"
 
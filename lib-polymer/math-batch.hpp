@@ -0,0 +1,715 @@
+/*
+ * File: math-batch.hpp
+ * Batched math over structure-of-arrays data. The types in linalg.h and math-spatial.hpp describe a single
+ * vector, pose or matrix, so loops over many of them run one element at a time. The arrays here store each
+ * component in its own 64-byte aligned stream, padded to a multiple of eight elements, and every kernel
+ * processes a full SIMD register of elements per step.
+ *
+ * Each kernel is written once against a small lane type and instantiated for one lane (the scalar fallback),
+ * four lanes (SSE) and eight lanes (AVX2). The widest level the processor supports is detected at startup and
+ * can be lowered with set_simd_level(), which is how the tests compare the paths. Kernels use the same
+ * operation order at every width and avoid fused multiply-add, so all levels produce identical results.
+ * The AVX2 path is always available to MSVC, which accepts AVX intrinsics without /arch:AVX2. Other
+ * compilers only build it when AVX2 is enabled for the translation unit.
+ */
+
+#pragma once
+
+#ifndef math_batch_hpp
+#define math_batch_hpp
+
+#include "math-common.hpp"
+#include "math-spatial.hpp"
+#include "math-primitives.hpp"
+
+#include <vector>
+#include <limits>
+#include <stdint.h>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+#if defined(_MSC_VER) || defined(__AVX2__)
+    #define POLYMER_BATCH_AVX2 1
+#else
+    #define POLYMER_BATCH_AVX2 0
+#endif
+
+namespace polymer
+{
+
+    ///////////////////////////////////
+    //   instruction set selection   //
+    ///////////////////////////////////
+
+    enum class simd_level : uint32_t { scalar, sse, avx2 };
+
+    namespace batch_detail
+    {
+        inline simd_level detect_simd_level()
+        {
+        #if !POLYMER_BATCH_AVX2
+            return simd_level::sse;
+        #elif defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            const int max_leaf = info[0];
+            __cpuid(info, 1);
+            const bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+            if (!os_saves_ymm || max_leaf < 7) return simd_level::sse;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) ? simd_level::avx2 : simd_level::sse;
+        #else
+            return __builtin_cpu_supports("avx2") ? simd_level::avx2 : simd_level::sse;
+        #endif
+        }
+
+        inline simd_level & active_simd_level()
+        {
+            static simd_level level = detect_simd_level();
+            return level;
+        }
+    }
+
+    // The widest instruction set the processor (and this build) supports
+    inline simd_level get_supported_simd_level()
+    {
+        static const simd_level level = batch_detail::detect_simd_level();
+        return level;
+    }
+
+    inline simd_level get_simd_level() { return batch_detail::active_simd_level(); }
+
+    // Requests are clamped to what is supported. Not thread-safe; meant for tests and benchmarks.
+    inline void set_simd_level(const simd_level level)
+    {
+        batch_detail::active_simd_level() = std::min(level, get_supported_simd_level());
+    }
+
+    inline const char * get_simd_level_name(const simd_level level)
+    {
+        switch (level)
+        {
+        case simd_level::scalar: return "scalar";
+        case simd_level::sse: return "sse";
+        case simd_level::avx2: return "avx2";
+        }
+        return "unknown";
+    }
+
+    ////////////////////////////
+    //   structure of arrays  //
+    ////////////////////////////
+
+    template<typename T>
+    struct simd_allocator
+    {
+        typedef T value_type;
+        simd_allocator() = default;
+        template<typename U> simd_allocator(const simd_allocator<U> &) {}
+        T * allocate(const size_t n) { if (void * p = _mm_malloc(n * sizeof(T), 64)) return static_cast<T *>(p); throw std::bad_alloc(); }
+        void deallocate(T * p, const size_t) { _mm_free(p); }
+        template<typename U> bool operator == (const simd_allocator<U> &) const { return true; }
+        template<typename U> bool operator != (const simd_allocator<U> &) const { return false; }
+    };
+
+    // N equally long float streams. Streams are padded with zeros to a multiple of eight elements so kernels
+    // never need a remainder loop; results written to the padding are meaningless.
+    template<uint32_t N>
+    struct simd_soa
+    {
+        static constexpr uint32_t stream_count = N;
+        std::vector<float, simd_allocator<float>> streams[N];
+        size_t count{ 0 };
+
+        void resize(const size_t n)
+        {
+            count = n;
+            for (auto & s : streams) s.resize((n + 7) & ~size_t(7), 0.f);
+        }
+
+        size_t size() const { return count; }
+        float * operator[] (const uint32_t stream) { return streams[stream].data(); }
+        const float * operator[] (const uint32_t stream) const { return streams[stream].data(); }
+    };
+
+    struct float3_array : public simd_soa<3>
+    {
+        void set(const size_t i, const float3 & v) { streams[0][i] = v.x; streams[1][i] = v.y; streams[2][i] = v.z; }
+        float3 get(const size_t i) const { return { streams[0][i], streams[1][i], streams[2][i] }; }
+    };
+
+    // Also holds rotation quaternions and bounding spheres (center, radius)
+    struct float4_array : public simd_soa<4>
+    {
+        void set(const size_t i, const float4 & v) { streams[0][i] = v.x; streams[1][i] = v.y; streams[2][i] = v.z; streams[3][i] = v.w; }
+        void set(const size_t i, const quatf & q) { streams[0][i] = q.x; streams[1][i] = q.y; streams[2][i] = q.z; streams[3][i] = q.w; }
+        float4 get(const size_t i) const { return { streams[0][i], streams[1][i], streams[2][i], streams[3][i] }; }
+        quatf get_quat(const size_t i) const { return { streams[0][i], streams[1][i], streams[2][i], streams[3][i] }; }
+    };
+
+    // Affine transforms: the top three rows of a column-major float4x4 whose bottom row is (0, 0, 0, 1).
+    // Stream c * 3 + r holds column c, row r.
+    struct float3x4_array : public simd_soa<12>
+    {
+        void set(const size_t i, const float4x4 & m)
+        {
+            for (uint32_t c = 0; c < 4; ++c) for (uint32_t r = 0; r < 3; ++r) streams[c * 3 + r][i] = m[c][r];
+        }
+
+        float4x4 get(const size_t i) const
+        {
+            float4x4 m;
+            for (uint32_t c = 0; c < 4; ++c) m[c] = float4(streams[c * 3][i], streams[c * 3 + 1][i], streams[c * 3 + 2][i], c == 3 ? 1.f : 0.f);
+            return m;
+        }
+    };
+
+    namespace batch_detail
+    {
+
+        ///////////////////
+        //   lane types  //
+        ///////////////////
+
+        struct lanes1
+        {
+            static constexpr size_t width = 1;
+            float v;
+
+            static lanes1 load(const float * p) { return { *p }; }
+            static lanes1 loadu(const float * p) { return { *p }; }
+            static lanes1 set1(const float s) { return { s }; }
+            void store(float * p) const { *p = v; }
+
+            friend lanes1 operator + (const lanes1 a, const lanes1 b) { return { a.v + b.v }; }
+            friend lanes1 operator - (const lanes1 a, const lanes1 b) { return { a.v - b.v }; }
+            friend lanes1 operator * (const lanes1 a, const lanes1 b) { return { a.v * b.v }; }
+            friend lanes1 operator / (const lanes1 a, const lanes1 b) { return { a.v / b.v }; }
+            friend lanes1 vmin(const lanes1 a, const lanes1 b) { return { a.v < b.v ? a.v : b.v }; }
+            friend lanes1 vmax(const lanes1 a, const lanes1 b) { return { a.v > b.v ? a.v : b.v }; }
+            friend lanes1 vabs(const lanes1 a) { return { std::abs(a.v) }; }
+
+            // One bit per lane
+            friend int less_mask(const lanes1 a, const lanes1 b) { return a.v < b.v ? 1 : 0; }
+            friend int less_equal_mask(const lanes1 a, const lanes1 b) { return a.v <= b.v ? 1 : 0; }
+
+            // Interleaved xyz xyz ... to and from one register per component
+            static void load3(const float * p, lanes1 & x, lanes1 & y, lanes1 & z) { x.v = p[0]; y.v = p[1]; z.v = p[2]; }
+            static void store3(float * p, const lanes1 x, const lanes1 y, const lanes1 z) { p[0] = x.v; p[1] = y.v; p[2] = z.v; }
+
+            float reduce_min() const { return v; }
+            float reduce_max() const { return v; }
+        };
+
+        struct lanes4
+        {
+            static constexpr size_t width = 4;
+            __m128 v;
+
+            static lanes4 load(const float * p) { return { _mm_load_ps(p) }; }
+            static lanes4 loadu(const float * p) { return { _mm_loadu_ps(p) }; }
+            static lanes4 set1(const float s) { return { _mm_set1_ps(s) }; }
+            void store(float * p) const { _mm_store_ps(p, v); }
+
+            friend lanes4 operator + (const lanes4 a, const lanes4 b) { return { _mm_add_ps(a.v, b.v) }; }
+            friend lanes4 operator - (const lanes4 a, const lanes4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+            friend lanes4 operator * (const lanes4 a, const lanes4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+            friend lanes4 operator / (const lanes4 a, const lanes4 b) { return { _mm_div_ps(a.v, b.v) }; }
+            friend lanes4 vmin(const lanes4 a, const lanes4 b) { return { _mm_min_ps(a.v, b.v) }; }
+            friend lanes4 vmax(const lanes4 a, const lanes4 b) { return { _mm_max_ps(a.v, b.v) }; }
+            friend lanes4 vabs(const lanes4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.f), a.v) }; }
+
+            friend int less_mask(const lanes4 a, const lanes4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)); }
+            friend int less_equal_mask(const lanes4 a, const lanes4 b) { return _mm_movemask_ps(_mm_cmple_ps(a.v, b.v)); }
+
+            // [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3]
+            static void load3(const float * p, lanes4 & x, lanes4 & y, lanes4 & z)
+            {
+                const __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+                x.v = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 3, 0, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 1, 0, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+                y.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 0, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(0, 2, 0, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+                z.v = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 1, 0, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+            }
+
+            static void store3(float * p, const lanes4 x, const lanes4 y, const lanes4 z)
+            {
+                const __m128 xy01 = _mm_unpacklo_ps(x.v, y.v), xy23 = _mm_unpackhi_ps(x.v, y.v);
+                _mm_storeu_ps(p, _mm_shuffle_ps(xy01, _mm_shuffle_ps(z.v, xy01, _MM_SHUFFLE(0, 2, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0)));
+                _mm_storeu_ps(p + 4, _mm_shuffle_ps(_mm_shuffle_ps(xy01, z.v, _MM_SHUFFLE(0, 1, 0, 3)), xy23, _MM_SHUFFLE(1, 0, 2, 0)));
+                _mm_storeu_ps(p + 8, _mm_shuffle_ps(_mm_shuffle_ps(z.v, xy23, _MM_SHUFFLE(0, 2, 0, 2)), _mm_shuffle_ps(xy23, z.v, _MM_SHUFFLE(0, 3, 0, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+            }
+
+            float reduce_min() const
+            {
+                const __m128 m = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+                return _mm_cvtss_f32(_mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1))));
+            }
+
+            float reduce_max() const
+            {
+                const __m128 m = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+                return _mm_cvtss_f32(_mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1))));
+            }
+        };
+
+    #if POLYMER_BATCH_AVX2
+        // Shuffles here use 256-bit permutes and blends rather than pairs of SSE operations: without /arch:AVX,
+        // MSVC emits SSE intrinsics with the legacy encoding, and mixing encodings in a loop is slow
+        struct lanes8
+        {
+            static constexpr size_t width = 8;
+            __m256 v;
+
+            static lanes8 load(const float * p) { return { _mm256_load_ps(p) }; }
+            static lanes8 loadu(const float * p) { return { _mm256_loadu_ps(p) }; }
+            static lanes8 set1(const float s) { return { _mm256_set1_ps(s) }; }
+            void store(float * p) const { _mm256_store_ps(p, v); }
+
+            friend lanes8 operator + (const lanes8 a, const lanes8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+            friend lanes8 operator - (const lanes8 a, const lanes8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+            friend lanes8 operator * (const lanes8 a, const lanes8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+            friend lanes8 operator / (const lanes8 a, const lanes8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+            friend lanes8 vmin(const lanes8 a, const lanes8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+            friend lanes8 vmax(const lanes8 a, const lanes8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+            friend lanes8 vabs(const lanes8 a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v) }; }
+
+            friend int less_mask(const lanes8 a, const lanes8 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+            friend int less_equal_mask(const lanes8 a, const lanes8 b) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)); }
+
+            // Three registers of interleaved points are blended so that each component sits in a distinct set
+            // of lanes, then permuted into order: [x0 y0 z0 x1 y1 z1 x2 y2] [z2 x3 y3 z3 x4 y4 z4 x5] [y5 z5 x6 y6 z6 x7 y7 z7]
+            static void load3(const float * p, lanes8 & x, lanes8 & y, lanes8 & z)
+            {
+                const __m256 m0 = _mm256_loadu_ps(p), m1 = _mm256_loadu_ps(p + 8), m2 = _mm256_loadu_ps(p + 16);
+                x.v = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(m0, m1, 0x92), m2, 0x24), _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+                y.v = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(m0, m1, 0x24), m2, 0x49), _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6));
+                z.v = _mm256_permutevar8x32_ps(_mm256_blend_ps(_mm256_blend_ps(m0, m1, 0x49), m2, 0x92), _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+            }
+
+            static void store3(float * p, const lanes8 x, const lanes8 y, const lanes8 z)
+            {
+                const __m256 xb = _mm256_permutevar8x32_ps(x.v, _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5));
+                const __m256 yb = _mm256_permutevar8x32_ps(y.v, _mm256_setr_epi32(5, 0, 3, 6, 1, 4, 7, 2));
+                const __m256 zb = _mm256_permutevar8x32_ps(z.v, _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7));
+                _mm256_storeu_ps(p, _mm256_blend_ps(_mm256_blend_ps(xb, yb, 0x92), zb, 0x24));
+                _mm256_storeu_ps(p + 8, _mm256_blend_ps(_mm256_blend_ps(xb, zb, 0x49), yb, 0x24));
+                _mm256_storeu_ps(p + 16, _mm256_blend_ps(_mm256_blend_ps(xb, yb, 0x49), zb, 0x92));
+            }
+
+            float reduce_min() const
+            {
+                __m256 m = _mm256_min_ps(v, _mm256_permute2f128_ps(v, v, 1));
+                m = _mm256_min_ps(m, _mm256_permute_ps(m, _MM_SHUFFLE(1, 0, 3, 2)));
+                return _mm_cvtss_f32(_mm256_castps256_ps128(_mm256_min_ps(m, _mm256_permute_ps(m, _MM_SHUFFLE(2, 3, 0, 1)))));
+            }
+
+            float reduce_max() const
+            {
+                __m256 m = _mm256_max_ps(v, _mm256_permute2f128_ps(v, v, 1));
+                m = _mm256_max_ps(m, _mm256_permute_ps(m, _MM_SHUFFLE(1, 0, 3, 2)));
+                return _mm_cvtss_f32(_mm256_castps256_ps128(_mm256_max_ps(m, _mm256_permute_ps(m, _MM_SHUFFLE(2, 3, 0, 1)))));
+            }
+        };
+    #endif
+
+        // Calls f with a lane type for the active instruction set
+        template<typename F>
+        inline void dispatch(F && f)
+        {
+            switch (get_simd_level())
+            {
+        #if POLYMER_BATCH_AVX2
+            case simd_level::avx2: f(lanes8()); _mm256_zeroupper(); return;
+        #endif
+            case simd_level::sse: f(lanes4()); return;
+            default: f(lanes1()); return;
+            }
+        }
+
+        template<typename V>
+        struct vec3 { V x, y, z; };
+
+        template<typename V>
+        inline vec3<V> load_vec3(const simd_soa<3> & a, const size_t i) { return { V::load(a[0] + i), V::load(a[1] + i), V::load(a[2] + i) }; }
+
+        template<typename V>
+        inline void store_vec3(simd_soa<3> & a, const size_t i, const vec3<V> & v) { v.x.store(a[0] + i); v.y.store(a[1] + i); v.z.store(a[2] + i); }
+
+        // The columns of a rotation matrix, as qxdir, qydir and qzdir
+        template<typename V>
+        inline void quat_columns(const V qx, const V qy, const V qz, const V qw, vec3<V> & cx, vec3<V> & cy, vec3<V> & cz)
+        {
+            const V two = V::set1(2.f);
+            const V xx = qx * qx, yy = qy * qy, zz = qz * qz, ww = qw * qw;
+            cx = { ww + xx - yy - zz, (qx * qy + qz * qw) * two, (qz * qx - qy * qw) * two };
+            cy = { (qx * qy - qz * qw) * two, ww - xx + yy - zz, (qy * qz + qx * qw) * two };
+            cz = { (qz * qx + qy * qw) * two, (qy * qz - qx * qw) * two, ww - xx - yy + zz };
+        }
+
+        // Affine matrix in 12 registers, laid out as float3x4_array streams
+        template<typename V>
+        struct affine { V m[12]; };
+
+        template<typename V>
+        inline affine<V> load_affine(const float3x4_array & a, const size_t i)
+        {
+            affine<V> r;
+            for (uint32_t k = 0; k < 12; ++k) r.m[k] = V::load(a[k] + i);
+            return r;
+        }
+
+        template<typename V>
+        inline affine<V> broadcast_affine(const float4x4 & m)
+        {
+            affine<V> r;
+            for (uint32_t c = 0; c < 4; ++c) for (uint32_t k = 0; k < 3; ++k) r.m[c * 3 + k] = V::set1(m[c][k]);
+            return r;
+        }
+
+        template<typename V>
+        inline void transform_point(const affine<V> & a, const V x, const V y, const V z, V & ox, V & oy, V & oz)
+        {
+            ox = a.m[0] * x + a.m[3] * y + a.m[6] * z + a.m[9];
+            oy = a.m[1] * x + a.m[4] * y + a.m[7] * z + a.m[10];
+            oz = a.m[2] * x + a.m[5] * y + a.m[8] * z + a.m[11];
+        }
+
+        /////////////////
+        //   kernels   //
+        /////////////////
+
+        template<typename V>
+        void compose(const float4_array & parent_rotation, const float3_array & parent_position, const float4_array & local_rotation, const float3_array & local_position,
+            float4_array & out_rotation, float3_array & out_position)
+        {
+            for (size_t i = 0; i < parent_rotation.size(); i += V::width)
+            {
+                const V ax = V::load(parent_rotation[0] + i), ay = V::load(parent_rotation[1] + i), az = V::load(parent_rotation[2] + i), aw = V::load(parent_rotation[3] + i);
+                const V bx = V::load(local_rotation[0] + i), by = V::load(local_rotation[1] + i), bz = V::load(local_rotation[2] + i), bw = V::load(local_rotation[3] + i);
+
+                // Quaternion product as in linalg's operator *
+                (ax * bw + aw * bx + ay * bz - az * by).store(out_rotation[0] + i);
+                (ay * bw + aw * by + az * bx - ax * bz).store(out_rotation[1] + i);
+                (az * bw + aw * bz + ax * by - ay * bx).store(out_rotation[2] + i);
+                (aw * bw - ax * bx - ay * by - az * bz).store(out_rotation[3] + i);
+
+                // parent.transform_coord(local.position)
+                vec3<V> cx, cy, cz;
+                quat_columns(ax, ay, az, aw, cx, cy, cz);
+                const vec3<V> p = load_vec3<V>(local_position, i), t = load_vec3<V>(parent_position, i);
+                store_vec3<V>(out_position, i, { t.x + (cx.x * p.x + cy.x * p.y + cz.x * p.z), t.y + (cx.y * p.x + cy.y * p.y + cz.y * p.z), t.z + (cx.z * p.x + cy.z * p.y + cz.z * p.z) });
+            }
+        }
+
+        template<typename V>
+        void make_matrices(const float4_array & rotation, const float3_array & position, const float3_array & scale, float3x4_array & out)
+        {
+            for (size_t i = 0; i < rotation.size(); i += V::width)
+            {
+                vec3<V> cx, cy, cz;
+                quat_columns(V::load(rotation[0] + i), V::load(rotation[1] + i), V::load(rotation[2] + i), V::load(rotation[3] + i), cx, cy, cz);
+                const vec3<V> s = load_vec3<V>(scale, i);
+
+                (cx.x * s.x).store(out[0] + i); (cx.y * s.x).store(out[1] + i); (cx.z * s.x).store(out[2] + i);
+                (cy.x * s.y).store(out[3] + i); (cy.y * s.y).store(out[4] + i); (cy.z * s.y).store(out[5] + i);
+                (cz.x * s.z).store(out[6] + i); (cz.y * s.z).store(out[7] + i); (cz.z * s.z).store(out[8] + i);
+                V::load(position[0] + i).store(out[9] + i);
+                V::load(position[1] + i).store(out[10] + i);
+                V::load(position[2] + i).store(out[11] + i);
+            }
+        }
+
+        template<typename V>
+        void multiply(const float3x4_array & lhs, const float3x4_array & rhs, float3x4_array & out)
+        {
+            for (size_t i = 0; i < lhs.size(); i += V::width)
+            {
+                const affine<V> a = load_affine<V>(lhs, i), b = load_affine<V>(rhs, i);
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    const V bx = b.m[c * 3], by = b.m[c * 3 + 1], bz = b.m[c * 3 + 2];
+                    for (uint32_t r = 0; r < 3; ++r)
+                    {
+                        V v = a.m[r] * bx + a.m[3 + r] * by + a.m[6 + r] * bz;
+                        if (c == 3) v = v + a.m[9 + r];
+                        v.store(out[c * 3 + r] + i);
+                    }
+                }
+            }
+        }
+
+        template<typename V>
+        void inverse(const float3x4_array & in, float3x4_array & out)
+        {
+            for (size_t i = 0; i < in.size(); i += V::width)
+            {
+                const affine<V> a = load_affine<V>(in, i);
+                const V a00 = a.m[0], a10 = a.m[1], a20 = a.m[2];   // column 0
+                const V a01 = a.m[3], a11 = a.m[4], a21 = a.m[5];   // column 1
+                const V a02 = a.m[6], a12 = a.m[7], a22 = a.m[8];   // column 2
+
+                // Cofactors of the upper 3x3, divided by the determinant
+                const V c00 = a11 * a22 - a12 * a21, c01 = a12 * a20 - a10 * a22, c02 = a10 * a21 - a11 * a20;
+                const V inv_det = V::set1(1.f) / (a00 * c00 + a01 * c01 + a02 * c02);
+
+                V r[9];
+                r[0] = c00 * inv_det;                       r[3] = (a02 * a21 - a01 * a22) * inv_det;   r[6] = (a01 * a12 - a02 * a11) * inv_det;
+                r[1] = c01 * inv_det;                       r[4] = (a00 * a22 - a02 * a20) * inv_det;   r[7] = (a02 * a10 - a00 * a12) * inv_det;
+                r[2] = c02 * inv_det;                       r[5] = (a01 * a20 - a00 * a21) * inv_det;   r[8] = (a00 * a11 - a01 * a10) * inv_det;
+                for (uint32_t k = 0; k < 9; ++k) r[k].store(out[k] + i);
+
+                // -inverse(A) * t
+                const V zero = V::set1(0.f);
+                for (uint32_t k = 0; k < 3; ++k) (zero - (r[k] * a.m[9] + r[3 + k] * a.m[10] + r[6 + k] * a.m[11])).store(out[9 + k] + i);
+            }
+        }
+
+        template<typename V>
+        void transform_points(const affine<V> & m, const float3_array & in, float3_array & out)
+        {
+            for (size_t i = 0; i < in.size(); i += V::width)
+            {
+                const vec3<V> p = load_vec3<V>(in, i);
+                vec3<V> r;
+                transform_point(m, p.x, p.y, p.z, r.x, r.y, r.z);
+                store_vec3<V>(out, i, r);
+            }
+        }
+
+        template<typename V>
+        size_t transform_points_interleaved(const float4x4 & matrix, const float3 * in, float3 * out, const size_t count)
+        {
+            const affine<V> m = broadcast_affine<V>(matrix);
+            size_t i = 0;
+            for (; i + V::width <= count; i += V::width)
+            {
+                V x, y, z, rx, ry, rz;
+                V::load3(&in[i].x, x, y, z);
+                transform_point(m, x, y, z, rx, ry, rz);
+                V::store3(&out[i].x, rx, ry, rz);
+            }
+            return i;
+        }
+
+        // As transform_aabb(): the center is transformed and the half extent is projected onto each world axis
+        template<typename V>
+        void transform_bounds(const float3x4_array & matrices, const float3_array & local_min, const float3_array & local_max, float3_array & world_min, float3_array & world_max)
+        {
+            const V half = V::set1(0.5f);
+            for (size_t i = 0; i < matrices.size(); i += V::width)
+            {
+                const affine<V> a = load_affine<V>(matrices, i);
+                const vec3<V> lo = load_vec3<V>(local_min, i), hi = load_vec3<V>(local_max, i);
+                const vec3<V> c = { (lo.x + hi.x) * half, (lo.y + hi.y) * half, (lo.z + hi.z) * half };
+                const vec3<V> e = { (hi.x - lo.x) * half, (hi.y - lo.y) * half, (hi.z - lo.z) * half };
+
+                vec3<V> wc, we;
+                transform_point(a, c.x, c.y, c.z, wc.x, wc.y, wc.z);
+                we.x = vabs(a.m[0]) * e.x + vabs(a.m[3]) * e.y + vabs(a.m[6]) * e.z;
+                we.y = vabs(a.m[1]) * e.x + vabs(a.m[4]) * e.y + vabs(a.m[7]) * e.z;
+                we.z = vabs(a.m[2]) * e.x + vabs(a.m[5]) * e.y + vabs(a.m[8]) * e.z;
+
+                store_vec3<V>(world_min, i, { wc.x - we.x, wc.y - we.y, wc.z - we.z });
+                store_vec3<V>(world_max, i, { wc.x + we.x, wc.y + we.y, wc.z + we.z });
+            }
+        }
+
+        // Writes frustum_containment values, with the semantics of frustum::intersects() and contains() for spheres
+        template<typename V>
+        void classify_spheres(const frustum & f, const float4_array & spheres, uint8_t * out)
+        {
+            for (size_t i = 0; i < spheres.size(); i += V::width)
+            {
+                const V x = V::load(spheres[0] + i), y = V::load(spheres[1] + i), z = V::load(spheres[2] + i), radius = V::load(spheres[3] + i);
+                const V neg_radius = V::set1(0.f) - radius;
+
+                int outside = 0, straddling = 0;
+                for (const plane & p : f.planes)
+                {
+                    const V d = V::set1(p.equation.x) * x + V::set1(p.equation.y) * y + V::set1(p.equation.z) * z + V::set1(p.equation.w);
+                    outside |= less_equal_mask(d, neg_radius);
+                    straddling |= less_mask(d, radius);
+                }
+
+                const size_t lanes = std::min(V::width, spheres.size() - i);
+                for (size_t l = 0; l < lanes; ++l)
+                {
+                    const frustum_containment c = (outside & (1 << l)) ? frustum_containment::outside : (straddling & (1 << l)) ? frustum_containment::intersecting : frustum_containment::inside;
+                    out[i + l] = static_cast<uint8_t>(c);
+                }
+            }
+        }
+
+        // Writes frustum_containment values, with the semantics of frustum::classify()
+        template<typename V>
+        void classify_boxes(const frustum & f, const float3_array & box_min, const float3_array & box_max, uint8_t * out)
+        {
+            const V half = V::set1(0.5f), zero = V::set1(0.f);
+            for (size_t i = 0; i < box_min.size(); i += V::width)
+            {
+                const vec3<V> lo = load_vec3<V>(box_min, i), hi = load_vec3<V>(box_max, i);
+                const vec3<V> c = { (lo.x + hi.x) * half, (lo.y + hi.y) * half, (lo.z + hi.z) * half };
+                const vec3<V> e = { (hi.x - lo.x) * half, (hi.y - lo.y) * half, (hi.z - lo.z) * half };
+
+                int outside = 0, straddling = 0;
+                for (const plane & p : f.planes)
+                {
+                    // Distance of the center, and the extent's projection onto the plane normal
+                    const V d = V::set1(p.equation.x) * c.x + V::set1(p.equation.y) * c.y + V::set1(p.equation.z) * c.z + V::set1(p.equation.w);
+                    const V r = V::set1(std::abs(p.equation.x)) * e.x + V::set1(std::abs(p.equation.y)) * e.y + V::set1(std::abs(p.equation.z)) * e.z;
+                    outside |= less_mask(d + r, zero);
+                    straddling |= less_mask(d - r, zero);
+                }
+
+                const size_t lanes = std::min(V::width, box_min.size() - i);
+                for (size_t l = 0; l < lanes; ++l)
+                {
+                    const frustum_containment c = (outside & (1 << l)) ? frustum_containment::outside : (straddling & (1 << l)) ? frustum_containment::intersecting : frustum_containment::inside;
+                    out[i + l] = static_cast<uint8_t>(c);
+                }
+            }
+        }
+
+        template<typename V>
+        size_t compute_bounds_interleaved(const float3 * points, const size_t count, float3 & bmin, float3 & bmax)
+        {
+            V min_x = V::set1(bmin.x), min_y = V::set1(bmin.y), min_z = V::set1(bmin.z);
+            V max_x = V::set1(bmax.x), max_y = V::set1(bmax.y), max_z = V::set1(bmax.z);
+
+            size_t i = 0;
+            for (; i + V::width <= count; i += V::width)
+            {
+                V x, y, z;
+                V::load3(&points[i].x, x, y, z);
+                min_x = vmin(min_x, x); min_y = vmin(min_y, y); min_z = vmin(min_z, z);
+                max_x = vmax(max_x, x); max_y = vmax(max_y, y); max_z = vmax(max_z, z);
+            }
+
+            bmin = float3(min_x.reduce_min(), min_y.reduce_min(), min_z.reduce_min());
+            bmax = float3(max_x.reduce_max(), max_y.reduce_max(), max_z.reduce_max());
+            return i;
+        }
+
+        template<typename V>
+        void compute_bounds(const float3_array & points, float3 & bmin, float3 & bmax)
+        {
+            V min_x = V::set1(bmin.x), min_y = V::set1(bmin.y), min_z = V::set1(bmin.z);
+            V max_x = V::set1(bmax.x), max_y = V::set1(bmax.y), max_z = V::set1(bmax.z);
+
+            // Only whole registers; the padding would otherwise be counted as points at the origin
+            size_t i = 0;
+            for (; i + V::width <= points.size(); i += V::width)
+            {
+                const vec3<V> p = load_vec3<V>(points, i);
+                min_x = vmin(min_x, p.x); min_y = vmin(min_y, p.y); min_z = vmin(min_z, p.z);
+                max_x = vmax(max_x, p.x); max_y = vmax(max_y, p.y); max_z = vmax(max_z, p.z);
+            }
+
+            bmin = float3(min_x.reduce_min(), min_y.reduce_min(), min_z.reduce_min());
+            bmax = float3(max_x.reduce_max(), max_y.reduce_max(), max_z.reduce_max());
+            for (; i < points.size(); ++i)
+            {
+                bmin = linalg::min(bmin, points.get(i));
+                bmax = linalg::max(bmax, points.get(i));
+            }
+        }
+
+    } // end namespace batch_detail
+
+    //////////////////////////
+    //   batch operations   //
+    //////////////////////////
+
+    // out[i] = parent[i] * local[i], as transform::operator *
+    inline void batch_compose(const float4_array & parent_rotation, const float3_array & parent_position, const float4_array & local_rotation, const float3_array & local_position,
+        float4_array & out_rotation, float3_array & out_position)
+    {
+        out_rotation.resize(parent_rotation.size());
+        out_position.resize(parent_rotation.size());
+        batch_detail::dispatch([&](auto lanes) { batch_detail::compose<decltype(lanes)>(parent_rotation, parent_position, local_rotation, local_position, out_rotation, out_position); });
+    }
+
+    // out[i] = transform(rotation[i], position[i]).matrix() * make_scaling_matrix(scale[i])
+    inline void batch_make_matrices(const float4_array & rotation, const float3_array & position, const float3_array & scale, float3x4_array & out)
+    {
+        out.resize(rotation.size());
+        batch_detail::dispatch([&](auto lanes) { batch_detail::make_matrices<decltype(lanes)>(rotation, position, scale, out); });
+    }
+
+    // out[i] = lhs[i] * rhs[i]
+    inline void batch_multiply(const float3x4_array & lhs, const float3x4_array & rhs, float3x4_array & out)
+    {
+        out.resize(lhs.size());
+        batch_detail::dispatch([&](auto lanes) { batch_detail::multiply<decltype(lanes)>(lhs, rhs, out); });
+    }
+
+    // out[i] = inverse(in[i])
+    inline void batch_inverse(const float3x4_array & in, float3x4_array & out)
+    {
+        out.resize(in.size());
+        batch_detail::dispatch([&](auto lanes) { batch_detail::inverse<decltype(lanes)>(in, out); });
+    }
+
+    // transform_coord() of every point by one affine matrix (no perspective divide)
+    inline void batch_transform_coords(const float4x4 & matrix, const float3_array & in, float3_array & out)
+    {
+        out.resize(in.size());
+        batch_detail::dispatch([&](auto lanes) { batch_detail::transform_points<decltype(lanes)>(batch_detail::broadcast_affine<decltype(lanes)>(matrix), in, out); });
+    }
+
+    // Interleaved form for vertex arrays; `in` and `out` may be the same array
+    inline void batch_transform_coords(const float4x4 & matrix, const float3 * in, float3 * out, const size_t count)
+    {
+        size_t done = 0;
+        batch_detail::dispatch([&](auto lanes) { done = batch_detail::transform_points_interleaved<decltype(lanes)>(matrix, in, out, count); });
+        batch_detail::transform_points_interleaved<batch_detail::lanes1>(matrix, in + done, out + done, count - done);
+    }
+
+    // transform_aabb() of each box by its own matrix
+    inline void batch_transform_bounds(const float3x4_array & matrices, const float3_array & local_min, const float3_array & local_max, float3_array & world_min, float3_array & world_max)
+    {
+        world_min.resize(matrices.size());
+        world_max.resize(matrices.size());
+        batch_detail::dispatch([&](auto lanes) { batch_detail::transform_bounds<decltype(lanes)>(matrices, local_min, local_max, world_min, world_max); });
+    }
+
+    // Spheres are (center, radius). Writes static_cast<uint8_t>(frustum_containment) per sphere, matching
+    // frustum::intersects() and frustum::contains() for spheres.
+    inline void batch_classify_spheres(const frustum & f, const float4_array & spheres, uint8_t * out)
+    {
+        batch_detail::dispatch([&](auto lanes) { batch_detail::classify_spheres<decltype(lanes)>(f, spheres, out); });
+    }
+
+    // Writes static_cast<uint8_t>(frustum_containment) per box, matching frustum::classify()
+    inline void batch_classify_boxes(const frustum & f, const float3_array & box_min, const float3_array & box_max, uint8_t * out)
+    {
+        batch_detail::dispatch([&](auto lanes) { batch_detail::classify_boxes<decltype(lanes)>(f, box_min, box_max, out); });
+    }
+
+    // Bounds of a point cloud. An empty input gives the inverted box (+inf, -inf), as compute_bounds() does.
+    inline aabb_3d batch_compute_bounds(const float3 * points, const size_t count)
+    {
+        float3 bmin = float3(std::numeric_limits<float>::infinity()), bmax = -bmin;
+        size_t done = 0;
+        batch_detail::dispatch([&](auto lanes) { done = batch_detail::compute_bounds_interleaved<decltype(lanes)>(points, count, bmin, bmax); });
+        for (size_t i = done; i < count; ++i)
+        {
+            bmin = linalg::min(bmin, points[i]);
+            bmax = linalg::max(bmax, points[i]);
+        }
+        return aabb_3d(bmin, bmax);
+    }
+
+    inline aabb_3d batch_compute_bounds(const float3_array & points)
+    {
+        float3 bmin = float3(std::numeric_limits<float>::infinity()), bmax = -bmin;
+        batch_detail::dispatch([&](auto lanes) { batch_detail::compute_bounds<decltype(lanes)>(points, bmin, bmax); });
+        return aabb_3d(bmin, bmax);
+    }
+
+} // end namespace polymer
+
+#endif // end math_batch_hpp
@@ -70,6 +70,7 @@ namespace polymer
         float3 size() const { return _max - _min; }
         float3 center() const { return (_min + _max) * 0.5f; }
         float volume() const { return (_max.x - _min.x) * (_max.y - _min.y) * (_max.z - _min.z); }
+        float surface_area() const { const float3 d = _max - _min; return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x); }
 
         float width() const { return _max.x - _min.x; }
         float height() const { return _max.y - _min.y; }
@@ -146,6 +147,20 @@ namespace polymer
     {
         return o << "{" << b.min() << " to " << b.max() << "}";
     }
+
+    // Conservative world-space bounds of a box under an affine transform (Arvo, "Transforming Axis-Aligned Bounding Boxes")
+    inline aabb_3d transform_aabb(const float4x4 & xform, const aabb_3d & box)
+    {
+        const float3 center = box.center();
+        const float3 extent = box.size() * 0.5f;
+        const float3 new_center = (xform * float4(center, 1.f)).xyz();
+        float3 new_extent;
+        for (int r = 0; r < 3; ++r)
+        {
+            new_extent[r] = std::abs(xform[0][r]) * extent.x + std::abs(xform[1][r]) * extent.y + std::abs(xform[2][r]) * extent.z;
+        }
+        return aabb_3d(new_center - new_extent, new_center + new_extent);
+    }
    
     ////////////////
     //   sphere   //
@@ -346,6 +361,8 @@ namespace polymer
 
     enum FrustumPlane { RIGHT, LEFT, BOTTOM, TOP, NEAR, FAR };
 
+    enum class frustum_containment { outside, intersecting, inside };
+
     struct frustum
     {
         // frustum normals point inward
@@ -429,6 +446,20 @@ namespace polymer
             return true;
         }
 
+        // Classifies a box as fully outside, straddling, or fully inside the frustum. Hierarchical culling
+        // uses the `inside` result to accept an entire subtree without testing its children.
+        frustum_containment classify(const aabb_3d & box) const
+        {
+            frustum_containment result = frustum_containment::inside;
+            for (int p = 0; p < 6; p++)
+            {
+                const float3 n = planes[p].get_normal();
+                if (planes[p].distance_to(box.get_positive(n)) < 0.f) return frustum_containment::outside;
+                if (planes[p].distance_to(box.get_negative(n)) < 0.f) result = frustum_containment::intersecting;
+            }
+            return result;
+        }
+
     };
 
     inline std::array<float3, 8> make_frustum_corners(const frustum & f)
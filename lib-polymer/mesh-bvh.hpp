@@ -0,0 +1,587 @@
+/*
+ * File: mesh-bvh.hpp
+ * A static bounding volume hierarchy over the triangles of a runtime_mesh, for ray queries such as editor
+ * picking and controller focus. The tree is built once with binned SAH (surface area heuristic) splits, then
+ * collapsed from a binary tree into a four-wide one. Each node stores the boxes of its four children as SSE
+ * lanes, so a single visit tests all four. Leaf triangles are stored as a vertex and two edges, packed four to
+ * a block in the same lane layout, so one Möller–Trumbore evaluation tests four triangles. Nodes and blocks live
+ * in flat, 64-byte aligned arrays. intersect4() traces four rays together; it pays off when the rays are
+ * coherent, like those covering a pick region.
+ */
+
+#pragma once
+
+#ifndef polymer_mesh_bvh_hpp
+#define polymer_mesh_bvh_hpp
+
+#include "geometry.hpp"
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <stdint.h>
+#include <assert.h>
+#include <xmmintrin.h>
+
+namespace polymer
+{
+    struct mesh_bvh_hit
+    {
+        float t{ std::numeric_limits<float>::infinity() };
+        uint32_t face{ 0xffffffff };    // index into runtime_mesh::faces
+        float2 uv{ 0, 0 };              // barycentrics of the hit within the face, as with intersect_ray_triangle
+        bool hit() const { return face != 0xffffffff; }
+    };
+
+    class mesh_bvh
+    {
+        static constexpr uint32_t leaf_flag = 0x80000000;     // leaf children: leaf_flag | first block << 2 | (block count - 1)
+        static constexpr uint32_t max_leaf_blocks = 4;
+        static constexpr uint32_t bin_count = 16;
+        static constexpr uint32_t max_build_depth = 64;         // deeper subtrees are median split
+
+        // Median splits halve the face count, so they add at most 32 levels below max_build_depth. A four-wide node
+        // leaves at most three siblings on the stack, and each one sits at least one binary level below its parent.
+        static constexpr uint32_t max_tree_depth = max_build_depth + 32;
+        static constexpr uint32_t stack_size = max_tree_depth * 3 + 1;
+
+        // Children are packed into the first |child_count| lanes
+        struct alignas(16) node
+        {
+            float min_x[4], min_y[4], min_z[4];
+            float max_x[4], max_y[4], max_z[4];
+            uint32_t child[4];
+            uint32_t child_count;
+            uint32_t pad[3];
+        };
+
+        // Unused lanes have zero edges, which the triangle test rejects
+        struct alignas(16) triangle_block
+        {
+            float v0_x[4], v0_y[4], v0_z[4];
+            float e1_x[4], e1_y[4], e1_z[4];
+            float e2_x[4], e2_y[4], e2_z[4];
+            uint32_t face[4];
+        };
+
+        struct build_node
+        {
+            aabb_3d bounds;
+            uint32_t left{ 0xffffffff }, right{ 0xffffffff };   // both unset for leaves
+            uint32_t first{ 0 }, count{ 0 };                    // range of the triangle order, for leaves
+            bool is_leaf() const { return left == 0xffffffff; }
+        };
+
+        struct build_state
+        {
+            std::vector<uint32_t> order;
+            std::vector<aabb_3d> bounds;
+            std::vector<float3> centroids;
+            std::vector<build_node> nodes;
+            uint32_t depth{ 0 };    // deepest node reached
+        };
+
+        std::vector<node, simd_allocator<node>> nodes;
+        std::vector<triangle_block, simd_allocator<triangle_block>> blocks;
+        aabb_3d root_bounds;
+        uint32_t depth{ 0 };
+
+        static float surface_area(const aabb_3d & b)
+        {
+            const float3 e = b._max - b._min;
+            return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+
+        static aabb_3d empty_bounds()
+        {
+            const float inf = std::numeric_limits<float>::infinity();
+            return { float3(inf), float3(-inf) };
+        }
+
+        static void grow(aabb_3d & b, const aabb_3d & other)
+        {
+            b._min = linalg::min(b._min, other._min);
+            b._max = linalg::max(b._max, other._max);
+        }
+
+        // Triangles are costed in blocks of four since that is how they are tested
+        static float block_cost(const uint32_t count) { return static_cast<float>((count + 3) / 4); }
+
+        uint32_t build_recursive(build_state & s, const uint32_t first, const uint32_t count, const uint32_t depth)
+        {
+            const uint32_t index = static_cast<uint32_t>(s.nodes.size());
+            s.nodes.emplace_back();
+            s.depth = std::max(s.depth, depth);
+
+            aabb_3d bounds = empty_bounds(), centroid_bounds = empty_bounds();
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                grow(bounds, s.bounds[s.order[i]]);
+                grow(centroid_bounds, { s.centroids[s.order[i]], s.centroids[s.order[i]] });
+            }
+            s.nodes[index].bounds = bounds;
+
+            auto make_leaf = [&]()
+            {
+                s.nodes[index].first = first;
+                s.nodes[index].count = count;
+                return index;
+            };
+
+            if (count <= 4) return make_leaf();
+
+            const float3 extent = centroid_bounds._max - centroid_bounds._min;
+            uint32_t split = first + count / 2;
+
+            if (depth >= max_build_depth || maxelem(extent) <= 0.f)
+            {
+                if (count <= max_leaf_blocks * 4) return make_leaf();
+
+                // Median split along the widest axis; always makes progress
+                const int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+                std::nth_element(s.order.begin() + first, s.order.begin() + split, s.order.begin() + first + count, [&](const uint32_t a, const uint32_t b) { return s.centroids[a][axis] < s.centroids[b][axis]; });
+            }
+            else
+            {
+                // Binned SAH: bucket centroids along each axis and sweep the bucket boundaries for the cheapest split
+                float best_cost = std::numeric_limits<float>::infinity();
+                int best_axis = -1;
+                uint32_t best_bin = 0;
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    if (extent[axis] <= 0.f) continue;
+
+                    aabb_3d bin_bounds[bin_count];
+                    uint32_t bin_counts[bin_count] = {};
+                    for (auto & b : bin_bounds) b = empty_bounds();
+
+                    const float scale = bin_count / extent[axis];
+                    for (uint32_t i = first; i < first + count; ++i)
+                    {
+                        const uint32_t t = s.order[i];
+                        const uint32_t b = std::min(bin_count - 1, static_cast<uint32_t>((s.centroids[t][axis] - centroid_bounds._min[axis]) * scale));
+                        bin_counts[b]++;
+                        grow(bin_bounds[b], s.bounds[t]);
+                    }
+
+                    float right_area[bin_count];
+                    uint32_t right_count[bin_count];
+                    aabb_3d accum = empty_bounds();
+                    uint32_t accum_count = 0;
+                    for (uint32_t b = bin_count - 1; b > 0; --b)
+                    {
+                        grow(accum, bin_bounds[b]);
+                        accum_count += bin_counts[b];
+                        right_area[b] = surface_area(accum);
+                        right_count[b] = accum_count;
+                    }
+
+                    accum = empty_bounds();
+                    accum_count = 0;
+                    for (uint32_t b = 1; b < bin_count; ++b)
+                    {
+                        grow(accum, bin_bounds[b - 1]);
+                        accum_count += bin_counts[b - 1];
+                        if (accum_count == 0 || right_count[b] == 0) continue;
+
+                        const float cost = surface_area(accum) * block_cost(accum_count) + right_area[b] * block_cost(right_count[b]);
+                        if (cost < best_cost)
+                        {
+                            best_cost = cost;
+                            best_axis = axis;
+                            best_bin = b;
+                        }
+                    }
+                }
+
+                // Relative to the parent's area; a node visit costs about as much as testing a block of triangles
+                const float leaf_cost = block_cost(count);
+                const float split_cost = 1.f + best_cost / std::max(surface_area(bounds), std::numeric_limits<float>::min());
+
+                if (best_axis < 0 || split_cost >= leaf_cost)
+                {
+                    if (count <= max_leaf_blocks * 4) return make_leaf();
+                }
+
+                if (best_axis >= 0)
+                {
+                    const float scale = bin_count / extent[best_axis];
+                    const float origin = centroid_bounds._min[best_axis];
+                    auto mid = std::partition(s.order.begin() + first, s.order.begin() + first + count, [&](const uint32_t t)
+                    {
+                        return std::min(bin_count - 1, static_cast<uint32_t>((s.centroids[t][best_axis] - origin) * scale)) < best_bin;
+                    });
+                    split = static_cast<uint32_t>(mid - s.order.begin());
+                }
+            }
+
+            const uint32_t left = build_recursive(s, first, split - first, depth + 1);
+            const uint32_t right = build_recursive(s, split, first + count - split, depth + 1);
+            s.nodes[index].left = left;
+            s.nodes[index].right = right;
+            return index;
+        }
+
+        uint32_t emit_leaf(const build_state & s, const build_node & leaf, const runtime_mesh & mesh)
+        {
+            const uint32_t first_block = static_cast<uint32_t>(blocks.size());
+            const uint32_t block_count = (leaf.count + 3) / 4;
+            assert(block_count <= max_leaf_blocks);
+
+            for (uint32_t b = 0; b < block_count; ++b)
+            {
+                triangle_block block = {};
+                for (uint32_t lane = 0; lane < 4; ++lane)
+                {
+                    const uint32_t i = b * 4 + lane;
+                    if (i >= leaf.count)
+                    {
+                        block.face[lane] = 0xffffffff;
+                        continue;
+                    }
+
+                    const uint32_t f = s.order[leaf.first + i];
+                    const uint3 & tri = mesh.faces[f];
+                    const float3 v0 = mesh.vertices[tri.x], e1 = mesh.vertices[tri.y] - v0, e2 = mesh.vertices[tri.z] - v0;
+                    block.v0_x[lane] = v0.x; block.v0_y[lane] = v0.y; block.v0_z[lane] = v0.z;
+                    block.e1_x[lane] = e1.x; block.e1_y[lane] = e1.y; block.e1_z[lane] = e1.z;
+                    block.e2_x[lane] = e2.x; block.e2_y[lane] = e2.y; block.e2_z[lane] = e2.z;
+                    block.face[lane] = f;
+                }
+                blocks.push_back(block);
+            }
+
+            return leaf_flag | (first_block << 2) | (block_count - 1);
+        }
+
+        // Collapses the binary subtree under |index| into four-wide nodes by repeatedly opening the largest inner child
+        uint32_t emit_node(const build_state & s, const uint32_t index, const runtime_mesh & mesh)
+        {
+            uint32_t children[4] = { s.nodes[index].left, s.nodes[index].right };
+            uint32_t count = 2;
+
+            while (count < 4)
+            {
+                int open = -1;
+                float open_area = -1.f;
+                for (uint32_t c = 0; c < count; ++c)
+                {
+                    const build_node & n = s.nodes[children[c]];
+                    if (!n.is_leaf() && surface_area(n.bounds) > open_area)
+                    {
+                        open = static_cast<int>(c);
+                        open_area = surface_area(n.bounds);
+                    }
+                }
+                if (open < 0) break;
+
+                const build_node & n = s.nodes[children[open]];
+                children[open] = n.left;
+                children[count++] = n.right;
+            }
+
+            const uint32_t slot = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+
+            uint32_t encoded[4];
+            for (uint32_t c = 0; c < count; ++c)
+            {
+                const build_node & child = s.nodes[children[c]];
+                encoded[c] = child.is_leaf() ? emit_leaf(s, child, mesh) : emit_node(s, children[c], mesh);
+            }
+
+            node & n = nodes[slot]; // emit_node() above may have reallocated
+            n = {};
+            n.child_count = count;
+            for (uint32_t c = 0; c < count; ++c)
+            {
+                const aabb_3d & b = s.nodes[children[c]].bounds;
+                n.min_x[c] = b._min.x; n.min_y[c] = b._min.y; n.min_z[c] = b._min.z;
+                n.max_x[c] = b._max.x; n.max_y[c] = b._max.y; n.max_z[c] = b._max.z;
+                n.child[c] = encoded[c];
+            }
+            return slot;
+        }
+
+        // Tests one ray (as broadcast lanes) against the four triangles of a block, keeping the nearest hit
+        static void intersect_block(const triangle_block & b, const __m128 o[3], const __m128 d[3], mesh_bvh_hit & best)
+        {
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+            const __m128 e1x = _mm_load_ps(b.e1_x), e1y = _mm_load_ps(b.e1_y), e1z = _mm_load_ps(b.e1_z);
+            const __m128 e2x = _mm_load_ps(b.e2_x), e2y = _mm_load_ps(b.e2_y), e2z = _mm_load_ps(b.e2_z);
+
+            const __m128 hx = _mm_sub_ps(_mm_mul_ps(d[1], e2z), _mm_mul_ps(d[2], e2y));
+            const __m128 hy = _mm_sub_ps(_mm_mul_ps(d[2], e2x), _mm_mul_ps(d[0], e2z));
+            const __m128 hz = _mm_sub_ps(_mm_mul_ps(d[0], e2y), _mm_mul_ps(d[1], e2x));
+            const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+            const __m128 f = _mm_div_ps(one, a);
+
+            const __m128 sx = _mm_sub_ps(o[0], _mm_load_ps(b.v0_x)), sy = _mm_sub_ps(o[1], _mm_load_ps(b.v0_y)), sz = _mm_sub_ps(o[2], _mm_load_ps(b.v0_z));
+            const __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+
+            const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+            const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+            const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+            const __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz)));
+            const __m128 t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+            __m128 mask = _mm_cmpneq_ps(a, zero);
+            mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+            mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+            mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, _mm_set1_ps(best.t))));
+
+            int hits = _mm_movemask_ps(mask);
+            if (!hits) return;
+
+            alignas(16) float ts[4], us[4], vs[4];
+            _mm_store_ps(ts, t); _mm_store_ps(us, u); _mm_store_ps(vs, v);
+            for (int lane = 0; hits; ++lane, hits >>= 1)
+            {
+                if ((hits & 1) && ts[lane] < best.t)
+                {
+                    best.t = ts[lane];
+                    best.face = b.face[lane];
+                    best.uv = { us[lane], vs[lane] };
+                }
+            }
+        }
+
+        // Avoids 0 * inf = NaN in the slab test for axis-parallel rays
+        static float safe_inverse(const float x)
+        {
+            const float tiny = 1e-20f;
+            return 1.f / ((std::abs(x) < tiny) ? (x < 0 ? -tiny : tiny) : x);
+        }
+
+    public:
+
+        mesh_bvh() = default;
+        explicit mesh_bvh(const runtime_mesh & mesh) { build(mesh); }
+
+        void build(const runtime_mesh & mesh)
+        {
+            nodes.clear();
+            blocks.clear();
+            root_bounds = {};
+            depth = 0;
+
+            const uint32_t face_count = static_cast<uint32_t>(mesh.faces.size());
+            if (face_count == 0) return;
+
+            build_state s;
+            s.order.resize(face_count);
+            s.bounds.resize(face_count);
+            s.centroids.resize(face_count);
+            s.nodes.reserve(face_count / 2 + 1);
+
+            for (uint32_t f = 0; f < face_count; ++f)
+            {
+                const uint3 & tri = mesh.faces[f];
+                const float3 & v0 = mesh.vertices[tri.x], & v1 = mesh.vertices[tri.y], & v2 = mesh.vertices[tri.z];
+                s.order[f] = f;
+                s.bounds[f] = { linalg::min(v0, linalg::min(v1, v2)), linalg::max(v0, linalg::max(v1, v2)) };
+                s.centroids[f] = (s.bounds[f]._min + s.bounds[f]._max) * 0.5f;
+            }
+
+            const uint32_t root = build_recursive(s, 0, face_count, 0);
+            root_bounds = s.nodes[root].bounds;
+            depth = s.depth;
+            assert(depth <= max_tree_depth);
+
+            nodes.reserve(s.nodes.size() / 3 + 1);
+            blocks.reserve(face_count / 3 + 1);
+
+            if (s.nodes[root].is_leaf())
+            {
+                // Small meshes still get a root node so that traversal always starts at one
+                nodes.emplace_back();
+                const uint32_t leaf = emit_leaf(s, s.nodes[root], mesh);
+                node & n = nodes[0];
+                n = {};
+                n.child_count = 1;
+                n.min_x[0] = root_bounds._min.x; n.min_y[0] = root_bounds._min.y; n.min_z[0] = root_bounds._min.z;
+                n.max_x[0] = root_bounds._max.x; n.max_y[0] = root_bounds._max.y; n.max_z[0] = root_bounds._max.z;
+                n.child[0] = leaf;
+            }
+            else emit_node(s, root, mesh);
+        }
+
+        bool empty() const { return nodes.empty(); }
+        aabb_3d get_bounds() const { return root_bounds; }
+        size_t node_count() const { return nodes.size(); }
+        uint32_t get_depth() const { return depth; }                // of the binary build tree; at most max_tree_depth
+        size_t size_bytes() const { return nodes.size() * sizeof(node) + blocks.size() * sizeof(triangle_block); }
+
+        // Nearest hit along the ray with t in [0, max_t)
+        mesh_bvh_hit intersect(const ray & r, const float max_t = std::numeric_limits<float>::infinity()) const
+        {
+            mesh_bvh_hit best;
+            best.t = max_t;
+            if (nodes.empty()) return best;
+
+            const __m128 o[3] = { _mm_set1_ps(r.origin.x), _mm_set1_ps(r.origin.y), _mm_set1_ps(r.origin.z) };
+            const __m128 d[3] = { _mm_set1_ps(r.direction.x), _mm_set1_ps(r.direction.y), _mm_set1_ps(r.direction.z) };
+            const float3 inv = { safe_inverse(r.direction.x), safe_inverse(r.direction.y), safe_inverse(r.direction.z) };
+            const __m128 inv_x = _mm_set1_ps(inv.x), inv_y = _mm_set1_ps(inv.y), inv_z = _mm_set1_ps(inv.z);
+            const __m128 o_inv_x = _mm_set1_ps(r.origin.x * inv.x), o_inv_y = _mm_set1_ps(r.origin.y * inv.y), o_inv_z = _mm_set1_ps(r.origin.z * inv.z);
+            const __m128 zero = _mm_setzero_ps();
+
+            uint32_t stack[stack_size];
+            uint32_t stack_top = 0;
+            stack[stack_top++] = 0;
+
+            while (stack_top)
+            {
+                const uint32_t item = stack[--stack_top];
+
+                if (item & leaf_flag)
+                {
+                    const uint32_t first = (item & ~leaf_flag) >> 2, count = (item & 3) + 1;
+                    for (uint32_t b = first; b < first + count; ++b) intersect_block(blocks[b], o, d, best);
+                    continue;
+                }
+
+                const node & n = nodes[item];
+                const __m128 tx0 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(n.min_x), inv_x), o_inv_x), tx1 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(n.max_x), inv_x), o_inv_x);
+                const __m128 ty0 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(n.min_y), inv_y), o_inv_y), ty1 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(n.max_y), inv_y), o_inv_y);
+                const __m128 tz0 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(n.min_z), inv_z), o_inv_z), tz1 = _mm_sub_ps(_mm_mul_ps(_mm_load_ps(n.max_z), inv_z), o_inv_z);
+
+                const __m128 t_near = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), zero));
+                const __m128 t_far = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(best.t)));
+
+                int hits = _mm_movemask_ps(_mm_cmple_ps(t_near, t_far)) & ((1 << n.child_count) - 1);
+                if (!hits) continue;
+
+                // Push far to near so the nearest child is visited first and tightens best.t for the others
+                alignas(16) float near_t[4];
+                _mm_store_ps(near_t, t_near);
+
+                uint32_t order[4], order_count = 0;
+                for (uint32_t c = 0; hits; ++c, hits >>= 1)
+                {
+                    if (!(hits & 1)) continue;
+                    uint32_t i = order_count++;
+                    while (i > 0 && near_t[order[i - 1]] < near_t[c]) { order[i] = order[i - 1]; --i; }
+                    order[i] = c;
+                }
+                for (uint32_t i = 0; i < order_count; ++i) stack[stack_top++] = n.child[order[i]];
+            }
+
+            if (!best.hit()) best.t = std::numeric_limits<float>::infinity();
+            return best;
+        }
+
+        // Traces four rays together; each node and triangle is fetched once for the whole packet
+        void intersect4(const ray rays[4], mesh_bvh_hit hits[4], const float max_t = std::numeric_limits<float>::infinity()) const
+        {
+            for (int i = 0; i < 4; ++i) { hits[i] = {}; hits[i].t = max_t; }
+            if (nodes.empty()) return;
+
+            __m128 o[3], d[3], inv[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                o[axis] = _mm_setr_ps(rays[0].origin[axis], rays[1].origin[axis], rays[2].origin[axis], rays[3].origin[axis]);
+                d[axis] = _mm_setr_ps(rays[0].direction[axis], rays[1].direction[axis], rays[2].direction[axis], rays[3].direction[axis]);
+                inv[axis] = _mm_setr_ps(safe_inverse(rays[0].direction[axis]), safe_inverse(rays[1].direction[axis]), safe_inverse(rays[2].direction[axis]), safe_inverse(rays[3].direction[axis]));
+            }
+            const __m128 o_inv[3] = { _mm_mul_ps(o[0], inv[0]), _mm_mul_ps(o[1], inv[1]), _mm_mul_ps(o[2], inv[2]) };
+            const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+            __m128 best_t = _mm_setr_ps(hits[0].t, hits[1].t, hits[2].t, hits[3].t);
+
+            uint32_t stack[stack_size];
+            uint32_t stack_top = 0;
+            stack[stack_top++] = 0;
+
+            while (stack_top)
+            {
+                const uint32_t item = stack[--stack_top];
+
+                if (item & leaf_flag)
+                {
+                    const uint32_t first = (item & ~leaf_flag) >> 2, count = (item & 3) + 1;
+                    for (uint32_t b = first; b < first + count; ++b)
+                    {
+                        const triangle_block & block = blocks[b];
+                        for (uint32_t lane = 0; lane < 4 && block.face[lane] != 0xffffffff; ++lane)
+                        {
+                            const __m128 e1x = _mm_set1_ps(block.e1_x[lane]), e1y = _mm_set1_ps(block.e1_y[lane]), e1z = _mm_set1_ps(block.e1_z[lane]);
+                            const __m128 e2x = _mm_set1_ps(block.e2_x[lane]), e2y = _mm_set1_ps(block.e2_y[lane]), e2z = _mm_set1_ps(block.e2_z[lane]);
+
+                            const __m128 hx = _mm_sub_ps(_mm_mul_ps(d[1], e2z), _mm_mul_ps(d[2], e2y));
+                            const __m128 hy = _mm_sub_ps(_mm_mul_ps(d[2], e2x), _mm_mul_ps(d[0], e2z));
+                            const __m128 hz = _mm_sub_ps(_mm_mul_ps(d[0], e2y), _mm_mul_ps(d[1], e2x));
+                            const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+                            const __m128 f = _mm_div_ps(one, a);
+
+                            const __m128 sx = _mm_sub_ps(o[0], _mm_set1_ps(block.v0_x[lane])), sy = _mm_sub_ps(o[1], _mm_set1_ps(block.v0_y[lane])), sz = _mm_sub_ps(o[2], _mm_set1_ps(block.v0_z[lane]));
+                            const __m128 u = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+
+                            const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                            const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                            const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                            const __m128 v = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], qx), _mm_mul_ps(d[1], qy)), _mm_mul_ps(d[2], qz)));
+                            const __m128 t = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+                            __m128 mask = _mm_cmpneq_ps(a, zero);
+                            mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)));
+                            mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+                            mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmpge_ps(t, zero), _mm_cmplt_ps(t, best_t)));
+
+                            int hit_mask = _mm_movemask_ps(mask);
+                            if (!hit_mask) continue;
+
+                            best_t = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, best_t));
+
+                            alignas(16) float ts[4], us[4], vs[4];
+                            _mm_store_ps(ts, t); _mm_store_ps(us, u); _mm_store_ps(vs, v);
+                            for (int r = 0; hit_mask; ++r, hit_mask >>= 1)
+                            {
+                                if (!(hit_mask & 1)) continue;
+                                hits[r].t = ts[r];
+                                hits[r].face = block.face[lane];
+                                hits[r].uv = { us[r], vs[r] };
+                            }
+                        }
+                    }
+                    continue;
+                }
+
+                // Each child is tested against all four rays and visited if any of them enters it
+                const node & n = nodes[item];
+                for (uint32_t c = 0; c < n.child_count; ++c)
+                {
+                    const __m128 tx0 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(n.min_x[c]), inv[0]), o_inv[0]), tx1 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(n.max_x[c]), inv[0]), o_inv[0]);
+                    const __m128 ty0 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(n.min_y[c]), inv[1]), o_inv[1]), ty1 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(n.max_y[c]), inv[1]), o_inv[1]);
+                    const __m128 tz0 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(n.min_z[c]), inv[2]), o_inv[2]), tz1 = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(n.max_z[c]), inv[2]), o_inv[2]);
+
+                    const __m128 t_near = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), zero));
+                    const __m128 t_far = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), best_t));
+
+                    if (_mm_movemask_ps(_mm_cmple_ps(t_near, t_far))) stack[stack_top++] = n.child[c];
+                }
+            }
+
+            for (int i = 0; i < 4; ++i) if (!hits[i].hit()) hits[i].t = std::numeric_limits<float>::infinity();
+        }
+    };
+
+    // Same results as the brute force intersect_ray_mesh, using a bvh previously built from |mesh|
+    inline bool intersect_ray_mesh(const ray & ray,
+        const geometry & mesh,
+        const mesh_bvh & bvh,
+        float * outRayT = nullptr,
+        float3 * outFaceNormal = nullptr,
+        float2 * outTexcoord = nullptr)
+    {
+        const mesh_bvh_hit hit = bvh.intersect(ray);
+        if (!hit.hit()) return false;
+
+        if (outRayT) *outRayT = hit.t;
+        get_ray_mesh_hit_attributes(mesh, mesh.faces[hit.face], hit.uv, outFaceNormal, outTexcoord);
+        return true;
+    }
+
+} // end namespace polymer
+
+#endif // end polymer_mesh_bvh_hpp
@@ -1,11 +1,19 @@
 /*
- * An octree is a tree data structure in which each internal node has exactly
- * eight children. Octrees are most often used to partition a three
- * dimensional space by recursively subdividing it into eight octants.
- * This implementation stores 8 pointers per node, instead of the other common
- * approach, which is to use a flat array with an offset. The `inside` method
- * defines the comparison function (loose in this case). The main usage of this
- * class is for basic frustum culling.
+ * A linear loose octree. Instead of allocating octants and linking them with pointers, every object is
+ * assigned to a cell by a key made from the Morton code of its center, and objects are kept in one array
+ * sorted by that key. The sort order is a depth-first walk of the tree, so each node owns a contiguous range
+ * of objects and each subtree owns a contiguous range that directly follows it. Nodes are rebuilt from the
+ * sorted keys in a single linear pass and stored in the same pre-order, each with an index that skips its
+ * subtree, so traversals are loops over flat arrays.
+ *
+ * Cells are "loose": an object lives in the deepest cell at least as large as the object, picked by its
+ * center, and each cell's bounds are grown by half its size on every side so that they contain whatever
+ * was placed in it. Finding an object's cell is then a constant time computation rather than a descent.
+ *
+ * Edits are batched. insert(), update() and remove() only record what changed, and commit() folds the
+ * changes into the sorted array by merging (or re-sorting when most objects changed), then rebuilds the
+ * nodes. An update that keeps an object in its cell is applied in place. Large batches can compute keys,
+ * sort and rebuild on a work_stealing_pool. Queries see the tree as of the last commit().
  */
 
 #pragma once
@@ -16,287 +24,456 @@
 #include "../lib-engine/gfx/gl/gl-api.hpp"
 
 #include "math-core.hpp"
-#include "util.hpp"
-#include "algo_misc.hpp"
+#include "radix_sort.hpp"
+#include "thread-pool.hpp"
 
-#include <list>
-#include <memory>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <assert.h>
 
 namespace polymer
 {
 
-    // Forward declare
     template<typename T>
-    struct octant;
-
-    template<typename T>
-    struct node_container
+    class octree
     {
-        T & object;
-        octant<T> * octant{ nullptr };
-        aabb_3d worldspaceBounds;
-        node_container(T & obj, const aabb_3d & bounds) : object(obj), worldspaceBounds(bounds) {}
-        bool operator== (const node_container<T> & other) { return &object == &other.object; }
-    };
-
-    template<typename T>
-    struct octant
-    {
-        std::list<node_container<T>> objects;
-
-        octant<T> * parent;
-        octant(octant<T> * parent) : parent(parent) {}
+    public:
 
-        aabb_3d box;
-        voxel_array<std::unique_ptr<octant<T>>> arr = { { 2, 2, 2 } };
-        uint32_t occupancy{ 0 };
+        static constexpr uint32_t max_supported_depth = 10; // 30 bits of Morton code
+        static constexpr uint32_t invalid_id = 0xffffffff;
 
-        int3 get_indices(const aabb_3d & other) const
+        struct node
         {
-            const float3 a = other.center();
-            const float3 b = box.center();
-            int3 index;
-            index.x = (a.x > b.x) ? 1 : 0;
-            index.y = (a.y > b.y) ? 1 : 0;
-            index.z = (a.z > b.z) ? 1 : 0;
-            return index;
-        }
+            aabb_3d box;            // loose bounds: the cell grown by half its size on every side
+            uint32_t depth;
+            uint32_t code;          // Morton code of the cell among the cells at its depth
+            uint32_t first;         // the node's own objects are [first, first + count)
+            uint32_t count;
+            uint32_t subtree_end;   // the objects of the node and all of its descendants are [first, subtree_end)
+            uint32_t next;          // index of the next node that is not a descendant of this one
+        };
 
-        void increase_occupancy(octant<T> * n) const
+        struct object
         {
-            if (n != nullptr)
-            {
-                n->occupancy++;
-                increase_occupancy(n->parent);
-            }
-        }
+            uint64_t key;           // depth-first order of the node holding the object
+            uint32_t id;
+            aabb_3d bounds;
+            T data;
+        };
 
-        void decrease_occupancy(octant<T> * n) const
+    private:
+
+        static constexpr uint32_t pending_bit = 0x80000000;
+        static constexpr uint64_t dead_key = ~0ull;
+        static constexpr size_t parallel_grain = 4096;
+
+        aabb_3d root_cell;
+        float root_size{ 0.f };
+        uint32_t max_depth;
+
+        std::vector<object> objects;        // committed, sorted by key
+        std::vector<node> nodes;            // pre-order
+        std::vector<object> pending;        // inserted or moved since the last commit
+        std::vector<uint32_t> slots;        // id -> index into objects, pending_bit | index into pending, or invalid_id
+        std::vector<uint32_t> free_ids;
+        size_t dead_count{ 0 };             // committed objects that were removed or moved since the last commit
+
+        std::vector<object> scratch;
+        std::vector<uint64_t> key_scratch;
+        std::vector<uint32_t> order_scratch;
+        std::vector<uint32_t> open_nodes;
+        std::vector<uint32_t> node_scratch;
+        radix_sort sorter;
+
+        static uint32_t spread_bits(uint32_t v)
         {
-            if (n != nullptr)
-            {
-                n->occupancy--;
-                decrease_occupancy(n->parent);
-            }
+            v &= 0x3ff;
+            v = (v | (v << 16)) & 0x030000ff;
+            v = (v | (v << 8)) & 0x0300f00f;
+            v = (v | (v << 4)) & 0x030c30c3;
+            v = (v | (v << 2)) & 0x09249249;
+            return v;
         }
 
-        // Returns true if the other is less than half the size of myself
-        bool check_fit(const aabb_3d & other) const
+        static uint32_t compact_bits(uint32_t v)
         {
-            return all(lequal(other.size(), box.size() * 0.5f));
+            v &= 0x09249249;
+            v = (v | (v >> 2)) & 0x030c30c3;
+            v = (v | (v >> 4)) & 0x0300f00f;
+            v = (v | (v >> 8)) & 0x030000ff;
+            v = (v | (v >> 16)) & 0x3ff;
+            return v;
         }
 
-    };
+        static uint32_t key_depth(const uint64_t key) { return static_cast<uint32_t>(key & 0xf); }
+        uint32_t key_code(const uint64_t key) const { return static_cast<uint32_t>((key >> 4) >> (3 * (max_depth - key_depth(key)))); }
 
-    template<typename T>
-    struct octree
-    {
-        // Instead of a strict bounds check which might force an object into a parent cell, this function
-        // checks centers, aka a "loose" octree. 
-        inline bool inside(const aabb_3d & node, const aabb_3d & other)
+        template<typename F>
+        static void run_parallel(work_stealing_pool * pool, const size_t count, F && f)
         {
-            // Compare centers
-            if (!(linalg::all(greater(other.max(), node.center())) && linalg::all(less(other.min(), node.center())))) return false;
-
-            // Otherwise ensure we shouldn't move to parent
-            return linalg::all(less(node.size(), other.size()));
+            if (pool && count > parallel_grain) pool->parallel_for(0, count, parallel_grain, f);
+            else for (size_t i = 0; i < count; ++i) f(i);
         }
 
-        enum class visibility : uint32_t
+        aabb_3d get_cell_bounds(const uint32_t depth, const uint32_t code) const
         {
-            inside,
-            intersect,
-            outside
-        };
-
-        std::unique_ptr<octant<T>> root;
-        uint32_t maxDepth{ 8 };
+            const float size = root_size / float(1u << depth);
+            const float3 cell = float3(float(compact_bits(code >> 2)), float(compact_bits(code >> 1)), float(compact_bits(code)));
+            const float3 cell_min = root_cell._min + cell * size;
+            return aabb_3d(cell_min - float3(size * 0.5f), cell_min + float3(size * 1.5f));
+        }
 
-        octree(const uint32_t maxDepth = 8, const aabb_3d rootBounds = { { -1, -1, -1 },{ +1, +1, +1 } })
+        void open_node(const uint32_t depth, const uint32_t code, const uint32_t first)
         {
-            root.reset(new octant<T>(nullptr));
-            root->box = rootBounds;
+            if (!open_nodes.empty()) node_scratch[open_nodes.back()]++;
+            node_scratch.push_back(0);
+
+            node n;
+            n.depth = depth;
+            n.code = code;
+            n.first = first;
+            n.count = 0;
+            n.subtree_end = first;
+            n.next = 0;
+            open_nodes.push_back(static_cast<uint32_t>(nodes.size()));
+            nodes.push_back(n);
         }
 
-        float3 get_resolution() const
+        void close_node(const uint32_t end)
         {
-            return root->box.size() / (float)maxDepth;
+            node & n = nodes[open_nodes.back()];
+            n.subtree_end = end;
+            n.next = static_cast<uint32_t>(nodes.size());
+            open_nodes.pop_back();
         }
 
-        void add(node_container<T> & sceneNode, octant<T> * child, uint32_t depth = 0)
+        // One pass over the sorted objects creates every cell that holds objects along with all of its ancestors,
+        // counting children in node_scratch. A second pass drops the chains of empty cells with a single child
+        // that sparse scenes produce: such a cell's subtree is exactly its child's, so culling loses nothing.
+        void build_nodes()
         {
-            if (!child) child = root.get();
-
-            const aabb_3d bounds = sceneNode.worldspaceBounds;
+            nodes.clear();
+            open_nodes.clear();
+            node_scratch.clear();
 
-            if (depth < maxDepth && child->check_fit(bounds))
+            const uint32_t object_count = static_cast<uint32_t>(objects.size());
+            for (uint32_t i = 0; i < object_count; ++i)
             {
-                int3 lookup = child->get_indices(bounds);
+                const uint32_t depth = key_depth(objects[i].key);
+                const uint32_t code = key_code(objects[i].key);
 
-                // No child for this octant
-                if (child->arr[lookup] == nullptr)
+                // Close the open nodes whose cell does not contain this object's cell
+                while (!open_nodes.empty())
                 {
-                    child->arr[lookup].reset(new octant<T>(child));
-
-                    const float3 octantMin = child->box.min();
-                    const float3 octantMax = child->box.max();
-                    const float3 octantCenter = child->box.center();
-
-                    float3 min, max;
-                    for (int axis : { 0, 1, 2 })
-                    {
-                        if (lookup[axis] == 0)
-                        {
-                            min[axis] = octantMin[axis];
-                            max[axis] = octantCenter[axis];
-                        }
-                        else
-                        {
-                            min[axis] = octantCenter[axis];
-                            max[axis] = octantMax[axis];
-                        }
-                    }
-
-                    child->arr[lookup]->box = aabb_3d(min, max);
+                    const node & top = nodes[open_nodes.back()];
+                    if (top.depth <= depth && (code >> (3 * (depth - top.depth))) == top.code) break;
+                    close_node(i);
                 }
 
-                // Recurse into a new depth
-                add(sceneNode, child->arr[lookup].get(), ++depth);
+                if (!open_nodes.empty() && nodes[open_nodes.back()].depth == depth)
+                {
+                    nodes[open_nodes.back()].count++;
+                    continue;
+                }
+
+                const uint32_t first_level = open_nodes.empty() ? 0 : nodes[open_nodes.back()].depth + 1;
+                for (uint32_t level = first_level; level <= depth; ++level) open_node(level, code >> (3 * (depth - level)), i);
+                nodes.back().count = 1;
             }
-            // The current octant fits this 
-            else
+            while (!open_nodes.empty()) close_node(object_count);
+
+            // node_scratch is reused to map old indices to new ones; a removed node maps to the next kept node,
+            // which is the first kept node of its subtree
+            const uint32_t node_count = static_cast<uint32_t>(nodes.size());
+            uint32_t kept = 0;
+            for (uint32_t i = 0; i < node_count; ++i)
             {
-                child->increase_occupancy(child);
-                child->objects.push_back(sceneNode);
-                sceneNode.octant = child;
+                const bool keep = (i == 0 || nodes[i].count > 0 || node_scratch[i] > 1);
+                node_scratch[i] = kept;
+                if (!keep) continue;
+                nodes[kept] = nodes[i];
+                nodes[kept].box = get_cell_bounds(nodes[i].depth, nodes[i].code);
+                ++kept;
             }
-        }
+            node_scratch.push_back(kept);
+            nodes.resize(kept);
+            for (auto & n : nodes) n.next = node_scratch[n.next];
 
-        void create(node_container<T> & sceneNode)
-        {
-            if (!inside(sceneNode.worldspaceBounds, root->box))
+            // Objects that don't fit inside the root cell are kept at the root, which grows to hold them
+            if (!nodes.empty())
             {
-                throw std::invalid_argument("object is not in the bounding volume of the root node");
+                node & root = nodes[0];
+                for (uint32_t i = root.first; i < root.first + root.count; ++i) root.box = root.box.add(objects[i].bounds);
             }
-            else
+        }
+
+        void refresh_slots(work_stealing_pool * pool)
+        {
+            run_parallel(pool, objects.size(), [this](const size_t i) { slots[objects[i].id] = static_cast<uint32_t>(i); });
+        }
+
+        // Full sort of `objects` by key. The radix sort builds its histograms on the pool.
+        void sort_objects(work_stealing_pool * pool)
+        {
+            const size_t count = objects.size();
+            key_scratch.resize(count);
+            order_scratch.resize(count);
+            run_parallel(pool, count, [this](const size_t i)
             {
-                add(sceneNode, root.get());
-            }
+                key_scratch[i] = objects[i].key;
+                order_scratch[i] = static_cast<uint32_t>(i);
+            });
+
+            sorter.sort(key_scratch.data(), order_scratch.data(), count, pool);
+
+            scratch.resize(count);
+            run_parallel(pool, count, [this](const size_t i) { scratch[i] = objects[order_scratch[i]]; });
+            std::swap(objects, scratch);
         }
 
-        void update(node_container<T> & sceneNode)
+        void apply_update(const uint32_t id, const aabb_3d & bounds, const uint64_t key)
         {
-            if (sceneNode.octant == nullptr)
+            assert(id < slots.size() && slots[id] != invalid_id);
+            const uint32_t slot = slots[id];
+
+            if (slot & pending_bit)
             {
-                throw std::runtime_error("cannot update a scene node that is not present in the tree");
+                object & o = pending[slot & ~pending_bit];
+                o.bounds = bounds;
+                o.key = key;
+                return;
             }
 
-            const aabb_3d box = sceneNode.worldspaceBounds;
-
-            // Check if this scene node has bounds that are not consistent with its assigned octant
-            if (!(inside(box, sceneNode.octant->box)))
+            // Objects that stay in their cell are updated in place. The root's box depends on the bounds of its
+            // own objects, so those always go through commit().
+            object & o = objects[slot];
+            if (o.key == key && key_depth(key) != 0)
             {
-                remove(sceneNode);
-                create(sceneNode);
+                o.bounds = bounds;
+                return;
             }
+
+            slots[id] = pending_bit | static_cast<uint32_t>(pending.size());
+            pending.push_back({ key, id, bounds, o.data });
+            o.key = dead_key;
+            ++dead_count;
+        }
+
+    public:
+
+        // The root cell is the cube that encloses `root_bounds`. Depth is limited to max_supported_depth.
+        octree(const uint32_t max_depth = 8, const aabb_3d root_bounds = { { -1, -1, -1 },{ +1, +1, +1 } }) : max_depth(max_depth < max_supported_depth ? max_depth : max_supported_depth)
+        {
+            set_root_bounds(root_bounds);
         }
 
-        void remove(node_container<T> & sceneNode)
+        void set_root_bounds(const aabb_3d & root_bounds)
         {
-            if (sceneNode.octant == nullptr)
+            const float3 size = root_bounds.size();
+            root_size = std::max<float>(std::max<float>(size.x, size.y), size.z);
+            root_cell = aabb_3d(root_bounds.center() - float3(root_size * 0.5f), root_bounds.center() + float3(root_size * 0.5f));
+        }
+
+        // The deepest cell at least as large as the object, found from the cell of its center
+        uint64_t compute_key(const aabb_3d & bounds) const
+        {
+            const float3 extent = bounds.size();
+            const float largest = std::max<float>(std::max<float>(extent.x, extent.y), extent.z);
+            const float3 center = bounds.center();
+
+            uint32_t depth = 0;
+            if (root_cell.contains(center))
             {
-                throw std::runtime_error("cannot remove a scene node that is not present in the tree");
+                float cell_size = root_size;
+                while (depth < max_depth && largest <= cell_size * 0.5f)
+                {
+                    cell_size *= 0.5f;
+                    ++depth;
+                }
             }
 
-            octant<T> * oct = sceneNode.octant;
-            oct->decrease_occupancy(oct);
-            oct->objects.erase(std::find(oct->objects.begin(), oct->objects.end(), sceneNode));
-            sceneNode.octant = nullptr;
+            const float cells = float(1u << depth);
+            const float3 cell = clamp(floor((center - root_cell._min) * (cells / root_size)), float3(0.f), float3(cells - 1.f));
+            const uint32_t code = (spread_bits(uint32_t(cell.x)) << 2) | (spread_bits(uint32_t(cell.y)) << 1) | spread_bits(uint32_t(cell.z));
+            return ((uint64_t(code) << (3 * (max_depth - depth))) << 4) | depth;
         }
 
-        void cull(const frustum & camera, std::vector<octant<T> *> & visibleNodeList, octant<T> * node, bool alreadyVisible)
+        uint32_t insert(const aabb_3d & bounds, const T & data)
         {
-            if (!node) node = root.get();
-            if (node->occupancy == 0) return;
+            uint32_t id;
+            if (!free_ids.empty()) { id = free_ids.back(); free_ids.pop_back(); }
+            else { id = static_cast<uint32_t>(slots.size()); slots.push_back(0); }
 
-            visibility status = visibility::outside;
+            slots[id] = pending_bit | static_cast<uint32_t>(pending.size());
+            pending.push_back({ compute_key(bounds), id, bounds, data });
+            return id;
+        }
+
+        void update(const uint32_t id, const aabb_3d & bounds)
+        {
+            apply_update(id, bounds, compute_key(bounds));
+        }
+
+        // Batched form of update(); keys are computed on the pool
+        void update(const uint32_t * ids, const aabb_3d * bounds, const size_t count, work_stealing_pool * pool = nullptr)
+        {
+            key_scratch.resize(count);
+            run_parallel(pool, count, [&](const size_t i) { key_scratch[i] = compute_key(bounds[i]); });
+            for (size_t i = 0; i < count; ++i) apply_update(ids[i], bounds[i], key_scratch[i]);
+        }
 
-            if (alreadyVisible)
+        void remove(const uint32_t id)
+        {
+            assert(id < slots.size() && slots[id] != invalid_id);
+            const uint32_t slot = slots[id];
+            if (slot & pending_bit) pending[slot & ~pending_bit].key = dead_key;
+            else
             {
-                status = visibility::inside;
+                objects[slot].key = dead_key;
+                ++dead_count;
             }
-            else if (node == root.get())
+            slots[id] = invalid_id;
+            free_ids.push_back(id);
+        }
+
+        // Folds pending edits into the sorted objects and rebuilds the nodes. A small batch is sorted on its own
+        // and merged in linear time; a batch touching a large fraction of the tree re-sorts everything.
+        void commit(work_stealing_pool * pool = nullptr)
+        {
+            if (pending.empty() && dead_count == 0) return;
+
+            auto is_dead = [](const object & o) { return o.key == dead_key; };
+            if (dead_count) objects.erase(std::remove_if(objects.begin(), objects.end(), is_dead), objects.end());
+            pending.erase(std::remove_if(pending.begin(), pending.end(), is_dead), pending.end());
+
+            if (pending.size() * 4 > objects.size())
             {
-                status = visibility::intersect;
+                objects.insert(objects.end(), pending.begin(), pending.end());
+                sort_objects(pool);
             }
             else
             {
-                if (camera.contains(node->box.center()))
+                auto by_key = [](const object & a, const object & b) { return a.key < b.key; };
+                std::sort(pending.begin(), pending.end(), by_key);
+                scratch.resize(objects.size() + pending.size());
+                std::merge(objects.begin(), objects.end(), pending.begin(), pending.end(), scratch.begin(), by_key);
+                std::swap(objects, scratch);
+            }
+
+            pending.clear();
+            dead_count = 0;
+            refresh_slots(pool);
+            build_nodes();
+        }
+
+        // Refits the root cell, recomputes every key and rebuilds from scratch, on the pool if one is given
+        void rebuild(const aabb_3d & root_bounds, work_stealing_pool * pool = nullptr)
+        {
+            set_root_bounds(root_bounds);
+
+            auto is_dead = [](const object & o) { return o.key == dead_key; };
+            objects.erase(std::remove_if(objects.begin(), objects.end(), is_dead), objects.end());
+            pending.erase(std::remove_if(pending.begin(), pending.end(), is_dead), pending.end());
+            objects.insert(objects.end(), pending.begin(), pending.end());
+            pending.clear();
+            dead_count = 0;
+
+            run_parallel(pool, objects.size(), [this](const size_t i) { objects[i].key = compute_key(objects[i].bounds); });
+            sort_objects(pool);
+            refresh_slots(pool);
+            build_nodes();
+        }
+
+        void clear()
+        {
+            objects.clear();
+            nodes.clear();
+            pending.clear();
+            slots.clear();
+            free_ids.clear();
+            dead_count = 0;
+        }
+
+        // Calls visit(id, data) for every object whose bounds touch the frustum. Subtrees whose loose bounds are
+        // entirely inside are accepted as one contiguous range without further tests; objects are only tested
+        // individually in nodes that straddle the frustum.
+        template<typename Visitor>
+        void cull(const frustum & f, Visitor && visit) const
+        {
+            assert(pending.empty() && dead_count == 0);
+
+            uint32_t i = 0;
+            while (i < nodes.size())
+            {
+                const node & n = nodes[i];
+                const frustum_containment c = f.classify(n.box);
+
+                if (c == frustum_containment::outside) { i = n.next; continue; }
+
+                if (c == frustum_containment::inside)
                 {
-                    status = visibility::inside;
+                    for (uint32_t o = n.first; o < n.subtree_end; ++o) visit(objects[o].id, objects[o].data);
+                    i = n.next;
+                    continue;
                 }
-            }
 
-            alreadyVisible = (status == visibility::inside);
+                for (uint32_t o = n.first; o < n.first + n.count; ++o)
+                {
+                    if (f.classify(objects[o].bounds) != frustum_containment::outside) visit(objects[o].id, objects[o].data);
+                }
+                ++i;
+            }
+        }
 
-            if (alreadyVisible)
+        // Calls visit(node, containment) for every node that is not outside the frustum, skipping the
+        // descendants of nodes that are fully inside
+        template<typename Visitor>
+        void cull_nodes(const frustum & f, Visitor && visit) const
+        {
+            uint32_t i = 0;
+            while (i < nodes.size())
             {
-                visibleNodeList.push_back(node);
+                const node & n = nodes[i];
+                const frustum_containment c = f.classify(n.box);
+                if (c != frustum_containment::outside) visit(n, c);
+                i = (c == frustum_containment::intersecting) ? i + 1 : n.next;
             }
+        }
 
-            // Recurse into children
-            octant<T> * child;
-            if ((child = node->arr[{0, 0, 0}].get()) != nullptr) cull(camera, visibleNodeList, child, alreadyVisible);
-            if ((child = node->arr[{0, 0, 1}].get()) != nullptr) cull(camera, visibleNodeList, child, alreadyVisible);
-            if ((child = node->arr[{0, 1, 0}].get()) != nullptr) cull(camera, visibleNodeList, child, alreadyVisible);
-            if ((child = node->arr[{0, 1, 1}].get()) != nullptr) cull(camera, visibleNodeList, child, alreadyVisible);
-            if ((child = node->arr[{1, 0, 0}].get()) != nullptr) cull(camera, visibleNodeList, child, alreadyVisible);
-            if ((child = node->arr[{1, 0, 1}].get()) != nullptr) cull(camera, visibleNodeList, child, alreadyVisible);
-            if ((child = node->arr[{1, 1, 0}].get()) != nullptr) cull(camera, visibleNodeList, child, alreadyVisible);
-            if ((child = node->arr[{1, 1, 1}].get()) != nullptr) cull(camera, visibleNodeList, child, alreadyVisible);
+        T & get_data(const uint32_t id)
+        {
+            const uint32_t slot = slots[id];
+            return (slot & pending_bit) ? pending[slot & ~pending_bit].data : objects[slot].data;
+        }
+
+        const aabb_3d & get_bounds(const uint32_t id) const
+        {
+            const uint32_t slot = slots[id];
+            return (slot & pending_bit) ? pending[slot & ~pending_bit].bounds : objects[slot].bounds;
         }
+
+        const std::vector<node> & get_nodes() const { return nodes; }
+        const std::vector<object> & get_objects() const { return objects; }
+        size_t size() const { return slots.size() - free_ids.size(); }
+        uint32_t get_max_depth() const { return max_depth; }
+        float3 get_resolution() const { return float3(root_size / float(1u << max_depth)); }
     };
 
+    // Draws the loose bounds of every node, tinted from green at the root to red at the deepest level
     template<typename T>
-    inline void octree_debug_draw(
-        const octree<T> & octree,
-        gl_shader * shader,
-        gl_mesh * boxMesh,
-        gl_mesh * sphereMesh,
-        const float4x4 & viewProj,
-        typename octant<T> * node, // rumble rumble something about dependent types
-        float3 octantColor)
+    inline void octree_debug_draw(const octree<T> & tree, gl_shader * shader, gl_mesh * boxMesh, const float4x4 & viewProj)
     {
-        if (!node) node = octree.root.get();
-
         shader->bind();
-
-        const auto boxModel = make_translation_matrix(node->box.center()) * make_scaling_matrix(node->box.size() / 2.f);
-        shader->uniform("u_color", octantColor);
-        shader->uniform("u_mvp", viewProj * boxModel);
-        boxMesh->draw_elements();
-
-        for (auto obj : node->objects)
+        for (const auto & n : tree.get_nodes())
         {
-            const auto & object = obj.object;
-            const auto sphereModel = object.p.matrix() * make_scaling_matrix(object.radius);
-            shader->uniform("u_color", octantColor);
-            shader->uniform("u_mvp", viewProj * sphereModel);
-            sphereMesh->draw_elements();
+            const float t = float(n.depth) / float(std::max(1u, tree.get_max_depth()));
+            const auto boxModel = make_translation_matrix(n.box.center()) * make_scaling_matrix(n.box.size() / 2.f);
+            shader->uniform("u_color", float3(t, 1.f - t, 0.f));
+            shader->uniform("u_mvp", viewProj * boxModel);
+            boxMesh->draw_elements();
         }
-
         shader->unbind();
-
-        // Recurse into children
-        octant<T> * child;
-        if ((child = node->arr[{0, 0, 0}].get()) != nullptr) octree_debug_draw<T>(octree, shader, boxMesh, sphereMesh, viewProj, child, { 0, 0, 0 });
-        if ((child = node->arr[{0, 0, 1}].get()) != nullptr) octree_debug_draw<T>(octree, shader, boxMesh, sphereMesh, viewProj, child, { 0, 0, 1 });
-        if ((child = node->arr[{0, 1, 0}].get()) != nullptr) octree_debug_draw<T>(octree, shader, boxMesh, sphereMesh, viewProj, child, { 0, 1, 0 });
-        if ((child = node->arr[{0, 1, 1}].get()) != nullptr) octree_debug_draw<T>(octree, shader, boxMesh, sphereMesh, viewProj, child, { 0, 1, 1 });
-        if ((child = node->arr[{1, 0, 0}].get()) != nullptr) octree_debug_draw<T>(octree, shader, boxMesh, sphereMesh, viewProj, child, { 1, 0, 0 });
-        if ((child = node->arr[{1, 0, 1}].get()) != nullptr) octree_debug_draw<T>(octree, shader, boxMesh, sphereMesh, viewProj, child, { 1, 0, 1 });
-        if ((child = node->arr[{1, 1, 0}].get()) != nullptr) octree_debug_draw<T>(octree, shader, boxMesh, sphereMesh, viewProj, child, { 1, 1, 0 });
-        if ((child = node->arr[{1, 1, 1}].get()) != nullptr) octree_debug_draw<T>(octree, shader, boxMesh, sphereMesh, viewProj, child, { 1, 1, 1 });
     }
 
 } // end namespace polymer
@@ -12,6 +12,8 @@
 #include <utility>
 #include <vector>
 
+#include "thread-pool.hpp"
+
 namespace polymer
 {
     class radix_sort
@@ -23,6 +25,93 @@ namespace polymer
         constexpr static const uint32_t HISTOGRAM_BUCKETS = (1 << RADIX_LENGTH_BITS);
         constexpr static const uint32_t BIT_MASK = (HISTOGRAM_BUCKETS - 1);
 
+        // Key/value sorting uses 8-bit digits so per-chunk histograms stay small enough to build in parallel
+        constexpr static const uint32_t PAIR_RADIX_BITS = 8;
+        constexpr static const uint32_t PAIR_BUCKETS = (1 << PAIR_RADIX_BITS);
+        constexpr static const uint32_t PAIR_MASK = (PAIR_BUCKETS - 1);
+        constexpr static const size_t PAIR_CHUNK_SIZE = 16384;
+
+        template<typename K>
+        static void count_digits(const K * keys, const size_t size, size_t * histograms)
+        {
+            const uint32_t passes = (sizeof(K) * 8) / PAIR_RADIX_BITS;
+            for (size_t i = 0; i < size; i++)
+            {
+                const K key = keys[i];
+                for (uint32_t r = 0; r < passes; r++) histograms[r * PAIR_BUCKETS + ((key >> (r * PAIR_RADIX_BITS)) & PAIR_MASK)]++;
+            }
+        }
+
+        template<typename K, typename V>
+        void radix_pairs_impl(K * keys, V * values, const size_t size, work_stealing_pool * pool)
+        {
+            static_assert(std::is_unsigned<K>::value, "keys must be unsigned integers");
+            const uint32_t passes = (sizeof(K) * 8) / PAIR_RADIX_BITS;
+            if (size < 2) return;
+
+            // Histogram every digit in a single read of the keys. With a pool, each chunk counts into 
+            // its own table and the tables are summed afterwards.
+            std::vector<size_t> histograms(passes * PAIR_BUCKETS, 0);
+            const size_t num_chunks = (size + PAIR_CHUNK_SIZE - 1) / PAIR_CHUNK_SIZE;
+            if (pool && num_chunks > 1)
+            {
+                std::vector<size_t> chunk_histograms(num_chunks * histograms.size(), 0);
+                pool->parallel_for(0, num_chunks, 1, [&](const size_t c)
+                {
+                    const size_t begin = c * PAIR_CHUNK_SIZE;
+                    count_digits(keys + begin, std::min(PAIR_CHUNK_SIZE, size - begin), &chunk_histograms[c * histograms.size()]);
+                });
+
+                for (size_t c = 0; c < num_chunks; c++)
+                {
+                    const size_t * h = &chunk_histograms[c * histograms.size()];
+                    for (size_t i = 0; i < histograms.size(); i++) histograms[i] += h[i];
+                }
+            }
+            else count_digits(keys, size, histograms.data());
+
+            std::vector<K> key_scratch(size);
+            std::vector<V> value_scratch(size);
+
+            K * src_keys = keys;
+            K * dst_keys = key_scratch.data();
+            V * src_values = values;
+            V * dst_values = value_scratch.data();
+
+            for (uint32_t r = 0; r < passes; r++)
+            {
+                size_t * h = &histograms[r * PAIR_BUCKETS];
+                const uint32_t shift = r * PAIR_RADIX_BITS;
+
+                // Every key shares this digit (common for the high bits of packed keys), so the pass is a no-op
+                if (h[(src_keys[0] >> shift) & PAIR_MASK] == size) continue;
+
+                size_t sum = 0;
+                for (uint32_t i = 0; i < PAIR_BUCKETS; i++)
+                {
+                    const size_t val = h[i];
+                    h[i] = sum;
+                    sum += val;
+                }
+
+                for (size_t i = 0; i < size; i++)
+                {
+                    const size_t index = h[(src_keys[i] >> shift) & PAIR_MASK]++;
+                    dst_keys[index] = src_keys[i];
+                    dst_values[index] = std::move(src_values[i]);
+                }
+
+                std::swap(src_keys, dst_keys);
+                std::swap(src_values, dst_values);
+            }
+
+            if (src_keys != keys)
+            {
+                std::copy(src_keys, src_keys + size, keys);
+                std::move(src_values, src_values + size, values);
+            }
+        }
+
         template<typename T>
         void radix_impl(T * data, size_t size)
         {
@@ -76,7 +165,7 @@ namespace polymer
 
     public:
 
-        template <typename T, typename = std::enable_if <std::is_integral<T>::value>::type>
+        template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
         void sort(T * data, const size_t size)
         {
             radix_impl<T>(data, size);
@@ -89,6 +178,14 @@ namespace polymer
             for (size_t i = 0; i < size; i++) inverse_float_flip((uint32_t &)data[i]);
         }
 
+        // Stable sort of unsigned integer `keys`, applying the same permutation to `values`. If a pool 
+        // is provided, digit histograms for large inputs are built in parallel.
+        template <typename K, typename V>
+        void sort(K * keys, V * values, const size_t size, work_stealing_pool * pool = nullptr)
+        {
+            radix_pairs_impl<K, V>(keys, values, size, pool);
+        }
+
     };
 
 } // end namespace polymer
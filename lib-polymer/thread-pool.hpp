@@ -5,11 +5,17 @@
 #ifndef polymer_thread_pool_hpp
 #define polymer_thread_pool_hpp
 
+#include <cstddef>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <atomic>
 #include <queue>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
 #include <thread>
 #include <mutex>
 #include <vector>
@@ -55,6 +61,8 @@ namespace polymer
             for (std::thread & worker : workers) if (worker.joinable()) worker.join();
         }
 
+        size_t size() const { return workers.size(); }
+
         template<class F, class... Args>
         decltype(auto) enqueue(F && f, Args &&... args)
         {
@@ -73,6 +81,401 @@ namespace polymer
         }
     };
 
+    /////////////////////
+    //   inline_task   //
+    /////////////////////
+
+    // A type-erased void() callable stored in a fixed inline buffer. Unlike std::function it never
+    // allocates; callables larger than |Capacity| are rejected at compile time. 
+    template<size_t Capacity = 48>
+    class inline_task
+    {
+        alignas(std::max_align_t) unsigned char storage[Capacity];
+        void(*invoke_fn)(void *) { nullptr };
+        void(*destroy_fn)(void *) { nullptr };
+
+        template<class Fn> static void invoke_impl(void * p) { (*static_cast<Fn *>(p))(); }
+        template<class Fn> static void destroy_impl(void * p) { static_cast<Fn *>(p)->~Fn(); }
+
+    public:
+
+        inline_task() = default;
+        inline_task(const inline_task &) = delete;
+        inline_task & operator = (const inline_task &) = delete;
+        ~inline_task() { reset(); }
+
+        template<class F> void emplace(F && f)
+        {
+            using Fn = typename std::decay<F>::type;
+            static_assert(sizeof(Fn) <= Capacity, "callable is too large for inline_task storage; capture by reference or pointer");
+            static_assert(alignof(Fn) <= alignof(std::max_align_t), "callable is over-aligned for inline_task storage");
+            reset();
+            new (storage) Fn(std::forward<F>(f));
+            invoke_fn = &invoke_impl<Fn>;
+            destroy_fn = &destroy_impl<Fn>;
+        }
+
+        void reset()
+        {
+            if (destroy_fn) destroy_fn(storage);
+            invoke_fn = nullptr;
+            destroy_fn = nullptr;
+        }
+
+        explicit operator bool() const { return invoke_fn != nullptr; }
+        void operator()() { invoke_fn(storage); }
+    };
+
+    // Counts outstanding jobs submitted against it; work_stealing_pool::wait() returns once it reaches zero.
+    using job_counter = std::atomic<uint32_t>;
+
+    ////////////////////////////
+    //   work_stealing_pool   //
+    ////////////////////////////
+
+    // Each worker owns a fixed-capacity Chase-Lev deque: it pushes and pops jobs at the bottom without 
+    // locking while idle workers steal from the top. Jobs live in per-thread rings of preallocated slots, 
+    // so submission does not allocate. Threads outside the pool submit through a single locked injection 
+    // queue. A thread that waits on a job_counter executes pending jobs instead of blocking, which makes 
+    // nested parallelism (a job that itself calls parallel_for) safe. If a deque or job ring is full, the 
+    // submitting thread runs the job inline.
+    class work_stealing_pool
+    {
+        static constexpr size_t kQueueCapacity = 4096; // power of two; per-worker jobs in flight
+
+        struct job
+        {
+            inline_task<48> task;
+            job_counter * counter{ nullptr };
+            std::atomic<bool> busy{ false };
+        };
+
+        // Chase & Lev, "Dynamic Circular Work-Stealing Deque", with the C11 orderings from 
+        // Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models" (2013).
+        class job_deque
+        {
+            std::unique_ptr<std::atomic<job *>[]> buffer{ new std::atomic<job *>[kQueueCapacity] };
+            char pad0[64];
+            std::atomic<int64_t> top{ 0 };
+            char pad1[64];
+            std::atomic<int64_t> bottom{ 0 };
+            char pad2[64];
+
+        public:
+
+            // Owner only
+            bool push(job * j)
+            {
+                const int64_t b = bottom.load(std::memory_order_relaxed);
+                const int64_t t = top.load(std::memory_order_acquire);
+                if (b - t >= static_cast<int64_t>(kQueueCapacity)) return false;
+                buffer[b & (kQueueCapacity - 1)].store(j, std::memory_order_relaxed);
+                bottom.store(b + 1, std::memory_order_release); // publishes the slot and the job it points to
+                return true;
+            }
+
+            // Owner only
+            job * pop()
+            {
+                const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+                bottom.store(b, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                int64_t t = top.load(std::memory_order_relaxed);
+
+                if (t > b)
+                {
+                    bottom.store(b + 1, std::memory_order_relaxed); // empty
+                    return nullptr;
+                }
+
+                job * j = buffer[b & (kQueueCapacity - 1)].load(std::memory_order_relaxed);
+                if (t == b)
+                {
+                    // Last item: race against thieves for it
+                    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) j = nullptr;
+                    bottom.store(b + 1, std::memory_order_relaxed);
+                }
+                return j;
+            }
+
+            // Any thread
+            job * steal()
+            {
+                int64_t t = top.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                const int64_t b = bottom.load(std::memory_order_acquire);
+                if (t >= b) return nullptr;
+
+                job * j = buffer[t & (kQueueCapacity - 1)].load(std::memory_order_relaxed);
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return nullptr;
+                return j;
+            }
+        };
+
+        struct worker
+        {
+            job_deque queue;
+            std::unique_ptr<job[]> ring{ new job[kQueueCapacity] };
+            size_t ring_next{ 0 };
+        };
+
+        std::vector<std::unique_ptr<worker>> workers;
+        std::vector<std::thread> threads;
+
+        std::mutex injection_mutex;
+        std::deque<job *> injection_queue;
+        std::unique_ptr<job[]> injection_ring{ new job[kQueueCapacity] };
+        size_t injection_ring_next{ 0 };
+
+        std::mutex sleep_mutex;
+        std::condition_variable sleep_cv;
+        std::atomic<uint32_t> sleepers{ 0 };
+        std::atomic<int64_t> queued{ 0 };
+        std::atomic<bool> should_stop{ false };
+
+        job_counter detached_jobs{ 0 }; // counter for fire-and-forget jobs submitted through enqueue()
+
+        struct thread_binding { work_stealing_pool * pool; size_t index; };
+        static thread_binding & current_thread() { static thread_local thread_binding b = { nullptr, 0 }; return b; }
+
+        // Index of the calling worker, or workers.size() for a thread outside this pool
+        size_t current_index() const
+        {
+            const thread_binding & b = current_thread();
+            return (b.pool == this) ? b.index : workers.size();
+        }
+
+        static void execute(job * j)
+        {
+            job_counter * counter = j->counter;
+            j->task();
+            j->task.reset();
+            j->busy.store(false, std::memory_order_release);
+            counter->fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        job * find_job(const size_t self)
+        {
+            if (self < workers.size())
+            {
+                if (job * j = workers[self]->queue.pop()) return j;
+            }
+
+            if (queued.load(std::memory_order_relaxed) <= 0) return nullptr;
+
+            {
+                std::lock_guard<std::mutex> lock(injection_mutex);
+                if (!injection_queue.empty())
+                {
+                    job * j = injection_queue.front();
+                    injection_queue.pop_front();
+                    return j;
+                }
+            }
+
+            // Start stealing at a neighbour so thieves spread across victims
+            const size_t n = workers.size();
+            for (size_t i = 1; i <= n; ++i)
+            {
+                const size_t victim = (self + i) % n;
+                if (victim == self) continue;
+                if (job * j = workers[victim]->queue.steal()) return j;
+            }
+            return nullptr;
+        }
+
+        bool run_one(const size_t self)
+        {
+            if (job * j = find_job(self))
+            {
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                execute(j);
+                return true;
+            }
+            return false;
+        }
+
+        void worker_loop(const size_t index)
+        {
+            current_thread() = { this, index };
+            uint32_t idle_spins = 0;
+
+            while (!should_stop.load(std::memory_order_acquire))
+            {
+                if (run_one(index))
+                {
+                    idle_spins = 0;
+                    continue;
+                }
+
+                if (++idle_spins < 64)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                // Park until new work is submitted. The timeout covers a wake-up that raced with going to sleep.
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                ++sleepers;
+                sleep_cv.wait_for(lock, std::chrono::milliseconds(2), [this] { return should_stop.load() || queued.load() > 0; });
+                --sleepers;
+                idle_spins = 0;
+            }
+        }
+
+        void notify_work()
+        {
+            if (sleepers.load(std::memory_order_relaxed) > 0) sleep_cv.notify_one();
+        }
+
+    public:
+
+        explicit work_stealing_pool(const size_t num_threads = std::max<size_t>(1, std::thread::hardware_concurrency()))
+        {
+            for (size_t i = 0; i < num_threads; ++i) workers.emplace_back(new worker());
+            for (size_t i = 0; i < num_threads; ++i) threads.emplace_back([this, i] { worker_loop(i); });
+        }
+
+        ~work_stealing_pool()
+        {
+            wait(detached_jobs);
+            should_stop = true;
+            sleep_cv.notify_all();
+            for (std::thread & t : threads) if (t.joinable()) t.join();
+        }
+
+        work_stealing_pool(const work_stealing_pool &) = delete;
+        work_stealing_pool & operator = (const work_stealing_pool &) = delete;
+
+        size_t size() const { return workers.size(); }
+
+        // Schedules |f| and increments |counter|, which must outlive the job. The callable is stored 
+        // inline, so it must be small (capture large state by reference).
+        template<class F>
+        void submit(job_counter & counter, F && f)
+        {
+            counter.fetch_add(1, std::memory_order_relaxed);
+            const size_t self = current_index();
+
+            if (self < workers.size())
+            {
+                worker & w = *workers[self];
+                job & slot = w.ring[w.ring_next & (kQueueCapacity - 1)];
+                if (!slot.busy.load(std::memory_order_acquire))
+                {
+                    ++w.ring_next;
+                    slot.busy.store(true, std::memory_order_relaxed);
+                    slot.task.emplace(std::forward<F>(f));
+                    slot.counter = &counter;
+
+                    // Count before publishing so thieves never see an empty hint while the job is visible
+                    queued.fetch_add(1, std::memory_order_relaxed);
+                    if (w.queue.push(&slot))
+                    {
+                        notify_work();
+                        return;
+                    }
+
+                    queued.fetch_sub(1, std::memory_order_relaxed);
+                    execute(&slot); // deque is full
+                    return;
+                }
+            }
+            else
+            {
+                std::unique_lock<std::mutex> lock(injection_mutex);
+                job & slot = injection_ring[injection_ring_next & (kQueueCapacity - 1)];
+                if (!slot.busy.load(std::memory_order_acquire))
+                {
+                    ++injection_ring_next;
+                    slot.busy.store(true, std::memory_order_relaxed);
+                    slot.task.emplace(std::forward<F>(f));
+                    slot.counter = &counter;
+                    queued.fetch_add(1, std::memory_order_relaxed);
+                    injection_queue.push_back(&slot);
+                    lock.unlock();
+                    notify_work();
+                    return;
+                }
+            }
+
+            // Every slot is in flight: run the job on the submitting thread
+            f();
+            counter.fetch_sub(1, std::memory_order_acq_rel);
+        }
+
+        // Blocks until |counter| reaches zero, executing queued jobs on the calling thread in the meantime.
+        void wait(const job_counter & counter)
+        {
+            const size_t self = current_index();
+            while (counter.load(std::memory_order_acquire) != 0)
+            {
+                if (!run_one(self)) std::this_thread::yield();
+            }
+        }
+
+        // Drop-in replacement for simple_thread_pool::enqueue. The returned future allocates its shared state.
+        template<class F, class... Args>
+        decltype(auto) enqueue(F && f, Args &&... args)
+        {
+            using return_type = typename std::result_of<F(Args...)>::type;
+            auto task = std::make_shared<std::packaged_task<return_type()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+            std::future<return_type> task_future = task->get_future();
+            submit(detached_jobs, [task]() { (*task)(); });
+            return task_future;
+        }
+
+        // Calls f(i) for every i in [begin, end). The range is split in halves until chunks are no larger 
+        // than |grain|; the split-off halves are pushed for other workers to steal. Returns once all calls finish.
+        template<class F>
+        void parallel_for(const size_t begin, const size_t end, const size_t grain, F && f)
+        {
+            struct range_splitter
+            {
+                work_stealing_pool * pool; typename std::remove_reference<F>::type * fn; job_counter * counter; size_t grain;
+                void run(size_t b, size_t e) const
+                {
+                    while (e - b > grain)
+                    {
+                        const size_t mid = b + (e - b) / 2;
+                        const range_splitter * self = this;
+                        pool->submit(*counter, [self, mid, e]() { self->run(mid, e); });
+                        e = mid;
+                    }
+                    for (size_t i = b; i < e; ++i) (*fn)(i);
+                }
+            };
+
+            if (end <= begin) return;
+            job_counter counter{ 0 };
+            const range_splitter splitter = { this, &f, &counter, std::max<size_t>(1, grain) };
+            splitter.run(begin, end);
+            wait(counter);
+        }
+
+        // Splits [begin, end) into chunks of at most |grain|, maps each chunk with chunk_fn(b, e) -> T, and
+        // folds the partial results in chunk order with combine(T, T) -> T, starting from |identity|.
+        template<class T, class ChunkFn, class CombineFn>
+        T parallel_reduce(const size_t begin, const size_t end, const size_t grain, const T identity, ChunkFn && chunk_fn, CombineFn && combine)
+        {
+            if (end <= begin) return identity;
+
+            const size_t g = std::max<size_t>(1, grain);
+            const size_t num_chunks = (end - begin + g - 1) / g;
+            std::vector<T> partials(num_chunks, identity);
+
+            parallel_for(0, num_chunks, 1, [&](const size_t c)
+            {
+                const size_t b = begin + c * g;
+                partials[c] = chunk_fn(b, std::min(end, b + g));
+            });
+
+            T result = identity;
+            for (const T & p : partials) result = combine(result, p);
+            return result;
+        }
+    };
+
 } // end namespace polymer
 
 #endif // end polymer_thread_pool_hpp
@@ -17,6 +17,7 @@ struct sample_engine_ecs final : public polymer_app
     perspective_camera cam;
     fps_camera_controller flycam;
 
+    std::unique_ptr<work_stealing_pool> system_pool; // declared first so it outlives the resolver and systems that use it
     std::unique_ptr<gl_shader_monitor> shaderMonitor;
     std::unique_ptr<entity_orchestrator> orchestrator;
     std::unique_ptr<asset_resolver> resolver;
@@ -46,22 +47,28 @@ sample_engine_ecs::sample_engine_ecs() : polymer_app(1280, 720, "sample-ecs-stre
     shaderMonitor.reset(new gl_shader_monitor("../../assets/"));
     fullscreen_surface.reset(new simple_texture_view());
     orchestrator.reset(new entity_orchestrator());
-    resolver.reset(new asset_resolver());
+    system_pool.reset(new work_stealing_pool());
+    resolver.reset(new asset_resolver(system_pool.get()));
 
     load_required_renderer_assets("../../assets/", *shaderMonitor);
 
     // Initial renderer settings
     renderer_settings settings;
     settings.renderSize = int2(width, height);
+    settings.gpuDrivenSubmission = true; // every icosahedron shares a mesh and material, so the scene is one indirect batch
 
     // Setup the required systems
     scene.collision_system = orchestrator->create_system<collision_system>(orchestrator.get());
     scene.xform_system = orchestrator->create_system<transform_system>(orchestrator.get());
     scene.identifier_system = orchestrator->create_system<identifier_system>(orchestrator.get());
     scene.render_system = orchestrator->create_system<render_system>(settings, orchestrator.get());
+    scene.render_system->get_renderer()->jobPool = system_pool.get();
     scene.mat_library.reset(new polymer::material_library("../../assets/sample-material.json"));
     scene.event_manager.reset(new polymer::event_manager_async());
 
+    // World transforms are propagated once per frame by the orchestrator rather than on every edit
+    scene.xform_system->set_deferred(true);
+
     // Only need to set the skybox on the |render_payload| once (unless we clear the payload)
     payload.skybox = scene.render_system->get_skybox();
     payload.sunlight = scene.render_system->get_implicit_sunlight();
@@ -107,12 +114,6 @@ sample_engine_ecs::sample_engine_ecs() : polymer_app(1280, 720, "sample-ecs-stre
             polymer::material_component material_component(debug_icosa);
             material_component.material = material_handle(material_library::kDefaultMaterialId);
             scene.render_system->create(debug_icosa, std::move(material_component));
-
-            // Assemble a render_component (gather components so the renderer does not have to interface
-            // with many systems). Ordinarily this assembly is done per-frame in the update loop, but
-            // this is a fully static scene.
-            render_component debug_icosahedron_renderable = assemble_render_component(scene, debug_icosa);
-            payload.render_components.push_back(debug_icosahedron_renderable);
         }
     }
 
@@ -135,6 +136,11 @@ void sample_engine_ecs::on_update(const app_update_event & e)
     glfwGetWindowSize(window, &width, &height);
     flycam.update(e.timestep_ms);
     shaderMonitor->handle_recompile();
+    resolver->update();
+
+    // Runs non-conflicting systems concurrently. The render system gathers renderables 
+    // (render_component assembly) after the transform system has flushed this frame's edits.
+    orchestrator->tick(e.timestep_ms, system_pool.get());
 }
 
 void sample_engine_ecs::on_draw()
@@ -151,6 +157,8 @@ void sample_engine_ecs::on_draw()
 
     payload.views.clear();
     payload.views.emplace_back(view_data(viewIndex, cam.pose, projectionMatrix));
+    payload.render_components = scene.render_system->get_frame_renderables();
+    payload.visibility = scene.render_system->get_frame_visibility();
     scene.render_system->get_renderer()->render_frame(payload);
 
     glUseProgram(0);
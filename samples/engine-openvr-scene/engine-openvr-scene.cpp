@@ -16,7 +16,7 @@ sample_vr_app::sample_vr_app() : polymer_app(1280, 800, "sample-engine-openvr-sc
         glfwSwapInterval(0);
 
         orchestrator.reset(new entity_orchestrator());
-        load_required_renderer_assets("../../assets", shaderMonitor);
+        load_required_renderer_assets("../../assets", shaderMonitor, true);
 
         shaderMonitor.watch("unlit-texture",
             "../../assets/shaders/renderer/renderer_vert.glsl",
@@ -47,6 +47,7 @@ sample_vr_app::sample_vr_app() : polymer_app(1280, 800, "sample-engine-openvr-sc
         renderer_settings settings;
         settings.renderSize = int2(eye_target_size.x, eye_target_size.y);
         settings.cameraCount = 2;
+        settings.singlePassStereo = true;
         settings.performanceProfiling = true;
 
         // Create required systems
@@ -130,6 +130,7 @@ void sample_engine_scene::on_update(const app_update_event & e)
     glfwGetWindowSize(window, &width, &height);
     flycam.update(e.timestep_ms);
     shaderMonitor->handle_recompile();
+    resolver->update();
 }
 
 void sample_engine_scene::on_draw()
@@ -1,7 +1,8 @@
 /*
  * File: samples/gl-octree-culling.cpp
  * This sample shows how to use Polymer's octree class to perform
- * basic frustum culling. 
+ * basic frustum culling. Press B to run a scaling benchmark (bulk build,
+ * batched update and cull) from 1k up to 1M objects.
  */
 
 #include "lib-polymer.hpp"
@@ -58,8 +59,10 @@ struct sample_gl_octree_culling final : public polymer_app
     gl_mesh sphereMesh;
     gl_mesh boxMesh;
 
-    octree<debug_sphere> octree{ 8,{ { -24, -24, -24 },{ +24, +24, +24 } } };
-    std::vector<node_container<debug_sphere>> nodes;
+    // The octree stores indices into `spheres`
+    octree<uint32_t> octree{ 8,{ { -24, -24, -24 },{ +24, +24, +24 } } };
+    std::vector<uint32_t> ids;
+    work_stealing_pool pool;
 
     std::unique_ptr<gl_gizmo> gizmo;
     tinygizmo::rigid_transform xform;
@@ -71,6 +74,8 @@ struct sample_gl_octree_culling final : public polymer_app
     void on_input(const app_input_event & event) override;
     void on_update(const app_update_event & e) override;
     void on_draw() override;
+
+    void run_benchmark(const frustum & f);
 };
 
 sample_gl_octree_culling::sample_gl_octree_culling() : polymer_app(1280, 720, "sample-gl-octree-culling")
@@ -108,12 +113,59 @@ sample_gl_octree_culling::sample_gl_octree_culling() : polymer_app(1280, 720, "s
 
     {
         scoped_timer create("create octree");
-        for (auto & s : spheres)
+        for (uint32_t i = 0; i < spheres.size(); ++i) ids.push_back(octree.insert(spheres[i].get_bounds(), i));
+        octree.commit(&pool);
+    }
+}
+
+void sample_gl_octree_culling::run_benchmark(const frustum & f)
+{
+    const aabb_3d worldBounds = { { -256, -256, -256 },{ +256, +256, +256 } };
+
+    for (uint32_t count = 1000; count <= 1000000; count *= 10)
+    {
+        std::vector<aabb_3d> bounds(count);
+        for (auto & b : bounds)
+        {
+            const float3 center = float3(gen.random_float(512.f), gen.random_float(512.f), gen.random_float(512.f)) - float3(256.f);
+            const float radius = 0.05f + gen.random_float(1.f);
+            b = { center - float3(radius), center + float3(radius) };
+        }
+
+        polymer::octree<uint32_t> tree{ 8, worldBounds };
+        std::vector<uint32_t> treeIds(count);
+
+        manual_timer buildTimer, updateTimer, cullTimer;
+
+        buildTimer.start();
+        for (uint32_t i = 0; i < count; ++i) treeIds[i] = tree.insert(bounds[i], i);
+        tree.rebuild(worldBounds, &pool);
+        buildTimer.stop();
+
+        // Move a tenth of the objects by a small amount, as a typical frame would
+        const uint32_t moveCount = count / 10;
+        std::vector<uint32_t> movedIds(moveCount);
+        std::vector<aabb_3d> movedBounds(moveCount);
+        for (uint32_t i = 0; i < moveCount; ++i)
         {
-            node_container<debug_sphere> container = { s, s.get_bounds() };
-            octree.create(container);
-            nodes.push_back(std::move(container));
+            const uint32_t which = (i * 10) % count;
+            const float3 offset = float3(gen.random_float(2.f), gen.random_float(2.f), gen.random_float(2.f)) - float3(1.f);
+            movedIds[i] = treeIds[which];
+            movedBounds[i] = { bounds[which]._min + offset, bounds[which]._max + offset };
         }
+
+        updateTimer.start();
+        tree.update(movedIds.data(), movedBounds.data(), moveCount, &pool);
+        tree.commit(&pool);
+        updateTimer.stop();
+
+        size_t visible = 0;
+        cullTimer.start();
+        tree.cull(f, [&](uint32_t, uint32_t) { ++visible; });
+        cullTimer.stop();
+
+        POLYMER_INFO("[octree benchmark] " << count << " objects, " << tree.get_nodes().size() << " nodes: build " << buildTimer.get()
+            << " ms, update 10% " << updateTimer.get() << " ms, cull " << cullTimer.get() << " ms (" << visible << " visible)");
     }
 }
 
@@ -127,6 +179,13 @@ void sample_gl_octree_culling::on_input(const app_input_event & event)
     {
         show_debug = !show_debug;
     }
+
+    if (event.type == app_input_event::KEY && event.value[0] == GLFW_KEY_B && event.action == GLFW_RELEASE)
+    {
+        int width, height;
+        glfwGetWindowSize(window, &width, &height);
+        run_benchmark(frustum(cam.get_projection_matrix((float)width / (float)height) * cam.get_view_matrix()));
+    }
 }
 
 void sample_gl_octree_culling::on_update(const app_update_event & e)
@@ -159,62 +218,42 @@ void sample_gl_octree_culling::on_draw()
     const float4x4 viewMatrix = cam.get_view_matrix();
     const float4x4 viewProjectionMatrix = (projectionMatrix * viewMatrix);
 
-    if (show_debug)
     {
-        octree_debug_draw<debug_sphere>(octree, shader.get(), &boxMesh, &sphereMesh, viewProjectionMatrix, nullptr, float3());
-    }
-
-    {
-        float3 xformPosition = { xform.position.x, xform.position.y, xform.position.z };
-        auto & n = nodes[0];
-        n.object.p.position = xformPosition;
-        n.worldspaceBounds = n.object.get_bounds();
-        octree.update(n);
+        const float3 xformPosition = { xform.position.x, xform.position.y, xform.position.z };
+        spheres[0].p.position = xformPosition;
+        octree.update(ids[0], spheres[0].get_bounds());
+        octree.commit(&pool);
     }
 
     const frustum cullingFrustum(viewProjectionMatrix);
 
-    shader->bind();
-
-    /*
-    // Debugging only
-    for (auto & s : spheres)
-    {
-        const auto sphereModel = (s.p.matrix() * make_scaling_matrix(s.radius));
-        shader->uniform("u_color", cullingFrustum.contains(s.p.position) ? float3(1, 0, 0) : float3(0, 0, 0));
-        shader->uniform("u_mvp", (viewProjectionMatrix * sphereModel));
-        sphereMesh.draw_elements();
-    }
-    */
-
-    std::vector<octant<debug_sphere> *> visibleNodes;
+    if (show_debug)
     {
-        // scoped_timer t("octree cull"); 
-        octree.cull(cullingFrustum, visibleNodes, nullptr, false);
+        octree_debug_draw<uint32_t>(octree, shader.get(), &boxMesh, viewProjectionMatrix);
     }
 
-    size_t visibleObjects = 0;
+    shader->bind();
 
-    for (octant<debug_sphere> * node : visibleNodes)
+    // Draw the nodes that touch the frustum in white
+    octree.cull_nodes(cullingFrustum, [&](const polymer::octree<uint32_t>::node & node, frustum_containment)
     {
-        // Draw bounding in white around this node
-        const float4x4 boxModelMatrix = make_translation_matrix(node->box.center()) * make_scaling_matrix(node->box.size() / 2.f);
+        const float4x4 boxModelMatrix = make_translation_matrix(node.box.center()) * make_scaling_matrix(node.box.size() / 2.f);
         shader->uniform("u_color", float3(1, 1, 1));
         shader->uniform("u_mvp", (viewProjectionMatrix * boxModelMatrix));
         boxMesh.draw_elements();
+    });
 
-        // Draw the contents of the node as red spheres
-        for (auto obj : node->objects)
-        {
-            const auto & object = obj.object;
-            const float4x4 sphereModelMatrix = (object.p.matrix() * make_scaling_matrix(object.radius));
-            shader->uniform("u_color", float3(1, 0, 0));
-            shader->uniform("u_mvp", (viewProjectionMatrix * sphereModelMatrix));
-            sphereMesh.draw_elements();
-        }
-
-        visibleObjects += node->objects.size();
-    }
+    // Draw the visible spheres in red
+    size_t visibleObjects = 0;
+    octree.cull(cullingFrustum, [&](uint32_t, uint32_t index)
+    {
+        const auto & object = spheres[index];
+        const float4x4 sphereModelMatrix = (object.p.matrix() * make_scaling_matrix(object.radius));
+        shader->uniform("u_color", float3(1, 0, 0));
+        shader->uniform("u_mvp", (viewProjectionMatrix * sphereModelMatrix));
+        sphereMesh.draw_elements();
+        ++visibleObjects;
+    });
 
     shader->unbind();
 
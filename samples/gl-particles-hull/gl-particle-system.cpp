@@ -71,7 +71,7 @@ void gl_particle_system::update(const float dt, const float3 gravityVec)
         }
     }
 
-    glNamedBufferDataEXT(instanceBuffer, instances.size() * sizeof(instance_data), instances.data(), GL_DYNAMIC_DRAW);
+    instanceRange = instanceBuffer.write(instances.data(), instances.size() * sizeof(instance_data));
 }
 
 void gl_particle_system::draw(
@@ -101,10 +101,10 @@ void gl_particle_system::draw(
 
     // Instance buffer contains position (xyz) and size/radius (w)
     // An attribute is referred to as instanced if its GL_VERTEX_ATTRIB_ARRAY_DIVISOR value is non-zero. 
-    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data), (GLvoid*)offsetof(instance_data, position_size));
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.handle());
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data), (GLvoid*)(instanceRange.offset + offsetof(instance_data, position_size)));
     glVertexAttribDivisor(0, 1);
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data), (GLvoid*)offsetof(instance_data, color));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(instance_data), (GLvoid*)(instanceRange.offset + offsetof(instance_data, color)));
     glVertexAttribDivisor(1, 1); 
 
     // Draw quad with texcoords
@@ -116,6 +116,7 @@ void gl_particle_system::draw(
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
     glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)instances.size());
+    instanceBuffer.end_frame();
     glDisableVertexAttribArray(0);
     glDisableVertexAttribArray(1);
     glDisableVertexAttribArray(2);
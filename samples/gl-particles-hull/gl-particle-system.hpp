@@ -125,7 +125,9 @@ namespace polymer
 
         std::vector<particle> particles;
         std::vector<instance_data> instances;
-        gl_buffer vertexBuffer, instanceBuffer;
+        gl_buffer vertexBuffer;
+        gl_ring_buffer instanceBuffer{ 64 * 1024, GL_NONE };
+        gl_ring_buffer::allocation instanceRange;
         gl_vertex_array_object vao;
         std::vector<std::shared_ptr<particle_modifier>> particleModifiers;
         size_t trail{ 0 };
@@ -6,7 +6,12 @@
 #include "ecs/core-events.hpp"
 #include "system-transform.hpp"
 #include "system-identifier.hpp"
+#include "system-collision.hpp"
+#include "asset-upload-queue.hpp"
+#include "file-watcher.hpp"
+#include "gl-texture-cooker.hpp"
 #include "ui-actions.hpp"
+#include "renderer-clusters.hpp"
 
 /// Quick reference for doctest macros
 /// REQUIRE, REQUIRE_FALSE, CHECK, WARN, CHECK_THROWS_AS(func(), std::exception)
@@ -193,6 +198,96 @@ namespace polymer
         REQUIRE(2080 * num_producers == handlerClass.static_accumulator);
     }
 
+    ///////////////////////////////
+    //   System Scheduler Tests   //
+    ///////////////////////////////
+
+    struct position_component : public base_component { float value{ 0.f }; };
+    struct velocity_component : public base_component { float value{ 0.f }; };
+    struct health_component : public base_component { float value{ 0.f }; };
+    POLYMER_SETUP_TYPEID(position_component);
+    POLYMER_SETUP_TYPEID(velocity_component);
+    POLYMER_SETUP_TYPEID(health_component);
+
+    struct movement_system final : public base_system
+    {
+        std::atomic<int> * sequence; int ticked_at{ -1 };
+        movement_system(entity_orchestrator * o, std::atomic<int> * seq) : base_system(o), sequence(seq)
+        {
+            declare_read<velocity_component>();
+            declare_write<position_component>();
+        }
+        void tick(const double dt) override { ticked_at = (*sequence)++; }
+    };
+    POLYMER_SETUP_TYPEID(movement_system);
+
+    struct position_reader_system final : public base_system
+    {
+        std::atomic<int> * sequence; int ticked_at{ -1 };
+        position_reader_system(entity_orchestrator * o, std::atomic<int> * seq) : base_system(o), sequence(seq)
+        {
+            declare_read<position_component>();
+        }
+        void tick(const double dt) override { ticked_at = (*sequence)++; }
+    };
+    POLYMER_SETUP_TYPEID(position_reader_system);
+
+    struct health_system final : public base_system
+    {
+        std::atomic<int> * sequence; int ticked_at{ -1 };
+        health_system(entity_orchestrator * o, std::atomic<int> * seq) : base_system(o), sequence(seq)
+        {
+            declare_write<health_component>();
+        }
+        void tick(const double dt) override { ticked_at = (*sequence)++; }
+    };
+    POLYMER_SETUP_TYPEID(health_system);
+
+    struct undeclared_system final : public base_system
+    {
+        undeclared_system(entity_orchestrator * o) : base_system(o) {}
+    };
+    POLYMER_SETUP_TYPEID(undeclared_system);
+
+    TEST_CASE("entity_orchestrator schedules conflicting systems in creation order")
+    {
+        std::atomic<int> sequence{ 0 };
+        entity_orchestrator orchestrator;
+        auto mover = orchestrator.create_system<movement_system>(&orchestrator, &sequence);
+        auto reader = orchestrator.create_system<position_reader_system>(&orchestrator, &sequence);
+        auto health = orchestrator.create_system<health_system>(&orchestrator, &sequence);
+
+        /// The reader depends on the mover's writes; the health system touches neither
+        const auto & schedule = orchestrator.get_schedule();
+        REQUIRE(schedule.size() == 2);
+        REQUIRE(schedule[0].size() == 2);
+        REQUIRE(schedule[0][0] == mover);
+        REQUIRE(schedule[0][1] == health);
+        REQUIRE(schedule[1].size() == 1);
+        REQUIRE(schedule[1][0] == reader);
+
+        work_stealing_pool pool(2);
+        for (int frame = 0; frame < 64; ++frame)
+        {
+            orchestrator.tick(0.016, &pool);
+            REQUIRE(mover->ticked_at < reader->ticked_at);
+            REQUIRE(health->ticked_at < reader->ticked_at);
+        }
+    }
+
+    TEST_CASE("entity_orchestrator serializes systems without declared access")
+    {
+        std::atomic<int> sequence{ 0 };
+        entity_orchestrator orchestrator;
+        orchestrator.create_system<health_system>(&orchestrator, &sequence);
+        orchestrator.create_system<undeclared_system>(&orchestrator);
+        orchestrator.create_system<position_reader_system>(&orchestrator, &sequence);
+
+        const auto & schedule = orchestrator.get_schedule();
+        REQUIRE(schedule.size() == 3);
+        for (auto & phase : schedule) REQUIRE(phase.size() == 1);
+    }
+
     ////////////////////////////////
     //   Transform System Tests   //
     ////////////////////////////////
@@ -325,7 +420,552 @@ namespace polymer
 
     TEST_CASE("transform system set local transform")
     {
-        // todo - test set_local_transform
+        const transform p1(make_rotation_quat_axis_angle({ 0, 1, 0 }, (float) POLYMER_PI / 2.0f), float3(0, 5.f, 0));
+        const transform p2(make_rotation_quat_axis_angle({ 1, 1, 0 }, (float) POLYMER_PI / 0.5f), float3(3.f, 0, 0));
+        const transform p3(make_rotation_quat_axis_angle({ 0, 1, -1 }, (float) POLYMER_PI), float3(0, 1.f, 4.f));
+
+        entity_orchestrator orchestrator;
+        transform_system * system = orchestrator.create_system<transform_system>(&orchestrator);
+
+        entity root = orchestrator.create_entity();
+        entity child = orchestrator.create_entity();
+        entity grandchild = orchestrator.create_entity();
+
+        system->create(root, transform(), float3(1));
+        system->create(child, p2, float3(1));
+        system->create(grandchild, p3, float3(1));
+        system->add_child(root, child);
+        system->add_child(child, grandchild);
+
+        REQUIRE(system->set_local_transform(root, p1));
+        REQUIRE(system->get_world_transform(root)->world_pose == p1);
+        REQUIRE(system->get_world_transform(child)->world_pose == p1 * p2);
+        REQUIRE(system->get_world_transform(grandchild)->world_pose == (p1 * p2) * p3);
+
+        REQUIRE_FALSE(system->set_local_transform(orchestrator.create_entity(), p1));
+    }
+
+    TEST_CASE("transform system deferred propagation")
+    {
+        const transform p1(make_rotation_quat_axis_angle({ 0, 1, 0 }, (float) POLYMER_PI / 2.0f), float3(0, 5.f, 0));
+        const transform p2(make_rotation_quat_axis_angle({ 1, 1, 0 }, (float) POLYMER_PI / 0.5f), float3(3.f, 0, 0));
+        const transform p3(make_rotation_quat_axis_angle({ 0, 1, -1 }, (float) POLYMER_PI), float3(0, 1.f, 4.f));
+
+        entity_orchestrator orchestrator;
+        transform_system * system = orchestrator.create_system<transform_system>(&orchestrator);
+        system->set_deferred(true);
+        REQUIRE(system->is_deferred());
+
+        entity root = orchestrator.create_entity();
+        entity child = orchestrator.create_entity();
+        entity grandchild = orchestrator.create_entity();
+
+        system->create(root, p1, float3(1));
+        system->create(child, p2, float3(1));
+        system->create(grandchild, p3, float3(1));
+        system->add_child(root, child);
+        system->add_child(child, grandchild);
+
+        /// World transforms are stale until update() is called
+        REQUIRE(system->get_world_transform(grandchild)->world_pose == transform());
+
+        system->update();
+        REQUIRE(system->get_world_transform(root)->world_pose == p1);
+        REQUIRE(system->get_world_transform(child)->world_pose == p1 * p2);
+        REQUIRE(system->get_world_transform(grandchild)->world_pose == (p1 * p2) * p3);
+
+        /// Editing a node and its descendant in the same frame only walks the subtree once
+        system->set_local_transform(grandchild, p1);
+        system->set_local_transform(root, p3);
+        REQUIRE(system->get_world_transform(root)->world_pose == p1);
+
+        system->update();
+        REQUIRE(system->get_world_transform(root)->world_pose == p3);
+        REQUIRE(system->get_world_transform(grandchild)->world_pose == (p3 * p2) * p1);
+
+        /// Returning to immediate mode flushes pending edits
+        system->set_local_transform(child, p1);
+        system->set_deferred(false);
+        REQUIRE(system->get_world_transform(grandchild)->world_pose == (p3 * p1) * p1);
+    }
+
+    TEST_CASE("transform system revision stamps moved subtrees")
+    {
+        entity_orchestrator orchestrator;
+        transform_system * system = orchestrator.create_system<transform_system>(&orchestrator);
+
+        entity root = orchestrator.create_entity();
+        entity child = orchestrator.create_entity();
+        entity other = orchestrator.create_entity();
+
+        system->create(root, transform(), float3(1));
+        system->create(child, transform(), float3(1));
+        system->create(other, transform(), float3(1));
+        system->add_child(root, child);
+
+        const uint64_t before = system->get_revision();
+        const uint64_t other_before = system->get_world_transform(other)->revision;
+
+        /// Moving the root restamps its subtree and nothing else
+        system->set_local_transform(root, transform(quatf(0, 0, 0, 1), float3(1, 2, 3)));
+        REQUIRE(system->get_revision() != before);
+        REQUIRE(system->get_world_transform(root)->revision == system->get_revision());
+        REQUIRE(system->get_world_transform(child)->revision == system->get_revision());
+        REQUIRE(system->get_world_transform(other)->revision == other_before);
+
+        /// Only the moved subtree is reported since the earlier revision
+        std::vector<entity> moved;
+        REQUIRE(system->get_moved_since(before, moved));
+        std::sort(moved.begin(), moved.end());
+        REQUIRE(moved == std::vector<entity>{ std::min(root, child), std::max(root, child) });
+
+        /// Destroying a node changes the revision so cached world-space state can be swept
+        const uint64_t before_destroy = system->get_revision();
+        system->destroy(other);
+        REQUIRE(system->get_revision() != before_destroy);
+
+        moved.clear();
+        REQUIRE(system->get_moved_since(before_destroy, moved));
+        REQUIRE(moved == std::vector<entity>{ other });
+
+        moved.clear();
+        REQUIRE(system->get_moved_since(system->get_revision(), moved));
+        REQUIRE(moved.empty());
+    }
+
+    TEST_CASE("transform system drops moved history once it outgrows the hierarchy")
+    {
+        entity_orchestrator orchestrator;
+        transform_system * system = orchestrator.create_system<transform_system>(&orchestrator);
+
+        entity e = orchestrator.create_entity();
+        system->create(e, transform(), float3(1));
+
+        const uint64_t start = system->get_revision();
+        for (int i = 0; i < 4096; ++i) system->set_local_transform(e, transform(quatf(0, 0, 0, 1), float3(float(i), 0, 0)));
+
+        /// The oldest revisions are gone, so callers must rescan; recent ones are still complete
+        std::vector<entity> moved;
+        REQUIRE_FALSE(system->get_moved_since(start, moved));
+        REQUIRE(moved.empty());
+        REQUIRE(system->get_moved_since(system->get_revision() - 1, moved));
+        REQUIRE(moved == std::vector<entity>{ e });
+    }
+
+    TEST_CASE("asset_handle resolves from concurrent system ticks")
+    {
+        // Copies of one handle and fresh handles to the same id race to resolve through the shared table
+        const cpu_mesh_handle shared("concurrent-resolve-test");
+        std::vector<cpu_mesh_handle> copies(64, shared);
+        std::vector<geometry *> resolved(copies.size() * 2, nullptr);
+
+        work_stealing_pool pool(4);
+        pool.parallel_for(0, resolved.size(), 1, [&](const size_t i)
+        {
+            if (i < copies.size()) resolved[i] = &copies[i].get();
+            else resolved[i] = &cpu_mesh_handle("concurrent-resolve-test").get();
+        });
+
+        for (geometry * g : resolved) REQUIRE(g == &shared.get());
+        REQUIRE(cpu_mesh_handle::list().size() > 0);
+        REQUIRE(cpu_mesh_handle::destroy("concurrent-resolve-test"));
+    }
+
+    struct test_decoded_asset
+    {
+        uint32_t id;
+        size_t bytes;
+    };
+
+    TEST_CASE("asset_upload_queue drains in arrival order within the byte budget")
+    {
+        asset_upload_queue<test_decoded_asset> queue;
+        const size_t sizes[] = { 10, 20, 30, 100, 5 };
+        for (uint32_t i = 0; i < 5; ++i) queue.push(std::unique_ptr<test_decoded_asset>(new test_decoded_asset{ i, sizes[i] }));
+
+        std::vector<uint32_t> order;
+        auto consume = [&](test_decoded_asset & a) { order.push_back(a.id); };
+
+        /// 10 + 20 fit; adding 30 would pass the budget
+        REQUIRE(queue.drain(40, consume) == 30);
+        REQUIRE(order == std::vector<uint32_t>{ 0, 1 });
+
+        REQUIRE(queue.drain(40, consume) == 30);
+        REQUIRE(order.back() == 2);
+
+        /// An asset larger than the budget is still consumed, alone
+        REQUIRE(queue.drain(40, consume) == 100);
+        REQUIRE(order.back() == 3);
+
+        REQUIRE(queue.drain(40, consume) == 5);
+        REQUIRE(queue.empty());
+        REQUIRE(queue.drain(40, consume) == 0);
+        REQUIRE(order == std::vector<uint32_t>{ 0, 1, 2, 3, 4 });
+    }
+
+    TEST_CASE("asset_upload_queue collects decode jobs submitted from a job")
+    {
+        asset_upload_queue<test_decoded_asset> queue;
+        work_stealing_pool pool(4);
+        job_counter outstanding{ 0 };
+
+        /// Like the resolver's directory walk: one job submits a decode job per match against the same counter
+        const uint32_t asset_count = 256;
+        pool.submit(outstanding, [&]()
+        {
+            for (uint32_t i = 0; i < asset_count; ++i)
+            {
+                pool.submit(outstanding, [&queue, i]()
+                {
+                    queue.push(std::unique_ptr<test_decoded_asset>(new test_decoded_asset{ i, size_t(i % 7) + 1 }));
+                });
+            }
+        });
+
+        pool.wait(outstanding);
+        REQUIRE(queue.size() == asset_count);
+
+        /// Every asset is uploaded exactly once, and no frame goes over budget
+        const size_t budget = 16;
+        std::vector<uint32_t> seen(asset_count, 0);
+        uint32_t frames = 0;
+        while (!queue.empty())
+        {
+            size_t frame_bytes = 0;
+            const size_t drained = queue.drain(budget, [&](test_decoded_asset & a) { seen[a.id]++; frame_bytes += a.bytes; });
+            REQUIRE(drained == frame_bytes);
+            REQUIRE(frame_bytes <= budget);
+            ++frames;
+        }
+
+        for (uint32_t count : seen) REQUIRE(count == 1);
+        REQUIRE(frames > 1);
+    }
+
+    TEST_CASE("cooked texture containers reload with the layout load_image uploads")
+    {
+        // The GL half of cook_texture() needs a context; this covers the container half that load_cooked_texture() relies on
+        namespace fs = std::experimental::filesystem;
+        std::mt19937 gen(7);
+
+        for (const texture_compression compression : { texture_compression::bc1, texture_compression::bc3, texture_compression::bc5, texture_compression::bc7 })
+        {
+            for (const bool srgb : { false, true })
+            {
+                const gli::format format = get_compressed_format(compression, srgb);
+                REQUIRE(gli::is_compressed(format));
+
+                // Non-power-of-two so the smallest levels are padded out to whole blocks
+                gli::texture2d cooked(format, gli::texture2d::extent_type(100, 36));
+                REQUIRE(cooked.levels() == 7);
+
+                uint8_t * bytes = static_cast<uint8_t *>(cooked.data());
+                for (size_t i = 0; i < cooked.size(); ++i) bytes[i] = uint8_t(gen());
+
+                for (const std::string extension : { ".dds", ".ktx" })
+                {
+                    const std::string path = (fs::temp_directory_path() / ("polymer-cooked-texture-test" + extension)).string();
+                    REQUIRE(gli::save(cooked, path));
+
+                    const gli::texture2d loaded(gli::load(path));
+                    REQUIRE_FALSE(loaded.empty());
+                    REQUIRE(loaded.format() == format);
+                    REQUIRE(loaded.levels() == cooked.levels());
+
+                    for (size_t level = 0; level < cooked.levels(); ++level)
+                    {
+                        REQUIRE(loaded.extent(level) == cooked.extent(level));
+                        REQUIRE(loaded.size(level) == cooked.size(level));
+                        REQUIRE(std::memcmp(loaded.data(0, 0, level), cooked.data(0, 0, level), cooked.size(level)) == 0);
+                    }
+
+                    std::remove(path.c_str());
+                }
+            }
+        }
+    }
+
+    TEST_CASE("file_watcher delivers debounced changes and stops after unwatch")
+    {
+        namespace fs = std::experimental::filesystem;
+        const std::string path = (fs::temp_directory_path() / "polymer-file-watcher-test.txt").string();
+
+        // Rewrite the file (inotify sees the write) and push its timestamp forward (the poller sees a new time)
+        auto touch = [&path]()
+        {
+            std::ofstream(path) << "changed";
+            fs::last_write_time(path, fs::last_write_time(path) + std::chrono::seconds(10));
+        };
+
+        // Polls until a callback arrives or |timeout| passes
+        auto wait_for_change = [](file_watcher & watcher, const uint32_t & count, const std::chrono::milliseconds timeout)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            while (count == 0 && std::chrono::steady_clock::now() - start < timeout)
+            {
+                watcher.poll();
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        };
+
+        for (const file_watcher::backend backend : { file_watcher::backend::polling, file_watcher::backend::native })
+        {
+            std::ofstream(path) << "initial";
+
+            const std::chrono::milliseconds debounce(200);
+            file_watcher watcher(debounce, backend);
+
+            uint32_t count = 0;
+            std::string notified;
+            const file_watcher::watch_id id = watcher.watch(path, [&](const std::string & p) { ++count; notified = p; });
+
+            const auto touched = std::chrono::steady_clock::now();
+            touch();
+            wait_for_change(watcher, count, std::chrono::seconds(5));
+
+            /// Delivered once, and no sooner than the debounce interval after the write
+            REQUIRE(count == 1);
+            REQUIRE(std::chrono::steady_clock::now() - touched >= debounce);
+            REQUIRE(notified == file_watcher::normalize(path));
+
+            /// Nothing more arrives without another write
+            std::this_thread::sleep_for(std::chrono::milliseconds(600));
+            watcher.poll();
+            REQUIRE(count == 1);
+
+            /// After unwatch, writes go unreported
+            watcher.unwatch(id);
+            count = 0;
+            touch();
+            wait_for_change(watcher, count, std::chrono::milliseconds(800));
+            REQUIRE(count == 0);
+        }
+
+        std::remove(path.c_str());
+    }
+
+    //////////////////////////
+    //   Collision Tests    //
+    //////////////////////////
+
+    TEST_CASE("dynamic_aabb_tree raycast_packet finds the same closest box as brute force")
+    {
+        uniform_random_gen gen;
+        dynamic_aabb_tree<uint32_t> tree;
+        std::vector<aabb_3d> boxes;
+
+        for (uint32_t i = 0; i < 2000; ++i)
+        {
+            const float3 center(gen.random_float(-50.f, 50.f), gen.random_float(-50.f, 50.f), gen.random_float(-50.f, 50.f));
+            const float3 half(gen.random_float(0.1f, 3.f), gen.random_float(0.1f, 3.f), gen.random_float(0.1f, 3.f));
+            boxes.push_back({ center - half, center + half });
+            tree.insert(boxes.back(), i);
+        }
+
+        auto entry_distance = [&](const ray & r, const uint32_t i, float & t) { float t_max; return intersect_ray_box(r, boxes[i].min(), boxes[i].max(), &t, &t_max); };
+
+        /// Full and partial packets, from a shared origin (coherent) and from scattered origins
+        for (uint32_t packet = 0; packet < 200; ++packet)
+        {
+            const uint32_t count = (packet % 3 == 0) ? 13 : dynamic_aabb_tree<uint32_t>::max_packet_size;
+            const bool coherent = (packet % 2) == 0;
+            const float3 shared_origin(gen.random_float(-50.f, 50.f), gen.random_float(-50.f, 50.f), gen.random_float(-50.f, 50.f));
+
+            ray rays[dynamic_aabb_tree<uint32_t>::max_packet_size];
+            float best_t[dynamic_aabb_tree<uint32_t>::max_packet_size];
+            uint32_t best[dynamic_aabb_tree<uint32_t>::max_packet_size];
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const float3 origin = coherent ? shared_origin : float3(gen.random_float(-50.f, 50.f), gen.random_float(-50.f, 50.f), gen.random_float(-50.f, 50.f));
+                rays[i] = ray(origin, normalize(float3(gen.random_float(-1.f, 1.f), gen.random_float(-1.f, 1.f), gen.random_float(-1.f, 1.f))));
+                best_t[i] = std::numeric_limits<float>::max();
+                best[i] = UINT32_MAX;
+            }
+
+            tree.raycast_packet(rays, count, best_t, [&](int32_t, const uint32_t box, const uint32_t i)
+            {
+                float t;
+                if (entry_distance(rays[i], box, t) && t < best_t[i]) { best_t[i] = t; best[i] = box; }
+            });
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                float expected_t = std::numeric_limits<float>::max();
+                for (uint32_t b = 0; b < boxes.size(); ++b)
+                {
+                    float t;
+                    if (entry_distance(rays[i], b, t) && t < expected_t) expected_t = t;
+                }
+                REQUIRE(best_t[i] == expected_t);
+                if (best[i] != UINT32_MAX) REQUIRE(entry_distance(rays[i], best[i], best_t[i]));
+            }
+        }
+    }
+
+    TEST_CASE("collision_system raycast_batch matches per-ray raycast")
+    {
+        entity_orchestrator orchestrator;
+        transform_system * xform_system = orchestrator.create_system<transform_system>(&orchestrator);
+        collision_system * collision = orchestrator.create_system<collision_system>(&orchestrator);
+
+        cpu_mesh_handle sphere_mesh("raycast-batch-test-sphere");
+        sphere_mesh.assign(make_sphere(0.5f));
+
+        uniform_random_gen gen;
+        for (int i = 0; i < 500; ++i)
+        {
+            const entity e = orchestrator.create_entity();
+            const float3 position(gen.random_float(-40.f, 40.f), gen.random_float(-40.f, 40.f), gen.random_float(-40.f, 40.f));
+            xform_system->create(e, transform(quatf(0, 0, 0, 1), position), float3(gen.random_float(0.5f, 2.f)));
+            collision->create(e, geometry_component(e, sphere_mesh));
+        }
+
+        /// Half the rays fan out from a few shared origins, the rest are scattered
+        std::vector<ray> rays;
+        for (int i = 0; i < 2000; ++i)
+        {
+            const float3 origin = (i < 1000) ? float3(float(i / 250) * 10.f - 15.f, 0, 0) : float3(gen.random_float(-40.f, 40.f), gen.random_float(-40.f, 40.f), gen.random_float(-40.f, 40.f));
+            rays.push_back(ray(origin, normalize(float3(gen.random_float(-1.f, 1.f), gen.random_float(-1.f, 1.f), gen.random_float(-1.f, 1.f)))));
+        }
+
+        work_stealing_pool pool(4);
+        std::vector<entity_hit_result> batch(rays.size()), pooled(rays.size());
+
+        for (const raycast_type type : { raycast_type::mesh, raycast_type::box })
+        {
+            collision->raycast_batch(rays, batch.data(), type);
+            collision->raycast_batch(rays, pooled.data(), type, &pool);
+
+            uint32_t hits = 0;
+            for (size_t i = 0; i < rays.size(); ++i)
+            {
+                const entity_hit_result single = collision->raycast(rays[i], type);
+                if (single.r.hit) ++hits;
+                REQUIRE(batch[i].e == single.e);
+                REQUIRE(pooled[i].e == single.e);
+                REQUIRE(batch[i].r.distance == single.r.distance);
+                REQUIRE(pooled[i].r.distance == single.r.distance);
+            }
+            REQUIRE(hits > 0);
+        }
+    }
+
+    TEST_CASE("collision_system refits the broadphase for moved entities only")
+    {
+        entity_orchestrator orchestrator;
+        transform_system * xform_system = orchestrator.create_system<transform_system>(&orchestrator);
+        collision_system * collision = orchestrator.create_system<collision_system>(&orchestrator);
+
+        cpu_mesh_handle sphere_mesh("broadphase-refit-test-sphere");
+        sphere_mesh.assign(make_sphere(0.5f));
+
+        uniform_random_gen gen;
+        std::vector<entity> entities;
+        for (int i = 0; i < 200; ++i)
+        {
+            const entity e = orchestrator.create_entity();
+            xform_system->create(e, transform(quatf(0, 0, 0, 1), float3(gen.random_float(-20.f, 20.f), 0, gen.random_float(-20.f, 20.f))), float3(1));
+            collision->create(e, geometry_component(e, sphere_mesh));
+            entities.push_back(e);
+        }
+
+        /// Every other sphere hangs off the previous one, so moving a parent moves its child without touching it directly
+        for (size_t i = 1; i < entities.size(); i += 2) xform_system->add_child(entities[i - 1], entities[i]);
+
+        // Each sphere's world bounds are tested against the query box by hand
+        const aabb_3d local_bounds = compute_bounds(sphere_mesh.get());
+        auto require_overlaps_match = [&]()
+        {
+            for (int q = 0; q < 20; ++q)
+            {
+                const float3 center(gen.random_float(-25.f, 25.f), 0, gen.random_float(-25.f, 25.f));
+                const aabb_3d box(center - float3(6.f), center + float3(6.f));
+
+                std::vector<entity> found;
+                collision->overlap_box(box, found);
+                std::sort(found.begin(), found.end());
+
+                std::vector<entity> expected;
+                for (const entity e : entities)
+                {
+                    const world_transform_component * world = xform_system->get_world_transform(e);
+                    if (!world) continue;
+                    const aabb_3d bounds = transform_aabb(world->world_pose.matrix(), local_bounds);
+                    const bool overlaps = bounds._max.x >= box._min.x && bounds._min.x <= box._max.x && bounds._max.y >= box._min.y &&
+                        bounds._min.y <= box._max.y && bounds._max.z >= box._min.z && bounds._min.z <= box._max.z;
+                    if (overlaps) expected.push_back(e);
+                }
+                REQUIRE(found.size() == expected.size());
+                for (size_t i = 0; i < found.size(); ++i) REQUIRE(found[i] == expected[i]);
+            }
+        };
+
+        require_overlaps_match();
+
+        /// Immediate moves of roots
+        for (size_t i = 0; i < entities.size(); i += 6) xform_system->set_local_transform(entities[i], transform(quatf(0, 0, 0, 1), float3(gen.random_float(-20.f, 20.f), 0, 0)));
+        require_overlaps_match();
+
+        /// A deferred, threaded batch
+        work_stealing_pool pool(3);
+        xform_system->set_deferred(true);
+        for (size_t i = 0; i < entities.size(); i += 4) xform_system->set_local_transform(entities[i], transform(quatf(0, 0, 0, 1), float3(0, 0, gen.random_float(-20.f, 20.f))));
+        xform_system->update(&pool);
+        xform_system->set_deferred(false);
+        require_overlaps_match();
+
+        /// Destroyed transforms, including the child destroyed along with its parent, leave the broadphase
+        xform_system->destroy(entities[10]);
+        require_overlaps_match();
+
+        /// Enough moves between queries that the transform system drops the history, forcing a rescan
+        for (int i = 0; i < 4096; ++i) xform_system->set_local_transform(entities[i % 8 * 2], transform(quatf(0, 0, 0, 1), float3(gen.random_float(-20.f, 20.f), 0, 0)));
+        require_overlaps_match();
+    }
+
+    TEST_CASE("transform system threaded update matches serial update")
+    {
+        entity_orchestrator orchestrator;
+        transform_system * serial = orchestrator.create_system<transform_system>(&orchestrator);
+
+        entity_orchestrator threaded_orchestrator;
+        transform_system * threaded = threaded_orchestrator.create_system<transform_system>(&threaded_orchestrator);
+
+        serial->set_deferred(true);
+        threaded->set_deferred(true);
+
+        uniform_random_gen gen;
+        std::vector<entity> entities;
+
+        for (int i = 0; i < 64; ++i)
+        {
+            const entity root = orchestrator.create_entity();
+            threaded_orchestrator.create_entity();
+            const transform pose(make_rotation_quat_axis_angle({ 0, 1, 0 }, gen.random_float_sphere()), float3(gen.random_float() * 10.f));
+            serial->create(root, pose, float3(1));
+            threaded->create(root, pose, float3(1));
+            entities.push_back(root);
+
+            entity parent = root;
+            for (int d = 0; d < 8; ++d)
+            {
+                const entity child = orchestrator.create_entity();
+                threaded_orchestrator.create_entity();
+                const transform child_pose(make_rotation_quat_axis_angle({ 1, 0, 0 }, gen.random_float_sphere()), float3(gen.random_float()));
+                serial->create(child, child_pose, float3(1));
+                threaded->create(child, child_pose, float3(1));
+                serial->add_child(parent, child);
+                threaded->add_child(parent, child);
+                entities.push_back(child);
+                parent = child;
+            }
+        }
+
+        work_stealing_pool pool(4);
+        serial->update();
+        threaded->update(&pool);
+
+        for (auto e : entities) REQUIRE(serial->get_world_transform(e)->world_pose == threaded->get_world_transform(e)->world_pose);
     }
 
     TEST_CASE("transform system performance testing")
@@ -382,6 +1022,37 @@ namespace polymer
         }
     }
 
+    TEST_CASE("transform system performance testing: immediate vs deferred edits")
+    {
+        entity_orchestrator orchestrator;
+        transform_system * system = orchestrator.create_system<transform_system>(&orchestrator);
+
+        const entity root = orchestrator.create_entity();
+        system->create(root, transform(), float3(1));
+
+        for (int i = 0; i < 10000; ++i)
+        {
+            const entity child = orchestrator.create_entity();
+            system->create(child, transform(float3((float) i, 0, 0)), float3(1));
+            system->add_child(root, child);
+        }
+
+        {
+            scoped_timer t("immediate: 64 edits of a root with 10k children");
+            for (int i = 0; i < 64; ++i) system->set_local_transform(root, transform(float3(0, (float) i, 0)));
+        }
+
+        system->set_deferred(true);
+
+        {
+            scoped_timer t("deferred: 64 edits of a root with 10k children + update");
+            for (int i = 0; i < 64; ++i) system->set_local_transform(root, transform(float3(0, (float) i, 0)));
+            system->update();
+        }
+
+        REQUIRE(system->get_world_transform(root)->world_pose.position == float3(0, 63, 0));
+    }
+
     //////////////////////////////
     //   Component Pool Tests   //
     //////////////////////////////
@@ -474,6 +1145,198 @@ namespace polymer
         REQUIRE(static_cast<int>(scene_graph_pool.size()) == (128 - 101 + 44));
     }
 
+    TEST_CASE("polymer_component_pool rejects stale entity versions")
+    {
+        polymer_component_pool<local_transform_component> scene_graph_pool(32);
+
+        const entity first = make_entity(7, 0);
+        const entity recycled = make_entity(7, 1);
+
+        scene_graph_pool.emplace(first)->parent = 1;
+        REQUIRE(scene_graph_pool.contains(first));
+        REQUIRE_FALSE(scene_graph_pool.contains(recycled));
+        REQUIRE(scene_graph_pool.get(recycled) == nullptr);
+
+        // A newer version of the same index replaces the stale object
+        auto obj = scene_graph_pool.emplace(recycled);
+        REQUIRE(obj != nullptr);
+        REQUIRE(obj->parent == kInvalidEntity);
+        REQUIRE_FALSE(scene_graph_pool.contains(first));
+        REQUIRE(scene_graph_pool.contains(recycled));
+        REQUIRE(static_cast<int>(scene_graph_pool.size()) == 1);
+
+        // An older version never evicts the newer object that owns the slot
+        obj->parent = 3;
+        REQUIRE(scene_graph_pool.emplace(first) == nullptr);
+        REQUIRE_FALSE(scene_graph_pool.contains(first));
+        REQUIRE(scene_graph_pool.get(recycled)->parent == 3);
+        REQUIRE(static_cast<int>(scene_graph_pool.size()) == 1);
+    }
+
+    TEST_CASE("polymer_component_pool packed arrays stay in sync")
+    {
+        polymer_component_pool<local_transform_component> scene_graph_pool(32);
+        for (int i = 1; i <= 64; ++i) scene_graph_pool.emplace(i);
+        for (int i = 1; i <= 64; i += 3) scene_graph_pool.destroy(i);
+
+        const auto & owners = scene_graph_pool.entities();
+        REQUIRE(owners.size() == scene_graph_pool.size());
+        for (size_t i = 0; i < owners.size(); ++i)
+        {
+            REQUIRE(scene_graph_pool.data()[i].get_entity() == owners[i]);
+            REQUIRE(scene_graph_pool.get(owners[i]) == &scene_graph_pool.data()[i]);
+        }
+    }
+
+    TEST_CASE("polymer_component_pool assign re-keys and overwrites")
+    {
+        polymer_component_pool<local_transform_component> scene_graph_pool(32);
+
+        local_transform_component source(3);
+        source.local_scale = float3(2.f);
+
+        // Assigning a component owned by another entity stores it under the new key
+        auto obj = scene_graph_pool.assign(9, source);
+        REQUIRE(obj != nullptr);
+        REQUIRE(obj->get_entity() == 9);
+        REQUIRE(obj->local_scale == float3(2.f));
+        REQUIRE_FALSE(scene_graph_pool.contains(3));
+
+        source.local_scale = float3(4.f);
+        REQUIRE(scene_graph_pool.assign(9, source) == scene_graph_pool.get(9));
+        REQUIRE(scene_graph_pool.get(9)->local_scale == float3(4.f));
+        REQUIRE(static_cast<int>(scene_graph_pool.size()) == 1);
+    }
+
+    TEST_CASE("entity_orchestrator recycles destroyed entities with a new version")
+    {
+        entity_orchestrator orchestrator;
+
+        const entity a = orchestrator.create_entity();
+        const entity b = orchestrator.create_entity();
+        REQUIRE(a == 1);
+        REQUIRE(b == 2);
+        REQUIRE(orchestrator.is_alive(a));
+        REQUIRE_FALSE(orchestrator.is_alive(kInvalidEntity));
+
+        orchestrator.destroy_entity(a);
+        REQUIRE_FALSE(orchestrator.is_alive(a));
+
+        const entity c = orchestrator.create_entity();
+        REQUIRE(get_entity_index(c) == get_entity_index(a));
+        REQUIRE(get_entity_version(c) == get_entity_version(a) + 1);
+        REQUIRE(orchestrator.is_alive(c));
+
+        // Retiring a stale handle is a no-op
+        orchestrator.destroy_entity(a);
+        REQUIRE(orchestrator.is_alive(c));
+    }
+
+    TEST_CASE("environment import remaps recycled entity handles")
+    {
+        auto make_environment = [](entity_orchestrator & orchestrator, environment & env)
+        {
+            env.xform_system = orchestrator.create_system<transform_system>(&orchestrator);
+            env.identifier_system = orchestrator.create_system<identifier_system>(&orchestrator);
+            env.render_system = nullptr;
+            env.collision_system = nullptr;
+        };
+
+        entity_orchestrator source_orchestrator;
+        environment source;
+        make_environment(source_orchestrator, source);
+
+        // Recycle an index so the exported handles carry a version in their upper 32 bits
+        source_orchestrator.destroy_entity(source_orchestrator.create_entity());
+        const entity parent = source.track_entity(source_orchestrator.create_entity());
+        const entity child = source.track_entity(source_orchestrator.create_entity());
+        REQUIRE(get_entity_version(parent) == 1);
+
+        source.xform_system->create(parent, transform(quatf(0, 0, 0, 1), float3(1, 2, 3)));
+        source.xform_system->create(child, transform(quatf(0, 0, 0, 1), float3(0, 1, 0)));
+        source.xform_system->add_child(parent, child);
+        source.identifier_system->create(parent, "recycled-parent");
+        source.identifier_system->create(child, "recycled-child");
+
+        const std::string path = "environment-import-test.json";
+        source.export_environment(path);
+
+        entity_orchestrator orchestrator;
+        environment env;
+        make_environment(orchestrator, env);
+        env.import_environment(path, orchestrator);
+        std::remove(path.c_str());
+
+        REQUIRE(env.entity_list().size() == 2);
+        const entity imported_parent = env.identifier_system->find_entity("recycled-parent");
+        const entity imported_child = env.identifier_system->find_entity("recycled-child");
+        REQUIRE(orchestrator.is_alive(imported_parent));
+        REQUIRE(orchestrator.is_alive(imported_child));
+        REQUIRE(env.xform_system->get_parent(imported_child) == imported_parent);
+        REQUIRE(env.xform_system->get_world_transform(imported_child)->world_pose.position == float3(1, 3, 3));
+    }
+
+    TEST_CASE("component pool performance: unordered_vector_map vs sparse_component_pool")
+    {
+        const int num_entities = 131072;
+
+        entity_orchestrator orchestrator;
+        std::vector<entity> entities(num_entities);
+        for (auto & e : entities) e = orchestrator.create_entity();
+
+        std::vector<entity> lookup_order = entities;
+        std::shuffle(lookup_order.begin(), lookup_order.end(), std::mt19937(1234));
+
+        unordered_vector_map<entity, world_transform_component, component_hash> map_pool(64);
+        polymer_component_pool<world_transform_component> sparse_pool(64);
+
+        {
+            scoped_timer t("unordered_vector_map: emplace 131072");
+            for (auto e : entities) map_pool.emplace(e);
+        }
+
+        {
+            scoped_timer t("sparse_component_pool: emplace 131072");
+            for (auto e : entities) sparse_pool.emplace(e);
+        }
+
+        float sum_map = 0.f, sum_sparse = 0.f;
+
+        {
+            scoped_timer t("unordered_vector_map: random get 131072");
+            for (auto e : lookup_order) sum_map += map_pool.get(e)->world_pose.position.x + 1.f;
+        }
+
+        {
+            scoped_timer t("sparse_component_pool: random get 131072");
+            for (auto e : lookup_order) sum_sparse += sparse_pool.get(e)->world_pose.position.x + 1.f;
+        }
+
+        REQUIRE(sum_map == sum_sparse);
+
+        {
+            scoped_timer t("unordered_vector_map: iterate 131072");
+            map_pool.for_each([&](world_transform_component & c) { c.world_pose.position += float3(0.001f); });
+        }
+
+        {
+            scoped_timer t("sparse_component_pool: iterate 131072");
+            sparse_pool.for_each([&](world_transform_component & c) { c.world_pose.position += float3(0.001f); });
+        }
+
+        {
+            scoped_timer t("unordered_vector_map: destroy half");
+            for (size_t i = 0; i < lookup_order.size(); i += 2) map_pool.destroy(lookup_order[i]);
+        }
+
+        {
+            scoped_timer t("sparse_component_pool: destroy half");
+            for (size_t i = 0; i < lookup_order.size(); i += 2) sparse_pool.destroy(lookup_order[i]);
+        }
+
+        REQUIRE(map_pool.size() == sparse_pool.size());
+    }
+
     /////////////////////////////////
     //   Identifier System Tests   //
     /////////////////////////////////
@@ -661,5 +1524,159 @@ namespace polymer
         REQUIRE(sky_turbidity == 15);
     }
 
-} // end namespace polymer
+    //////////////////////////////////
+    //   Clustered Lighting Tests   //
+    //////////////////////////////////
+
+    TEST_CASE("light_cluster_grid assignment matches brute force")
+    {
+        uniform_random_gen gen;
+        const float4x4 projection = make_projection_matrix(to_radians(75.f), 16.f / 9.f, 0.1f, 256.f);
+        const transform pose = transform(make_rotation_quat_axis_angle({ 0, 1, 0 }, 0.5f), float3(3, 2, 10));
+        const float4x4 view = pose.view_matrix();
+
+        std::vector<uniforms::light_gpu> lights;
+        for (int i = 0; i < 512; ++i)
+        {
+            const float3 position((gen.random_float() - 0.5f) * 200.f, (gen.random_float() - 0.5f) * 50.f, (gen.random_float() - 0.5f) * 200.f);
+            if (i % 4 == 0)
+            {
+                uniforms::spot_light s;
+                s.position = position;
+                s.direction = float3(gen.random_float() - 0.5f, gen.random_float() - 0.5f, gen.random_float() - 0.5f);
+                s.color = float3(1, 1, 1);
+                s.attenuation = float3(1.f, 0.5f, 0.2f + gen.random_float());
+                s.cutoff = 0.5f + gen.random_float() * 0.45f;
+                lights.push_back(make_gpu_light(s, 256.f));
+            }
+            else
+            {
+                uniforms::point_light p;
+                p.position = position;
+                p.color = float3(1, 1, 1);
+                p.radius = 0.25f + gen.random_float() * 2.f;
+                lights.push_back(make_gpu_light(p));
+            }
+        }
+
+        light_cluster_grid grid;
+        grid.update_projection(projection);
+        grid.assign(view, lights);
+        REQUIRE(grid.ranges.size() == uniforms::NUM_CLUSTERS);
+
+        // A light is only listed in clusters whose box its bounding sphere touches. The screen-space tile 
+        // range may reject a few more, since a cluster's box is looser than its frustum-shaped cell; the 
+        // next test checks that no light is missing where it has an effect.
+        uint32_t total = 0, rejected_by_tile = 0;
+        for (uint32_t c = 0; c < uniforms::NUM_CLUSTERS; ++c)
+        {
+            const aabb_3d & box = grid.get_cluster_bounds(c);
+            std::vector<uint32_t> expected;
+            for (uint32_t i = 0; i < lights.size(); ++i)
+            {
+                const float4 sphere = light_bounding_sphere(lights[i]);
+                const float3 center = (view * float4(sphere.xyz(), 1.f)).xyz();
+                const float3 d = max(max(box._min - center, center - box._max), float3(0.f));
+                if (dot(d, d) <= sphere.w * sphere.w) expected.push_back(i);
+            }
+
+            const uniforms::cluster_range r = grid.ranges[c];
+            const std::vector<uint32_t> actual(grid.indices.begin() + r.offset, grid.indices.begin() + r.offset + r.count);
+            REQUIRE(std::is_sorted(actual.begin(), actual.end()));
+            REQUIRE(std::includes(expected.begin(), expected.end(), actual.begin(), actual.end()));
+            if (actual != expected) ++rejected_by_tile;
+            total += r.count;
+        }
+        REQUIRE(total == grid.indices.size());
+        REQUIRE(total > 0);
+        REQUIRE(rejected_by_tile < uniforms::NUM_CLUSTERS / 4);
+    }
+
+    TEST_CASE("light_cluster_grid shader lookup finds the lights touching a point")
+    {
+        uniform_random_gen gen;
+        const float4x4 projection = make_projection_matrix(to_radians(90.f), 1.5f, 0.05f, 100.f);
+        const float4x4 view = transform(float3(0, 1, 0)).view_matrix();
+
+        std::vector<uniforms::light_gpu> lights;
+        for (int i = 0; i < 256; ++i)
+        {
+            uniforms::point_light p;
+            p.position = float3((gen.random_float() - 0.5f) * 40.f, (gen.random_float() - 0.5f) * 10.f, -gen.random_float() * 60.f);
+            p.radius = 0.1f + gen.random_float();
+            lights.push_back(make_gpu_light(p));
+        }
+
+        light_cluster_grid grid;
+        grid.update_projection(projection);
+        grid.assign(view, lights);
+        const float2 depth_scale_bias = grid.get_depth_scale_bias();
 
+        // Mirrors get_cluster_index() in renderer_common.glsl
+        auto lookup = [&](const float3 & world) -> int
+        {
+            const float4 v = view * float4(world, 1);
+            const float4 clip = projection * v;
+            const float2 ndc = clip.xy() / clip.w;
+            if (clip.w <= 0.f || std::abs(ndc.x) > 1.f || std::abs(ndc.y) > 1.f) return -1;
+            const uint32_t x = std::min(uint32_t((ndc.x * 0.5f + 0.5f) * uniforms::CLUSTER_GRID_X), uint32_t(uniforms::CLUSTER_GRID_X - 1));
+            const uint32_t y = std::min(uint32_t((ndc.y * 0.5f + 0.5f) * uniforms::CLUSTER_GRID_Y), uint32_t(uniforms::CLUSTER_GRID_Y - 1));
+            const float slice = std::log(-v.z) * depth_scale_bias.x + depth_scale_bias.y;
+            const uint32_t z = std::min(uint32_t(std::max(slice, 0.f)), uint32_t(uniforms::CLUSTER_GRID_Z - 1));
+            return int(light_cluster_grid::cluster_index(x, y, z));
+        };
+
+        uint32_t checked = 0;
+        for (int s = 0; s < 20000; ++s)
+        {
+            const uint32_t i = uint32_t(gen.random_float() * (lights.size() - 1));
+            const float range = lights[i].positionRange.w;
+            const float3 offset = float3(gen.random_float() - 0.5f, gen.random_float() - 0.5f, gen.random_float() - 0.5f) * range;
+            if (length(offset) >= range) continue;
+
+            const int cluster = lookup(lights[i].positionRange.xyz() + offset);
+            if (cluster < 0) continue;
+
+            const uniforms::cluster_range r = grid.ranges[cluster];
+            const auto begin = grid.indices.begin() + r.offset;
+            REQUIRE(std::find(begin, begin + r.count, i) != begin + r.count);
+            ++checked;
+        }
+        REQUIRE(checked > 1000);
+    }
+
+    TEST_CASE("light_cluster_grid performance: 4 vs 4096 lights")
+    {
+        uniform_random_gen gen;
+        const float4x4 projection = make_projection_matrix(to_radians(75.f), 16.f / 9.f, 0.1f, 256.f);
+        const float4x4 view = transform(float3(0, 2, 0)).view_matrix();
+
+        light_cluster_grid grid;
+        {
+            scoped_timer t("light_cluster_grid: build cluster bounds");
+            grid.update_projection(projection);
+        }
+
+        for (const int count : { 4, 4096 })
+        {
+            std::vector<uniforms::light_gpu> lights;
+            for (int i = 0; i < count; ++i)
+            {
+                uniforms::point_light p;
+                p.position = float3((gen.random_float() - 0.5f) * 200.f, gen.random_float() * 10.f, -gen.random_float() * 200.f);
+                p.radius = 0.1f + gen.random_float() * 0.5f;
+                lights.push_back(make_gpu_light(p));
+            }
+
+            scoped_timer t("light_cluster_grid: assign " + std::to_string(count) + " point lights");
+            grid.assign(view, lights);
+        }
+
+        // Each cluster holds a small fraction of the scene's lights
+        uint32_t most = 0;
+        for (const auto & r : grid.ranges) most = std::max(most, r.count);
+        std::cout << "Most lights in one cluster: " << most << " of 4096" << std::endl;
+        REQUIRE(most < 4096 / 4);
+    }
+
+} // end namespace polymer
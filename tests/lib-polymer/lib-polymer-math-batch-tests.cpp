@@ -0,0 +1,292 @@
+#include "lib-polymer.hpp"
+
+using namespace polymer;
+
+#include "doctest.h"
+
+namespace
+{
+    struct batch_test_scene
+    {
+        std::vector<transform> poses, locals;
+        std::vector<float3> scales, points;
+        std::vector<aabb_3d> bounds;
+        float4_array rotation, local_rotation;
+        float3_array position, local_position, scale, local_min, local_max;
+
+        batch_test_scene(const size_t count)
+        {
+            uniform_random_gen rand;
+            auto random_pose = [&rand]()
+            {
+                const float3 axis = normalize(float3(rand.random_float(-1.f, 1.f), rand.random_float(-1.f, 1.f), rand.random_float(-1.f, 1.f)) + float3(0.f, 0.001f, 0.f));
+                return transform(make_rotation_quat_axis_angle(axis, rand.random_float(-3.f, 3.f)), float3(rand.random_float(-100.f, 100.f), rand.random_float(-100.f, 100.f), rand.random_float(-100.f, 100.f)));
+            };
+
+            rotation.resize(count); local_rotation.resize(count);
+            position.resize(count); local_position.resize(count); scale.resize(count);
+            local_min.resize(count); local_max.resize(count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                poses.push_back(random_pose());
+                locals.push_back(random_pose());
+                scales.push_back(float3(rand.random_float(0.1f, 4.f), rand.random_float(0.1f, 4.f), rand.random_float(0.1f, 4.f)));
+                points.push_back(float3(rand.random_float(-10.f, 10.f), rand.random_float(-10.f, 10.f), rand.random_float(-10.f, 10.f)));
+                const float3 extent = float3(rand.random_float(0.1f, 2.f), rand.random_float(0.1f, 2.f), rand.random_float(0.1f, 2.f));
+                bounds.push_back({ points.back() - extent, points.back() + extent });
+
+                rotation.set(i, poses[i].orientation); position.set(i, poses[i].position);
+                local_rotation.set(i, locals[i].orientation); local_position.set(i, locals[i].position);
+                scale.set(i, scales[i]);
+                local_min.set(i, bounds[i]._min); local_max.set(i, bounds[i]._max);
+            }
+        }
+    };
+
+    /// Runs f once per instruction set this machine supports, then restores the default
+    template<typename F>
+    void for_each_simd_level(F && f)
+    {
+        const simd_level supported = get_supported_simd_level();
+        for (uint32_t l = 0; l <= static_cast<uint32_t>(supported); ++l)
+        {
+            set_simd_level(static_cast<simd_level>(l));
+            f(static_cast<simd_level>(l));
+        }
+        set_simd_level(supported);
+    }
+
+    bool approx_equal(const float3 & a, const float3 & b, const float tolerance = 1e-3f)
+    {
+        return maxelem(abs(a - b)) <= tolerance * std::max(1.f, maxelem(abs(b)));
+    }
+
+    bool approx_equal(const float4 & a, const float4 & b, const float tolerance = 1e-3f)
+    {
+        return maxelem(abs(a - b)) <= tolerance * std::max(1.f, maxelem(abs(b)));
+    }
+
+    bool approx_equal(const float4x4 & a, const float4x4 & b, const float tolerance = 1e-3f)
+    {
+        for (int c = 0; c < 4; ++c) for (int r = 0; r < 4; ++r)
+        {
+            if (std::abs(a[c][r] - b[c][r]) > tolerance * std::max(1.f, std::abs(b[c][r]))) return false;
+        }
+        return true;
+    }
+
+    /// The per-vertex loop that compute_bounds() used before it moved to batch_compute_bounds()
+    aabb_3d compute_bounds_scalar(const std::vector<float3> & points)
+    {
+        aabb_3d bounds;
+        bounds._min = float3(std::numeric_limits<float>::infinity());
+        bounds._max = -bounds.min();
+        for (const auto & p : points)
+        {
+            bounds._min = linalg::min(bounds.min(), p);
+            bounds._max = linalg::max(bounds.max(), p);
+        }
+        return bounds;
+    }
+}
+
+/// The batch kernels operate on structure-of-arrays data (`float3_array`, `float4_array`, `float3x4_array`)
+/// and are dispatched to AVX2, SSE or a scalar loop at runtime. Every path must agree with `linalg`.
+TEST_CASE("batch transforms match linalg")
+{
+    const size_t count = 1003; // not a multiple of the register width
+    batch_test_scene scene(count);
+
+    float4_array composed_rotation;
+    float3_array composed_position, transformed, first_level_transformed;
+    float3x4_array matrices, local_matrices, products, inverses;
+    std::vector<float3> interleaved(count);
+    std::vector<float4x4> first_level_matrices;
+
+    for_each_simd_level([&](const simd_level level)
+    {
+        const char * level_name = get_simd_level_name(level);
+        CAPTURE(level_name);
+
+        batch_compose(scene.rotation, scene.position, scene.local_rotation, scene.local_position, composed_rotation, composed_position);
+        batch_make_matrices(scene.rotation, scene.position, scene.scale, matrices);
+        batch_make_matrices(scene.local_rotation, scene.local_position, scene.scale, local_matrices);
+        batch_multiply(matrices, local_matrices, products);
+        batch_inverse(matrices, inverses);
+        batch_transform_coords(scene.poses[0].matrix(), scene.local_position, transformed);
+        batch_transform_coords(scene.poses[0].matrix(), scene.points.data(), interleaved.data(), count);
+
+        bool matches = true;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const transform expected_pose = scene.poses[i] * scene.locals[i];
+            const float4x4 model = scene.poses[i].matrix() * make_scaling_matrix(scene.scales[i]);
+            const float4x4 local_model = scene.locals[i].matrix() * make_scaling_matrix(scene.scales[i]);
+
+            if (!approx_equal(composed_position.get(i), expected_pose.position)) matches = false;
+            if (!approx_equal(composed_rotation.get(i), float4(expected_pose.orientation.x, expected_pose.orientation.y, expected_pose.orientation.z, expected_pose.orientation.w))) matches = false;
+            if (!approx_equal(matrices.get(i), model)) matches = false;
+            if (!approx_equal(products.get(i), model * local_model)) matches = false;
+            if (!approx_equal(inverses.get(i), inverse(model))) matches = false;
+            if (!approx_equal(transformed.get(i), transform_coord(scene.poses[0].matrix(), scene.locals[i].position))) matches = false;
+            if (!approx_equal(interleaved[i], transform_coord(scene.poses[0].matrix(), scene.points[i]))) matches = false;
+        }
+        REQUIRE(matches);
+
+        /// Kernels use the same operation order at every width, so the results are identical
+        if (level == simd_level::scalar)
+        {
+            first_level_transformed = transformed;
+            first_level_matrices.clear();
+            for (size_t i = 0; i < count; ++i) first_level_matrices.push_back(products.get(i));
+        }
+        else
+        {
+            bool identical = true;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (transformed.get(i) != first_level_transformed.get(i) || products.get(i) != first_level_matrices[i]) identical = false;
+            }
+            REQUIRE(identical);
+        }
+    });
+}
+
+TEST_CASE("batch bounds and frustum classification match scalar")
+{
+    const size_t count = 4099;
+    batch_test_scene scene(count);
+
+    const frustum f(make_projection_matrix(to_radians(60.f), 16.f / 9.f, 0.1f, 150.f) * transform(float3(0, 0, 60)).view_matrix());
+
+    float3x4_array matrices;
+    float3_array world_min, world_max;
+    float4_array spheres;
+    spheres.resize(count);
+    for (size_t i = 0; i < count; ++i) spheres.set(i, float4(scene.poses[i].position, scene.scales[i].x * 5.f));
+
+    std::vector<uint8_t> box_result(count), sphere_result(count);
+
+    for_each_simd_level([&](const simd_level level)
+    {
+        const char * level_name = get_simd_level_name(level);
+        CAPTURE(level_name);
+
+        batch_make_matrices(scene.rotation, scene.position, scene.scale, matrices);
+        batch_transform_bounds(matrices, scene.local_min, scene.local_max, world_min, world_max);
+        batch_classify_boxes(f, world_min, world_max, box_result.data());
+        batch_classify_spheres(f, spheres, sphere_result.data());
+
+        uint32_t bounds_mismatches = 0, box_mismatches = 0, sphere_mismatches = 0, visible = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const aabb_3d expected = transform_aabb(scene.poses[i].matrix() * make_scaling_matrix(scene.scales[i]), scene.bounds[i]);
+            if (!approx_equal(world_min.get(i), expected._min) || !approx_equal(world_max.get(i), expected._max)) ++bounds_mismatches;
+
+            /// The batch test measures the box from its center rather than its corners, which can round
+            /// differently for a box touching a plane; compare with the batch bounds so only that can differ
+            const aabb_3d world = { world_min.get(i), world_max.get(i) };
+            if (box_result[i] != static_cast<uint8_t>(f.classify(world))) ++box_mismatches;
+
+            const float4 s = spheres.get(i);
+            const frustum_containment expected_sphere = !f.intersects(s.xyz(), s.w) ? frustum_containment::outside : f.contains(s.xyz(), s.w) ? frustum_containment::inside : frustum_containment::intersecting;
+            if (sphere_result[i] != static_cast<uint8_t>(expected_sphere)) ++sphere_mismatches;
+            if (sphere_result[i] != static_cast<uint8_t>(frustum_containment::outside)) ++visible;
+        }
+
+        REQUIRE(bounds_mismatches == 0);
+        REQUIRE(box_mismatches <= count / 1000);
+        REQUIRE(sphere_mismatches == 0);
+        REQUIRE(visible > 0);
+        REQUIRE(visible < count);
+
+        const aabb_3d expected_bounds = compute_bounds_scalar(scene.points);
+        const aabb_3d interleaved_bounds = batch_compute_bounds(scene.points.data(), scene.points.size());
+        REQUIRE(interleaved_bounds._min == expected_bounds._min);
+        REQUIRE(interleaved_bounds._max == expected_bounds._max);
+
+        float3_array soa_points;
+        soa_points.resize(count);
+        for (size_t i = 0; i < count; ++i) soa_points.set(i, scene.points[i] + float3(50.f)); // the zero padding must not count
+        const aabb_3d soa_bounds = batch_compute_bounds(soa_points);
+        REQUIRE(soa_bounds._min == expected_bounds._min + float3(50.f));
+        REQUIRE(soa_bounds._max == expected_bounds._max + float3(50.f));
+    });
+
+    REQUIRE(batch_compute_bounds(nullptr, 0)._min.x == std::numeric_limits<float>::infinity());
+}
+
+/// Timings of the scalar `linalg` loops these kernels replace, followed by each kernel at every supported level
+TEST_CASE("batch math benchmarks")
+{
+    const size_t count = 100000;
+    batch_test_scene scene(count);
+    const frustum f(make_projection_matrix(to_radians(60.f), 16.f / 9.f, 0.1f, 150.f) * transform(float3(0, 0, 60)).view_matrix());
+
+    std::vector<transform> composed(count);
+    std::vector<float4x4> models(count);
+    std::vector<aabb_3d> world_bounds(count);
+    std::vector<float3> transformed(count);
+    std::vector<uint8_t> visible(count);
+    float checksum = 0.f;
+
+    {
+        scoped_timer t("linalg transform composition (100k)");
+        for (size_t i = 0; i < count; ++i) composed[i] = scene.poses[i] * scene.locals[i];
+    }
+    {
+        scoped_timer t("linalg world matrices (100k)");
+        for (size_t i = 0; i < count; ++i) models[i] = scene.poses[i].matrix() * make_scaling_matrix(scene.scales[i]);
+    }
+    {
+        scoped_timer t("linalg matrix multiply (100k)");
+        for (size_t i = 0; i < count; ++i) models[i] = models[i] * models[count - 1 - i];
+    }
+    {
+        scoped_timer t("linalg transform_aabb (100k)");
+        for (size_t i = 0; i < count; ++i) world_bounds[i] = transform_aabb(models[i], scene.bounds[i]);
+    }
+    {
+        scoped_timer t("frustum::classify (100k boxes)");
+        for (size_t i = 0; i < count; ++i) visible[i] = static_cast<uint8_t>(f.classify(world_bounds[i]));
+    }
+    {
+        scoped_timer t("frustum::intersects (100k spheres)");
+        for (size_t i = 0; i < count; ++i) visible[i] = f.intersects(scene.poses[i].position, scene.scales[i].x) ? 1 : 0;
+    }
+    {
+        scoped_timer t("linalg transform_coord (100k points)");
+        const float4x4 m = scene.poses[0].matrix();
+        for (size_t i = 0; i < count; ++i) transformed[i] = transform_coord(m, scene.points[i]);
+    }
+    {
+        scoped_timer t("compute_bounds loop (100k points)");
+        checksum += compute_bounds_scalar(scene.points)._max.x;
+    }
+
+    float4_array rotation, spheres;
+    float3_array position, world_min, world_max;
+    float3x4_array matrices, products;
+    spheres.resize(count);
+    for (size_t i = 0; i < count; ++i) spheres.set(i, float4(scene.poses[i].position, scene.scales[i].x));
+
+    /// Allocate outputs up front so the first level measured doesn't pay for page faults
+    rotation.resize(count); position.resize(count); world_min.resize(count); world_max.resize(count);
+    matrices.resize(count); products.resize(count);
+
+    for_each_simd_level([&](const simd_level level)
+    {
+        const std::string suffix = std::string(" (100k, ") + get_simd_level_name(level) + ")";
+        { scoped_timer t("batch_compose" + suffix); batch_compose(scene.rotation, scene.position, scene.local_rotation, scene.local_position, rotation, position); }
+        { scoped_timer t("batch_make_matrices" + suffix); batch_make_matrices(scene.rotation, scene.position, scene.scale, matrices); }
+        { scoped_timer t("batch_multiply" + suffix); batch_multiply(matrices, matrices, products); }
+        { scoped_timer t("batch_transform_bounds" + suffix); batch_transform_bounds(products, scene.local_min, scene.local_max, world_min, world_max); }
+        { scoped_timer t("batch_classify_boxes" + suffix); batch_classify_boxes(f, world_min, world_max, visible.data()); }
+        { scoped_timer t("batch_classify_spheres" + suffix); batch_classify_spheres(f, spheres, visible.data()); }
+        { scoped_timer t("batch_transform_coords" + suffix); batch_transform_coords(scene.poses[0].matrix(), scene.points.data(), transformed.data(), count); }
+        { scoped_timer t("batch_compute_bounds" + suffix); checksum += batch_compute_bounds(scene.points.data(), count)._max.x; }
+    });
+
+    REQUIRE(std::isfinite(checksum));
+}
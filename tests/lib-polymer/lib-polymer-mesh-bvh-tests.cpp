@@ -0,0 +1,179 @@
+#include "lib-polymer.hpp"
+
+using namespace polymer;
+
+#include "doctest.h"
+
+namespace
+{
+    // A bumpy grid with a soup of small random triangles floating above it
+    runtime_mesh make_test_terrain(std::mt19937 & gen, const uint32_t grid_size, const uint32_t soup_count)
+    {
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+        runtime_mesh mesh;
+
+        for (uint32_t y = 0; y <= grid_size; ++y)
+        {
+            for (uint32_t x = 0; x <= grid_size; ++x)
+            {
+                mesh.vertices.push_back({ x / float(grid_size) * 2.f - 1.f, 0.1f * std::sin(x * 0.7f) * std::cos(y * 0.9f), y / float(grid_size) * 2.f - 1.f });
+            }
+        }
+
+        for (uint32_t y = 0; y < grid_size; ++y)
+        {
+            for (uint32_t x = 0; x < grid_size; ++x)
+            {
+                const uint32_t i = y * (grid_size + 1) + x;
+                mesh.faces.push_back({ i, i + grid_size + 1, i + 1 });
+                mesh.faces.push_back({ i + 1, i + grid_size + 1, i + grid_size + 2 });
+            }
+        }
+
+        for (uint32_t k = 0; k < soup_count; ++k)
+        {
+            const uint32_t base = static_cast<uint32_t>(mesh.vertices.size());
+            const float3 center = { dist(gen), 0.25f + dist(gen) * 0.2f, dist(gen) };
+            for (int j = 0; j < 3; ++j) mesh.vertices.push_back(center + float3(dist(gen), dist(gen), dist(gen)) * 0.1f);
+            mesh.faces.push_back({ base, base + 1, base + 2 });
+        }
+
+        return mesh;
+    }
+
+    // Rays from above aimed into the mesh, plus a few that start inside it, run axis-parallel or miss entirely
+    std::vector<ray> make_test_rays(std::mt19937 & gen, const uint32_t count)
+    {
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+        std::vector<ray> rays;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const float3 origin = { dist(gen) * 2.f, 2.f + dist(gen), dist(gen) * 2.f };
+            const float3 target = { dist(gen), 0.f, dist(gen) };
+            rays.push_back(ray(origin, normalize(target - origin)));
+        }
+
+        rays.push_back(ray({ 0.3f, 1.f, 0.2f }, { 0, -1, 0 }));
+        rays.push_back(ray({ 0.3f, 0.05f, -3.f }, { 0, 0, 1 }));
+        rays.push_back(ray({ 0.f, 0.25f, 0.f }, normalize(float3(1, 0.1f, 0.3f))));
+        rays.push_back(ray({ 5.f, 5.f, 5.f }, { 1, 0, 0 }));
+        while (rays.size() % 4) rays.push_back(ray({ 0.f, 3.f, 0.f }, { 0, 1, 0 }));
+
+        return rays;
+    }
+
+    void require_same_hit(const ray & r, const runtime_mesh & mesh, const mesh_bvh_hit & hit)
+    {
+        float t = 0.f;
+        const bool expected = intersect_ray_mesh(r, mesh, &t);
+
+        REQUIRE(hit.hit() == expected);
+        if (!expected)
+        {
+            REQUIRE(hit.t == std::numeric_limits<float>::infinity());
+            return;
+        }
+
+        /// Ties between overlapping faces may resolve to either face, but never to a different distance
+        REQUIRE(hit.t == doctest::Approx(t).epsilon(1e-5));
+        float face_t = 0.f;
+        const uint3 & face = mesh.faces[hit.face];
+        REQUIRE(intersect_ray_triangle(r, mesh.vertices[face.x], mesh.vertices[face.y], mesh.vertices[face.z], &face_t));
+        REQUIRE(face_t == doctest::Approx(hit.t).epsilon(1e-5));
+    }
+}
+
+TEST_CASE("mesh_bvh intersect and intersect4 match brute force intersect_ray_mesh")
+{
+    std::mt19937 gen(21);
+
+    for (const uint32_t grid_size : { 1u, 8u, 64u })
+    {
+        const runtime_mesh mesh = make_test_terrain(gen, grid_size, grid_size * 4);
+        const mesh_bvh bvh(mesh);
+        REQUIRE_FALSE(bvh.empty());
+
+        const std::vector<ray> rays = make_test_rays(gen, 400);
+
+        uint32_t hit_count = 0;
+        for (const ray & r : rays)
+        {
+            const mesh_bvh_hit hit = bvh.intersect(r);
+            require_same_hit(r, mesh, hit);
+            hit_count += hit.hit();
+
+            /// The bvh overload of intersect_ray_mesh reports the same attributes as the brute force one
+            float t_brute = 0.f, t_bvh = 0.f;
+            float3 n_brute, n_bvh;
+            if (intersect_ray_mesh(r, mesh, &t_brute, &n_brute) && intersect_ray_mesh(r, mesh, bvh, &t_bvh, &n_bvh))
+            {
+                REQUIRE(t_bvh == doctest::Approx(t_brute).epsilon(1e-5));
+            }
+        }
+        REQUIRE(hit_count > rays.size() / 2);
+
+        for (size_t i = 0; i < rays.size(); i += 4)
+        {
+            mesh_bvh_hit hits[4];
+            bvh.intersect4(&rays[i], hits);
+            for (size_t j = 0; j < 4; ++j) require_same_hit(rays[i + j], mesh, hits[j]);
+        }
+    }
+}
+
+TEST_CASE("mesh_bvh respects max_t")
+{
+    std::mt19937 gen(5);
+    const runtime_mesh mesh = make_test_terrain(gen, 16, 0);
+    const mesh_bvh bvh(mesh);
+
+    const ray down({ 0.1f, 1.f, 0.1f }, { 0, -1, 0 });
+    const mesh_bvh_hit hit = bvh.intersect(down);
+    REQUIRE(hit.hit());
+
+    REQUIRE_FALSE(bvh.intersect(down, hit.t * 0.5f).hit());
+    REQUIRE(bvh.intersect(down, hit.t * 2.f).t == hit.t);
+
+    const ray rays[4] = { down, down, down, down };
+    mesh_bvh_hit hits[4];
+    bvh.intersect4(rays, hits, hit.t * 0.5f);
+    for (const mesh_bvh_hit & h : hits) REQUIRE_FALSE(h.hit());
+}
+
+TEST_CASE("mesh_bvh handles coincident triangles without overflowing its traversal stack")
+{
+    /// Every centroid is identical, so each level falls back to a median split; the tree must still stay within bounds
+    runtime_mesh mesh;
+    for (uint32_t i = 0; i < 4096; ++i)
+    {
+        const uint32_t base = static_cast<uint32_t>(mesh.vertices.size());
+        mesh.vertices.push_back({ -1, 0, -1 });
+        mesh.vertices.push_back({ 1, 0, -1 });
+        mesh.vertices.push_back({ 0, 0, 1 });
+        mesh.faces.push_back({ base, base + 1, base + 2 });
+    }
+
+    const mesh_bvh bvh(mesh);
+    REQUIRE(bvh.get_depth() > 0);
+
+    const ray down({ 0.f, 1.f, 0.f }, { 0, -1, 0 });
+    const mesh_bvh_hit hit = bvh.intersect(down);
+    REQUIRE(hit.hit());
+    REQUIRE(hit.t == doctest::Approx(1.f));
+
+    const ray rays[4] = { down, ray({ 0.f, -1.f, 0.f }, { 0, 1, 0 }), ray({ 3.f, 1.f, 0.f }, { 0, -1, 0 }), down };
+    mesh_bvh_hit hits[4];
+    bvh.intersect4(rays, hits);
+    REQUIRE(hits[0].hit());
+    REQUIRE(hits[1].hit());
+    REQUIRE_FALSE(hits[2].hit());
+    REQUIRE(hits[3].t == hits[0].t);
+}
+
+TEST_CASE("mesh_bvh of an empty mesh never hits")
+{
+    const mesh_bvh bvh{ runtime_mesh() };
+    REQUIRE(bvh.empty());
+    REQUIRE_FALSE(bvh.intersect(ray({ 0, 1, 0 }, { 0, -1, 0 })).hit());
+}
@@ -0,0 +1,241 @@
+#include "lib-polymer.hpp"
+#include "../lib-model-io/model-io.hpp"
+
+#include <cstddef>
+#include <filesystem>
+
+using namespace polymer;
+
+#include "doctest.h"
+
+namespace
+{
+    std::string temp_mesh_path(const std::string & name)
+    {
+        return (std::experimental::filesystem::temp_directory_path() / name).string();
+    }
+
+    // A sphere with every optional stream filled in, so each one goes through the writer and reader
+    runtime_mesh make_test_mesh()
+    {
+        runtime_mesh mesh = make_sphere(1.f);
+        compute_tangents(mesh);
+
+        for (size_t i = 0; i < mesh.vertices.size(); ++i)
+        {
+            const float3 & n = mesh.normals[i];
+            mesh.colors.push_back({ n.x * 0.5f + 0.5f, n.y * 0.5f + 0.5f, n.z * 0.5f + 0.5f, 1.f });
+            mesh.texcoord1.push_back(mesh.texcoord0[i] * 4.f);
+        }
+
+        for (size_t i = 0; i < mesh.faces.size(); ++i) mesh.material.push_back(uint32_t(i % 3));
+
+        return mesh;
+    }
+
+    // The meshopt index codec may rotate a triangle's indices (keeping its winding), so faces match up to rotation
+    bool same_faces(const std::vector<uint3> & a, const std::vector<uint3> & b)
+    {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            const uint3 & f = a[i], & g = b[i];
+            const bool rotated = (f.x == g.x && f.y == g.y && f.z == g.z) || (f.x == g.y && f.y == g.z && f.z == g.x) || (f.x == g.z && f.y == g.x && f.z == g.y);
+            if (!rotated) return false;
+        }
+        return true;
+    }
+
+    template<typename T>
+    float max_difference(const std::vector<T> & a, const std::vector<T> & b)
+    {
+        REQUIRE(a.size() == b.size());
+        const float * x = reinterpret_cast<const float *>(a.data());
+        const float * y = reinterpret_cast<const float *>(b.data());
+
+        float result = 0.f;
+        for (size_t i = 0; i < a.size() * sizeof(T) / sizeof(float); ++i) result = std::max(result, std::abs(x[i] - y[i]));
+        return result;
+    }
+}
+
+TEST_CASE("export_mesh_binary round trips every stream format and codec")
+{
+    const runtime_mesh source = make_test_mesh();
+    const std::string path = temp_mesh_path("polymer-model-io-test.mesh");
+
+    for (const bool compressed : { false, true })
+    {
+        for (const bool quantized : { false, true })
+        {
+            runtime_mesh mesh = source;
+            export_mesh_binary(path, mesh, compressed, quantized);
+
+            /// The header describes the layout that was asked for
+            {
+                const runtime_mesh_binary_view view(path);
+                REQUIRE(view.get_header().headerVersion == runtime_mesh_binary_version);
+                REQUIRE(view.has_encoded_streams() == compressed);
+
+                const runtime_mesh_binary_stream & normals = view.get_stream(mesh_stream::normals);
+                REQUIRE(normals.count == source.normals.size());
+                REQUIRE(normals.format == (quantized ? mesh_stream_format::snorm16 : mesh_stream_format::float32));
+                REQUIRE(normals.components == (quantized ? 4 : 3)); // 16-bit triples are padded to 4 components
+
+                const runtime_mesh_binary_stream & texcoords = view.get_stream(mesh_stream::texcoord0);
+                REQUIRE(texcoords.format == (quantized ? mesh_stream_format::float16 : mesh_stream_format::float32));
+
+                /// Positions and indices are never quantized
+                REQUIRE(view.get_stream(mesh_stream::positions).format == mesh_stream_format::float32);
+                REQUIRE(view.get_stream(mesh_stream::faces).format == mesh_stream_format::uint32);
+
+                REQUIRE(view.get_stream(mesh_stream::faces).codec == (compressed ? mesh_stream_codec::meshopt_index : mesh_stream_codec::none));
+                REQUIRE(view.get_stream(mesh_stream::positions).codec == (compressed ? mesh_stream_codec::meshopt_vertex : mesh_stream_codec::none));
+
+                for (const runtime_mesh_binary_stream & stream : view.get_header().streams)
+                {
+                    REQUIRE(stream.offset % runtime_mesh_binary_alignment == 0);
+                    if (stream.codec == mesh_stream_codec::none) REQUIRE(stream.bytes == uint64_t(stream.count) * stream.stride());
+                    else REQUIRE(stream.bytes < uint64_t(stream.count) * stream.stride());
+                }
+            }
+
+            const runtime_mesh loaded = import_mesh_binary(path);
+
+            /// Lossless streams come back intact
+            REQUIRE(max_difference(loaded.vertices, source.vertices) == 0.f);
+            REQUIRE(same_faces(loaded.faces, source.faces));
+            REQUIRE(loaded.material == source.material);
+            REQUIRE(loaded.lods.empty());
+
+            /// Quantized streams stay within a step of their storage format
+            const float unit_tolerance = quantized ? 1.f / 32767.f + 1e-6f : 0.f;
+            const float half_tolerance = quantized ? 4.f / 2048.f : 0.f; // half floats keep 11 significant bits; texcoord1 reaches 4
+            REQUIRE(max_difference(loaded.normals, source.normals) <= unit_tolerance);
+            REQUIRE(max_difference(loaded.tangents, source.tangents) <= (quantized ? 4.f / 2048.f : 0.f)); // unnormalized, so may fall back to half floats
+            REQUIRE(max_difference(loaded.bitangents, source.bitangents) <= (quantized ? 4.f / 2048.f : 0.f));
+            REQUIRE(max_difference(loaded.colors, source.colors) <= half_tolerance);
+            REQUIRE(max_difference(loaded.texcoord0, source.texcoord0) <= half_tolerance);
+            REQUIRE(max_difference(loaded.texcoord1, source.texcoord1) <= half_tolerance);
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("export_mesh_binary round trips levels of detail")
+{
+    runtime_mesh source = make_test_mesh();
+    optimize_model(source, 3);
+    REQUIRE(source.lods.size() > 1);
+
+    const std::string path = temp_mesh_path("polymer-model-io-lod-test.mesh");
+
+    for (const bool compressed : { false, true })
+    {
+        runtime_mesh mesh = source;
+        export_mesh_binary(path, mesh, compressed, false);
+
+        const runtime_mesh loaded = import_mesh_binary(path);
+        REQUIRE(same_faces(loaded.faces, source.faces));
+        REQUIRE(loaded.lods.size() == source.lods.size());
+        for (size_t i = 0; i < source.lods.size(); ++i) REQUIRE(same_faces(loaded.lods[i], source.lods[i]));
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("import_mesh_binary reads version 2 files without lod streams")
+{
+    runtime_mesh source = make_test_mesh();
+    const std::string path = temp_mesh_path("polymer-model-io-v2-test.mesh");
+    export_mesh_binary(path, source, true, true);
+
+    /// A version 2 table is the first nine entries of the current one; offsets are absolute, so the streams still line up
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        const uint32_t version = 2, streamCount = static_cast<uint32_t>(mesh_stream::lod_faces);
+        file.seekp(offsetof(runtime_mesh_binary_header_v2, headerVersion));
+        file.write(reinterpret_cast<const char *>(&version), sizeof(uint32_t));
+        file.seekp(offsetof(runtime_mesh_binary_header_v2, streamCount));
+        file.write(reinterpret_cast<const char *>(&streamCount), sizeof(uint32_t));
+    }
+
+    const runtime_mesh loaded = import_mesh_binary(path);
+    REQUIRE(max_difference(loaded.vertices, source.vertices) == 0.f);
+    REQUIRE(same_faces(loaded.faces, source.faces));
+    REQUIRE(loaded.normals.size() == source.normals.size());
+    REQUIRE(loaded.lods.empty());
+
+    /// A version 3 header must describe every stream
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        const uint32_t version = runtime_mesh_binary_version;
+        file.write(reinterpret_cast<const char *>(&version), sizeof(uint32_t));
+    }
+    REQUIRE_THROWS(import_mesh_binary(path));
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE("import_mesh_binary rejects files it can't map")
+{
+    const std::string missing = temp_mesh_path("polymer-model-io-missing.mesh");
+    std::remove(missing.c_str());
+    REQUIRE_THROWS(import_mesh_binary(missing));
+
+    /// Opened but unmappable; the file handle is released on the way out, so the file can be removed afterwards
+    const std::string empty = temp_mesh_path("polymer-model-io-empty.mesh");
+    std::ofstream(empty, std::ios::binary).close();
+    REQUIRE_THROWS(import_mesh_binary(empty));
+    REQUIRE(std::remove(empty.c_str()) == 0);
+
+    /// Not a mesh file at all
+    const std::string garbage = temp_mesh_path("polymer-model-io-garbage.mesh");
+    std::ofstream(garbage, std::ios::binary) << "not a mesh";
+    REQUIRE_THROWS(import_mesh_binary(garbage));
+    REQUIRE(std::remove(garbage.c_str()) == 0);
+}
+
+TEST_CASE("runtime_mesh_binary_view rejects stream tables that point past the file")
+{
+    runtime_mesh source = make_test_mesh();
+    const std::string path = temp_mesh_path("polymer-model-io-corrupt-test.mesh");
+
+    // Exports an uncompressed file, lets |corrupt| edit its header, writes it back and tries to map it
+    auto map_corrupted = [&](const std::function<void(runtime_mesh_binary_header_v2 &)> & corrupt)
+    {
+        export_mesh_binary(path, source, false, true);
+
+        runtime_mesh_binary_header_v2 header;
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        corrupt(header);
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.close();
+
+        const runtime_mesh_binary_view view(path);
+    };
+
+    /// The untouched file maps
+    REQUIRE_NOTHROW(map_corrupted([](runtime_mesh_binary_header_v2 &) {}));
+
+    /// More elements than the stored bytes hold, for a raw, a 16-bit and an index stream
+    REQUIRE_THROWS(map_corrupted([](runtime_mesh_binary_header_v2 & h) { h[mesh_stream::positions].count += 1; }));
+    REQUIRE_THROWS(map_corrupted([](runtime_mesh_binary_header_v2 & h) { h[mesh_stream::normals].count *= 2; }));
+    REQUIRE_THROWS(map_corrupted([](runtime_mesh_binary_header_v2 & h) { h[mesh_stream::faces].bytes -= 4; }));
+
+    /// Components that don't match what readers assume for the stream
+    REQUIRE_THROWS(map_corrupted([](runtime_mesh_binary_header_v2 & h) { h[mesh_stream::faces].components = 1; }));
+    REQUIRE_THROWS(map_corrupted([](runtime_mesh_binary_header_v2 & h) { h[mesh_stream::texcoord0].components = 9; }));
+
+    /// An offset and size that wrap around when added
+    REQUIRE_THROWS(map_corrupted([](runtime_mesh_binary_header_v2 & h)
+    {
+        h[mesh_stream::positions].offset = ~uint64_t(0) - 7;
+        h[mesh_stream::positions].bytes = 16;
+    }));
+
+    std::remove(path.c_str());
+}
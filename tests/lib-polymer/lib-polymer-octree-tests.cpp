@@ -0,0 +1,239 @@
+#include "lib-polymer.hpp"
+
+using namespace polymer;
+
+#include "doctest.h"
+
+namespace
+{
+    // Objects are spread past the root bounds (+/- 24) so that some of them only fit at the root
+    struct octree_fixture
+    {
+        std::mt19937 gen{ 11 };
+        std::uniform_real_distribution<float> position{ -30.f, 30.f };
+        std::uniform_real_distribution<float> radius{ 0.01f, 3.f };
+
+        const aabb_3d root_bounds = { { -24, -24, -24 }, { 24, 24, 24 } };
+        octree<uint32_t> tree{ 8, root_bounds };
+
+        std::vector<aabb_3d> bounds;    // by object index, which is also the data stored in the tree
+        std::vector<uint32_t> ids;      // by object index; octree<>::invalid_id once removed
+
+        aabb_3d random_bounds()
+        {
+            const float3 center = { position(gen), position(gen), position(gen) };
+            const float r = radius(gen);
+            return { center - float3(r), center + float3(r) };
+        }
+
+        void populate(const uint32_t count)
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const uint32_t index = static_cast<uint32_t>(bounds.size());
+                bounds.push_back(random_bounds());
+                ids.push_back(tree.insert(bounds.back(), index));
+            }
+        }
+
+        frustum random_frustum()
+        {
+            const float3 eye = { position(gen), position(gen), position(gen) };
+            const float3 target = { position(gen), position(gen), position(gen) };
+            const float4x4 view = inverse(lookat_rh(eye, target).matrix());
+            const float4x4 projection = make_projection_matrix(1.f, 1.3f, 0.1f, 40.f);
+            return frustum(projection * view);
+        }
+
+        static bool encloses(const aabb_3d & outer, const aabb_3d & inner)
+        {
+            return inner._min.x >= outer._min.x && inner._min.y >= outer._min.y && inner._min.z >= outer._min.z &&
+                   inner._max.x <= outer._max.x && inner._max.y <= outer._max.y && inner._max.z <= outer._max.z;
+        }
+
+        // Every live object is stored once with its latest bounds, in key order, inside the loose bounds of its node
+        void require_consistent()
+        {
+            const size_t live = std::count_if(ids.begin(), ids.end(), [](const uint32_t id) { return id != octree<uint32_t>::invalid_id; });
+            REQUIRE(tree.size() == live);
+
+            const auto & objects = tree.get_objects();
+            REQUIRE(objects.size() == live);
+
+            for (size_t o = 0; o < objects.size(); ++o)
+            {
+                const auto & object = objects[o];
+                REQUIRE(object.data < ids.size());
+                REQUIRE(ids[object.data] == object.id);
+                REQUIRE(object.bounds._min == bounds[object.data]._min);
+                REQUIRE(object.bounds._max == bounds[object.data]._max);
+                REQUIRE(object.key == tree.compute_key(object.bounds));
+                if (o > 0) REQUIRE(objects[o - 1].key <= object.key);
+            }
+
+            for (const auto & n : tree.get_nodes())
+            {
+                REQUIRE(n.first + n.count <= n.subtree_end);
+                for (uint32_t o = n.first; o < n.first + n.count; ++o) REQUIRE(encloses(n.box, objects[o].bounds));
+            }
+        }
+
+        // cull() visits exactly the live objects that a per-object frustum test keeps, each once
+        void require_cull_matches_brute_force(const uint32_t frustum_count)
+        {
+            for (uint32_t k = 0; k < frustum_count; ++k)
+            {
+                const frustum f = random_frustum();
+
+                std::vector<uint32_t> visits(bounds.size(), 0);
+                tree.cull(f, [&](const uint32_t id, const uint32_t data)
+                {
+                    REQUIRE(ids[data] == id);
+                    visits[data]++;
+                });
+
+                for (size_t i = 0; i < bounds.size(); ++i)
+                {
+                    const bool visible = ids[i] != octree<uint32_t>::invalid_id && f.classify(bounds[i]) != frustum_containment::outside;
+                    REQUIRE(visits[i] == (visible ? 1u : 0u));
+                }
+            }
+        }
+
+        // Moves |count| distinct live objects to new random bounds through the batched update()
+        void move_random(const size_t count, work_stealing_pool * pool)
+        {
+            std::vector<uint32_t> order(ids.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::shuffle(order.begin(), order.end(), gen);
+
+            std::vector<uint32_t> moved_ids;
+            std::vector<aabb_3d> moved_bounds;
+            for (const uint32_t i : order)
+            {
+                if (moved_ids.size() == count) break;
+                if (ids[i] == octree<uint32_t>::invalid_id) continue;
+                bounds[i] = random_bounds();
+                moved_ids.push_back(ids[i]);
+                moved_bounds.push_back(bounds[i]);
+            }
+
+            tree.update(moved_ids.data(), moved_bounds.data(), moved_ids.size(), pool);
+        }
+    };
+}
+
+TEST_CASE("octree cull matches brute force frustum classification")
+{
+    octree_fixture fixture;
+    fixture.populate(5000);
+    fixture.tree.commit();
+
+    fixture.require_consistent();
+    fixture.require_cull_matches_brute_force(50);
+
+    /// A frustum that holds the whole scene takes the accept-whole-subtree path for every node
+    const frustum everything(make_orthographic_matrix(-100.f, 100.f, -100.f, 100.f, -100.f, 100.f));
+    size_t visited = 0;
+    fixture.tree.cull(everything, [&](const uint32_t, const uint32_t) { ++visited; });
+    REQUIRE(visited == fixture.tree.size());
+}
+
+TEST_CASE("octree commit stays consistent across in-place, merged and re-sorted batches")
+{
+    enum class batch { in_place, small_merge, full_sort, cross_root_bounds, remove_and_insert };
+
+    for (const bool threaded : { false, true })
+    {
+        for (const batch b : { batch::in_place, batch::small_merge, batch::full_sort, batch::cross_root_bounds, batch::remove_and_insert })
+        {
+            work_stealing_pool pool(3);
+            work_stealing_pool * p = threaded ? &pool : nullptr;
+
+            octree_fixture fixture;
+            fixture.populate(20000);
+            fixture.tree.commit(p);
+            fixture.require_consistent();
+
+            switch (b)
+            {
+            case batch::in_place:
+            {
+                /// Nudges too small to change the key. Objects at the root (depth 0, the low bits of the key) are
+                /// skipped since the root's box depends on them, so they always go through commit().
+                std::vector<uint32_t> moved_ids;
+                std::vector<aabb_3d> moved_bounds;
+                for (size_t i = 0; i < fixture.bounds.size(); ++i)
+                {
+                    const aabb_3d nudged = { fixture.bounds[i]._min + float3(0.001f), fixture.bounds[i]._max + float3(0.001f) };
+                    const uint64_t key = fixture.tree.compute_key(nudged);
+                    if (key != fixture.tree.compute_key(fixture.bounds[i]) || (key & 0xf) == 0) continue;
+
+                    fixture.bounds[i] = nudged;
+                    moved_ids.push_back(fixture.ids[i]);
+                    moved_bounds.push_back(nudged);
+                }
+                REQUIRE(moved_ids.size() > fixture.bounds.size() / 2);
+
+                std::vector<uint32_t> order_before;
+                for (const auto & o : fixture.tree.get_objects()) order_before.push_back(o.id);
+
+                fixture.tree.update(moved_ids.data(), moved_bounds.data(), moved_ids.size(), p);
+                fixture.tree.commit(p);
+
+                /// Nothing was re-sorted or merged
+                std::vector<uint32_t> order_after;
+                for (const auto & o : fixture.tree.get_objects()) order_after.push_back(o.id);
+                REQUIRE(order_after == order_before);
+                break;
+            }
+            case batch::small_merge:
+            {
+                /// Under a quarter of the tree: the batch is sorted on its own and merged
+                fixture.move_random(fixture.bounds.size() / 20, p);
+                fixture.tree.commit(p);
+                break;
+            }
+            case batch::full_sort:
+            {
+                /// Over a quarter of the tree: everything is radix sorted again
+                fixture.move_random(fixture.bounds.size() / 2, p);
+                fixture.tree.commit(p);
+                break;
+            }
+            case batch::cross_root_bounds:
+            {
+                /// Shifting by 40 along x takes objects from inside the root bounds to outside and from outside back in
+                std::vector<uint32_t> moved_ids;
+                std::vector<aabb_3d> moved_bounds;
+                for (size_t i = 0; i < fixture.bounds.size(); i += 7)
+                {
+                    const float3 offset = (fixture.bounds[i].center().x > 0.f) ? float3(-40.f, 0.f, 0.f) : float3(40.f, 0.f, 0.f);
+                    fixture.bounds[i] = { fixture.bounds[i]._min + offset, fixture.bounds[i]._max + offset };
+                    moved_ids.push_back(fixture.ids[i]);
+                    moved_bounds.push_back(fixture.bounds[i]);
+                }
+
+                fixture.tree.update(moved_ids.data(), moved_bounds.data(), moved_ids.size(), p);
+                fixture.tree.commit(p);
+                break;
+            }
+            case batch::remove_and_insert:
+            {
+                for (size_t i = 0; i < fixture.bounds.size(); i += 13)
+                {
+                    fixture.tree.remove(fixture.ids[i]);
+                    fixture.ids[i] = octree<uint32_t>::invalid_id;
+                }
+                fixture.move_random(500, p);
+                fixture.populate(1000);
+                fixture.tree.commit(p);
+                break;
+            }
+            }
+
+            fixture.require_consistent();
+            fixture.require_cull_matches_brute_force(10);
+        }
+    }
+}
@@ -162,6 +162,27 @@ TEST_CASE("axis-aligned bounding box (float, 3D)")
     aabb_3d bounds;
 }
 
+TEST_CASE("transformed bounds and frustum classification")
+{
+    const aabb_3d unit = { { -1, -1, -1 },{ 1, 1, 1 } };
+
+    /// A 45 degree rotation about y widens the box in x and z by sqrt(2)
+    const float4x4 xform = make_rigid_transformation_matrix(make_rotation_quat_axis_angle({ 0, 1, 0 }, float(POLYMER_PI) / 4.f), { 10, 0, 0 });
+    const aabb_3d rotated = transform_aabb(xform, unit);
+    REQUIRE(rotated.center().x == doctest::Approx(10.f));
+    REQUIRE(rotated.size().x == doctest::Approx(2.f * std::sqrt(2.f)));
+    REQUIRE(rotated.size().y == doctest::Approx(2.f));
+
+    /// A camera at the origin looking down -z
+    const float4x4 proj = make_projection_matrix(to_radians(90.f), 1.f, 0.1f, 100.f);
+    const frustum f(proj);
+
+    REQUIRE(f.classify(aabb_3d({ -1, -1, -11 }, { 1, 1, -9 })) == frustum_containment::inside);
+    REQUIRE(f.classify(aabb_3d({ -1, -1, -101 }, { 1, 1, -99 })) == frustum_containment::intersecting);
+    REQUIRE(f.classify(aabb_3d({ -1, -1, 9 }, { 1, 1, 11 })) == frustum_containment::outside);
+    REQUIRE(f.classify(aabb_3d({ 30, -1, -11 }, { 32, 1, -9 })) == frustum_containment::outside);
+}
+
 TEST_CASE("unifom random number generation")
 {
     uniform_random_gen gen;
@@ -346,3 +367,149 @@ TEST_CASE("integral and floating point radix sort")
     radix_sorter.sort(int_list.data(), int_list.size());
     radix_sorter.sort(float_list.data(), float_list.size());
 }
+
+TEST_CASE("radix sort of 64-bit key/value pairs")
+{
+    uniform_random_gen random_generator;
+    work_stealing_pool pool(4);
+    radix_sort radix_sorter;
+
+    /// Packed keys with constant high bits, like render queue draw keys. Values record the original
+    /// position so stability can be checked.
+    const size_t count = 200000;
+    std::vector<uint64_t> keys(count);
+    std::vector<uint32_t> values(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        keys[i] = (uint64_t(1) << 62) | (uint64_t(random_generator.random_uint(64)) << 32) | random_generator.random_uint(1 << 20);
+        values[i] = static_cast<uint32_t>(i);
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> expected(count);
+    for (size_t i = 0; i < count; ++i) expected[i] = { keys[i], values[i] };
+    std::vector<uint64_t> serial_keys = keys;
+    std::vector<uint32_t> serial_values = values;
+
+    {
+        scoped_timer t("std::stable_sort (200k pairs)");
+        std::stable_sort(expected.begin(), expected.end(), [](const std::pair<uint64_t, uint32_t> & a, const std::pair<uint64_t, uint32_t> & b) { return a.first < b.first; });
+    }
+
+    {
+        scoped_timer t("radix_sort::sort (200k pairs)");
+        radix_sorter.sort(serial_keys.data(), serial_values.data(), count);
+    }
+
+    {
+        scoped_timer t("radix_sort::sort with parallel histograms (200k pairs)");
+        radix_sorter.sort(keys.data(), values.data(), count, &pool);
+    }
+
+    bool matches = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (keys[i] != expected[i].first || values[i] != expected[i].second) matches = false;
+        if (serial_keys[i] != keys[i] || serial_values[i] != values[i]) matches = false;
+    }
+    REQUIRE(matches);
+}
+
+TEST_CASE("dynamic_aabb_tree insert, update, remove and query")
+{
+    uniform_random_gen rand;
+    dynamic_aabb_tree<uint32_t> tree(0.25f);
+
+    std::vector<aabb_3d> boxes;
+    std::vector<int32_t> proxies;
+    for (uint32_t i = 0; i < 2048; ++i)
+    {
+        const float3 c = { rand.random_float(-100.f, 100.f), rand.random_float(-100.f, 100.f), rand.random_float(-100.f, 100.f) };
+        boxes.push_back({ c - float3(0.5f), c + float3(0.5f) });
+        proxies.push_back(tree.insert(boxes.back(), i));
+    }
+
+    REQUIRE(tree.size() == 2048);
+    REQUIRE(tree.validate());
+
+    /// Rotations keep the tree close to log2(n) deep even though inserts arrive in random order
+    REQUIRE(tree.get_height() < 32);
+
+    /// Small moves stay within the fat margin and leave the hierarchy untouched
+    REQUIRE_FALSE(tree.update(proxies[0], { boxes[0]._min + float3(0.1f), boxes[0]._max + float3(0.1f) }));
+
+    /// Larger moves reinsert the leaf
+    for (uint32_t i = 0; i < 2048; i += 2)
+    {
+        boxes[i] = { boxes[i]._min + float3(5.f, 0, 0), boxes[i]._max + float3(5.f, 0, 0) };
+        REQUIRE(tree.update(proxies[i], boxes[i]));
+    }
+    REQUIRE(tree.validate());
+
+    /// Remove a quarter of the leaves; their proxies are recycled by later inserts
+    std::vector<bool> alive(boxes.size(), true);
+    for (uint32_t i = 1; i < 2048; i += 4)
+    {
+        tree.remove(proxies[i]);
+        alive[i] = false;
+    }
+    REQUIRE(tree.size() == 2048 - 512);
+    REQUIRE(tree.validate());
+
+    /// Queries must match a brute-force test against the (unfattened) boxes
+    const float4x4 view = transform(make_rotation_quat_axis_angle({ 0, 1, 0 }, 0.7f), float3(0, 0, 0)).view_matrix();
+    const frustum f(make_projection_matrix(to_radians(60.f), 1.f, 0.1f, 80.f) * view);
+
+    std::vector<bool> found(boxes.size(), false);
+    tree.query(f, [&](int32_t, const uint32_t idx) { found[idx] = true; });
+
+    for (uint32_t i = 0; i < boxes.size(); ++i)
+    {
+        if (!alive[i]) REQUIRE_FALSE(found[i]);
+        else if (f.intersects(boxes[i].center(), boxes[i].size())) REQUIRE(found[i]);
+    }
+
+    const aabb_3d region = { { -20, -20, -20 },{ 20, 20, 20 } };
+    std::vector<bool> overlapping(boxes.size(), false);
+    tree.query(region, [&](int32_t, const uint32_t idx) { overlapping[idx] = true; });
+    for (uint32_t i = 0; i < boxes.size(); ++i)
+    {
+        const bool expected = alive[i] && region.contains(boxes[i].center());
+        if (expected) REQUIRE(overlapping[i]);
+    }
+
+    tree.clear();
+    REQUIRE(tree.empty());
+    REQUIRE(tree.validate());
+}
+
+TEST_CASE("dynamic_aabb_tree frustum query vs. brute force")
+{
+    uniform_random_gen rand;
+    dynamic_aabb_tree<uint32_t> tree;
+
+    std::vector<aabb_3d> boxes;
+    for (uint32_t i = 0; i < 100000; ++i)
+    {
+        const float3 c = { rand.random_float(-500.f, 500.f), rand.random_float(-50.f, 50.f), rand.random_float(-500.f, 500.f) };
+        boxes.push_back({ c - float3(1.f), c + float3(1.f) });
+        tree.insert(boxes.back(), i);
+    }
+
+    const frustum f(make_projection_matrix(to_radians(60.f), 16.f / 9.f, 0.1f, 250.f) * transform().view_matrix());
+
+    uint32_t brute_visible = 0;
+    {
+        scoped_timer t("brute force frustum test (100k boxes)");
+        for (auto & b : boxes) if (f.intersects(b.center(), b.size())) ++brute_visible;
+    }
+
+    uint32_t tree_visible = 0;
+    {
+        scoped_timer t("dynamic_aabb_tree frustum query (100k boxes)");
+        tree.query(f, [&](int32_t, uint32_t) { ++tree_visible; });
+    }
+
+    /// The tree tests fattened boxes so it may report a few extra leaves, but never fewer
+    REQUIRE(tree_visible >= brute_visible);
+    REQUIRE(tree_visible < brute_visible + brute_visible / 10 + 16);
+}
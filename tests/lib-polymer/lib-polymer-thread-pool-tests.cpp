@@ -0,0 +1,173 @@
+#include "lib-polymer.hpp"
+
+using namespace polymer;
+
+#include "doctest.h"
+
+TEST_CASE("inline_task stores and invokes small callables")
+{
+    int value = 0;
+    inline_task<> task;
+    REQUIRE_FALSE(task);
+
+    task.emplace([&value]() { value = 42; });
+    REQUIRE(task);
+    task();
+    REQUIRE(value == 42);
+
+    task.reset();
+    REQUIRE_FALSE(task);
+}
+
+TEST_CASE("work_stealing_pool submit and wait")
+{
+    work_stealing_pool pool(4);
+    std::atomic<uint32_t> sum{ 0 };
+    job_counter counter{ 0 };
+
+    for (uint32_t i = 0; i < 10000; ++i)
+    {
+        pool.submit(counter, [&sum, i]() { sum += i; });
+    }
+
+    pool.wait(counter);
+    REQUIRE(counter.load() == 0);
+    REQUIRE(sum.load() == (9999u * 10000u) / 2u);
+}
+
+TEST_CASE("work_stealing_pool enqueue matches simple_thread_pool")
+{
+    work_stealing_pool pool;
+    std::vector<std::future<uint32_t>> results;
+
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        results.emplace_back(pool.enqueue([i] { return i * i; }));
+    }
+
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        REQUIRE(results[i].get() == (i * i));
+    }
+}
+
+TEST_CASE("work_stealing_pool parallel_for visits every index once")
+{
+    work_stealing_pool pool(4);
+
+    for (size_t grain : { 1, 7, 64, 100000 })
+    {
+        std::vector<std::atomic<uint32_t>> visits(50000);
+        for (auto & v : visits) v = 0;
+
+        pool.parallel_for(0, visits.size(), grain, [&](const size_t i) { visits[i]++; });
+
+        bool all_once = true;
+        for (auto & v : visits) if (v.load() != 1) all_once = false;
+        REQUIRE(all_once);
+    }
+
+    /// An empty range is a no-op
+    pool.parallel_for(10, 10, 1, [&](const size_t) { REQUIRE(false); });
+}
+
+TEST_CASE("work_stealing_pool nested parallel_for")
+{
+    work_stealing_pool pool(4);
+    std::atomic<uint32_t> total{ 0 };
+
+    /// Workers that wait on an inner loop execute queued jobs rather than blocking
+    pool.parallel_for(0, 64, 1, [&](const size_t)
+    {
+        pool.parallel_for(0, 256, 16, [&](const size_t) { total++; });
+    });
+
+    REQUIRE(total.load() == 64 * 256);
+}
+
+TEST_CASE("work_stealing_pool parallel_reduce")
+{
+    work_stealing_pool pool(4);
+
+    std::vector<uint64_t> values(100003);
+    for (size_t i = 0; i < values.size(); ++i) values[i] = i;
+
+    const uint64_t sum = pool.parallel_reduce<uint64_t>(0, values.size(), 1024, 0,
+        [&](const size_t b, const size_t e) { uint64_t s = 0; for (size_t i = b; i < e; ++i) s += values[i]; return s; },
+        [](const uint64_t a, const uint64_t b) { return a + b; });
+
+    REQUIRE(sum == (uint64_t(values.size()) * (values.size() - 1)) / 2);
+
+    const uint64_t empty = pool.parallel_reduce<uint64_t>(5, 5, 16, 7,
+        [&](const size_t, const size_t) { return uint64_t(0); },
+        [](const uint64_t a, const uint64_t b) { return a + b; });
+    REQUIRE(empty == 7);
+}
+
+/// Fine-grained jobs (a few hundred nanoseconds each) submitted from one thread. This measures scheduling
+/// overhead and queue contention rather than throughput of the work itself.
+TEST_CASE("thread pool contention: simple_thread_pool vs work_stealing_pool")
+{
+    const uint32_t num_jobs = 1 << 17;
+    std::vector<float> data(num_jobs, 1.f);
+
+    auto tiny_job = [&data](const size_t i)
+    {
+        float v = data[i];
+        for (int k = 0; k < 32; ++k) v = v * 1.0001f + 0.0001f;
+        data[i] = v;
+    };
+
+    {
+        simple_thread_pool pool;
+        std::vector<std::future<void>> results;
+        results.reserve(num_jobs);
+
+        scoped_timer t("simple_thread_pool: 131072 enqueued jobs");
+        for (uint32_t i = 0; i < num_jobs; ++i) results.emplace_back(pool.enqueue([&tiny_job, i]() { tiny_job(i); }));
+        for (auto & r : results) r.get();
+    }
+
+    {
+        work_stealing_pool pool;
+        job_counter counter{ 0 };
+
+        scoped_timer t("work_stealing_pool: 131072 submitted jobs");
+        for (uint32_t i = 0; i < num_jobs; ++i) pool.submit(counter, [&tiny_job, i]() { tiny_job(i); });
+        pool.wait(counter);
+    }
+
+    {
+        work_stealing_pool pool;
+
+        scoped_timer t("work_stealing_pool: parallel_for over 131072 (grain 1)");
+        pool.parallel_for(0, num_jobs, 1, tiny_job);
+    }
+
+    {
+        work_stealing_pool pool;
+
+        scoped_timer t("work_stealing_pool: parallel_for over 131072 (grain 256)");
+        pool.parallel_for(0, num_jobs, 256, tiny_job);
+    }
+
+    /// Several producer threads contending on the same pool
+    {
+        work_stealing_pool pool;
+        std::atomic<uint32_t> executed{ 0 };
+
+        scoped_timer t("work_stealing_pool: 4 producers x 32768 jobs");
+        std::vector<std::thread> producers;
+        for (int p = 0; p < 4; ++p)
+        {
+            producers.emplace_back([&]()
+            {
+                job_counter counter{ 0 };
+                for (uint32_t i = 0; i < num_jobs / 4; ++i) pool.submit(counter, [&executed]() { executed++; });
+                pool.wait(counter);
+            });
+        }
+        for (auto & p : producers) p.join();
+        REQUIRE(executed.load() == num_jobs);
+    }
+}